@@ -13,6 +13,7 @@
 	void play_one_audio_clip(string path);
 	void play_one_audio_clip_source_config(Audio_Source source, Audio_Playback_Config config);
 	void play_one_audio_clip_config(string path, Audio_Playback_Config config);
+	void play_one_audio_clip_atom_with_config(Atom path, Audio_Playback_Config config); // path from string_intern()
 	
 		Playing audio (with players):
 	
@@ -122,6 +123,15 @@ typedef struct Wav_Stream {
 	Wav_Subformat_Guid sub_format;
 } Wav_Stream;
 
+// Audio_Source is passed around by value, so the mutex can't live in it: every copy would get
+// its own lock word. All copies point to this instead. The source holds a reference until it's
+// destroyed and each player holds one while the source is set on it, so it outlives them all.
+typedef struct Audio_Source_Lock {
+	Mutex mutex;
+	volatile u64 reference_count;
+	bool destroyed; // Players stop sampling it once this is set
+} Audio_Source_Lock;
+
 typedef struct Audio_Source {
 
 	Audio_Source_Kind kind;
@@ -149,7 +159,8 @@ typedef struct Audio_Source {
 	// For memory source
 	void *pcm_frames;
 	
-	Mutex mutex_for_destroy; // This should ONLY be used so a source isnt sampled on audio thread while it's being destroyed
+	// This should ONLY be used so a source isnt sampled on audio thread while it's being destroyed
+	Audio_Source_Lock *destroy_lock;
 	
 } Audio_Source;
 
@@ -157,6 +168,26 @@ int
 convert_frames(void *dst, Audio_Format dst_format, 
                void *src, Audio_Format src_format, u64 src_frame_count);
 
+Audio_Source_Lock *
+_audio_source_lock_make() {
+	Audio_Source_Lock *lock = (Audio_Source_Lock*)alloc(get_heap_allocator(), sizeof(Audio_Source_Lock));
+	mutex_init(&lock->mutex);
+	lock->reference_count = 1;
+	lock->destroyed = false;
+	return lock;
+}
+void
+_audio_source_lock_retain(Audio_Source_Lock *lock) {
+	if (lock) atomic_fetch_add_64(&lock->reference_count, 1);
+}
+void
+_audio_source_lock_release(Audio_Source_Lock *lock) {
+	if (lock && atomic_fetch_add_64(&lock->reference_count, (u64)-1) == 1) {
+		mutex_destroy(&lock->mutex);
+		dealloc(get_heap_allocator(), lock);
+	}
+}
+
 bool 
 check_wav_header(string data) {
 	return string_starts_with(data, STR("RIFF"));
@@ -378,7 +409,7 @@ wav_read_frames(Wav_Stream *wav, Audio_Format format, void *frames,
 		
 		u64 new_size = get_next_power_of_two(required_size);
 		
-		raw_buffer = alloc(get_heap_allocator(), new_size);
+		raw_buffer = alloc_uninitialized(get_heap_allocator(), new_size);
 		memset(raw_buffer, 0, new_size);
 		raw_buffer_size = new_size;
 	}
@@ -387,7 +418,7 @@ wav_read_frames(Wav_Stream *wav, Audio_Format format, void *frames,
 		
 		u64 new_size = get_next_power_of_two(required_size);
 		
-		convert_buffer = alloc(get_heap_allocator(), new_size);
+		convert_buffer = alloc_uninitialized(get_heap_allocator(), new_size);
 		memset(convert_buffer, 0, new_size);
 		convert_buffer_size = new_size;
 	}
@@ -554,8 +585,6 @@ audio_open_source_stream_format(Audio_Source *src, string path, Audio_Format for
 	src->uid = next_audio_source_uid;
 	next_audio_source_uid += 1;
 	
-	mutex_init(&src->mutex_for_destroy);
-	
 	src->allocator = allocator;
 	src->kind = AUDIO_SOURCE_FILE_STREAM;
 	
@@ -595,6 +624,8 @@ audio_open_source_stream_format(Audio_Source *src, string path, Audio_Format for
 		return false;
 	}
 	
+	src->destroy_lock = _audio_source_lock_make();
+	
 	return true;
 }
 bool
@@ -612,8 +643,6 @@ audio_open_source_load_format(Audio_Source *src, string path, Audio_Format forma
 	src->uid = next_audio_source_uid;
 	next_audio_source_uid += 1;
 	
-	mutex_init(&src->mutex_for_destroy);
-	
 	src->allocator = allocator;
 	src->kind = AUDIO_SOURCE_MEMORY;
 	src->format = format;
@@ -672,6 +701,8 @@ audio_open_source_load_format(Audio_Source *src, string path, Audio_Format forma
 		return false;
 	}
 	
+	src->destroy_lock = _audio_source_lock_make();
+	
 	return true;
 }
 bool
@@ -685,7 +716,8 @@ audio_open_source_load(Audio_Source *src, string path, Allocator allocator) {
 void 
 audio_source_destroy(Audio_Source *src) {
 
-	mutex_acquire_or_wait(&src->mutex_for_destroy);
+	Audio_Source_Lock *lock = src->destroy_lock;
+	if (lock) mutex_acquire_or_wait(&lock->mutex);
 
 	switch (src->kind) {
 		case AUDIO_SOURCE_FILE_STREAM: {
@@ -710,7 +742,12 @@ audio_source_destroy(Audio_Source *src) {
 		}
 	}
 	
-	mutex_release(&src->mutex_for_destroy);
+	if (lock) {
+		lock->destroyed = true;
+		mutex_release(&lock->mutex);
+		_audio_source_lock_release(lock);
+		src->destroy_lock = 0;
+	}
 }
 
 int
@@ -754,7 +791,7 @@ audio_source_get_frames(Audio_Source *src, u64 first_frame_index,
 			
 			u64 new_size = get_next_power_of_two(required_size);
 			
-			convert_buffer = alloc(get_heap_allocator(), new_size);
+			convert_buffer = alloc_uninitialized(get_heap_allocator(), new_size);
 			memset(convert_buffer, 0, new_size);
 			convert_buffer_size = new_size;
 		}
@@ -1328,6 +1365,8 @@ audio_player_set_source(Audio_Player *p, Audio_Source src) {
 	
 	spinlock_acquire_or_wait(&p->sample_lock);
 
+	_audio_source_lock_retain(src.destroy_lock);
+	if (p->has_source) _audio_source_lock_release(p->source.destroy_lock);
 	p->source = src;
 	p->has_source = true;
 	
@@ -1340,6 +1379,7 @@ audio_player_clear_source(Audio_Player *p) {
 	spinlock_acquire_or_wait(&p->sample_lock);
 	assert(p->frame_index <= p->source.number_of_frames);
 	
+	if (p->has_source) _audio_source_lock_release(p->source.destroy_lock);
 	p->has_source = false;
 	p->state = AUDIO_PLAYER_STATE_PAUSED;
 	p->source = ZERO(Audio_Source);
@@ -1360,14 +1400,31 @@ audio_player_set_looping(Audio_Player *p, bool looping) {
 }
 
 // #Global
-ogb_instance Hash_Table just_audio_clips;
-ogb_instance bool just_audio_clips_initted;
+// Interned path -> Audio_Source, for play_one_audio_clip*(). Might be called from any thread.
+ogb_instance Concurrent_Hash_Table just_audio_clips;
+ogb_instance Once just_audio_clips_init;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-Hash_Table just_audio_clips;
-bool just_audio_clips_initted = false;
+Concurrent_Hash_Table just_audio_clips;
+Once just_audio_clips_init = {0};
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
+bool _just_audio_clip_open(void *key, void *value, void *data) {
+	string path = atom_get_string(*(Atom*)key);
+	bool ok = audio_open_source_stream((Audio_Source*)value, path, get_heap_allocator());
+	if (!ok) {
+		log_error("Could not load audio to play from %s", path);
+	}
+	return ok;
+}
+Audio_Source *_just_audio_clip_get(Atom path) {
+	if (once_begin(&just_audio_clips_init)) {
+		just_audio_clips = make_concurrent_hash_table(Atom, Audio_Source, get_heap_allocator());
+		once_end(&just_audio_clips_init, true);
+	}
+	return (Audio_Source*)concurrent_hash_table_get_or_create(&just_audio_clips, path, _just_audio_clip_open, 0);
+}
+
 void
 DEPRECATED(play_one_audio_clip_source_at_position(Audio_Source source, Vector3 pos), "Use play_one_audio_clip_source_with_config() instead") {
 	Audio_Player *p = audio_player_get_one();
@@ -1396,47 +1453,24 @@ play_one_audio_clip_source(Audio_Source source) {
 }
 void
 DEPRECATED(play_one_audio_clip_at_position(string path, Vector3 pos), "Use play_one_audio_clip_with_config() instead") {
-	if (!just_audio_clips_initted) {
-		just_audio_clips_initted = true;
-		just_audio_clips = make_hash_table(string, Audio_Source, get_heap_allocator());
-	}
-	
-	Audio_Source *src_ptr = hash_table_find(&just_audio_clips, path);
+	Audio_Source *src_ptr = _just_audio_clip_get(string_intern(path));
 	if (src_ptr) {
 		play_one_audio_clip_source_at_position(*src_ptr, pos);
-	} else {
-		Audio_Source new_src;
-		bool ok = audio_open_source_stream(&new_src, path, get_heap_allocator());
-		if (!ok) {
-			log_error("Could not load audio to play from %s", path);
-			return;
-		}
-		hash_table_add(&just_audio_clips, path, new_src);
-		play_one_audio_clip_source_at_position(new_src, pos);
 	}
-	
 }
+// Same as play_one_audio_clip_with_config(), but with a path from string_intern() so we don't
+// need to hash and compare the whole path every time.
 void
-play_one_audio_clip_with_config(string path, Audio_Playback_Config config) {
-	if (!just_audio_clips_initted) {
-		just_audio_clips_initted = true;
-		just_audio_clips = make_hash_table(string, Audio_Source, get_heap_allocator());
-	}
-	
-	Audio_Source *src_ptr = hash_table_find(&just_audio_clips, path);
+play_one_audio_clip_atom_with_config(Atom path, Audio_Playback_Config config) {
+	Audio_Source *src_ptr = _just_audio_clip_get(path);
 	if (src_ptr) {
 		play_one_audio_clip_source_with_config(*src_ptr, config);
-	} else {
-		Audio_Source new_src;
-		bool ok = audio_open_source_stream(&new_src, path, get_heap_allocator());
-		if (!ok) {
-			log_error("Could not load audio to play from %s", path);
-			return;
-		}
-		hash_table_add(&just_audio_clips, path, new_src);
-		play_one_audio_clip_source_with_config(new_src, config);
 	}
 }
+void
+play_one_audio_clip_with_config(string path, Audio_Playback_Config config) {
+	play_one_audio_clip_atom_with_config(string_intern(path), config);
+}
 void inline
 play_one_audio_clip(string path) {
 	Audio_Playback_Config config = {0};
@@ -1678,27 +1712,28 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 	
 	memset(mix_buffer, 0, mix_buffer_size);
 	
-	u64 *started_this_frame;
-	growing_array_init((void**)&started_this_frame, sizeof(u64), get_temporary_allocator());
+	// Kept between callbacks so it doesn't grow from nothing every time
+	local_persist thread_local u64 *started_this_frame = 0;
+	if (!started_this_frame) growing_array_init_typed(&started_this_frame, get_heap_allocator());
+	growing_array_clear((void**)&started_this_frame);
 	
 	while (block) {
 		
 		for (u64 i = 0; i < AUDIO_PLAYERS_PER_BLOCK; i++) {
 			Audio_Player *p = &block->players[i];
-			if (p->release_when_done && (p->frame_index >= p->source.number_of_frames
-										  || !p->has_source)) {
+			bool release = p->marked_for_release || (p->release_when_done 
+				&& (p->frame_index >= p->source.number_of_frames || !p->has_source));
+			if (p->allocated && release) {
+				// Let go of the source before the player can be handed out again
+				if (p->has_source) _audio_source_lock_release(p->source.destroy_lock);
+				p->has_source = false;
+				p->marked_for_release = false;
 				p->allocated = false;
 			}
 			if (!p->allocated) {
 				continue;
 			}
 			
-			if (p->marked_for_release) {
-				p->marked_for_release = false;
-				p->allocated = false;
-				continue;
-			}
-			
 			if (p->state != AUDIO_PLAYER_STATE_PLAYING) {
 				if (p->fade_frames == 0) continue;
 			}
@@ -1712,7 +1747,19 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 			
 			Audio_Source src = p->source;
 			
-			mutex_acquire_or_wait(&src.mutex_for_destroy);
+			Audio_Source_Lock *destroy_lock = src.destroy_lock;
+			if (destroy_lock) {
+				mutex_acquire_or_wait(&destroy_lock->mutex);
+				if (destroy_lock->destroyed) {
+					// Destroyed while it was set on this player, nothing left to play
+					mutex_release(&destroy_lock->mutex);
+					_audio_source_lock_release(destroy_lock);
+					p->has_source = false;
+					p->state = AUDIO_PLAYER_STATE_PAUSED;
+					spinlock_release(&p->sample_lock);
+					continue;
+				}
+			}
 
 			Audio_Format sample_format = src.format;
 			sample_format.sample_rate = sample_format.sample_rate*p->config.playback_speed;
@@ -1734,7 +1781,7 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 			if (!mix_buffer || mix_buffer_size < biggest_size) {
 				u64 new_size = get_next_power_of_two(biggest_size);
 				if (mix_buffer) dealloc(get_heap_allocator(), mix_buffer);
-				mix_buffer = alloc(get_heap_allocator(), new_size);
+				mix_buffer = alloc_uninitialized(get_heap_allocator(), new_size);
 				mix_buffer_size = new_size;
 				memset(mix_buffer, 0, new_size);
 			}
@@ -1756,7 +1803,7 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 					if (!mix_buffer || mix_buffer_size < biggest_size) {
 						u64 new_size = get_next_power_of_two(biggest_size);
 						if (mix_buffer) dealloc(get_heap_allocator(), mix_buffer);
-						mix_buffer = alloc(get_heap_allocator(), new_size);
+						mix_buffer = alloc_uninitialized(get_heap_allocator(), new_size);
 						mix_buffer_size = new_size;
 						memset(mix_buffer, 0, new_size);
 					}
@@ -1766,7 +1813,7 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 				if (!convert_buffer || convert_buffer_size < biggest_size) {
 					u64 new_size = get_next_power_of_two(biggest_size);
 					if (convert_buffer) dealloc(get_heap_allocator(), convert_buffer);
-					convert_buffer = alloc(get_heap_allocator(), new_size);
+					convert_buffer = alloc_uninitialized(get_heap_allocator(), new_size);
 					convert_buffer_size = new_size;
 					memset(convert_buffer, 0, new_size);
 				}
@@ -1788,6 +1835,8 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 					// in looping players.
 					// #Incomplete player->is_muted_for_phase_cancellation ? 
 					p->frame_index = src.number_of_frames;
+					if (destroy_lock) mutex_release(&destroy_lock->mutex);
+					spinlock_release(&p->sample_lock);
 					continue;
 				}
 				growing_array_add((void**)&started_this_frame, &src.uid);
@@ -1881,7 +1930,7 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 			
 			mix_frames(output, mix_buffer, number_of_output_frames, out_format);
 			
-			mutex_release(&src.mutex_for_destroy);
+			if (destroy_lock) mutex_release(&destroy_lock->mutex);
 		}
 		
 		block = block->next;
@@ -62,6 +62,13 @@ typedef enum Allocator_Message {
 	ALLOCATOR_ALLOCATE,
 	ALLOCATOR_DEALLOCATE,
 	ALLOCATOR_REALLOCATE,
+	// p is the alignment, a power of two. Return 0 if you can't do that alignment.
+	ALLOCATOR_ALLOCATE_ALIGNED,
+	// Return zeroed memory, or 0 to have alloc() memset it. This is for allocators that know
+	// when memory is still zero from the OS, so alloc() doesn't have to clear it again.
+	// Only sent to the heap and arena allocator procs, others might treat it as a plain
+	// allocation and hand back dirty memory.
+	ALLOCATOR_ALLOCATE_ZEROED,
 } Allocator_Message;
 typedef void*(*Allocator_Proc)(u64, void*, Allocator_Message, void*);
 
@@ -81,6 +88,10 @@ typedef struct Allocator {
 	void *data;	
 } Allocator;
 
+// memory.c. These are the only procs alloc() asks for zeroed memory.
+void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* data);
+void* arena_allocator_proc(u64 size, void *p, Allocator_Message message, void* data);
+
 Allocator
 get_heap_allocator();
 
@@ -114,6 +125,23 @@ alloc_uninitialized(Allocator allocator, u64 size);
 ogb_instance void 
 dealloc(Allocator allocator, void *p);
 
+// alignment must be a power of two. Free with dealloc() like anything else.
+ogb_instance void* 
+alloc_aligned(Allocator allocator, u64 size, u64 alignment);
+
+ogb_instance void* 
+alloc_aligned_uninitialized(Allocator allocator, u64 size, u64 alignment);
+
+// Grows or shrinks an allocation, in place if the allocator can do that.
+// If the allocator can't reallocate we make a new allocation and copy old_size bytes over.
+// Like alloc(), new memory is zero initialized if DO_ZERO_INITIALIZATION.
+ogb_instance void* 
+reallocate(Allocator allocator, void *p, u64 old_size, u64 new_size);
+
+// Same as reallocate(), but if the allocation has to move it keeps the alignment.
+ogb_instance void* 
+reallocate_aligned(Allocator allocator, void *p, u64 old_size, u64 new_size, u64 alignment);
+
 ogb_instance void 
 push_context(Context c);
 
@@ -132,9 +160,15 @@ thread_local u64 num_contexts = 0;
 void* 
 alloc(Allocator allocator, u64 size) {
 	assert(size > 0, "You requested an allocation of zero bytes. I'm not sure what you want with that.");
-	void *p = allocator.proc(size, 0, ALLOCATOR_ALLOCATE, allocator.data);
 #if DO_ZERO_INITIALIZATION
+	if (allocator.proc == heap_allocator_proc || allocator.proc == arena_allocator_proc) {
+		void *p = allocator.proc(size, 0, ALLOCATOR_ALLOCATE_ZEROED, allocator.data);
+		if (p) return p;
+	}
+	void *p = allocator.proc(size, 0, ALLOCATOR_ALLOCATE, allocator.data);
 	memset(p, 0, size);
+#else
+	void *p = allocator.proc(size, 0, ALLOCATOR_ALLOCATE, allocator.data);
 #endif
 	return p;
 }
@@ -145,12 +179,73 @@ alloc_uninitialized(Allocator allocator, u64 size) {
 	return allocator.proc(size, 0, ALLOCATOR_ALLOCATE, allocator.data);	
 }
 
+void* 
+alloc_aligned_uninitialized(Allocator allocator, u64 size, u64 alignment) {
+	assert(size > 0, "You requested an allocation of zero bytes. I'm not sure what you want with that.");
+	assert(alignment && (alignment & (alignment-1)) == 0, "Alignment must be a power of two, you asked for %llu", alignment);
+	void *p = allocator.proc(size, (void*)alignment, ALLOCATOR_ALLOCATE_ALIGNED, allocator.data);
+	assert(p, "Allocator can't do allocations aligned to %llu bytes", alignment);
+	assert((u64)p % alignment == 0, "Allocator returned memory that is not aligned to %llu bytes", alignment);
+	return p;
+}
+
+void* 
+alloc_aligned(Allocator allocator, u64 size, u64 alignment) {
+	void *p = alloc_aligned_uninitialized(allocator, size, alignment);
+#if DO_ZERO_INITIALIZATION
+	memset(p, 0, size);
+#endif
+	return p;
+}
+
 void 
 dealloc(Allocator allocator, void *p) {
 	assert(p != 0, "You tried to deallocate a pointer at adress 0. That doesn't make sense!");
 	allocator.proc(0, p, ALLOCATOR_DEALLOCATE, allocator.data);
 }
 
+void* 
+reallocate(Allocator allocator, void *p, u64 old_size, u64 new_size) {
+	assert(new_size > 0, "You requested a reallocation to zero bytes. Use dealloc() for that.");
+	if (!p) return alloc(allocator, new_size);
+	
+	void *new = allocator.proc(new_size, p, ALLOCATOR_REALLOCATE, allocator.data);
+	if (!new) {
+		new = allocator.proc(new_size, 0, ALLOCATOR_ALLOCATE, allocator.data);
+		memcpy(new, p, min(old_size, new_size));
+		allocator.proc(0, p, ALLOCATOR_DEALLOCATE, allocator.data);
+	}
+	
+#if DO_ZERO_INITIALIZATION
+	if (new_size > old_size) memset((u8*)new+old_size, 0, new_size-old_size);
+#endif
+	return new;
+}
+
+void* 
+reallocate_aligned(Allocator allocator, void *p, u64 old_size, u64 new_size, u64 alignment) {
+	assert(new_size > 0, "You requested a reallocation to zero bytes. Use dealloc() for that.");
+	if (!p) return alloc_aligned(allocator, new_size, alignment);
+	
+	void *new = allocator.proc(new_size, p, ALLOCATOR_REALLOCATE, allocator.data);
+	if (new && (u64)new % alignment != 0) {
+		// Allocator moved it by itself and didn't keep the alignment, so move it once more
+		p = new;
+		old_size = min(old_size, new_size);
+		new = 0;
+	}
+	if (!new) {
+		new = alloc_aligned_uninitialized(allocator, new_size, alignment);
+		memcpy(new, p, min(old_size, new_size));
+		allocator.proc(0, p, ALLOCATOR_DEALLOCATE, allocator.data);
+	}
+	
+#if DO_ZERO_INITIALIZATION
+	if (new_size > old_size) memset((u8*)new+old_size, 0, new_size-old_size);
+#endif
+	return new;
+}
+
 void 
 push_context(Context c) {
 	assert(num_contexts < CONTEXT_STACK_MAX, "Context stack overflow");
@@ -10,6 +10,48 @@ inline bool compare_and_swap_32(volatile uint32_t *a, uint32_t b, uint32_t old);
 inline bool compare_and_swap_64(volatile uint64_t *a, uint64_t b, uint64_t old);
 inline bool compare_and_swap_bool(volatile bool *a, bool b, bool old);
 
+// Atomics (cpu.c). Loads are acquire, stores are release and everything else is a full barrier.
+inline u32 atomic_load_acquire_32(volatile u32 *a);
+inline u64 atomic_load_acquire_64(volatile u64 *a);
+inline void atomic_store_release_32(volatile u32 *a, u32 x);
+inline void atomic_store_release_64(volatile u64 *a, u64 x);
+inline u32 atomic_fetch_add_32(volatile u32 *a, u32 x); // Returns the old value
+inline u64 atomic_fetch_add_64(volatile u64 *a, u64 x); // Returns the old value
+inline u32 atomic_exchange_32(volatile u32 *a, u32 x); // Returns the old value
+inline u64 atomic_exchange_64(volatile u64 *a, u64 x); // Returns the old value
+inline u32 atomic_compare_exchange_32(volatile u32 *a, u32 b, u32 old); // Returns the old value
+inline u64 atomic_compare_exchange_64(volatile u64 *a, u64 b, u64 old); // Returns the old value
+inline void atomic_full_fence();
+
+///
+// Atomic_Counter
+// A counter on its own cache line, for counters which many threads hammer at the same time.
+// Without the padding, anything next to it in memory gets dragged along between cores.
+typedef struct Atomic_Counter {
+	alignat(CACHE_LINE_SIZE) volatile u64 value;
+	u8 padding[CACHE_LINE_SIZE-sizeof(u64)];
+} Atomic_Counter;
+
+// Returns the old value
+inline u64 atomic_counter_add(Atomic_Counter *c, u64 x) { return atomic_fetch_add_64(&c->value, x); }
+inline u64 atomic_counter_get(Atomic_Counter *c)        { return atomic_load_acquire_64(&c->value); }
+
+///
+// Lock_Stats
+// Contention counters for Mutex and RW_Lock. They're only touched when a thread doesn't get
+// the lock right away, so they're cheap to keep around. Report them to the profiler with
+// tm_lock_stats("Name", &lock.stats).
+typedef struct Lock_Stats {
+	volatile u64 acquire_count;   // Mutex and RW_Lock writers only, readers aren't counted
+	volatile u64 contended_count; // Acquires which didn't get the lock on the first try
+	volatile u64 park_count;      // Times a thread had to go to sleep waiting for the lock
+} Lock_Stats;
+
+// Spin loops back off by pausing 1, 2, 4 ... times between each try, up to this many. After that they yield.
+#ifndef SPIN_BACKOFF_MAX
+	#define SPIN_BACKOFF_MAX 64
+#endif
+
 ///
 // Spinlock "primitive"
 // Like a mutex but it eats up the entire core while waiting.
@@ -33,16 +75,17 @@ spinlock_release(Spinlock* l);
 
 
 ///
-// High-level mutex primitive (short spinlock then OS mutex lock)
-// Just spins for a few (configurable) microseconds with a spinlock,
-// and if acquiring fails it falls back to a OS mutex.
-#define MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS 100
+// High-level mutex primitive (futex style)
+// A single u32 lock word, so taking an uncontended Mutex is one compare_and_swap and releasing
+// it is another. If it's taken, we spin a bit with backoff and then sleep with
+// os_wait_on_address until the owner wakes us.
+// Not recursive.
+#define MUTEX_DEFAULT_SPIN_COUNT 100
 typedef struct Mutex {
-	Spinlock spinlock;
-	f64 spin_time_microseconds;
-	Mutex_Handle os_handle;
-	volatile bool spinlock_acquired;
+	volatile u32 state; // 0 = unlocked, 1 = locked, 2 = locked and there might be sleepers
+	u32 spin_count; // How many times we try before going to sleep
 	volatile u64 acquiring_thread;
+	Lock_Stats stats;
 } Mutex;
 
 void ogb_instance
@@ -54,16 +97,254 @@ mutex_destroy(Mutex *m);
 void ogb_instance
 mutex_acquire_or_wait(Mutex *m);
 
+// Returns false right away if someone else has it
+bool ogb_instance
+mutex_acquire_or_fail(Mutex *m);
+
 void ogb_instance
 mutex_release(Mutex *m);
 
 
+///
+// Reader-writer lock
+// Any number of readers or one writer. For read-mostly stuff like caches that are rarely
+// written to. Writers go first: once a writer is waiting, new readers wait too, so a steady
+// stream of readers can't starve it. That also means it's not recursive, a thread which
+// takes the read lock twice can deadlock with a waiting writer.
+#define RW_LOCK_WRITER      (1U << 31)
+#define RW_LOCK_PARKED      (1U << 30) // Someone might be sleeping on state
+#define RW_LOCK_READER_MASK (RW_LOCK_PARKED-1)
+typedef struct RW_Lock {
+	volatile u32 state; // Number of readers | RW_LOCK_WRITER | RW_LOCK_PARKED
+	volatile u32 writers_waiting;
+	u32 spin_count;
+	volatile u64 writing_thread;
+	Lock_Stats stats;
+} RW_Lock;
+
+void ogb_instance
+rw_lock_init(RW_Lock *l);
+
+void ogb_instance
+rw_lock_read_acquire_or_wait(RW_Lock *l);
+
+void ogb_instance
+rw_lock_read_release(RW_Lock *l);
+
+void ogb_instance
+rw_lock_write_acquire_or_wait(RW_Lock *l);
+
+void ogb_instance
+rw_lock_write_release(RW_Lock *l);
+
+///
+// Counting semaphore
+// semaphore_wait takes one from the count, or waits until there is one to take.
+// semaphore_signal adds to it and wakes that many waiters.
+typedef struct Semaphore {
+	volatile u32 count;
+	volatile u32 waiters;
+	u32 spin_count;
+} Semaphore;
+
+void ogb_instance
+semaphore_init(Semaphore *s, u32 initial_count);
+
+void ogb_instance
+semaphore_wait(Semaphore *s);
+
+// Returns false right away if the count is 0
+bool ogb_instance
+semaphore_try_wait(Semaphore *s);
+
+void ogb_instance
+semaphore_signal(Semaphore *s, u32 count);
+
+
+///
+// Latch
+// Counts down once and stays open. Good for "wait until these N things are done" when the N
+// things aren't jobs.
+typedef struct Latch {
+	volatile u32 count;
+	volatile u32 waiters;
+	u32 spin_count;
+} Latch;
+
+void ogb_instance
+latch_init(Latch *l, u32 count);
+
+void ogb_instance
+latch_count_down(Latch *l, u32 count);
+
+void ogb_instance
+latch_wait(Latch *l);
+
+void ogb_instance
+latch_count_down_and_wait(Latch *l);
+
+
+///
+// Once
+// For lazy init that more than one thread might race to do:
+//
+//     if (once_begin(&thing_once)) {
+//         init_thing();
+//         once_end(&thing_once, true);
+//     }
+//
+// once_begin returns true on the one thread that should do it. Anyone else who gets there in
+// the meantime waits until it's done and gets false. If it didn't work out, once_end with false
+// lets the next once_begin have a go instead.
+#define ONCE_NOT_DONE 0
+#define ONCE_RUNNING  1
+#define ONCE_DONE     2
+typedef struct Once {
+	volatile u32 state;
+	volatile u32 waiters;
+} Once;
+
+bool ogb_instance
+once_begin(Once *o);
+
+void ogb_instance
+once_end(Once *o, bool done);
+
+bool ogb_instance
+once_is_done(Once *o);
+
+
+///
+// Barrier
+// thread_count threads call barrier_wait and nobody gets through until all of them have.
+// Then it resets, so the same barrier can be used for every phase of every frame:
+//
+//     while (running) {
+//         simulate_my_part();
+//         barrier_wait(&frame_barrier);
+//         build_my_draw_frame();
+//         if (barrier_wait(&frame_barrier)) submit_draw_frames(); // Only one thread gets true
+//         barrier_wait(&frame_barrier);
+//     }
+//
+// Waiters spin for a while before going to sleep, since the other threads are usually close
+// behind.
+#ifndef BARRIER_DEFAULT_SPIN_COUNT
+	#define BARRIER_DEFAULT_SPIN_COUNT 200
+#endif
+typedef struct Barrier {
+	alignat(CACHE_LINE_SIZE) volatile u32 arrived;
+	volatile u32 generation; // Goes up by one every time everyone has arrived
+	volatile u32 waiters;
+	u32 thread_count;
+	u32 spin_count;
+} Barrier;
+
+void ogb_instance
+barrier_init(Barrier *b, u32 thread_count);
+
+// Returns true on exactly one of the threads each time, handy for work that should happen once
+// between phases.
+bool ogb_instance
+barrier_wait(Barrier *b);
+
+
+///
+// Lock-free ring queues
+// Bounded queues for handing stuff between threads without locks, like audio commands, log lines
+// or loaded assets. Items are copied in and out, item_size bytes each. Capacity is rounded up to
+// a power of two. Push returns false when full and pop returns false when empty, what to do then
+// is up to you (yield, drop it, do something else).
+//
+// Spsc_Queue: one producer thread and one consumer thread.
+// Mpsc_Queue: any number of producer threads and one consumer thread.
+//
+// The _many versions move as many items as they can in one go and return how many that was.
+
+typedef struct Spsc_Queue {
+	// Producer side
+	alignat(CACHE_LINE_SIZE) volatile u64 tail;
+	u64 cached_head; // So the producer doesn't read head (the consumer's cache line) on every push
+	// Consumer side
+	alignat(CACHE_LINE_SIZE) volatile u64 head;
+	u64 cached_tail;
+	
+	alignat(CACHE_LINE_SIZE) u8 *items;
+	u64 item_size;
+	u64 capacity;
+	Allocator allocator;
+} Spsc_Queue;
+
+void ogb_instance
+spsc_queue_init(Spsc_Queue *q, u64 item_size, u64 capacity, Allocator allocator);
+
+void ogb_instance
+spsc_queue_destroy(Spsc_Queue *q);
+
+bool ogb_instance
+spsc_queue_push(Spsc_Queue *q, void *item);
+
+bool ogb_instance
+spsc_queue_pop(Spsc_Queue *q, void *item);
+
+u64 ogb_instance
+spsc_queue_push_many(Spsc_Queue *q, void *items, u64 count);
+
+u64 ogb_instance
+spsc_queue_pop_many(Spsc_Queue *q, void *items, u64 max_count);
+
+// Each slot has a sequence number in front of the item which tells the consumer when a producer
+// is done writing it, like in Dmitry Vyukov's bounded queue.
+typedef struct Mpsc_Queue {
+	alignat(CACHE_LINE_SIZE) volatile u64 tail; // Producers reserve slots here
+	alignat(CACHE_LINE_SIZE) volatile u64 head; // Consumer
+	
+	alignat(CACHE_LINE_SIZE) u8 *slots;
+	u64 item_size;
+	u64 slot_size;
+	u64 capacity;
+	Allocator allocator;
+} Mpsc_Queue;
+
+void ogb_instance
+mpsc_queue_init(Mpsc_Queue *q, u64 item_size, u64 capacity, Allocator allocator);
+
+void ogb_instance
+mpsc_queue_destroy(Mpsc_Queue *q);
+
+bool ogb_instance
+mpsc_queue_push(Mpsc_Queue *q, void *item);
+
+// Any thread
+u64 ogb_instance
+mpsc_queue_push_many(Mpsc_Queue *q, void *items, u64 count);
+
+// Consumer thread only
+bool ogb_instance
+mpsc_queue_pop(Mpsc_Queue *q, void *item);
+
+// Consumer thread only
+u64 ogb_instance
+mpsc_queue_pop_many(Mpsc_Queue *q, void *items, u64 max_count);
+
+
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
+// Pauses for a bit and doubles how long we pause next time. Once that gets long we yield
+// instead, so whoever we're waiting for can run if they're on our core.
+inline void spin_backoff(u32 *backoff) {
+	if (*backoff >= SPIN_BACKOFF_MAX) {
+		os_yield_thread();
+		return;
+	}
+	for (u32 i = 0; i < *backoff; i += 1) cpu_relax();
+	*backoff *= 2;
+}
 void spinlock_init(Spinlock *l) {
 	memset(l, 0, sizeof(*l));
 }
 void spinlock_acquire_or_wait(Spinlock* l) {
+	u32 backoff = 1;
 	while (true) {
         bool expected = false;
         if (compare_and_swap_bool(&l->locked, true, expected)) {
@@ -71,12 +352,14 @@ void spinlock_acquire_or_wait(Spinlock* l) {
         }
         while (l->locked) {
             // spinny boi
+            spin_backoff(&backoff);
         }
     }
 }
 // Returns true on aquired, false if timeout seconds reached
 bool spinlock_acquire_or_wait_timeout(Spinlock* l, f64 timeout_seconds) {
     f64 start = os_get_elapsed_seconds();
+	u32 backoff = 1;
 	while (true) {
         bool expected = false;
         if (compare_and_swap_bool(&l->locked, true, expected)) {
@@ -85,6 +368,7 @@ bool spinlock_acquire_or_wait_timeout(Spinlock* l, f64 timeout_seconds) {
         while (l->locked) {
             // spinny boi
             if ((os_get_elapsed_seconds()-start) >= timeout_seconds) return false;
+            spin_backoff(&backoff);
         }
     }
     return true;
@@ -97,38 +381,455 @@ void spinlock_release(Spinlock* l) {
 
 
 ///
-// High-level mutex primitive (short spinlock then OS mutex lock)
+// High-level mutex primitive (futex style)
+// This is the three state mutex from Ulrich Drepper's "Futexes Are Tricky". Only mark the lock
+// as having sleepers (2) when we're about to sleep, so release only goes to the kernel when it
+// has to.
 
 void mutex_init(Mutex *m) {
-	spinlock_init(&m->spinlock);
-	m->spin_time_microseconds = MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS;
-	m->os_handle = os_make_mutex();
-	m->spinlock_acquired = false;
-	m->acquiring_thread = 0;
+	*m = ZERO(Mutex);
+	m->spin_count = MUTEX_DEFAULT_SPIN_COUNT;
 }
 void mutex_destroy(Mutex *m) {
-	os_destroy_mutex(m->os_handle);
+	assert(m->state == 0, "Destroying a mutex which is acquired");
 }
 void mutex_acquire_or_wait(Mutex *m) {
-	if (spinlock_acquire_or_wait_timeout(&m->spinlock, m->spin_time_microseconds / 1000000.0)) {
-        assert(!m->spinlock_acquired, "Internal sync error in Mutex");
-    	m->spinlock_acquired = true;
-    }
-    os_lock_mutex(m->os_handle);
-    
-    assert(!m->acquiring_thread, "Internal sync error in Mutex: Multiple threads acquired");
-    m->acquiring_thread = context.thread_id;
+	u32 c = m->state;
+	if (c == 0 && compare_and_swap_32(&m->state, 1, 0)) {
+		m->stats.acquire_count += 1;
+		assert(!m->acquiring_thread, "Internal sync error in Mutex: Multiple threads acquired");
+		m->acquiring_thread = context.thread_id;
+		return;
+	}
+	
+	bool acquired = false;
+	u32 backoff = 1;
+	for (u32 i = 0; i < m->spin_count; i += 1) {
+		spin_backoff(&backoff);
+		c = m->state;
+		if (c == 0 && compare_and_swap_32(&m->state, 1, 0)) {
+			acquired = true;
+			break;
+		}
+		if (c == 2) break; // Others are already sleeping, no point spinning
+	}
+	
+	u64 parks = 0;
+	if (!acquired) {
+		c = atomic_exchange_32(&m->state, 2);
+		while (c != 0) {
+			os_wait_on_address(&m->state, 2);
+			parks += 1;
+			c = atomic_exchange_32(&m->state, 2);
+		}
+	}
+	
+	// We own it now, so no need for atomics
+	m->stats.acquire_count += 1;
+	m->stats.contended_count += 1;
+	m->stats.park_count += parks;
+	
+	assert(!m->acquiring_thread, "Internal sync error in Mutex: Multiple threads acquired");
+	m->acquiring_thread = context.thread_id;
+}
+bool mutex_acquire_or_fail(Mutex *m) {
+	if (m->state != 0 || !compare_and_swap_32(&m->state, 1, 0)) return false;
+	
+	m->stats.acquire_count += 1;
+	assert(!m->acquiring_thread, "Internal sync error in Mutex: Multiple threads acquired");
+	m->acquiring_thread = context.thread_id;
+	return true;
 }
 void mutex_release(Mutex *m) {
 	assert(m->acquiring_thread != 0, "Tried to release a mutex which is not acquired");
 	assert(m->acquiring_thread == context.thread_id, "Non-owning thread tried to release mutex");
 	m->acquiring_thread = 0;
-	bool was_spinlock_acquired = m->spinlock_acquired;
-	m->spinlock_acquired = false;
-	os_unlock_mutex(m->os_handle);
-	if (was_spinlock_acquired) {
-		spinlock_release(&m->spinlock);
+	
+	if (compare_and_swap_32(&m->state, 0, 1)) return;
+	
+	// Someone might be sleeping
+	atomic_store_release_32(&m->state, 0);
+	os_wake_one_on_address(&m->state);
+}
+
+
+///
+// Reader-writer lock
+
+void rw_lock_init(RW_Lock *l) {
+	*l = ZERO(RW_Lock);
+	l->spin_count = MUTEX_DEFAULT_SPIN_COUNT;
+}
+
+// Sets RW_LOCK_PARKED and sleeps until state changes. Returns false if state changed before
+// we could set the flag, then just try again.
+bool rw_lock_park(RW_Lock *l, u32 s) {
+	if (!(s & RW_LOCK_PARKED)) {
+		if (!compare_and_swap_32(&l->state, s | RW_LOCK_PARKED, s)) return false;
+		s |= RW_LOCK_PARKED;
+	}
+	os_wait_on_address(&l->state, s);
+	atomic_fetch_add_64(&l->stats.park_count, 1);
+	return true;
+}
+
+void rw_lock_read_acquire_or_wait(RW_Lock *l) {
+	u32 backoff = 1;
+	u32 tries = 0;
+	while (true) {
+		u32 s = l->state;
+		if (!(s & RW_LOCK_WRITER) && !l->writers_waiting) {
+			assert((s & RW_LOCK_READER_MASK) != RW_LOCK_READER_MASK, "Too many readers on RW_Lock");
+			if (compare_and_swap_32(&l->state, s+1, s)) break;
+			continue; // Another reader got in first, just try again
+		}
+		
+		if (tries == 0) atomic_fetch_add_64(&l->stats.contended_count, 1);
+		tries += 1;
+		
+		if (tries < l->spin_count) spin_backoff(&backoff);
+		else rw_lock_park(l, s);
+	}
+}
+void rw_lock_read_release(RW_Lock *l) {
+	while (true) {
+		u32 s = l->state;
+		assert((s & RW_LOCK_READER_MASK) != 0, "Tried to release a read lock which is not acquired");
+		assert(!(s & RW_LOCK_WRITER), "Internal sync error in RW_Lock: Reader and writer at the same time");
+		
+		u32 new_s = s - 1;
+		bool last_reader = (new_s & RW_LOCK_READER_MASK) == 0;
+		if (last_reader) new_s &= ~RW_LOCK_PARKED;
+		
+		if (compare_and_swap_32(&l->state, new_s, s)) {
+			if (last_reader && (s & RW_LOCK_PARKED)) os_wake_all_on_address(&l->state);
+			return;
+		}
+	}
+}
+
+void rw_lock_write_acquire_or_wait(RW_Lock *l) {
+	u32 s = l->state;
+	if (s == 0 && compare_and_swap_32(&l->state, RW_LOCK_WRITER, 0)) {
+		l->stats.acquire_count += 1;
+		l->writing_thread = context.thread_id;
+		return;
+	}
+	
+	atomic_fetch_add_32(&l->writers_waiting, 1);
+	
+	u32 backoff = 1;
+	u32 tries = 0;
+	while (true) {
+		s = l->state;
+		if ((s & ~RW_LOCK_PARKED) == 0) {
+			if (compare_and_swap_32(&l->state, s | RW_LOCK_WRITER, s)) break;
+			continue;
+		}
+		
+		tries += 1;
+		if (tries < l->spin_count) spin_backoff(&backoff);
+		else rw_lock_park(l, s);
+	}
+	
+	atomic_fetch_add_32(&l->writers_waiting, (u32)-1);
+	
+	// We own it now, so no need for atomics
+	l->stats.acquire_count += 1;
+	l->stats.contended_count += 1;
+	l->writing_thread = context.thread_id;
+}
+void rw_lock_write_release(RW_Lock *l) {
+	assert(l->state & RW_LOCK_WRITER, "Tried to release a write lock which is not acquired");
+	assert(l->writing_thread == context.thread_id, "Non-owning thread tried to release write lock");
+	l->writing_thread = 0;
+	
+	u32 s = atomic_exchange_32(&l->state, 0);
+	if (s & RW_LOCK_PARKED) os_wake_all_on_address(&l->state);
+}
+
+///
+// Counting semaphore
+
+void semaphore_init(Semaphore *s, u32 initial_count) {
+	*s = ZERO(Semaphore);
+	s->count = initial_count;
+	s->spin_count = MUTEX_DEFAULT_SPIN_COUNT;
+}
+bool semaphore_try_wait(Semaphore *s) {
+	u32 c = s->count;
+	while (c > 0) {
+		u32 old = atomic_compare_exchange_32(&s->count, c-1, c);
+		if (old == c) return true;
+		c = old;
+	}
+	return false;
+}
+void semaphore_wait(Semaphore *s) {
+	u32 backoff = 1;
+	for (u32 i = 0; i < s->spin_count; i += 1) {
+		if (semaphore_try_wait(s)) return;
+		spin_backoff(&backoff);
+	}
+	
+	// Either we see the signalled count or the signaller sees us waiting, both are full barriers
+	atomic_fetch_add_32(&s->waiters, 1);
+	while (!semaphore_try_wait(s)) {
+		os_wait_on_address(&s->count, 0);
+	}
+	atomic_fetch_add_32(&s->waiters, (u32)-1);
+}
+void semaphore_signal(Semaphore *s, u32 count) {
+	if (count == 0) return;
+	atomic_fetch_add_32(&s->count, count);
+	if (s->waiters) {
+		if (count == 1) os_wake_one_on_address(&s->count);
+		else            os_wake_all_on_address(&s->count);
+	}
+}
+
+
+///
+// Latch
+
+void latch_init(Latch *l, u32 count) {
+	*l = ZERO(Latch);
+	l->count = count;
+	l->spin_count = MUTEX_DEFAULT_SPIN_COUNT;
+}
+void latch_count_down(Latch *l, u32 count) {
+	u32 old = atomic_fetch_add_32(&l->count, (u32)-(s32)count);
+	assert(old >= count, "Latch counted down below 0");
+	if (old == count && l->waiters) os_wake_all_on_address(&l->count);
+}
+void latch_wait(Latch *l) {
+	u32 backoff = 1;
+	for (u32 i = 0; i < l->spin_count; i += 1) {
+		if (atomic_load_acquire_32(&l->count) == 0) return;
+		spin_backoff(&backoff);
+	}
+	
+	atomic_fetch_add_32(&l->waiters, 1);
+	u32 c;
+	while ((c = atomic_load_acquire_32(&l->count)) != 0) {
+		os_wait_on_address(&l->count, c);
+	}
+	atomic_fetch_add_32(&l->waiters, (u32)-1);
+}
+void latch_count_down_and_wait(Latch *l) {
+	latch_count_down(l, 1);
+	latch_wait(l);
+}
+
+
+///
+// Once
+
+bool once_begin(Once *o) {
+	u32 backoff = 1;
+	u32 spins = 0;
+	while (true) {
+		u32 state = atomic_load_acquire_32(&o->state);
+		if (state == ONCE_DONE) return false;
+		if (state == ONCE_NOT_DONE) {
+			if (atomic_compare_exchange_32(&o->state, ONCE_RUNNING, ONCE_NOT_DONE) == ONCE_NOT_DONE) return true;
+			continue;
+		}
+		
+		if (spins < MUTEX_DEFAULT_SPIN_COUNT) {
+			spins += 1;
+			spin_backoff(&backoff);
+			continue;
+		}
+		atomic_fetch_add_32(&o->waiters, 1);
+		os_wait_on_address(&o->state, ONCE_RUNNING);
+		atomic_fetch_add_32(&o->waiters, (u32)-1);
 	}
 }
+void once_end(Once *o, bool done) {
+	assert(o->state == ONCE_RUNNING, "once_end without once_begin");
+	// Exchange rather than a plain store so the waiters load can't happen before it
+	atomic_exchange_32(&o->state, done ? ONCE_DONE : ONCE_NOT_DONE);
+	if (o->waiters) os_wake_all_on_address(&o->state);
+}
+bool once_is_done(Once *o) {
+	return atomic_load_acquire_32(&o->state) == ONCE_DONE;
+}
+
+
+///
+// Barrier
+
+void barrier_init(Barrier *b, u32 thread_count) {
+	assert(thread_count > 0, "Barrier needs at least 1 thread");
+	*b = ZERO(Barrier);
+	b->thread_count = thread_count;
+	b->spin_count = BARRIER_DEFAULT_SPIN_COUNT;
+}
+bool barrier_wait(Barrier *b) {
+	// Need to know which generation we're in before we arrive, or the last thread could move
+	// it on before we look.
+	u32 generation = atomic_load_acquire_32(&b->generation);
+	
+	if (atomic_fetch_add_32(&b->arrived, 1) + 1 == b->thread_count) {
+		// Last one in. Nobody can arrive for the next round before they see the new generation,
+		// so it's safe to reset arrived first.
+		b->arrived = 0;
+		atomic_fetch_add_32(&b->generation, 1);
+		if (b->waiters) os_wake_all_on_address(&b->generation);
+		return true;
+	}
+	
+	u32 backoff = 1;
+	for (u32 i = 0; i < b->spin_count; i += 1) {
+		if (atomic_load_acquire_32(&b->generation) != generation) return false;
+		spin_backoff(&backoff);
+	}
+	
+	atomic_fetch_add_32(&b->waiters, 1);
+	while (atomic_load_acquire_32(&b->generation) == generation) {
+		os_wait_on_address(&b->generation, generation);
+	}
+	atomic_fetch_add_32(&b->waiters, (u32)-1);
+	return false;
+}
+
+
+///
+// Lock-free ring queues
+
+void spsc_queue_init(Spsc_Queue *q, u64 item_size, u64 capacity, Allocator allocator) {
+	assert(item_size > 0, "Queue item_size must be more than 0");
+	*q = ZERO(Spsc_Queue);
+	q->item_size = item_size;
+	q->capacity = get_next_power_of_two(max(capacity, 2));
+	q->allocator = allocator;
+	q->items = (u8*)alloc_aligned(allocator, q->capacity*item_size, CACHE_LINE_SIZE);
+}
+void spsc_queue_destroy(Spsc_Queue *q) {
+	dealloc(q->allocator, q->items);
+	*q = ZERO(Spsc_Queue);
+}
+
+// Copies count items into the ring starting at index, wrapping around
+void _ring_copy_in(u8 *ring, u64 capacity, u64 item_size, u64 index, u8 *items, u64 count) {
+	u64 first = index & (capacity-1);
+	u64 first_count = min(count, capacity-first);
+	memcpy(ring + first*item_size, items, first_count*item_size);
+	if (count > first_count) memcpy(ring, items + first_count*item_size, (count-first_count)*item_size);
+}
+void _ring_copy_out(u8 *ring, u64 capacity, u64 item_size, u64 index, u8 *items, u64 count) {
+	u64 first = index & (capacity-1);
+	u64 first_count = min(count, capacity-first);
+	memcpy(items, ring + first*item_size, first_count*item_size);
+	if (count > first_count) memcpy(items + first_count*item_size, ring, (count-first_count)*item_size);
+}
+
+u64 spsc_queue_push_many(Spsc_Queue *q, void *items, u64 count) {
+	u64 tail = q->tail;
+	u64 space = q->capacity - (tail - q->cached_head);
+	if (space < count) {
+		q->cached_head = atomic_load_acquire_64(&q->head);
+		space = q->capacity - (tail - q->cached_head);
+	}
+	count = min(count, space);
+	if (count == 0) return 0;
+	
+	_ring_copy_in(q->items, q->capacity, q->item_size, tail, (u8*)items, count);
+	atomic_store_release_64(&q->tail, tail + count);
+	return count;
+}
+bool spsc_queue_push(Spsc_Queue *q, void *item) {
+	return spsc_queue_push_many(q, item, 1) == 1;
+}
+u64 spsc_queue_pop_many(Spsc_Queue *q, void *items, u64 max_count) {
+	u64 head = q->head;
+	u64 available = q->cached_tail - head;
+	if (available < max_count) {
+		q->cached_tail = atomic_load_acquire_64(&q->tail);
+		available = q->cached_tail - head;
+	}
+	u64 count = min(max_count, available);
+	if (count == 0) return 0;
+	
+	_ring_copy_out(q->items, q->capacity, q->item_size, head, (u8*)items, count);
+	atomic_store_release_64(&q->head, head + count);
+	return count;
+}
+bool spsc_queue_pop(Spsc_Queue *q, void *item) {
+	return spsc_queue_pop_many(q, item, 1) == 1;
+}
+
+#define _mpsc_slot(q, index) ((q)->slots + ((index) & ((q)->capacity-1))*(q)->slot_size)
+
+void mpsc_queue_init(Mpsc_Queue *q, u64 item_size, u64 capacity, Allocator allocator) {
+	assert(item_size > 0, "Queue item_size must be more than 0");
+	*q = ZERO(Mpsc_Queue);
+	q->item_size = item_size;
+	q->slot_size = align_next(sizeof(u64) + item_size, sizeof(u64));
+	q->capacity = get_next_power_of_two(max(capacity, 2));
+	q->allocator = allocator;
+	q->slots = (u8*)alloc_aligned(allocator, q->capacity*q->slot_size, CACHE_LINE_SIZE);
+	
+	// A slot is free for position i when its sequence is i, and ready to pop when it's i+1
+	for (u64 i = 0; i < q->capacity; i += 1) {
+		*(u64*)_mpsc_slot(q, i) = i;
+	}
+}
+void mpsc_queue_destroy(Mpsc_Queue *q) {
+	dealloc(q->allocator, q->slots);
+	*q = ZERO(Mpsc_Queue);
+}
+
+u64 mpsc_queue_push_many(Mpsc_Queue *q, void *items, u64 count) {
+	if (count == 0) return 0;
+	
+	u64 tail = atomic_load_acquire_64(&q->tail);
+	while (true) {
+		// head only moves after the consumer is done with the slots before it, so anything
+		// between head and head+capacity is free to write once we own it.
+		u64 head = atomic_load_acquire_64(&q->head);
+		if ((s64)(tail - head) < 0) {
+			tail = atomic_load_acquire_64(&q->tail); // Our tail is old news
+			continue;
+		}
+		u64 space = q->capacity - (tail - head);
+		if (space == 0) return 0;
+		u64 n = min(count, space);
+		
+		u64 old = atomic_compare_exchange_64(&q->tail, tail+n, tail);
+		if (old != tail) {
+			tail = old;
+			continue;
+		}
+		
+		for (u64 i = 0; i < n; i += 1) {
+			u8 *slot = _mpsc_slot(q, tail+i);
+			memcpy(slot + sizeof(u64), (u8*)items + i*q->item_size, q->item_size);
+			atomic_store_release_64((volatile u64*)slot, tail+i+1);
+		}
+		return n;
+	}
+}
+bool mpsc_queue_push(Mpsc_Queue *q, void *item) {
+	return mpsc_queue_push_many(q, item, 1) == 1;
+}
+u64 mpsc_queue_pop_many(Mpsc_Queue *q, void *items, u64 max_count) {
+	u64 head = q->head;
+	u64 count = 0;
+	while (count < max_count) {
+		u8 *slot = _mpsc_slot(q, head+count);
+		// A producer may have reserved the slot but not written it yet
+		if (atomic_load_acquire_64((volatile u64*)slot) != head+count+1) break;
+		memcpy((u8*)items + count*q->item_size, slot + sizeof(u64), q->item_size);
+		atomic_store_release_64((volatile u64*)slot, head+count+q->capacity);
+		count += 1;
+	}
+	if (count) atomic_store_release_64(&q->head, head + count);
+	return count;
+}
+bool mpsc_queue_pop(Mpsc_Queue *q, void *item) {
+	return mpsc_queue_pop_many(q, item, 1) == 1;
+}
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,278 @@
+// Concurrent hash table
+// For caches that any thread might look things up in or add to, like loaded audio clips or
+// font atlases. Keys are spread over shards by hash, and each shard is a Hash_Table with its own
+// RW_Lock, so threads only get in each other's way when they touch the same shard, and lookups
+// only take the read lock.
+// Values live outside of the Hash_Table, in blocks which are never moved, so pointers to them
+// stay valid until the table is destroyed, even while other threads keep adding.
+// concurrent_hash_table_get_or_create builds a missing value outside of the lock, and any other
+// thread asking for the same key meanwhile waits for that instead of building it again.
+
+/*
+
+	Example Usage:
+
+	Concurrent_Hash_Table images = make_concurrent_hash_table(string, Gfx_Image*, get_heap_allocator());
+
+	bool load_image_for_cache(void *key, void *value, void *data) {
+		*(Gfx_Image**)value = load_image_from_disk(*(string*)key, get_heap_allocator());
+		return *(Gfx_Image**)value != 0; // false: not added, the next get_or_create tries again
+	}
+
+	// Returns a pointer to the value, or NULL if it wasn't there and load_image_for_cache failed.
+	// Only one thread ever runs load_image_for_cache for the same path (at a time).
+	string path = STR("player.png");
+	Gfx_Image **image = concurrent_hash_table_get_or_create(&images, path, load_image_for_cache, 0);
+
+	// NULL if not there (or still being created)
+	Gfx_Image **same_image = concurrent_hash_table_find(&images, path);
+
+	// Copies value in if the key isn't there yet. Returns whether it was added.
+	Gfx_Image *other = ...;
+	string other_path = STR("other.png");
+	concurrent_hash_table_add(&images, other_path, other);
+
+	// Visit everything. visit_image runs without any locks held, so it may add to the table too.
+	bool visit_image(void *key, void *value, void *data) {
+		delete_image(*(Gfx_Image**)value);
+		return true; // false to stop
+	}
+	concurrent_hash_table_walk(&images, visit_image, 0);
+
+	concurrent_hash_table_destroy(&images);
+
+	Limitations:
+		- There's no remove. This is for caches which live as long as the thing they cache for,
+		  and it's what lets pointers to values stay valid.
+		- Same key rules as Hash_Table, and keys need to be lvalues for the macros.
+		- Destroy is not thread safe, nobody else can be using the table.
+		- Keys added while walking might or might not be visited.
+*/
+
+#ifndef CONCURRENT_HASH_TABLE_DEFAULT_SHARD_COUNT
+	#define CONCURRENT_HASH_TABLE_DEFAULT_SHARD_COUNT 16
+#endif
+#define CONCURRENT_HASH_TABLE_NODES_PER_BLOCK 64
+
+// Return false if the value couldn't be made. key and value are the caller's key and the value
+// to fill in (zeroed). data is whatever was passed to get_or_create.
+typedef bool(*Concurrent_Hash_Table_Create_Proc)(void *key, void *value, void *data);
+// Return false to stop walking
+typedef bool(*Concurrent_Hash_Table_Walk_Proc)(void *key, void *value, void *data);
+
+typedef struct Concurrent_Hash_Table_Shard {
+	alignat(CACHE_LINE_SIZE) RW_Lock lock;
+	Hash_Table table; // key -> Concurrent_Hash_Table_Node*
+	// Nodes are handed out from blocks of CONCURRENT_HASH_TABLE_NODES_PER_BLOCK. The first
+	// 16 bytes of a block point to the block before it.
+	u8 *block;
+	u64 block_used;
+} Concurrent_Hash_Table_Shard;
+
+// Value comes after this, at CONCURRENT_HASH_TABLE_VALUE_OFFSET
+typedef struct Concurrent_Hash_Table_Node {
+	Once created;
+} Concurrent_Hash_Table_Node;
+#define CONCURRENT_HASH_TABLE_VALUE_OFFSET 16
+
+typedef struct Concurrent_Hash_Table {
+	Concurrent_Hash_Table_Shard *shards;
+	u64 shard_count; // Power of two
+
+	u64 _key_size;
+	u64 _value_size;
+	u64 _node_size;
+	bool _key_is_string;
+
+	Allocator allocator;
+} Concurrent_Hash_Table;
+
+// API:
+#define make_concurrent_hash_table(Key_Type, Value_Type, allocator) \
+	make_concurrent_hash_table_raw(sizeof(Key_Type), sizeof(Value_Type), CONCURRENT_HASH_TABLE_DEFAULT_SHARD_COUNT, allocator, _hash_table_key_is_string((Key_Type){0}))
+
+#define concurrent_hash_table_find(table_ptr, key) \
+	concurrent_hash_table_find_raw((table_ptr), get_hash(key), &(key), sizeof(key))
+
+#define concurrent_hash_table_get_or_create(table_ptr, key, create_proc, data) \
+	concurrent_hash_table_get_or_create_raw((table_ptr), get_hash(key), &(key), sizeof(key), (create_proc), (data))
+
+#define concurrent_hash_table_add(table_ptr, key, value) \
+	concurrent_hash_table_add_raw((table_ptr), get_hash(key), &(key), &(value), sizeof(key), sizeof(value))
+
+Concurrent_Hash_Table make_concurrent_hash_table_raw(u64 key_size, u64 value_size, u64 shard_count, Allocator allocator, bool key_is_string) {
+	assert(shard_count > 0, "Concurrent hash table needs at least 1 shard");
+
+	Concurrent_Hash_Table t = ZERO(Concurrent_Hash_Table);
+	t.shard_count = 1;
+	while (t.shard_count < shard_count) t.shard_count *= 2;
+	t._key_size = key_size;
+	t._value_size = value_size;
+	t._node_size = align_next(CONCURRENT_HASH_TABLE_VALUE_OFFSET + value_size, 16);
+	t._key_is_string = key_is_string;
+	t.allocator = allocator;
+
+	t.shards = (Concurrent_Hash_Table_Shard*)alloc_aligned_uninitialized(allocator, t.shard_count*sizeof(Concurrent_Hash_Table_Shard), CACHE_LINE_SIZE);
+	for (u64 i = 0; i < t.shard_count; i += 1) {
+		rw_lock_init(&t.shards[i].lock);
+		t.shards[i].table = make_hash_table_reserve_raw(key_size, sizeof(Concurrent_Hash_Table_Node*), 16, allocator, key_is_string);
+		t.shards[i].block = 0;
+		t.shards[i].block_used = 0;
+	}
+
+	return t;
+}
+
+void concurrent_hash_table_destroy(Concurrent_Hash_Table *t) {
+	for (u64 i = 0; i < t->shard_count; i += 1) {
+		u8 *block = t->shards[i].block;
+		while (block) {
+			u8 *previous = *(u8**)block;
+			dealloc(t->allocator, block);
+			block = previous;
+		}
+		hash_table_destroy(&t->shards[i].table);
+	}
+	dealloc(t->allocator, t->shards);
+	*t = ZERO(Concurrent_Hash_Table);
+}
+
+inline Concurrent_Hash_Table_Shard *_concurrent_hash_table_shard(Concurrent_Hash_Table *t, u64 hash) {
+	// Hash_Table picks slots from the low bits, so shard by some higher ones
+	return &t->shards[(hash >> 40) & (t->shard_count-1)];
+}
+inline void *_concurrent_hash_table_node_value(Concurrent_Hash_Table_Node *node) {
+	return (u8*)node + CONCURRENT_HASH_TABLE_VALUE_OFFSET;
+}
+
+Concurrent_Hash_Table_Node *_concurrent_hash_table_find_node(Concurrent_Hash_Table_Shard *shard, u64 hash, void *k, u64 key_size) {
+	rw_lock_read_acquire_or_wait(&shard->lock);
+	Concurrent_Hash_Table_Node **node = (Concurrent_Hash_Table_Node**)hash_table_find_raw(&shard->table, hash, k, key_size);
+	Concurrent_Hash_Table_Node *result = node ? *node : 0;
+	rw_lock_read_release(&shard->lock);
+	return result;
+}
+// Needs the shard's write lock
+Concurrent_Hash_Table_Node *_concurrent_hash_table_new_node(Concurrent_Hash_Table *t, Concurrent_Hash_Table_Shard *shard) {
+	if (!shard->block || shard->block_used == CONCURRENT_HASH_TABLE_NODES_PER_BLOCK) {
+		u8 *block = (u8*)alloc_uninitialized(t->allocator, 16 + t->_node_size*CONCURRENT_HASH_TABLE_NODES_PER_BLOCK);
+		*(u8**)block = shard->block;
+		shard->block = block;
+		shard->block_used = 0;
+	}
+	Concurrent_Hash_Table_Node *node = (Concurrent_Hash_Table_Node*)(shard->block + 16 + shard->block_used*t->_node_size);
+	shard->block_used += 1;
+	// The value is filled in when it's created, only this has to start out right
+	node->created = ZERO(Once);
+	return node;
+}
+// Adds a node which isn't created yet, unless someone beat us to it
+Concurrent_Hash_Table_Node *_concurrent_hash_table_find_or_add_node(Concurrent_Hash_Table *t, Concurrent_Hash_Table_Shard *shard, u64 hash, void *k, u64 key_size) {
+	rw_lock_write_acquire_or_wait(&shard->lock);
+	Concurrent_Hash_Table_Node **existing = (Concurrent_Hash_Table_Node**)hash_table_find_raw(&shard->table, hash, k, key_size);
+	Concurrent_Hash_Table_Node *result;
+	if (existing) {
+		result = *existing;
+	} else {
+		result = _concurrent_hash_table_new_node(t, shard);
+		hash_table_add_raw(&shard->table, hash, k, &result, key_size, sizeof(Concurrent_Hash_Table_Node*));
+	}
+	rw_lock_write_release(&shard->lock);
+	return result;
+}
+
+void *concurrent_hash_table_find_raw(Concurrent_Hash_Table *t, u64 hash, void *k, u64 key_size) {
+	assert(key_size == t->_key_size, "Key type size does not match hash table initted key type size");
+	Concurrent_Hash_Table_Node *node = _concurrent_hash_table_find_node(_concurrent_hash_table_shard(t, hash), hash, k, key_size);
+	if (!node || !once_is_done(&node->created)) return 0;
+	return _concurrent_hash_table_node_value(node);
+}
+
+void *concurrent_hash_table_get_or_create_raw(Concurrent_Hash_Table *t, u64 hash, void *k, u64 key_size, Concurrent_Hash_Table_Create_Proc create_proc, void *data) {
+	assert(key_size == t->_key_size, "Key type size does not match hash table initted key type size");
+	Concurrent_Hash_Table_Shard *shard = _concurrent_hash_table_shard(t, hash);
+
+	Concurrent_Hash_Table_Node *node = _concurrent_hash_table_find_node(shard, hash, k, key_size);
+	if (node && once_is_done(&node->created)) return _concurrent_hash_table_node_value(node);
+
+	if (!node) node = _concurrent_hash_table_find_or_add_node(t, shard, hash, k, key_size);
+
+	// Whoever gets here first creates it, everyone else waits in once_begin
+	if (once_begin(&node->created)) {
+		void *value = _concurrent_hash_table_node_value(node);
+		memset(value, 0, t->_value_size); // Could be left over from a create that failed
+		bool ok = create_proc(k, value, data);
+		once_end(&node->created, ok);
+		if (!ok) return 0;
+	}
+
+	return _concurrent_hash_table_node_value(node);
+}
+
+// Does nothing if the key is already there. Returns whether it was added.
+bool concurrent_hash_table_add_raw(Concurrent_Hash_Table *t, u64 hash, void *k, void *v, u64 key_size, u64 value_size) {
+	assert(key_size == t->_key_size, "Key type size does not match hash table initted key type size");
+	assert(value_size == t->_value_size, "Value type size does not match hash table initted value type size");
+	Concurrent_Hash_Table_Shard *shard = _concurrent_hash_table_shard(t, hash);
+
+	Concurrent_Hash_Table_Node *node = _concurrent_hash_table_find_or_add_node(t, shard, hash, k, key_size);
+
+	// A node that is there but not created (being created, or its create failed) is
+	// for us to fill in too
+	if (once_begin(&node->created)) {
+		memcpy(_concurrent_hash_table_node_value(node), v, value_size);
+		once_end(&node->created, true);
+		return true;
+	}
+	return false;
+}
+
+// proc is called after the shard is unlocked, so it can use the table (RW_Lock isn't recursive).
+// Nodes never move, but keys do when the shard's Hash_Table grows, so those are copied out.
+void concurrent_hash_table_walk(Concurrent_Hash_Table *t, Concurrent_Hash_Table_Walk_Proc proc, void *data) {
+	u64 item_size = align_next(sizeof(Concurrent_Hash_Table_Node*) + t->_key_size, 8);
+	u8 *items = 0;
+	u64 items_capacity = 0;
+	
+	bool keep_going = true;
+	for (u64 i = 0; i < t->shard_count && keep_going; i += 1) {
+		Concurrent_Hash_Table_Shard *shard = &t->shards[i];
+		
+		rw_lock_read_acquire_or_wait(&shard->lock);
+		if (shard->table.count > items_capacity) {
+			if (items) dealloc(t->allocator, items);
+			items_capacity = shard->table.count;
+			items = (u8*)alloc_uninitialized(t->allocator, items_capacity*item_size);
+		}
+		u64 count = 0;
+		for (u64 j = 0; j < shard->table.count; j += 1) {
+			Concurrent_Hash_Table_Node *node = *(Concurrent_Hash_Table_Node**)hash_table_get_nth_value(&shard->table, j);
+			if (!once_is_done(&node->created)) continue;
+			u8 *item = items + count*item_size;
+			*(Concurrent_Hash_Table_Node**)item = node;
+			memcpy(item + sizeof(Concurrent_Hash_Table_Node*), hash_table_get_nth_key(&shard->table, j), t->_key_size);
+			count += 1;
+		}
+		rw_lock_read_release(&shard->lock);
+		
+		for (u64 j = 0; j < count && keep_going; j += 1) {
+			u8 *item = items + j*item_size;
+			void *value = _concurrent_hash_table_node_value(*(Concurrent_Hash_Table_Node**)item);
+			keep_going = proc(item + sizeof(Concurrent_Hash_Table_Node*), value, data);
+		}
+	}
+	
+	if (items) dealloc(t->allocator, items);
+}
+
+// Number of keys, including ones that are still being created. Only a snapshot if other
+// threads are adding.
+u64 concurrent_hash_table_count(Concurrent_Hash_Table *t) {
+	u64 count = 0;
+	for (u64 i = 0; i < t->shard_count; i += 1) {
+		rw_lock_read_acquire_or_wait(&t->shards[i].lock);
+		count += t->shards[i].table.count;
+		rw_lock_read_release(&t->shards[i].lock);
+	}
+	return count;
+}
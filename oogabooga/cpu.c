@@ -23,15 +23,19 @@ typedef struct Cpu_Capabilities {
 // I think this is the standard? (sse1)
 #define COMPILER_CAN_DO_SSE 1
 
+// Stuff that different threads write to should be aligned & padded to this, so two threads
+// don't keep stealing the same cache line from each other (false sharing).
+#define CACHE_LINE_SIZE 64
+
 ///
 // Compiler specific stuff
-#if COMPILER_MVSC
+#if COMPILER_MSVC
 	#define inline __forceinline
 	#define alignat(x) __declspec(align(x))
 	#define noreturn __declspec(noreturn)
     #define COMPILER_HAS_MEMCPY_INTRINSICS 1
-    inline void 
-    crash() noreturn {
+    noreturn inline void 
+    crash() {
 		__debugbreak();
 		volatile int *a = 0;
 		*a = 5;
@@ -73,7 +77,7 @@ typedef struct Cpu_Capabilities {
 		#define COMPILER_CAN_DO_AVX512 0
 	#endif
 	
-	#define DEPRECATED(proc, msg) __declspec(deprecated(msg)) func
+	#define DEPRECATED(proc, msg) __declspec(deprecated(msg)) proc
 	
 	#pragma intrinsic(_InterlockedCompareExchange8)
 	#pragma intrinsic(_InterlockedCompareExchange16)
@@ -105,8 +109,96 @@ typedef struct Cpu_Capabilities {
 	    return compare_and_swap_8((uint8_t*)a, (uint8_t)b, (uint8_t)old);
 	}
 	
+	#pragma intrinsic(_InterlockedExchangeAdd)
+	#pragma intrinsic(_InterlockedExchangeAdd64)
+	#pragma intrinsic(_InterlockedExchange)
+	#pragma intrinsic(_InterlockedExchange64)
+	
+	// Plain loads and stores are already acquire/release on x86, we just need to stop the
+	// compiler from moving things around them.
+	inline u32 
+	atomic_load_acquire_32(volatile u32 *a) {
+		u32 x = *a;
+		_ReadWriteBarrier();
+		return x;
+	}
+	inline u64 
+	atomic_load_acquire_64(volatile u64 *a) {
+		u64 x = *a;
+		_ReadWriteBarrier();
+		return x;
+	}
+	inline void 
+	atomic_store_release_32(volatile u32 *a, u32 x) {
+		_ReadWriteBarrier();
+		*a = x;
+	}
+	inline void 
+	atomic_store_release_64(volatile u64 *a, u64 x) {
+		_ReadWriteBarrier();
+		*a = x;
+	}
+	
+	// Returns the old value
+	inline u32 
+	atomic_fetch_add_32(volatile u32 *a, u32 x) {
+		return (u32)_InterlockedExchangeAdd((volatile long*)a, (long)x);
+	}
+	inline u64 
+	atomic_fetch_add_64(volatile u64 *a, u64 x) {
+		return (u64)_InterlockedExchangeAdd64((volatile long long*)a, (long long)x);
+	}
+	inline u32 
+	atomic_exchange_32(volatile u32 *a, u32 x) {
+		return (u32)_InterlockedExchange((volatile long*)a, (long)x);
+	}
+	inline u64 
+	atomic_exchange_64(volatile u64 *a, u64 x) {
+		return (u64)_InterlockedExchange64((volatile long long*)a, (long long)x);
+	}
+	// Like compare_and_swap but returns what was in *a, so you don't need to load it again
+	inline u32 
+	atomic_compare_exchange_32(volatile u32 *a, u32 b, u32 old) {
+		return (u32)_InterlockedCompareExchange((volatile long*)a, (long)b, (long)old);
+	}
+	inline u64 
+	atomic_compare_exchange_64(volatile u64 *a, u64 b, u64 old) {
+		return (u64)_InterlockedCompareExchange64((volatile long long*)a, (long long)b, (long long)old);
+	}
+	
+	// Nothing moves across this, not even stores past later loads
+	inline void 
+	atomic_full_fence() {
+		_mm_mfence();
+	}
+	
+	#pragma intrinsic(_BitScanForward64)
+	#pragma intrinsic(_BitScanReverse64)
+	
+	// Index of the lowest set bit. x must not be 0.
+	inline u32 
+	bit_scan_forward_64(u64 x) {
+		unsigned long index;
+		_BitScanForward64(&index, x);
+		return (u32)index;
+	}
+	
+	// Index of the highest set bit. x must not be 0.
+	inline u32 
+	bit_scan_reverse_64(u64 x) {
+		unsigned long index;
+		_BitScanReverse64(&index, x);
+		return (u32)index;
+	}
+	
 	#define MEMORY_BARRIER _ReadWriteBarrier()
 	
+	// Tells the cpu we're in a spin loop, so it doesn't starve the other hyperthread
+	inline void
+	cpu_relax() {
+		_mm_pause();
+	}
+	
 	#define thread_local __declspec(thread)
 	
 	#define SHARED_EXPORT __declspec(dllexport)
@@ -225,8 +317,78 @@ typedef struct Cpu_Capabilities {
 	    return compare_and_swap_8((uint8_t*)a, (uint8_t)b, (uint8_t)old);
 	}
 	
+	inline u32 
+	atomic_load_acquire_32(volatile u32 *a) {
+		return __atomic_load_n(a, __ATOMIC_ACQUIRE);
+	}
+	inline u64 
+	atomic_load_acquire_64(volatile u64 *a) {
+		return __atomic_load_n(a, __ATOMIC_ACQUIRE);
+	}
+	inline void 
+	atomic_store_release_32(volatile u32 *a, u32 x) {
+		__atomic_store_n(a, x, __ATOMIC_RELEASE);
+	}
+	inline void 
+	atomic_store_release_64(volatile u64 *a, u64 x) {
+		__atomic_store_n(a, x, __ATOMIC_RELEASE);
+	}
+	
+	// Returns the old value
+	inline u32 
+	atomic_fetch_add_32(volatile u32 *a, u32 x) {
+		return __atomic_fetch_add(a, x, __ATOMIC_SEQ_CST);
+	}
+	inline u64 
+	atomic_fetch_add_64(volatile u64 *a, u64 x) {
+		return __atomic_fetch_add(a, x, __ATOMIC_SEQ_CST);
+	}
+	inline u32 
+	atomic_exchange_32(volatile u32 *a, u32 x) {
+		return __atomic_exchange_n(a, x, __ATOMIC_SEQ_CST);
+	}
+	inline u64 
+	atomic_exchange_64(volatile u64 *a, u64 x) {
+		return __atomic_exchange_n(a, x, __ATOMIC_SEQ_CST);
+	}
+	// Like compare_and_swap but returns what was in *a, so you don't need to load it again
+	inline u32 
+	atomic_compare_exchange_32(volatile u32 *a, u32 b, u32 old) {
+		__atomic_compare_exchange_n(a, &old, b, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+		return old;
+	}
+	inline u64 
+	atomic_compare_exchange_64(volatile u64 *a, u64 b, u64 old) {
+		__atomic_compare_exchange_n(a, &old, b, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+		return old;
+	}
+	
+	// Nothing moves across this, not even stores past later loads
+	inline void 
+	atomic_full_fence() {
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	}
+	
+	// Index of the lowest set bit. x must not be 0.
+	inline u32 
+	bit_scan_forward_64(u64 x) {
+		return (u32)__builtin_ctzll(x);
+	}
+	
+	// Index of the highest set bit. x must not be 0.
+	inline u32 
+	bit_scan_reverse_64(u64 x) {
+		return 63 - (u32)__builtin_clzll(x);
+	}
+	
 	#define MEMORY_BARRIER {__asm__ __volatile__("" ::: "memory");__sync_synchronize();}
 	
+	// Tells the cpu we're in a spin loop, so it doesn't starve the other hyperthread
+	inline void
+	cpu_relax() {
+		__asm__ __volatile__("pause" ::: "memory");
+	}
+	
 	#define thread_local __thread
 	
 #if TARGET_OS == WINDOWS
@@ -251,9 +413,27 @@ typedef struct Cpu_Capabilities {
     
     #define DEPRECATED(proc, msg) 
     
+    inline u32 
+    bit_scan_forward_64(u64 x) {
+    	u32 index = 0;
+    	while (!(x & 1)) { x >>= 1; index += 1; }
+    	return index;
+    }
+    inline u32 
+    bit_scan_reverse_64(u64 x) {
+    	u32 index = 0;
+    	while (x >>= 1) index += 1;
+    	return index;
+    }
+    
     #define MEMORY_BARRIER
     
-    #warning "Compiler is not explicitly supported, some things will probably not work as expected"
+    inline void
+    cpu_relax() {}
+    
+    // concurrency.c, memory.c and jobs.c are built on compare_and_swap_* and atomic_*, and
+    // there's no portable way to do those here.
+    #error "Compiler is not supported: no compare_and_swap_* or atomic_* for it"
 #endif
 
 
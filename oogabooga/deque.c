@@ -0,0 +1,140 @@
+// Deque
+// A ring buffer you can push and pop at both ends, item_size bytes per item. Capacity is a power
+// of two and it never allocates after init unless you call deque_reserve(), so push returns false
+// when it's full and what to do then is up to you. Not thread safe, see Spsc_Queue/Mpsc_Queue in
+// concurrency.c for that.
+
+/*
+
+	Example Usage:
+
+	Deque events;
+	deque_init(&events, sizeof(Event), 256, get_heap_allocator());
+
+	Event e = ...;
+	if (!deque_push_back(&events, &e)) {
+		// Full. Drop it, or make room:
+		deque_reserve(&events, events.capacity*2);
+		deque_push_back(&events, &e);
+	}
+	deque_push_front(&events, &urgent_event);
+
+	// Peek without popping. 0 if empty.
+	Event *next = (Event*)deque_peek_front(&events);
+
+	Event popped;
+	while (deque_pop_front(&events, &popped)) {
+		handle_event(popped);
+	}
+
+	// i = 0 is the front
+	for (u64 i = 0; i < events.count; i += 1) {
+		Event *e = (Event*)deque_get(&events, i);
+	}
+
+	deque_destroy(&events);
+
+	Limitations:
+		- Pointers from deque_get()/deque_peek_*() are good until the next push, pop or reserve.
+*/
+
+typedef struct Deque {
+	u8 *items;
+	u64 item_size;
+	u64 capacity; // Power of two
+	u64 head; // Index of the front item, wrapped
+	u64 count;
+	Allocator allocator;
+} Deque;
+
+void deque_init(Deque *d, u64 item_size, u64 capacity, Allocator allocator) {
+	assert(item_size > 0, "Deque item size must be more than 0");
+	*d = ZERO(Deque);
+	d->item_size = item_size;
+	d->capacity = get_next_power_of_two(max(capacity, 2));
+	d->allocator = allocator;
+	d->items = (u8*)alloc_uninitialized(allocator, d->capacity*item_size);
+}
+void deque_destroy(Deque *d) {
+	if (d->items) dealloc(d->allocator, d->items);
+	*d = ZERO(Deque);
+}
+
+// Grows to at least capacity items. Never shrinks.
+void deque_reserve(Deque *d, u64 capacity) {
+	if (capacity <= d->capacity) return;
+	u64 new_capacity = get_next_power_of_two(capacity);
+	u8 *new_items = (u8*)alloc_uninitialized(d->allocator, new_capacity*d->item_size);
+	// Unwrap so head is 0 in the new one
+	_ring_copy_out(d->items, d->capacity, d->item_size, d->head, new_items, d->count);
+	dealloc(d->allocator, d->items);
+	d->items = new_items;
+	d->capacity = new_capacity;
+	d->head = 0;
+}
+
+inline bool deque_is_full(Deque *d) {
+	return d->count == d->capacity;
+}
+
+// 0 if i is out of range
+inline void *deque_get(Deque *d, u64 i) {
+	if (i >= d->count) return 0;
+	return d->items + ((d->head + i) & (d->capacity-1))*d->item_size;
+}
+inline void *deque_peek_front(Deque *d) {
+	return deque_get(d, 0);
+}
+inline void *deque_peek_back(Deque *d) {
+	return d->count ? deque_get(d, d->count-1) : 0;
+}
+
+bool deque_push_back(Deque *d, void *item) {
+	if (deque_is_full(d)) return false;
+	memcpy(d->items + ((d->head + d->count) & (d->capacity-1))*d->item_size, item, d->item_size);
+	d->count += 1;
+	return true;
+}
+bool deque_push_front(Deque *d, void *item) {
+	if (deque_is_full(d)) return false;
+	d->head = (d->head - 1) & (d->capacity-1);
+	memcpy(d->items + d->head*d->item_size, item, d->item_size);
+	d->count += 1;
+	return true;
+}
+
+// item can be 0 if you just want to drop it
+bool deque_pop_front(Deque *d, void *item) {
+	if (d->count == 0) return false;
+	if (item) memcpy(item, d->items + d->head*d->item_size, d->item_size);
+	d->head = (d->head + 1) & (d->capacity-1);
+	d->count -= 1;
+	return true;
+}
+bool deque_pop_back(Deque *d, void *item) {
+	if (d->count == 0) return false;
+	d->count -= 1;
+	if (item) memcpy(item, d->items + ((d->head + d->count) & (d->capacity-1))*d->item_size, d->item_size);
+	return true;
+}
+
+// Push as many as fit, returns how many that was
+u64 deque_push_back_many(Deque *d, void *items, u64 count) {
+	count = min(count, d->capacity - d->count);
+	_ring_copy_in(d->items, d->capacity, d->item_size, d->head + d->count, (u8*)items, count);
+	d->count += count;
+	return count;
+}
+// Pop up to max_count from the front, returns how many that was
+u64 deque_pop_front_many(Deque *d, void *items, u64 max_count) {
+	u64 count = min(max_count, d->count);
+	_ring_copy_out(d->items, d->capacity, d->item_size, d->head, (u8*)items, count);
+	d->head = (d->head + count) & (d->capacity-1);
+	d->count -= count;
+	return count;
+}
+
+void deque_clear(Deque *d) {
+	d->head = 0;
+	d->count = 0;
+}
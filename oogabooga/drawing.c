@@ -108,13 +108,15 @@
 			void draw_frame_init(Draw_Frame *frame);
 			void draw_frame_init_reserve(Draw_Frame *frame, u64 number_of_quads_to_reserve);
 			void draw_frame_reset(Draw_Frame *frame);
+			void draw_frame_deinit(Draw_Frame *frame);
 			
 			- draw_frame_init needs to be called once to set up some initial stuff. I don't like this so it
 				might change.
 			- draw_frame_init_reserve does the same as draw_frame_init, but you can pre-allocate for a certain
 				amount of quads.
 			- draw_frame_reset will, in short, clear the array of computed Draw_Quad's and zero everything
-				out.	
+				out. The quad buffer and the z/scissor stacks keep their memory, so resetting is cheap.
+			- draw_frame_deinit frees the memory of a Draw_Frame you're done with.
 				
 			- A practical example for using Draw_Frame's can be found in examples/threaded_drawing.c	
 		
@@ -163,8 +165,9 @@
 // We use radix sort so the exact bit count is of importance
 #define MAX_Z_BITS 21
 #define MAX_Z ((1 << MAX_Z_BITS)/2)
-#define Z_STACK_MAX 4096
-#define SCISSOR_STACK_MAX 4096
+// The z/scissor stacks grow as needed, but pushing this deep is almost certainly a missing pop.
+// Only checked in debug.
+#define DRAW_STACK_SANITY_MAX 65536
 
 typedef struct Draw_Quad {
 	// BEWARE !! These are in ndc
@@ -195,13 +198,17 @@ typedef struct Draw_Frame {
 	
 	void *cbuffer;
 	
+	// The stacks are heap allocated and grow when pushed past capacity. They, and the quad
+	// buffer, keep their memory when the frame is reset, so the frame itself stays small.
 	u64 scissor_count;
-	Vector4 scissor_stack[SCISSOR_STACK_MAX];
+	u64 scissor_capacity;
+	Vector4 *scissor_stack;
 	
 	Draw_Quad *quad_buffer;
 	
 	u64 z_count;
-	s32 z_stack[Z_STACK_MAX];
+	u64 z_capacity;
+	s32 *z_stack;
 	bool enable_z_sorting;
 	
 } Draw_Frame;
@@ -216,6 +223,12 @@ void draw_frame_init_reserve(Draw_Frame *frame, u64 number_of_quads_to_reserve)
 	
 	growing_array_init_reserve((void**)&frame->quad_buffer, sizeof(Draw_Quad), number_of_quads_to_reserve, get_heap_allocator());
 }
+void draw_frame_deinit(Draw_Frame *frame) {
+	if (frame->quad_buffer)   growing_array_deinit((void**)&frame->quad_buffer);
+	if (frame->z_stack)       dealloc(get_heap_allocator(), frame->z_stack);
+	if (frame->scissor_stack) dealloc(get_heap_allocator(), frame->scissor_stack);
+	*frame = ZERO(Draw_Frame);
+}
 
 void draw_frame_reset(Draw_Frame *frame) {
 
@@ -225,12 +238,14 @@ void draw_frame_reset(Draw_Frame *frame) {
 	// highest number of quads the program submits in a frame.
 	// For now, we just reset the count in the heap allocated buffer
 
-	Draw_Quad *quad_buffer = frame->quad_buffer;
-	if (quad_buffer) growing_array_clear((void**)&quad_buffer);
-
-	*frame = (Draw_Frame){0};
+	if (frame->quad_buffer) growing_array_clear((void**)&frame->quad_buffer);
+	else                    growing_array_init((void**)&frame->quad_buffer, sizeof(Draw_Quad), get_heap_allocator());
 	
-	frame->quad_buffer = quad_buffer;
+	// The stacks keep their memory, only the counts go back to 0
+	frame->z_count = 0;
+	frame->scissor_count = 0;
+	frame->cbuffer = 0;
+	frame->enable_z_sorting = false;
 	
 	frame->projection 
 		= m4_make_orthographic_projection(-window.width/2, window.width/2, -window.height/2, window.height/2, -1, 10);
@@ -277,11 +292,8 @@ Draw_Quad *draw_quad_projected_in_frame(Draw_Quad quad, Matrix4 world_to_clip, D
 	
 	memset(quad.userdata, 0, sizeof(quad.userdata));
 	
-	Draw_Quad **target_buffer = &frame->quad_buffer;
-	
-	growing_array_add((void**)target_buffer, &quad);
-	
-	Draw_Quad *q = &(*target_buffer)[growing_array_get_valid_count(*target_buffer)-1];
+	Draw_Quad *q = growing_array_push_empty(&frame->quad_buffer);
+	*q = quad;
 	
 	// This is meant to fix the annoying artifacts that shows up when sampling from a large atlas
     // presumably for floating point precision issues or something.
@@ -463,7 +475,14 @@ void draw_line_in_frame(Vector2 p0, Vector2 p1, float line_width, Vector4 color,
 }
 
 void push_z_layer_in_frame(s32 z, Draw_Frame *frame) {
-	assert(frame->z_count < Z_STACK_MAX, "Too many z layers pushed. You can pop with pop_z_layer() when you are done drawing to it.");
+#if CONFIGURATION == DEBUG
+	assert(frame->z_count < DRAW_STACK_SANITY_MAX, "Too many z layers pushed. You can pop with pop_z_layer() when you are done drawing to it.");
+#endif
+	if (frame->z_count >= frame->z_capacity) {
+		u64 new_capacity = max(frame->z_capacity*2, 16);
+		frame->z_stack = (s32*)reallocate(get_heap_allocator(), frame->z_stack, frame->z_capacity*sizeof(s32), new_capacity*sizeof(s32));
+		frame->z_capacity = new_capacity;
+	}
 	
 	frame->z_stack[frame->z_count] = z;
 	frame->z_count += 1;
@@ -474,7 +493,14 @@ void pop_z_layer_in_frame(Draw_Frame *frame) {
 }
 
 void push_window_scissor_in_frame(Vector2 min, Vector2 max, Draw_Frame *frame) {
-	assert(frame->scissor_count < SCISSOR_STACK_MAX, "Too many scissors pushed. You can pop with pop_window_scissor() when you are done drawing to it.");
+#if CONFIGURATION == DEBUG
+	assert(frame->scissor_count < DRAW_STACK_SANITY_MAX, "Too many scissors pushed. You can pop with pop_window_scissor() when you are done drawing to it.");
+#endif
+	if (frame->scissor_count >= frame->scissor_capacity) {
+		u64 new_capacity = max(frame->scissor_capacity*2, 16);
+		frame->scissor_stack = (Vector4*)reallocate(get_heap_allocator(), frame->scissor_stack, frame->scissor_capacity*sizeof(Vector4), new_capacity*sizeof(Vector4));
+		frame->scissor_capacity = new_capacity;
+	}
 	
 	frame->scissor_stack[frame->scissor_count] = v4(min.x, min.y, max.x, max.y);
 	frame->scissor_count += 1;
@@ -70,7 +70,8 @@ int entry(int argc, char **argv) {
 			local_persist Emission_Handle inst = ZERO(Emission_Handle);
 			local_persist bool inst_set = false;
 			
-			if (!inst_set) {
+			// The poof doesn't loop so it's released when it's done
+			if (!inst_set || !emission_is_alive(inst)) {
 				inst = emit_particles(emission_poof, v2(mx, my));
 				inst_set = true;
 			} else {
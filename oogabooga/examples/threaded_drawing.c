@@ -10,9 +10,10 @@
 	So what we do is that we split the total work (draw X sprites) up for a certain amount of thread, each
 	which has it's own Draw_Frame. 
 
-	We use Binary_Semaphore's per thread to notify 1. When draw thread can start drawing, after main thread
-	has finished rendering the result draw_frames and 2. When draw thread is done, which the main thread needs
-	to wait for before using the potentially unfinished result Draw_Frame's for rendering.
+	We use one Barrier which the draw threads and the main thread all wait on twice per frame: 1. When the draw
+	threads are done, which the main thread needs to wait for before using the potentially unfinished result
+	Draw_Frame's for rendering and 2. When the main thread has finished rendering the result Draw_Frame's, so
+	the draw threads can start drawing the next ones.
 	
 	If your computer has at lest 5-6 logical processors, that seems to split the time it takes to draw in
 	about 1/3 (at least on my computer).
@@ -28,8 +29,7 @@ typedef struct Draw_Context {
 	Draw_Frame frame;
 	u64 index;
 	Gfx_Image *sprite;
-	Binary_Semaphore draw_thread_start_sem;
-	Binary_Semaphore draw_thread_done_sem;
+	Barrier *frame_barrier;
 	u64 number_of_sprites;
 	Vector4 color;
 	
@@ -57,6 +57,10 @@ int entry(int argc, char **argv) {
 	Thread *threads = (Thread*)alloc(get_heap_allocator(), number_of_threads*sizeof(Thread));
 	Draw_Context *draw_contexts = (Draw_Context*)alloc(get_heap_allocator(), number_of_threads*sizeof(Draw_Context));
 	
+	// All draw threads + the main thread
+	Barrier frame_barrier;
+	barrier_init(&frame_barrier, number_of_threads+1);
+	
 	// Initialize each thread and the respective draw context, and start the threads
 	for (u64 i = 0; i < number_of_threads; i += 1) {
 		Thread *t = threads + i;
@@ -66,14 +70,10 @@ int entry(int argc, char **argv) {
 		t->data = draw_context;
 		
 		draw_frame_init(&draw_context->frame);
-		os_binary_semaphore_init(&draw_context->draw_thread_start_sem, false);
-		os_binary_semaphore_init(&draw_context->draw_thread_done_sem, false);
 		draw_context->index = i;
 		draw_context->sprite = sprite;
+		draw_context->frame_barrier = &frame_barrier;
 		draw_context->number_of_sprites = total_number_of_sprites/number_of_threads;
-		// Draw threads can start right away. Also if we don't do this, we will deadlock since draw thread will wait
-		// for this signal, but we will wait for draw thread to signal being done.
-		os_binary_semaphore_signal(&draw_context->draw_thread_start_sem);
 		draw_context->color = v4(
 			get_random_float32_in_range(0, 1),
 			get_random_float32_in_range(0, 1),
@@ -94,19 +94,17 @@ int entry(int argc, char **argv) {
 		if ((int)now != (int)last_time) log("%.2f FPS\n%.2fms", 1.0/(now-last_time), (now-last_time)*1000);
 		last_time = now;
 		
+		// Wait for the draw threads to be done
+		barrier_wait(&frame_barrier);
+		
+		// Render the result Draw_Frame's
 		for (u64 i = 0; i < number_of_threads; i += 1) {
-			Draw_Context *draw_context = draw_contexts + i;
-			
-			// Wait for draw thread to be done
-			os_binary_semaphore_wait(&draw_context->draw_thread_done_sem);
-			
-			// Render the result Draw_Frame
-			gfx_render_draw_frame_to_window(&draw_context->frame); 
-			
-			// Signal the draw thread that it can start drawing the next Draw_Frame
-			os_binary_semaphore_signal(&draw_context->draw_thread_start_sem);
+			gfx_render_draw_frame_to_window(&draw_contexts[i].frame); 
 		}
 		
+		// Let the draw threads start drawing the next Draw_Frame's
+		barrier_wait(&frame_barrier);
+		
 		os_update(); 
 		gfx_update();
 		
@@ -128,8 +126,6 @@ void draw_thread(Thread *t) {
 		
 		float64 now = os_get_elapsed_seconds();
 		
-		os_binary_semaphore_wait(&draw_context->draw_thread_start_sem);
-		
 		tm_scope("Thread draw") {
 			draw_frame_reset(&draw_context->frame);
 	
@@ -155,6 +151,8 @@ void draw_thread(Thread *t) {
 			draw_context->frame_count += 1;
 		}
 		
-		os_binary_semaphore_signal(&draw_context->draw_thread_done_sem);
+		// Done drawing, then wait for the main thread to be done rendering
+		barrier_wait(draw_context->frame_barrier);
+		barrier_wait(draw_context->frame_barrier);
 	}
 }
\ No newline at end of file
@@ -41,6 +41,7 @@
 		void emission_set_config(Emission_Handle h, Emission_Config config);
 		void emission_set_position(Emission_Handle h, Vector2 pos);
 		void emission_release(Emission_Handle h);
+		bool emission_is_alive(Emission_Handle h);
 		
 		NOTE:
 			Emission instances will, by default,  be released and their handles invalidated after the last particle
@@ -158,20 +159,17 @@ typedef struct Emission_Instance {
 	Emission_Config config;
 	Vector2 pos;
 	float32 start_time;
-	bool allocated;
-	u32 generation;
 } Emission_Instance;
 
 typedef struct Emission_Handle {
-	u32 index;
-	u32 generation;
+	Pool_Handle pool_handle;
 } Emission_Handle;
 
 // #Global
 #if OOGABOOGA_LINK_EXTERNAL_INSTANCE
-ogb_instance Emission_Instance *emissions;
+ogb_instance Pool emissions;
 #else
-Emission_Instance *emissions;
+Pool emissions;
 #endif
 
 float32 sample_interp_one(Emission_Interpolation_Kind interp, float32 min, float32 max, float t) {
@@ -268,64 +266,46 @@ Emission_Handle emit_particles(Emission_Config config, Vector2 pos) {
 	config.emissions_per_second = max(config.emissions_per_second, 1);
 	if (config.seed == 0) config.seed = get_random();
 
-	for (u64 i = 0; i < growing_array_get_valid_count(emissions); i += 1) {
-		if (!emissions[i].allocated) {
-			emissions[i] = ZERO(Emission_Instance);
-			emissions[i].config = config;
-			emissions[i].pos = pos;
-			emissions[i].start_time = os_get_elapsed_seconds();
-			emissions[i].allocated = true;
-			emissions[i].generation += 1;
-			
-			return (Emission_Handle) { i, emissions[i].generation };
-		}
-	}
-
-	Emission_Instance inst = ZERO(Emission_Instance);
-	inst.config = config;
-	inst.pos = pos;
-	inst.start_time = os_get_elapsed_seconds();
-	inst.allocated = true;	
-	inst.generation = 0;	
-	growing_array_add((void**)&emissions, &inst);
+	Emission_Handle h;
+	Emission_Instance *e = (Emission_Instance*)pool_acquire(&emissions, &h.pool_handle);
+	*e = ZERO(Emission_Instance);
+	e->config = config;
+	e->pos = pos;
+	e->start_time = os_get_elapsed_seconds();
 	
-	return (Emission_Handle){ growing_array_get_valid_count(emissions) - 1, 0 };
+	return h;
+}
+
+// Emissions which are not persist or loop are released when they are done
+bool emission_is_alive(Emission_Handle h) {
+	return pool_get(&emissions, h.pool_handle) != 0;
 }
 
 void emission_reset(Emission_Handle h) {
-	assert(h.index < growing_array_get_valid_count(emissions), "Invalid Emission_Handle");
-	assert(h.generation == emissions[h.index].generation, "Invalid Emission_Handle; emission has been released");
+	Emission_Instance *e = (Emission_Instance*)pool_get(&emissions, h.pool_handle);
+	assert(e, "Invalid Emission_Handle; emission has been released");
 	
-	Emission_Instance *e = &emissions[h.index];
 	e->start_time = os_get_elapsed_seconds();
 }
 
 void emission_set_config(Emission_Handle h, Emission_Config config) {
-	assert(h.index < growing_array_get_valid_count(emissions), "Invalid Emission_Handle");
-	assert(h.generation == emissions[h.index].generation, "Invalid Emission_Handle; emission has been released");
-	
-	Emission_Instance *e = &emissions[h.index];
+	Emission_Instance *e = (Emission_Instance*)pool_get(&emissions, h.pool_handle);
+	assert(e, "Invalid Emission_Handle; emission has been released");
 	
 	e->config = config;
 }
 void emission_set_position(Emission_Handle h, Vector2 pos) {
-	assert(h.index < growing_array_get_valid_count(emissions), "Invalid Emission_Handle");
-	assert(h.generation == emissions[h.index].generation, "Invalid Emission_Handle; emission has been released");
-	
-	Emission_Instance *e = &emissions[h.index];
+	Emission_Instance *e = (Emission_Instance*)pool_get(&emissions, h.pool_handle);
+	assert(e, "Invalid Emission_Handle; emission has been released");
 	
 	e->pos = pos;
 }
 void emission_release(Emission_Handle h) {
-	assert(h.index < growing_array_get_valid_count(emissions), "Invalid Emission_Handle");
-	
-	Emission_Instance *e = &emissions[h.index];
-	
-	if (e->generation == h.generation) e->allocated = false;
+	pool_release(&emissions, h.pool_handle);
 }
 
 void particles_init() {
-	growing_array_init_reserve((void**)&emissions, sizeof(Emission_Instance), 16, get_heap_allocator());
+	emissions = make_pool(Emission_Instance, get_heap_allocator());
 }
 
 void particles_update() {
@@ -340,9 +320,9 @@ void particles_draw() {
 
 	u64 backup_seed = seed_for_random;
 	
-	for (u64 i = 0; i < growing_array_get_valid_count(emissions); i += 1) {
-		Emission_Instance *e = &emissions[i];
-		if (!e->allocated) continue;
+	// Backwards so we can release while iterating
+	for (s64 i = (s64)emissions.count-1; i >= 0; i -= 1) {
+		Emission_Instance *e = (Emission_Instance*)pool_get_live(&emissions, i);
 		
 		float32 passed = now - e->start_time;
 		
@@ -359,7 +339,7 @@ void particles_draw() {
 		max_emitted = min(max_emitted, e->config.number_of_particles);
 		
 		if (!e->config.persist && !e->config.loop && passed > last_death_duration) {
-			e->allocated = false;
+			pool_release_pointer(&emissions, e);
 			continue;
 		}
 		
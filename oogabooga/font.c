@@ -105,8 +105,9 @@ typedef struct Gfx_Font_Variation {
 	Gfx_Font_Metrics metrics;
 	float scale;
 	u32 codepoint_range_per_atlas;
-	Hash_Table atlases; // u32 atlas_index, Gfx_Font_Atlas
+	Concurrent_Hash_Table atlases; // u32 atlas_index, Gfx_Font_Atlas. Text can be drawn from any thread.
 	bool initted;
+	Once init_once;
 } Gfx_Font_Variation;
 typedef struct Gfx_Font {
 	stbtt_fontinfo stbtt_handle;
@@ -139,6 +140,13 @@ Gfx_Font *load_font_from_disk(string path, Allocator allocator) {
 	
 	return font;
 }
+bool _font_atlas_destroy(void *key, void *value, void *data) {
+	Gfx_Font *font = (Gfx_Font*)data;
+	Gfx_Font_Atlas *atlas = (Gfx_Font_Atlas*)value;
+	delete_image(atlas->image);
+	dealloc(font->allocator, atlas->glyphs);
+	return true;
+}
 void destroy_font(Gfx_Font *font) {
 
 	third_party_allocator = font->allocator;
@@ -147,13 +155,9 @@ void destroy_font(Gfx_Font *font) {
 		Gfx_Font_Variation *variation = &font->variations[i];
 		if (!variation->initted) continue;
 		
-		for (u64 j = 0; j < variation->atlases.count; j++) {
-			Gfx_Font_Atlas *atlas = (Gfx_Font_Atlas*)hash_table_get_nth_value(&variation->atlases, j);
-			delete_image(atlas->image);
-			dealloc(font->allocator, atlas->glyphs);
-		}
+		concurrent_hash_table_walk(&variation->atlases, _font_atlas_destroy, font);
 		
-		hash_table_destroy(&variation->atlases);
+		concurrent_hash_table_destroy(&variation->atlases);
 		
 	}
 
@@ -173,7 +177,7 @@ void font_variation_init(Gfx_Font_Variation *variation, Gfx_Font *font, u32 font
 	
 	variation->codepoint_range_per_atlas = x_range*y_range;
 	
-	variation->atlases = make_hash_table(u32, Gfx_Font_Atlas, font->allocator);
+	variation->atlases = make_concurrent_hash_table(u32, Gfx_Font_Atlas, font->allocator);
 	
 	variation->scale = stbtt_ScaleForPixelHeight(&font->stbtt_handle, (float)font_height);
 	
@@ -269,21 +273,31 @@ void font_atlas_init(Gfx_Font_Atlas *atlas, Gfx_Font_Variation *variation, u32 f
 	third_party_allocator = ZERO(Allocator);
 }
 
-void render_atlas_if_not_yet_rendered(Gfx_Font *font, u32 font_height, u32 codepoint) {
+Gfx_Font_Variation *font_get_variation(Gfx_Font *font, u32 font_height) {
 	assert(font_height <= MAX_FONT_HEIGHT, "Font height too large; maximum of %d is allowed.", MAX_FONT_HEIGHT);
 	Gfx_Font_Variation *variation = &font->variations[font_height];
 	
-	if (!variation->initted) {
+	if (once_begin(&variation->init_once)) {
 		font_variation_init(variation, font, font_height);
+		once_end(&variation->init_once, true);
 	}
 	
+	return variation;
+}
+
+bool _font_atlas_create(void *key, void *value, void *data) {
+	Gfx_Font_Variation *variation = (Gfx_Font_Variation*)data;
+	u32 atlas_index = *(u32*)key;
+	font_atlas_init((Gfx_Font_Atlas*)value, variation, atlas_index*variation->codepoint_range_per_atlas);
+	return true;
+}
+Gfx_Font_Atlas *render_atlas_if_not_yet_rendered(Gfx_Font *font, u32 font_height, u32 codepoint) {
+	Gfx_Font_Variation *variation = font_get_variation(font, font_height);
+	
 	u32 atlas_index = codepoint / variation->codepoint_range_per_atlas;
 	
-	if (!hash_table_contains(&variation->atlases, atlas_index)) {
-		Gfx_Font_Atlas atlas = ZERO(Gfx_Font_Atlas);
-		font_atlas_init(&atlas, variation, atlas_index*variation->codepoint_range_per_atlas);
-		hash_table_add(&variation->atlases, atlas_index, atlas);
-	}
+	// If another thread is rendering this atlas right now, this waits for it
+	return (Gfx_Font_Atlas*)concurrent_hash_table_get_or_create(&variation->atlases, atlas_index, _font_atlas_create, variation);
 }
 
 typedef bool(*Walk_Glyphs_Callback_Proc)(Gfx_Glyph glyph, Gfx_Font_Atlas *atlas, float glyph_x, float glyph_y, void *ud);
@@ -300,7 +314,7 @@ void walk_glyphs(Walk_Glyphs_Spec spec, Walk_Glyphs_Callback_Proc proc) {
 	
 	if (spec.text.data == 0 || spec.text.count <= 0) return;
 	
-	Gfx_Font_Variation *variation = &spec.font->variations[spec.raster_height];
+	Gfx_Font_Variation *variation = font_get_variation(spec.font, spec.raster_height);
 	
 	float x = 0;
 	float y = 0;
@@ -309,7 +323,7 @@ void walk_glyphs(Walk_Glyphs_Spec spec, Walk_Glyphs_Callback_Proc proc) {
 	u32 c = next_utf8(&spec.text);
 	while (c != 0) {
 		
-		render_atlas_if_not_yet_rendered(spec.font, spec.raster_height, c);
+		Gfx_Font_Atlas *atlas = render_atlas_if_not_yet_rendered(spec.font, spec.raster_height, c);
 		
 		if (c == '\n') {
 			x = 0;
@@ -322,9 +336,6 @@ void walk_glyphs(Walk_Glyphs_Spec spec, Walk_Glyphs_Callback_Proc proc) {
 			continue;
 		}
 		
-		u32 atlas_index = c/variation->codepoint_range_per_atlas;
-		
-		Gfx_Font_Atlas *atlas = (Gfx_Font_Atlas*)hash_table_find(&variation->atlases, atlas_index);
 		Gfx_Glyph glyph = atlas->glyphs[c-atlas->first_codepoint];
 		
 		float glyph_x = x+glyph.xoffset*spec.scale.x;
@@ -347,11 +358,7 @@ void walk_glyphs(Walk_Glyphs_Spec spec, Walk_Glyphs_Callback_Proc proc) {
 }
 
 Gfx_Font_Metrics get_font_metrics(Gfx_Font *font, u32 raster_height) {
-	Gfx_Font_Variation *variation = &font->variations[raster_height];
-	
-	if (!variation->initted) {
-		font_variation_init(variation, font, raster_height);
-	}
+	Gfx_Font_Variation *variation = font_get_variation(font, raster_height);
 	
 	return variation->metrics;
 }
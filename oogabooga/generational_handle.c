@@ -0,0 +1,60 @@
+// Generational handles
+// 32 bit handles to things in slots that get reused (Pool, Slot_Map, Priority_Queue). The low
+// bits are the slot index, the high bits are the slot's generation when the handle was made.
+// A slot's generation goes up by one when it's taken and again when it's freed, so it's odd
+// while live and even while free, and old handles stop matching once the slot is freed.
+
+/*
+
+	Example Usage:
+
+	// Makes the Thing_Handle type and thing_make_handle(), thing_handle_index(),
+	// thing_handle_generation() and thing_handle_matches(), with 20 bits for the index.
+	DEFINE_GENERATIONAL_HANDLE(Thing_Handle, thing, 20);
+
+	// Taking a slot. Generations start at 0.
+	slot->generation += 1; // Now odd, live
+	Thing_Handle h = thing_make_handle(slot_index, slot->generation);
+
+	// Looking it up
+	u32 index = thing_handle_index(h);
+	if (index < slot_count && thing_handle_matches(h, slots[index].generation)) { ... }
+
+	// Freeing it
+	slot->generation += 1; // Now even, free. h doesn't match anymore.
+
+	Limitations:
+		- The handle only has (32 - index bits) bits of the generation, so after
+		  2^(31 - index bits) reuses of the same slot a very old handle could match again.
+		- 0 is never a valid handle (a live generation is odd, so never 0 in the handle).
+*/
+
+#define GENERATIONAL_HANDLE_INDEX_MASK(index_bits) ((1u << (index_bits))-1)
+#define GENERATIONAL_HANDLE_GENERATION_MASK(index_bits) ((u32)(0xFFFFFFFFu >> (index_bits)))
+
+inline bool generation_is_live(u32 generation) {
+	return (generation & 1) != 0;
+}
+
+#define DEFINE_GENERATIONAL_HANDLE(Handle_Type, prefix, index_bits) \
+	\
+	typedef struct Handle_Type { \
+		u32 value; \
+	} Handle_Type; \
+	\
+	inline Handle_Type prefix##_make_handle(u32 index, u32 generation) { \
+		Handle_Type h; \
+		h.value = ((generation & GENERATIONAL_HANDLE_GENERATION_MASK(index_bits)) << (index_bits)) | index; \
+		return h; \
+	} \
+	inline u32 prefix##_handle_index(Handle_Type h) { \
+		return h.value & GENERATIONAL_HANDLE_INDEX_MASK(index_bits); \
+	} \
+	inline u32 prefix##_handle_generation(Handle_Type h) { \
+		return h.value >> (index_bits); \
+	} \
+	/* Whether h is for what's live in a slot with this generation now */ \
+	inline bool prefix##_handle_matches(Handle_Type h, u32 slot_generation) { \
+		return generation_is_live(slot_generation) \
+			&& (slot_generation & GENERATIONAL_HANDLE_GENERATION_MASK(index_bits)) == prefix##_handle_generation(h); \
+	}
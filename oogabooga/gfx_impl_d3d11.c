@@ -61,8 +61,9 @@ void *d3d11_staging_quad_buffer = 0;
 ID3D11Buffer *d3d11_cbuffer = 0;
 u64 d3d11_cbuffer_size = 0;
 
-Draw_Quad *d3d11_sort_quad_buffer = 0;
-u64 d3d11_sort_quad_buffer_size = 0;
+// (z, quad index) pairs for z sorting, 2 u64 per quad
+u64 *d3d11_sort_key_buffer = 0;
+u64 d3d11_sort_key_buffer_count = 0;
 
 u64 d3d11_thread_id = 0;
 
@@ -652,8 +653,8 @@ void gfx_render_draw_frame(Draw_Frame *frame, Gfx_Image *render_target) {
 		
 		d3d11_quad_vbo_size = new_size;
 		
-		d3d11_staging_quad_buffer = alloc(get_heap_allocator(), d3d11_quad_vbo_size);
-		u32 *indices = (u32*)alloc(get_heap_allocator(), new_indices*sizeof(u32));
+		d3d11_staging_quad_buffer = alloc_uninitialized(get_heap_allocator(), d3d11_quad_vbo_size);
+		u32 *indices = (u32*)alloc_uninitialized(get_heap_allocator(), new_indices*sizeof(u32));
 		
 		for (u64 i = 0; i < new_indices; i += 6) {
 			indices[i + 0] = (i/6)*4 + 0;
@@ -710,19 +711,22 @@ void gfx_render_draw_frame(Draw_Frame *frame, Gfx_Image *render_target) {
 		// here on the main thread.
 		//
 		tm_scope("Quad processing") {
+			// Sorting only moves (z, index) pairs, the quads stay where they are and we read them
+			// in sorted order below. 0 means draw them in the order they were pushed.
+			u64 *quad_order = 0;
 			if (frame->enable_z_sorting) tm_scope("Z sorting") {
-				if (!d3d11_sort_quad_buffer || (d3d11_sort_quad_buffer_size < number_of_quads*sizeof(Draw_Quad))) {
+				if (d3d11_sort_key_buffer_count < number_of_quads) {
 					// #Memory #Heapalloc
-					if (d3d11_sort_quad_buffer) dealloc(get_heap_allocator(), d3d11_sort_quad_buffer);
-					d3d11_sort_quad_buffer = alloc(get_heap_allocator(), number_of_quads*sizeof(Draw_Quad));
-					d3d11_sort_quad_buffer_size = number_of_quads*sizeof(Draw_Quad);
+					if (d3d11_sort_key_buffer) dealloc(get_heap_allocator(), d3d11_sort_key_buffer);
+					d3d11_sort_key_buffer = alloc_uninitialized(get_heap_allocator(), number_of_quads*2*sizeof(u64));
+					d3d11_sort_key_buffer_count = number_of_quads;
 				}
-				radix_sort(frame->quad_buffer, d3d11_sort_quad_buffer, number_of_quads, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS);
+				quad_order = radix_sort_indices(frame->quad_buffer, number_of_quads, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS, d3d11_sort_key_buffer, d3d11_sort_key_buffer + number_of_quads);
 			}
 		
 			for (u64 i = 0; i < number_of_quads; i++)  {
 				
-				Draw_Quad *q = &frame->quad_buffer[i];
+				Draw_Quad *q = &frame->quad_buffer[quad_order ? (u32)quad_order[i] : i];
 				
 				assert(q->z <= MAX_Z, "Z is too high. Z is %d, Max is %d.", q->z, MAX_Z);
 				assert(q->z >= (-MAX_Z+1), "Z is too low. Z is %d, Min is %d.", q->z, -MAX_Z+1);
@@ -922,8 +926,8 @@ void gfx_reserve_vbo_bytes(u64 number_of_bytes) {
 		
 		d3d11_quad_vbo_size = new_size;
 		
-		d3d11_staging_quad_buffer = alloc(get_heap_allocator(), d3d11_quad_vbo_size);
-		u32 *indices = (u32*)alloc(get_heap_allocator(), new_indices*sizeof(u32));
+		d3d11_staging_quad_buffer = alloc_uninitialized(get_heap_allocator(), d3d11_quad_vbo_size);
+		u32 *indices = (u32*)alloc_uninitialized(get_heap_allocator(), new_indices*sizeof(u32));
 		
 		for (u64 i = 0; i < new_indices; i += 6) {
 			indices[i + 0] = (i/6)*4 + 0;
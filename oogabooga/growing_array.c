@@ -1,184 +1,326 @@
-
 /*
 
 	Full API:
-	
+
 		void growing_array_init_reserve(void **array, u64 block_size_in_bytes, u64 count_to_reserve, Allocator allocator);
+		void growing_array_init_reserve_aligned(void **array, u64 block_size_in_bytes, u64 count_to_reserve, u64 alignment, Allocator allocator);
 		void growing_array_init(void **array, u64 block_size_in_bytes, Allocator allocator);
 		void growing_array_deinit(void **array);
-		
+
 		void *growing_array_add_empty(void **array);
-		void *growing_array_add_multiple_empty(void **array);
+		void *growing_array_add_multiple_empty(void **array, u64 count);
 		void growing_array_add(void **array, void *item);
 		void growing_array_add_multiple(void **array, void *items, u64 count);
-		
+
 		void growing_array_reserve(void **array, u64 count_to_reserve);
 		void growing_array_resize(void **array, u64 new_count);
 		void growing_array_pop(void **array);
 		void growing_array_clear(void **array);
-		
+
 		// Returns -1 if not found
-		s32  growing_array_find_index_from_left_by_pointer(void **array, void *p);
-		s32  growing_array_find_index_from_left_by_value(void **array, void *p);
-		
-		void growing_array_ordered_remove_by_index(void **array, u32 index);
-		void growing_array_unordered_remove_by_index(void **array, u32 index);
+		s64  growing_array_find_index_from_left_by_pointer(void **array, void *p);
+		s64  growing_array_find_index_from_left_by_value(void **array, void *p);
+
+		void growing_array_ordered_remove_by_index(void **array, u64 index);
+		void growing_array_unordered_remove_by_index(void **array, u64 index);
 		bool growing_array_ordered_remove_by_pointer(void **array, void *p);
 		bool growing_array_unordered_remove_by_pointer(void **array, void *p);
 		bool growing_array_ordered_remove_one_by_value(void **array, void *p);
 		bool growing_array_unordered_remove_one_by_value(void **array, void *p);
-		
-		u32  growing_array_get_valid_count(void *array);
-		u32  growing_array_get_allocated_count(void *array);
+
+		u64  growing_array_get_valid_count(void *array);
+		u64  growing_array_get_allocated_count(void *array);
+
+	Typed API:
+
+		These take a pointer to the array (Thing **), so the item size is a sizeof() the compiler
+		knows and everything can inline. Items are passed by value.
+
+		growing_array_init_typed(array_ptr, allocator)
+		growing_array_init_reserve_typed(array_ptr, count_to_reserve, allocator)
+
+		growing_array_push(array_ptr, item)
+		growing_array_push_empty(array_ptr)                      // Returns pointer to the new item
+		growing_array_push_many(array_ptr, items, count)         // Copies count items from a plain array
+		growing_array_append_array(array_ptr, other_array)       // Copies all of another growing array
+		growing_array_insert(array_ptr, index, item)             // item must be an lvalue
+		growing_array_insert_many(array_ptr, index, items, count)
+		growing_array_remove_at(array_ptr, index)                // Keeps order
+		growing_array_remove_range(array_ptr, index, count)      // Keeps order
+		growing_array_remove_at_unordered(array_ptr, index)      // Moves the last item into index
+
+		growing_array_count(array)
+		growing_array_capacity(array)
+		growing_array_last(array)
 
 	Usage:
-	
+
 	    Thing *things;
 	    growing_array_init(&things, sizeof(Thing));
-	    
+
 	    growing_array_deinit(&things);
-	    
+
+	    // Items start on a 64 byte boundary, and stay there when the array grows
+	    growing_array_init_reserve_aligned(&things, sizeof(Thing), 128, 64, get_heap_allocator());
+
 	    Thing new_thing;
 	    growing_array_add(&things, &new_thing); // 'thing' is copied
-	    
+
 	    Thing *nth_thing = &things[n];
-	    
+
 	    growing_array_reserve_count(&things, 690);
 	    growing_array_resize_count(&things, 69);
-	    
+
 	    // "Slow", but stuff in the array keeps the same order
 	    growing_array_ordered_remove_by_index(&things, i);
-	    
+
 	    // Fast, but will not keep stuff ordered
 	    growing_array_unordered_remove_by_index(&things, i);
-	    
+
 	    growing_array_ordered_remove_by_pointer(&things, nth_thing);
 	    growing_array_unordered_remove_by_pointer(&things, nth_thing);
-	    
+
 	    Thing thing_prototype;
 	    growing_array_ordered_remove_one_by_value(&things, thing_prototype);
 	    growing_array_unordered_remove_one_by_value(&things, thing_prototype);
 	    growing_array_ordered_remove_all_by_value(&things, thing_prototype);
 	    growing_array_unordered_remove_all_by_value(&things, thing_prototype);
-	    
+
 	    growing_array_get_valid_count(&things);
 	    growing_array_get_allocated_count(&things);
-    
+
+	    // Same thing with the typed API
+	    Thing *others;
+	    growing_array_init_typed(&others, get_heap_allocator());
+	    growing_array_push(&others, new_thing);
+	    growing_array_push_many(&others, some_things, some_thing_count);
+	    growing_array_insert(&others, 0, new_thing);
+	    growing_array_remove_range(&others, 1, 3);
+	    for (u64 i = 0; i < growing_array_count(others); i += 1) {
+	    	Thing *thing = &others[i];
+	    }
+
 */
 
 #define GROWING_ARRAY_SIGNATURE 2224364215
 
 typedef struct Growing_Array_Header {
 	u32 signature;
-    u32 valid_count;
-    u32 allocated_count;
-    u32 block_size_in_bytes;
+    u32 alignment; // Of the first item
+    u64 valid_count;
+    u64 allocated_count;
+    u64 block_size_in_bytes;
     Allocator allocator;
 } Growing_Array_Header;
 
-bool 
+// Bytes from the start of the allocation to the first item. The header is right before the items.
+inline u64
+growing_array_items_offset(u64 alignment) {
+	return align_next(sizeof(Growing_Array_Header), alignment);
+}
+inline void*
+growing_array_get_allocation(Growing_Array_Header *header) {
+	return (u8*)(header+1) - growing_array_items_offset(header->alignment);
+}
+inline Growing_Array_Header*
+growing_array_get_header(void *array) {
+	return ((Growing_Array_Header*)array) - 1;
+}
+
+bool
 check_growing_array_signature(void **array) {
 	Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
 	if (header->signature != GROWING_ARRAY_SIGNATURE) return false;
 	return true;
 }
 
+// assert() still evaluates its condition in release, so this is its own macro that compiles out
+#if CONFIGURATION == RELEASE
+	#define growing_array_check(array)
+	#define growing_array_check_size(array, size)
+#else
+	#define growing_array_check(array) assert(check_growing_array_signature(array), "Not a valid growing array")
+	#define growing_array_check_size(array, size) assert(check_growing_array_signature(array) && growing_array_get_header(*(array))->block_size_in_bytes == (size), "Not a valid growing array, or the item type doesn't match the one it was initted with")
+#endif
+
 void
-growing_array_init_reserve(void **array, u64 block_size_in_bytes, u64 count_to_reserve, Allocator allocator) {
-    
+growing_array_init_reserve_aligned(void **array, u64 block_size_in_bytes, u64 count_to_reserve, u64 alignment, Allocator allocator) {
+
+    alignment = max(alignment, 16);
     count_to_reserve = get_next_power_of_two(count_to_reserve);
-    u64 bytes_to_allocate = count_to_reserve*block_size_in_bytes + sizeof(Growing_Array_Header);
-    
-    Growing_Array_Header *header = (Growing_Array_Header*)alloc(allocator, bytes_to_allocate);
-    
+    u64 items_offset = growing_array_items_offset(alignment);
+    u64 bytes_to_allocate = count_to_reserve*block_size_in_bytes + items_offset;
+
+    u8 *allocation = (u8*)alloc_aligned(allocator, bytes_to_allocate, alignment);
+    Growing_Array_Header *header = ((Growing_Array_Header*)(allocation + items_offset)) - 1;
+
     header->allocator = allocator;
     header->block_size_in_bytes = block_size_in_bytes;
     header->valid_count = 0;
     header->allocated_count = count_to_reserve;
+    header->alignment = (u32)alignment;
     header->signature = GROWING_ARRAY_SIGNATURE;
-    
+
     *array = header+1;
 }
 void
+growing_array_init_reserve(void **array, u64 block_size_in_bytes, u64 count_to_reserve, Allocator allocator) {
+    growing_array_init_reserve_aligned(array, block_size_in_bytes, count_to_reserve, 16, allocator);
+}
+void
 growing_array_init(void **array, u64 block_size_in_bytes, Allocator allocator) {
     growing_array_init_reserve(array, block_size_in_bytes, 8, allocator);
 }
 void
 growing_array_deinit(void **array) {
-	assert(check_growing_array_signature(array), "Not a valid growing array");
+	growing_array_check(array);
     Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
-    dealloc(header->allocator, header);
+    dealloc(header->allocator, growing_array_get_allocation(header));
 }
 
 void
 growing_array_reserve(void **array, u64 count_to_reserve) {
-	assert(check_growing_array_signature(array), "Not a valid growing array");
+	growing_array_check(array);
     Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
-    
+
     if (header->allocated_count >= count_to_reserve) return;
-    
-    u64 old_allocated_bytes = header->allocated_count*header->block_size_in_bytes+sizeof(Growing_Array_Header);
+
+    u64 items_offset = growing_array_items_offset(header->alignment);
+    u64 old_allocated_bytes = header->allocated_count*header->block_size_in_bytes+items_offset;
     count_to_reserve = get_next_power_of_two(count_to_reserve);
-    u64 bytes_to_allocate = count_to_reserve*header->block_size_in_bytes+sizeof(Growing_Array_Header);
-    Growing_Array_Header *new_header = (Growing_Array_Header*)alloc(header->allocator, bytes_to_allocate);
-    
-    memcpy(new_header, header, old_allocated_bytes);
-    
-    
+    u64 bytes_to_allocate = count_to_reserve*header->block_size_in_bytes+items_offset;
+
+    // Grows in place if the allocator can, otherwise copies
+    u8 *allocation = (u8*)reallocate_aligned(header->allocator, growing_array_get_allocation(header), old_allocated_bytes, bytes_to_allocate, header->alignment);
+    Growing_Array_Header *new_header = ((Growing_Array_Header*)(allocation + items_offset)) - 1;
+
     *array = new_header+1;
-    
+
     new_header->allocated_count = count_to_reserve;
-    
-    dealloc(header->allocator, header);
 }
 
+///
+// Sized versions of everything. block_size is the same as the array's block_size_in_bytes, but
+// when it's a sizeof() the compiler can inline these with a constant item size.
+
+inline void*
+growing_array_add_multiple_empty_sized(void **array, u64 block_size, u64 count) {
+	growing_array_check_size(array, block_size);
+    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
+    if (header->valid_count+count > header->allocated_count) {
+    	growing_array_reserve(array, header->valid_count+count);
+	    // Pointer was invalidated by reserve
+	    header = ((Growing_Array_Header*)*array) - 1;
+    }
+
+    void *start = (u8*)*array + header->valid_count*block_size;
+    header->valid_count += count;
+    return start;
+}
+inline void
+growing_array_add_multiple_sized(void **array, u64 block_size, void *items, u64 count) {
+	void *start = growing_array_add_multiple_empty_sized(array, block_size, count);
+	memcpy(start, items, block_size*count);
+}
+// Makes room for count items at index, moving the ones after it up. Returns pointer to the first one.
+inline void*
+growing_array_insert_multiple_empty_sized(void **array, u64 block_size, u64 index, u64 count) {
+	growing_array_check_size(array, block_size);
+	u64 old_count = growing_array_get_header(*array)->valid_count;
+	assert(index <= old_count, "Growing array insert index %llu out of range, count is %llu", index, old_count);
+
+	growing_array_add_multiple_empty_sized(array, block_size, count);
+
+	u8 *at = (u8*)*array + index*block_size;
+	memmove(at + count*block_size, at, (old_count-index)*block_size);
+	return at;
+}
+inline void
+growing_array_insert_multiple_sized(void **array, u64 block_size, u64 index, void *items, u64 count) {
+	void *at = growing_array_insert_multiple_empty_sized(array, block_size, index, count);
+	memcpy(at, items, count*block_size);
+}
+inline void
+growing_array_ordered_remove_range_sized(void **array, u64 block_size, u64 index, u64 count) {
+	growing_array_check_size(array, block_size);
+    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
+    assert(index+count <= header->valid_count, "Growing array remove range %llu-%llu out of range, count is %llu", index, index+count, header->valid_count);
+
+    u8 *at = (u8*)*array + index*block_size;
+    // The ranges overlap when moving items down, so memmove
+    memmove(at, at + count*block_size, (header->valid_count-index-count)*block_size);
+    header->valid_count -= count;
+}
+inline void
+growing_array_unordered_remove_by_index_sized(void **array, u64 block_size, u64 index) {
+	growing_array_check_size(array, block_size);
+    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
+    assert(index < header->valid_count, "Growing array index out of range");
+
+    header->valid_count -= 1;
+    if (index != header->valid_count) {
+	    memcpy((u8*)*array + index*block_size, (u8*)*array + header->valid_count*block_size, block_size);
+    }
+}
+
+///
+// Typed API
+
+#define growing_array_init_typed(array_ptr, allocator) \
+	growing_array_init((void**)(array_ptr), sizeof(**(array_ptr)), (allocator))
+#define growing_array_init_reserve_typed(array_ptr, count_to_reserve, allocator) \
+	growing_array_init_reserve((void**)(array_ptr), sizeof(**(array_ptr)), (count_to_reserve), (allocator))
+
+// Comma, so the new slot exists (and *array_ptr is the grown array) before we index into it
+#define growing_array_push(array_ptr, item) \
+	(growing_array_add_multiple_empty_sized((void**)(array_ptr), sizeof(**(array_ptr)), 1), \
+	 (*(array_ptr))[growing_array_count(*(array_ptr))-1] = (item))
+#define growing_array_push_empty(array_ptr) \
+	growing_array_add_multiple_empty_sized((void**)(array_ptr), sizeof(**(array_ptr)), 1)
+#define growing_array_push_many(array_ptr, items, count) \
+	growing_array_add_multiple_sized((void**)(array_ptr), sizeof(**(array_ptr)), (items), (count))
+#define growing_array_append_array(array_ptr, other_array) \
+	growing_array_add_multiple_sized((void**)(array_ptr), sizeof(**(array_ptr)), (other_array), growing_array_count(other_array))
+
+// item needs to be an lvalue here, so index is only evaluated once (it could be growing_array_count())
+#define growing_array_insert(array_ptr, index, item) \
+	growing_array_insert_multiple_sized((void**)(array_ptr), sizeof(**(array_ptr)), (index), &(item), 1)
+#define growing_array_insert_many(array_ptr, index, items, count) \
+	growing_array_insert_multiple_sized((void**)(array_ptr), sizeof(**(array_ptr)), (index), (items), (count))
+
+#define growing_array_remove_at(array_ptr, index) \
+	growing_array_ordered_remove_range_sized((void**)(array_ptr), sizeof(**(array_ptr)), (index), 1)
+#define growing_array_remove_range(array_ptr, index, count) \
+	growing_array_ordered_remove_range_sized((void**)(array_ptr), sizeof(**(array_ptr)), (index), (count))
+#define growing_array_remove_at_unordered(array_ptr, index) \
+	growing_array_unordered_remove_by_index_sized((void**)(array_ptr), sizeof(**(array_ptr)), (index))
+
+#define growing_array_count(array) (growing_array_get_header(array)->valid_count)
+#define growing_array_capacity(array) (growing_array_get_header(array)->allocated_count)
+#define growing_array_last(array) (&(array)[growing_array_count(array)-1])
+
+///
+// Untyped API
+
 void*
 growing_array_add_empty(void **array) {
-	assert(check_growing_array_signature(array), "Not a valid growing array");
-    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
-    growing_array_reserve(array, header->valid_count+1);
-    
-    // Pointer might have been invalidated after reserve
-    header = ((Growing_Array_Header*)*array) - 1; 
-    
-    void *item = (u8*)*array + header->valid_count*header->block_size_in_bytes;
-    
-    header->valid_count += 1;
-    
-    return item;
+	growing_array_check(array);
+    return growing_array_add_multiple_empty_sized(array, growing_array_get_header(*array)->block_size_in_bytes, 1);
 }
 void*
 growing_array_add_multiple_empty(void **array, u64 count) {
-	assert(check_growing_array_signature(array), "Not a valid growing array");
-    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
-    growing_array_reserve(array, header->valid_count+count);
-    
-    // Pointer might have been invalidated after reserve
-    header = ((Growing_Array_Header*)*array) - 1; 
-    
-    void *start = (u8*)*array + header->valid_count*header->block_size_in_bytes;
-    
-    header->valid_count += count;
-    
-    return start;
+	growing_array_check(array);
+    return growing_array_add_multiple_empty_sized(array, growing_array_get_header(*array)->block_size_in_bytes, count);
 }
 void
 growing_array_add(void **array, void *item) {
-
-    void *new = growing_array_add_empty(array);
-
-    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
-    
-    memcpy(new, item, header->block_size_in_bytes);
+	growing_array_check(array);
+    growing_array_add_multiple_sized(array, growing_array_get_header(*array)->block_size_in_bytes, item, 1);
 }
 void
 growing_array_add_multiple(void **array, void *items, u64 count) {
-
-    void *start = growing_array_add_multiple_empty(array, count);
-
-    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
-    
-    memcpy(start, items, header->block_size_in_bytes*count);
+	growing_array_check(array);
+    growing_array_add_multiple_sized(array, growing_array_get_header(*array)->block_size_in_bytes, items, count);
 }
 
 void growing_array_resize(void **array, u64 new_count) {
@@ -188,84 +330,53 @@ void growing_array_resize(void **array, u64 new_count) {
 }
 
 void growing_array_pop(void **array) {
-	assert(check_growing_array_signature(array), "Not a valid growing array");
+	growing_array_check(array);
     Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
     assert(header->valid_count > 0, "No items to pop in growing array");
     header->valid_count -= 1;
 }
 
 void growing_array_clear(void **array) {
-	assert(check_growing_array_signature(array), "Not a valid growing array");
+	growing_array_check(array);
     Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
     header->valid_count = 0;
 }
 
-void 
-growing_array_ordered_remove_by_index(void **array, u32 index) {
-	assert(check_growing_array_signature(array), "Not a valid growing array");
-    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
-    assert(index < header->valid_count, "Growing array index out of range");
-    
-    if (index == header->valid_count-1) {
-        growing_array_pop(array);
-        return;
-    }
-    
-    u64 byte_index = header->block_size_in_bytes*index;
-    
-    memcpy(
-        (u8*)*array + byte_index, 
-        (u8*)*array + byte_index + header->block_size_in_bytes,
-        (header->valid_count-index-1)*header->block_size_in_bytes
-    );
-    header->valid_count -= 1;
+void
+growing_array_ordered_remove_by_index(void **array, u64 index) {
+	growing_array_check(array);
+    growing_array_ordered_remove_range_sized(array, growing_array_get_header(*array)->block_size_in_bytes, index, 1);
 }
-void 
-growing_array_unordered_remove_by_index(void **array, u32 index) {
-	assert(check_growing_array_signature(array), "Not a valid growing array");
-    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
-    assert(index < header->valid_count, "Growing array index out of range");
-    
-    if (index == header->valid_count-1) {
-        growing_array_pop(array);
-        return;
-    }
-    
-    u64 byte_index = header->block_size_in_bytes*index;
-    u64 last_item_index = header->block_size_in_bytes*header->valid_count-header->block_size_in_bytes;
-    
-    memcpy(
-        (u8*)*array + byte_index, 
-        (u8*)*array + last_item_index,
-        header->block_size_in_bytes
-    );
-    header->valid_count -= 1;
+void
+growing_array_unordered_remove_by_index(void **array, u64 index) {
+	growing_array_check(array);
+    growing_array_unordered_remove_by_index_sized(array, growing_array_get_header(*array)->block_size_in_bytes, index);
 }
 
-s32
+s64
 growing_array_find_index_from_left_by_pointer(void **array, void *p) {
-	assert(check_growing_array_signature(array), "Not a valid growing array");
+	growing_array_check(array);
     Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
-    
-    for (u32 i = 0; i < header->valid_count; i++) {
+
+    for (u64 i = 0; i < header->valid_count; i++) {
         void *next = (u8*)*array + i*header->block_size_in_bytes;
-        
+
         if (next == p) {
-            return i;
+            return (s64)i;
         }
     }
     return -1;
 }
-s32
+s64
 growing_array_find_index_from_left_by_value(void **array, void *p) {
-	assert(check_growing_array_signature(array), "Not a valid growing array");
+	growing_array_check(array);
     Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
-    
-    for (u32 i = 0; i < header->valid_count; i++) {
+
+    for (u64 i = 0; i < header->valid_count; i++) {
         void *next = (u8*)*array + i*header->block_size_in_bytes;
-        
+
         if (bytes_match(next, p, header->block_size_in_bytes)) {
-            return i;
+            return (s64)i;
         }
     }
     return -1;
@@ -273,50 +384,42 @@ growing_array_find_index_from_left_by_value(void **array, void *p) {
 
 bool
 growing_array_ordered_remove_by_pointer(void **array, void *p) {
-    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
-    
-    s32 i = growing_array_find_index_from_left_by_pointer(array, p);
-    
+    s64 i = growing_array_find_index_from_left_by_pointer(array, p);
+
     if (i < 0) return false;
-    
-    growing_array_ordered_remove_by_index(array, i);
-    
+
+    growing_array_ordered_remove_by_index(array, (u64)i);
+
     return true;
 }
-bool 
+bool
 growing_array_unordered_remove_by_pointer(void **array, void *p) {
-    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
-    
-    s32 i = growing_array_find_index_from_left_by_pointer(array, p);
-    
+    s64 i = growing_array_find_index_from_left_by_pointer(array, p);
+
     if (i < 0) return false;
-    
-    growing_array_unordered_remove_by_index(array, i);
-    
+
+    growing_array_unordered_remove_by_index(array, (u64)i);
+
     return true;
 }
-bool 
+bool
 growing_array_ordered_remove_one_by_value(void **array, void *p) {
-    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
-    
-    s32 i = growing_array_find_index_from_left_by_value(array, p);
-    
+    s64 i = growing_array_find_index_from_left_by_value(array, p);
+
     if (i < 0) return false;
-    
-    growing_array_ordered_remove_by_index(array, i);
-    
+
+    growing_array_ordered_remove_by_index(array, (u64)i);
+
     return true;
 }
-bool 
+bool
 growing_array_unordered_remove_one_by_value(void **array, void *p) {
-    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
-    
-    s32 i = growing_array_find_index_from_left_by_value(array, p);
-    
+    s64 i = growing_array_find_index_from_left_by_value(array, p);
+
     if (i < 0) return false;
-    
-    growing_array_unordered_remove_by_index(array, i);
-    
+
+    growing_array_unordered_remove_by_index(array, (u64)i);
+
     return true;
 }
 
@@ -324,15 +427,15 @@ growing_array_unordered_remove_one_by_value(void **array, void *p) {
 // s32 growing_array_ordered_remove_one_by_value(void **array, void *p)
 // s32 growing_array_unordered_remove_one_by_value(void **array, void *p)
 
-u32
+u64
 growing_array_get_valid_count(void *array) {
-	assert(check_growing_array_signature(&array), "Not a valid growing array");
+	growing_array_check(&array);
     Growing_Array_Header *header = ((Growing_Array_Header*)array) - 1;
     return header->valid_count;
 }
-u32
+u64
 growing_array_get_allocated_count(void *array) {
-	assert(check_growing_array_signature(&array), "Not a valid growing array");
+	growing_array_check(&array);
     Growing_Array_Header *header = ((Growing_Array_Header*)array) - 1;
     return header->allocated_count;
-}
\ No newline at end of file
+}
@@ -1,5 +1,4 @@
 
-
 #define PRIME64_1 11400714785074694791ULL
 #define PRIME64_2 14029467366897019727ULL
 #define PRIME64_3 1609587929392839161ULL
@@ -18,34 +17,387 @@ static inline u64 xx_hash(u64 x) {
     return h64;
 }
 
-static inline u64 city_hash(string s) {
-    const u64 k = 0x9ddfea08eb382d69ULL;
-    u64 a = s.count;
-    u64 b = s.count * 5;
-    u64 c = 9;
-    u64 d = b;
-
-    if (s.count <= 16) {
-        memcpy(&a, s.data, sizeof(u64));
-        memcpy(&b, s.data + s.count - 8, sizeof(u64));
-    } else {
-        memcpy(&a, s.data, sizeof(u64));
-        memcpy(&b, s.data + 8, sizeof(u64));
-        memcpy(&c, s.data + s.count - 8, sizeof(u64));
-        memcpy(&d, s.data + s.count - 16, sizeof(u64));
-    }
+///
+// Hashing bytes
+//
+// hash_bytes() hashes any number of bytes into 64 bits, with a seed. It's wyhash (final
+// version 4): 48 bytes per step with 64x64->128 bit multiplies, and it never reads outside
+// of the data.
+// If the compiler can do AVX2 (-mavx2), anything over HASH_SHORT_MAX bytes goes through the
+// long-input loop from XXH3 instead (with our own secret), 8 lanes eating 64 bytes per step.
+// That's faster than wyhash with AVX2 but slower with only SSE2, so without AVX2 it's
+// wyhash all the way.
+// Hasher gives the exact same hash as hash_bytes() when you feed it the bytes in pieces.
+//
+// The hashes are for hash tables and caches, not for security or for saving to disk (the
+// algorithm and the secrets might change).
+
+#define HASH_SHORT_MAX 256
+
+#define HASH_USE_STRIPES COMPILER_CAN_DO_AVX2
+
+static const u64 wyhash_secret[4] = {
+	0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+inline u64 _hash_read64(const u8 *p) { u64 x; memcpy(&x, p, 8); return x; }
+inline u64 _hash_read32(const u8 *p) { u32 x; memcpy(&x, p, 4); return x; }
+
+// 64x64 -> 128, lo in *a and hi in *b
+inline void _hash_mul128(u64 *a, u64 *b) {
+#if COMPILER_MSVC
+	*a = _umul128(*a, *b, b);
+#else
+	__uint128_t r = (__uint128_t)*a * *b;
+	*a = (u64)r;
+	*b = (u64)(r >> 64);
+#endif
+}
+inline u64 _hash_mix(u64 a, u64 b) {
+	_hash_mul128(&a, &b);
+	return a ^ b;
+}
+
+inline u64 _wyhash_seed(u64 seed) {
+	return seed ^ _hash_mix(seed ^ wyhash_secret[0], wyhash_secret[1]);
+}
+// One 48 byte step, lanes is seed, see1, see2
+inline void _wyhash_48(u64 *lanes, const u8 *p) {
+	const u64 *secret = wyhash_secret;
+	lanes[0] = _hash_mix(_hash_read64(p)      ^ secret[1], _hash_read64(p + 8)  ^ lanes[0]);
+	lanes[1] = _hash_mix(_hash_read64(p + 16) ^ secret[2], _hash_read64(p + 24) ^ lanes[1]);
+	lanes[2] = _hash_mix(_hash_read64(p + 32) ^ secret[3], _hash_read64(p + 40) ^ lanes[2]);
+}
+// At most 48 bytes left (p, count). last_16 is the last 16 bytes of all of it, for
+// total_count > 16.
+inline u64 _wyhash_finish(u64 seed, const u8 *p, u64 count, const u8 *last_16, u64 total_count) {
+	const u64 *secret = wyhash_secret;
+	u64 a, b;
+	if (total_count <= 16) {
+		if (count >= 4) {
+			a = (_hash_read32(p) << 32) | _hash_read32(p + ((count >> 3) << 2));
+			b = (_hash_read32(p + count - 4) << 32) | _hash_read32(p + count - 4 - ((count >> 3) << 2));
+		} else if (count > 0) {
+			a = ((u64)p[0] << 16) | ((u64)p[count >> 1] << 8) | p[count-1];
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		while (count > 16) {
+			seed = _hash_mix(_hash_read64(p) ^ secret[1], _hash_read64(p + 8) ^ seed);
+			count -= 16;
+			p += 16;
+		}
+		a = _hash_read64(last_16);
+		b = _hash_read64(last_16 + 8);
+	}
+	a ^= secret[1];
+	b ^= seed;
+	_hash_mul128(&a, &b);
+	return _hash_mix(a ^ secret[0] ^ total_count, b ^ secret[1]);
+}
+u64 _hash_wyhash(const u8 *p, u64 count, u64 seed) {
+	u64 lanes[3];
+	lanes[0] = _wyhash_seed(seed);
+	u64 left = count;
+	if (count > 48) {
+		lanes[1] = lanes[2] = lanes[0];
+		do {
+			_wyhash_48(lanes, p);
+			p += 48;
+			left -= 48;
+		} while (left > 48);
+		lanes[0] ^= lanes[1] ^ lanes[2];
+	}
+	// The last 16 can overlap with what we already did
+	return _wyhash_finish(lanes[0], p, left, count > 16 ? p + left - 16 : 0, count);
+}
+
+#if HASH_USE_STRIPES
+
+#define HASH_STRIPE_SIZE 64
+#define HASH_SECRET_SIZE 192
+#define HASH_STRIPES_PER_BLOCK ((HASH_SECRET_SIZE - HASH_STRIPE_SIZE) / 8)
+#define HASH_LAST_STRIPE_SECRET_OFFSET (HASH_SECRET_SIZE - HASH_STRIPE_SIZE - 7)
+#define HASH_MERGE_SECRET_OFFSET 11
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME32_2 0x85EBCA77U
+#define PRIME32_3 0xC2B2AE3DU
+
+// Random numbers, nothing special about them
+alignat(64) static const u64 hash_secret[HASH_SECRET_SIZE/8] = {
+	0x3ef5a5ec21fdca43ULL, 0x774f856cfc54591aULL, 0x9f1af01e6e8e2b4cULL, 0x2f1d558c34a1b685ULL,
+	0xde4839bfe8577b62ULL, 0xd7c74410ebd837ddULL, 0x157344dad52cfcabULL, 0xc818c2d9ebf29e64ULL,
+	0x618ea3b83c7dcdcaULL, 0xd6b0191e808ace97ULL, 0xaf98ba962cff51cdULL, 0x88d8a6922b0b0f2fULL,
+	0x669c57a95df52af1ULL, 0x8b512609d8e4240eULL, 0x6d1a87c16398a240ULL, 0x3b93ea1389963a26ULL,
+	0x6399d9b53b72c017ULL, 0x3f6a364bcef9b751ULL, 0x67365b9c5f58791cULL, 0x2cdb7e3c95a62b8bULL,
+	0x01e871b06499d26eULL, 0x9eb551b08893354bULL, 0x4be1a14b1f73a9dcULL, 0x379f6ffa59a9d643ULL,
+};
+
+// One 64 byte stripe into the 8 accumulators
+inline void _hash_accumulate_stripe(__m256i *acc, const u8 *p, const u8 *key) {
+	for (u64 i = 0; i < 2; i += 1) {
+		__m256i data      = _mm256_loadu_si256((__m256i*)(p + i*32));
+		__m256i data_key  = _mm256_xor_si256(data, _mm256_loadu_si256((__m256i*)(key + i*32)));
+		__m256i key_hi    = _mm256_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+		__m256i product   = _mm256_mul_epu32(data_key, key_hi);
+		__m256i data_swap = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+		acc[i] = _mm256_add_epi64(product, _mm256_add_epi64(acc[i], data_swap));
+	}
+}
+inline void _hash_scramble(__m256i *acc, const u8 *key) {
+	const __m256i prime = _mm256_set1_epi32((int)PRIME32_1);
+	for (u64 i = 0; i < 2; i += 1) {
+		__m256i x = _mm256_xor_si256(acc[i], _mm256_srli_epi64(acc[i], 47));
+		x = _mm256_xor_si256(x, _mm256_loadu_si256((__m256i*)(key + i*32)));
+		__m256i lo = _mm256_mul_epu32(x, prime);
+		__m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), prime);
+		acc[i] = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+	}
+}
+// stripe_index is where in the current block the first stripe goes. Scrambles at the end of
+// each block, returns the new stripe_index.
+u64 _hash_accumulate(u64 *acc_out, const u8 *p, u64 stripe_count, u64 stripe_index, const u8 *secret) {
+	__m256i acc[2] = { _mm256_loadu_si256((__m256i*)acc_out), _mm256_loadu_si256((__m256i*)acc_out + 1) };
+	for (u64 i = 0; i < stripe_count; i += 1) {
+		_hash_accumulate_stripe(acc, p + i*HASH_STRIPE_SIZE, secret + stripe_index*8);
+		stripe_index += 1;
+		if (stripe_index == HASH_STRIPES_PER_BLOCK) {
+			_hash_scramble(acc, secret + HASH_SECRET_SIZE - HASH_STRIPE_SIZE);
+			stripe_index = 0;
+		}
+	}
+	_mm256_storeu_si256((__m256i*)acc_out, acc[0]);
+	_mm256_storeu_si256((__m256i*)acc_out + 1, acc[1]);
+	return stripe_index;
+}
+void _hash_accumulate_last_stripe(u64 *acc_out, const u8 *p, const u8 *secret) {
+	__m256i acc[2] = { _mm256_loadu_si256((__m256i*)acc_out), _mm256_loadu_si256((__m256i*)acc_out + 1) };
+	_hash_accumulate_stripe(acc, p, secret + HASH_LAST_STRIPE_SECRET_OFFSET);
+	_mm256_storeu_si256((__m256i*)acc_out, acc[0]);
+	_mm256_storeu_si256((__m256i*)acc_out + 1, acc[1]);
+}
+inline void _hash_init_accumulators(u64 *acc) {
+	acc[0] = PRIME32_3; acc[1] = PRIME64_1; acc[2] = PRIME64_2; acc[3] = PRIME64_3;
+	acc[4] = PRIME64_4; acc[5] = PRIME32_2; acc[6] = PRIME64_5; acc[7] = PRIME32_1;
+}
+u64 _hash_merge_accumulators(u64 *acc, const u8 *secret, u64 count) {
+	u64 result = count * PRIME64_1;
+	for (u64 i = 0; i < 4; i += 1) {
+		const u8 *key = secret + HASH_MERGE_SECRET_OFFSET + i*16;
+		result += _hash_mix(acc[i*2] ^ _hash_read64(key), acc[i*2+1] ^ _hash_read64(key + 8));
+	}
+	result ^= result >> 37;
+	result *= 0x165667919E3779F9ULL;
+	result ^= result >> 32;
+	return result;
+}
+// The secret with the seed mixed in, like XXH3 does it
+void _hash_make_seeded_secret(u8 *secret, u64 seed) {
+	const u8 *base = (const u8*)hash_secret;
+	for (u64 i = 0; i < HASH_SECRET_SIZE; i += 16) {
+		u64 lo = _hash_read64(base + i)     + seed;
+		u64 hi = _hash_read64(base + i + 8) - seed;
+		memcpy(secret + i, &lo, 8);
+		memcpy(secret + i + 8, &hi, 8);
+	}
+}
+
+u64 _hash_bytes_long(const u8 *p, u64 count, u64 seed) {
+	alignat(64) u8 seeded_secret[HASH_SECRET_SIZE];
+	const u8 *secret = (const u8*)hash_secret;
+	if (seed) {
+		_hash_make_seeded_secret(seeded_secret, seed);
+		secret = seeded_secret;
+	}
+
+	alignat(32) u64 acc[8];
+	_hash_init_accumulators(acc);
+
+	// All full stripes except the one with the last byte in it, then the last 64 bytes
+	u64 stripe_count = (count-1) / HASH_STRIPE_SIZE;
+	_hash_accumulate(acc, p, stripe_count, 0, secret);
+	_hash_accumulate_last_stripe(acc, p + count - HASH_STRIPE_SIZE, secret);
+
+	return _hash_merge_accumulators(acc, secret, count);
+}
+
+#endif // HASH_USE_STRIPES
 
-    a += b;
-    a = (a << 43) | (a >> (64 - 43));
-    a += c;
-    a = a * 5 + 0x52dce729;
-    d ^= a;
-    d = (d << 44) | (d >> (64 - 44));
-    d += b;
+u64 hash_bytes(void *data, u64 count, u64 seed) {
+#if HASH_USE_STRIPES
+	if (count > HASH_SHORT_MAX) return _hash_bytes_long((const u8*)data, count, seed);
+#endif
+	return _hash_wyhash((const u8*)data, count, seed);
+}
+
+/*
+	Hasher: same as hash_bytes() but the bytes can come in pieces.
+
+	Hasher h;
+	hasher_init(&h, 0);
+	hasher_update(&h, header, sizeof(header));
+	hasher_update(&h, contents.data, contents.count);
+	u64 hash = hasher_finish(&h); // == hash_bytes() of header and contents after each other
+
+	You can keep updating after hasher_finish().
+*/
+
+#if HASH_USE_STRIPES
+
+// Everything up to HASH_SHORT_MAX is kept so it can be hashed in one go if that's all there
+// is. After that, 64 byte stripes are only eaten when we know more bytes come after them,
+// because the last stripe is done differently.
+#define HASHER_BUFFER_SIZE HASH_SHORT_MAX
+typedef struct Hasher {
+	alignat(32) u64 acc[8];
+	alignat(64) u8 secret[HASH_SECRET_SIZE];
+	u8 buffer[HASHER_BUFFER_SIZE];
+	u64 buffered;
+	u64 total;
+	u64 stripe_index;
+	u64 seed;
+} Hasher;
+
+void hasher_init(Hasher *h, u64 seed) {
+	h->buffered = 0;
+	h->total = 0;
+	h->stripe_index = 0;
+	h->seed = seed;
+	_hash_init_accumulators(h->acc);
+	if (seed) _hash_make_seeded_secret(h->secret, seed);
+	else      memcpy(h->secret, hash_secret, HASH_SECRET_SIZE);
+}
+
+void hasher_update(Hasher *h, void *data, u64 count) {
+	const u8 *p = (const u8*)data;
+	h->total += count;
+
+	if (h->buffered + count <= HASHER_BUFFER_SIZE) {
+		memcpy(h->buffer + h->buffered, p, count);
+		h->buffered += count;
+		return;
+	}
+
+	if (h->buffered) {
+		u64 fill = HASHER_BUFFER_SIZE - h->buffered;
+		memcpy(h->buffer + h->buffered, p, fill);
+		p += fill;
+		count -= fill;
+		h->stripe_index = _hash_accumulate(h->acc, h->buffer, HASHER_BUFFER_SIZE/HASH_STRIPE_SIZE, h->stripe_index, h->secret);
+		h->buffered = 0;
+	}
+
+	// Straight from the input, as long as more than a buffer's worth is left
+	if (count > HASHER_BUFFER_SIZE) {
+		u64 stripe_count = (count - 1) / HASH_STRIPE_SIZE;
+		h->stripe_index = _hash_accumulate(h->acc, p, stripe_count, h->stripe_index, h->secret);
+		p += stripe_count*HASH_STRIPE_SIZE;
+		count -= stripe_count*HASH_STRIPE_SIZE;
+		// Keep the stripe we just did at the end of the buffer, in case finish needs its bytes
+		memcpy(h->buffer + HASHER_BUFFER_SIZE - HASH_STRIPE_SIZE, p - HASH_STRIPE_SIZE, HASH_STRIPE_SIZE);
+	}
+
+	memcpy(h->buffer, p, count);
+	h->buffered = count;
+}
+
+u64 hasher_finish(Hasher *h) {
+	if (h->total <= HASH_SHORT_MAX) return _hash_wyhash(h->buffer, h->total, h->seed);
+
+	alignat(32) u64 acc[8];
+	memcpy(acc, h->acc, sizeof(acc));
 
-    return d * k;
+	u64 stripe_count = (h->buffered - 1) / HASH_STRIPE_SIZE;
+	_hash_accumulate(acc, h->buffer, stripe_count, h->stripe_index, h->secret);
+
+	if (h->buffered >= HASH_STRIPE_SIZE) {
+		_hash_accumulate_last_stripe(acc, h->buffer + h->buffered - HASH_STRIPE_SIZE, h->secret);
+	} else {
+		// The last 64 bytes started before the buffer. The bytes before it are still at the end
+		// of the buffer from the last time it was full.
+		u8 last_stripe[HASH_STRIPE_SIZE];
+		u64 from_before = HASH_STRIPE_SIZE - h->buffered;
+		memcpy(last_stripe, h->buffer + HASHER_BUFFER_SIZE - from_before, from_before);
+		memcpy(last_stripe + from_before, h->buffer, h->buffered);
+		_hash_accumulate_last_stripe(acc, last_stripe, h->secret);
+	}
+
+	return _hash_merge_accumulators(acc, h->secret, h->total);
+}
+
+#else // HASH_USE_STRIPES
+
+// wyhash eats 48 bytes at a time as long as there are more than 48 left, so a full buffer is
+// only eaten once we know more bytes come after it.
+typedef struct Hasher {
+	u64 lanes[3];
+	u8 buffer[48];
+	u64 buffered;
+	u64 total;
+} Hasher;
+
+void hasher_init(Hasher *h, u64 seed) {
+	h->lanes[0] = h->lanes[1] = h->lanes[2] = _wyhash_seed(seed);
+	h->buffered = 0;
+	h->total = 0;
+}
+
+void hasher_update(Hasher *h, void *data, u64 count) {
+	const u8 *p = (const u8*)data;
+	h->total += count;
+
+	if (h->buffered + count <= 48) {
+		memcpy(h->buffer + h->buffered, p, count);
+		h->buffered += count;
+		return;
+	}
+
+	// From here there's always something left after a full buffer
+	if (h->buffered) {
+		u64 fill = 48 - h->buffered;
+		memcpy(h->buffer + h->buffered, p, fill);
+		p += fill;
+		count -= fill;
+		_wyhash_48(h->lanes, h->buffer);
+		h->buffered = 0;
+	}
+
+	if (count > 48) {
+		do {
+			_wyhash_48(h->lanes, p);
+			p += 48;
+			count -= 48;
+		} while (count > 48);
+		// Keep the last 16 bytes, in case finish needs them
+		memcpy(h->buffer + 32, p - 16, 16);
+	}
+
+	memcpy(h->buffer, p, count);
+	h->buffered = count;
 }
 
+u64 hasher_finish(Hasher *h) {
+	u64 seed = h->lanes[0];
+	if (h->total > 48) seed ^= h->lanes[1] ^ h->lanes[2];
+
+	u8 last_16[16];
+	if (h->buffered >= 16 || h->total <= 48) {
+		if (h->total > 16) memcpy(last_16, h->buffer + h->buffered - 16, 16);
+	} else {
+		// Starts before the buffer, the bytes before are still at the end of it
+		u64 from_before = 16 - h->buffered;
+		memcpy(last_16, h->buffer + 48 - from_before, from_before);
+		memcpy(last_16 + from_before, h->buffer, h->buffered);
+	}
+	return _wyhash_finish(seed, h->buffer, h->buffered, last_16, h->total);
+}
+
+#endif // HASH_USE_STRIPES
+
+// Old string hash, kept around for comparison
 u64 djb2_hash(string s) {
     u64 hash = 5381;
     for (u64 i = 0; i < s.count; i++) {
@@ -55,8 +407,7 @@ u64 djb2_hash(string s) {
 }
 
 u64 string_get_hash(string s) {
-    if (s.count > 32) return djb2_hash(s);
-    return city_hash(s);
+	return hash_bytes(s.data, s.count, 0);
 }
 u64 pointer_get_hash(void *p) {
 	return xx_hash((u64)p);
@@ -81,4 +432,4 @@ u64 float32_get_hash(float32 x) {
 		    f32: float32_get_hash, \
 		    f64: float64_get_hash, \
 		    default: pointer_get_hash \
-		    )(x)
\ No newline at end of file
+		    )(x)
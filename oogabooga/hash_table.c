@@ -1,58 +1,76 @@
 
-// Very naive implementation but it should be very cache efficient so it's alright
-// for non-excessive use for now.
+// Open addressing hash table, laid out like a Swiss table.
+// The entries (hash-key-value) are kept dense, in the order they were added, so iterating is
+// just walking an array. Lookups go through a separate array of one control byte per slot
+// (7 bits of the hash or empty/deleted) which we scan 16 at a time with sse2, and the matching
+// slot tells us which entry to compare keys with.
 
 /*
 
 	Example Usage:
-	
-	
+
+
 	// Make a table with key type 'string' and value type 'int', allocated on the heap
 	Hash_Table table = make_hash_table(string, int, get_heap_allocator());
-	
+
 	// Set key "Key string" to integer value 69. This returns whether or not key was newly added.
 	string key = STR("Key string");
 	bool newly_added = hash_table_set(&table, key, 69);
-	
+
 	// Find value associated with given key. Returns pointer to that value.
 	string other_key = STR("Some other key");
 	int* value = hash_table_find(&table, other_key);
-	
+
 	if (value) {
 		// Pointer is OK, item with key exists
 	} else {
 		// Pointer is null, item with key does NOT exist
 	}
-	
+
 	// Same as hash_table_find() != NULL
 	string another_key = STR("Another key");
 	if (hash_table_contains(&table, another_key)) {
-		
+
 	}
-	
+
+	// Remove an entry. Returns whether or not the key was in the table.
+	hash_table_remove(&table, key);
+
+	// Iterate all entries
+	for (u64 i = 0; i < table.count; i += 1) {
+		string *key = (string*)hash_table_get_nth_key(&table, i);
+		int *value = (int*)hash_table_get_nth_value(&table, i);
+	}
+
 	// Reset all entries (but keep allocated memory)
 	hash_table_reset(&table);
-	
+
 	// Free allocated entries in hash table
 	hash_table_destroy(&table);
-	
-	
+
+
 	Limitations:
-		- Key can only be a base type or pointer
+		- Key can only be a base type, string or pointer
+		- String keys are copied into the table, but other keys are compared byte by byte, so
+		  a pointer key is compared by address and not by what it points to.
+		- Removing moves the last entry into the removed entry's place, so if you remove while
+		  iterating, iterate backwards. Pointers to values are only valid until the table is
+		  changed.
 		- Key and value passed to the following function needs to be lvalues (we need to be able to take their addresses with '&'):
 			- hash_table_add
 			- hash_table_find
 			- hash_table_contains
 			- hash_table_set
-			
+			- hash_table_remove
+
 			Example:
-			
+
 			hash_table_set(&table, my_key+5, my_value+3); // ERROR
-			
+
 			int key = my_key+5;
 			int value = my_value+3;
 			hash_table_set(&table, key, value); // OK
-			
+
 
 */
 
@@ -60,159 +78,373 @@ typedef struct Hash_Table Hash_Table;
 
 // API:
 #define make_hash_table_reserve(Key_Type, Value_Type, capacity_count, allocator) \
-	make_hash_table_reserve(sizeof(Key_Type), sizeof(Value_Type), capacity_count, allocator)
-	
+	make_hash_table_reserve_raw(sizeof(Key_Type), sizeof(Value_Type), capacity_count, allocator, _hash_table_key_is_string((Key_Type){0}))
+
 #define make_hash_table(Key_Type, Value_Type, allocator) \
-	make_hash_table_raw(sizeof(Key_Type), sizeof(Value_Type), allocator)
+	make_hash_table_reserve_raw(sizeof(Key_Type), sizeof(Value_Type), 128, allocator, _hash_table_key_is_string((Key_Type){0}))
 
 #define hash_table_add(table_ptr, key, value) \
 	hash_table_add_raw((table_ptr), get_hash(key), &(key), &(value), sizeof(key), sizeof(value))
 
 #define hash_table_find(table_ptr, key) \
-	hash_table_find_raw((table_ptr), get_hash(key))
-	
+	hash_table_find_raw((table_ptr), get_hash(key), &(key), sizeof(key))
+
 #define hash_table_contains(table_ptr, key) \
-	hash_table_contains_raw((table_ptr), get_hash(key))
-	
+	hash_table_contains_raw((table_ptr), get_hash(key), &(key), sizeof(key))
+
 #define hash_table_set(table_ptr, key, value) \
 	hash_table_set_raw((table_ptr), get_hash(key), &key, &value, sizeof(key), sizeof(value))
 
+#define hash_table_remove(table_ptr, key) \
+	hash_table_remove_raw((table_ptr), get_hash(key), &(key), sizeof(key))
+
 void hash_table_reserve(Hash_Table *t, u64 required_count);
 
+#define _hash_table_key_is_string(key) _Generic((key), string: true, default: false)
+
+#define HASH_TABLE_GROUP_SIZE 16
+#define HASH_TABLE_CONTROL_EMPTY   0x80
+#define HASH_TABLE_CONTROL_DELETED 0xFE
+// Rehash when used (valid + deleted) slots go over 7/8
+#define HASH_TABLE_MAX_LOAD_NUMERATOR   7
+#define HASH_TABLE_MAX_LOAD_DENOMINATOR 8
 
 typedef struct Hash_Table {
-	
-	// Each entry is hash-key-value
+
+	// Each entry is hash-key-value, in the order they were added
 	// Hash is sizeof(u64) bytes, key is _key_size bytes and value is _value_size bytes
-	void *entries; 
-	
+	void *entries;
+
 	u64 count; // Number of valid entries
-	u64 capacity_count; // Number of allocated entries
-	
+	u64 capacity_count; // Number of slots, always a power of two
+
 	u64 _key_size;
 	u64 _value_size;
-	
+	u64 _entry_size;
+	u64 _value_offset;
+	bool _key_is_string;
+
+	u8 *_control; // One per slot: 7 bits of hash, HASH_TABLE_CONTROL_EMPTY or HASH_TABLE_CONTROL_DELETED
+	u32 *_slots; // Index into entries for each full slot
+	u64 _deleted_count;
+
 	Allocator allocator;
 } Hash_Table;
 
-Hash_Table make_hash_table_reserve_raw(u64 key_size, u64 value_size, u64 capacity_count, Allocator allocator) {
+inline u64 _hash_table_max_count(u64 capacity_count) {
+	return (capacity_count*HASH_TABLE_MAX_LOAD_NUMERATOR)/HASH_TABLE_MAX_LOAD_DENOMINATOR;
+}
+inline u8 *_hash_table_entry(Hash_Table *t, u64 index) {
+	return (u8*)t->entries + index*t->_entry_size;
+}
+inline u8 _hash_table_h2(u64 hash) {
+	return (u8)(hash & 0x7F);
+}
+inline u64 _hash_table_h1(u64 hash) {
+	return hash >> 7;
+}
+
+// Bit i is set if control[i] == c
+inline u32 _hash_table_group_match(u8 *control, u8 c) {
+#if COMPILER_CAN_DO_SSE2
+	__m128i group = _mm_loadu_si128((__m128i*)control);
+	return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)c)));
+#else
+	u32 mask = 0;
+	for (u32 i = 0; i < HASH_TABLE_GROUP_SIZE; i += 1) {
+		if (control[i] == c) mask |= 1 << i;
+	}
+	return mask;
+#endif
+}
+// Bit i is set if control[i] is empty or deleted
+inline u32 _hash_table_group_match_free(u8 *control) {
+#if COMPILER_CAN_DO_SSE2
+	__m128i group = _mm_loadu_si128((__m128i*)control);
+	return (u32)_mm_movemask_epi8(group); // Empty and deleted both have the high bit set
+#else
+	u32 mask = 0;
+	for (u32 i = 0; i < HASH_TABLE_GROUP_SIZE; i += 1) {
+		if (control[i] & 0x80) mask |= 1 << i;
+	}
+	return mask;
+#endif
+}
 
-	capacity_count = min(capacity_count, 8);
+inline bool _hash_table_keys_match(Hash_Table *t, void *a, void *b) {
+	if (t->_key_is_string) return strings_match(*(string*)a, *(string*)b);
+	return bytes_match(a, b, t->_key_size);
+}
+
+// Allocates control bytes, slots and room for entries for capacity_count slots
+void _hash_table_allocate(Hash_Table *t, u64 capacity_count) {
+	u64 control_size = capacity_count;
+	u64 slots_size = capacity_count*sizeof(u32);
+	u64 entries_size = _hash_table_max_count(capacity_count)*t->_entry_size;
+
+	// Groups are loaded unaligned, so this works with allocators that can't do aligned allocations
+	u8 *memory = (u8*)alloc_uninitialized(t->allocator, control_size+slots_size+entries_size);
+	t->_control = memory;
+	t->_slots = (u32*)(memory + control_size);
+	t->entries = memory + control_size + slots_size;
+	t->capacity_count = capacity_count;
+
+	memset(t->_control, HASH_TABLE_CONTROL_EMPTY, control_size);
+	t->_deleted_count = 0;
+}
+
+// Returns the slot which would hold hash, which is the first free one in its probe sequence
+u64 _hash_table_find_free_slot(Hash_Table *t, u64 hash) {
+	u64 group_mask = t->capacity_count/HASH_TABLE_GROUP_SIZE - 1;
+	u64 group = _hash_table_h1(hash) & group_mask;
+	for (u64 probe = 1; ; probe += 1) {
+		u8 *control = t->_control + group*HASH_TABLE_GROUP_SIZE;
+		u32 free = _hash_table_group_match_free(control);
+		if (free) return group*HASH_TABLE_GROUP_SIZE + bit_scan_forward_64(free);
+		// Triangular numbers visit every group when the group count is a power of two
+		group = (group + probe) & group_mask;
+	}
+}
+
+// Points the slots at the entries again, for after the slot arrays changed size or were cleared
+void _hash_table_rebuild_slots(Hash_Table *t) {
+	for (u64 i = 0; i < t->count; i += 1) {
+		u64 hash = *(u64*)_hash_table_entry(t, i);
+		u64 slot = _hash_table_find_free_slot(t, hash);
+		t->_control[slot] = _hash_table_h2(hash);
+		t->_slots[slot] = (u32)i;
+	}
+}
+
+void _hash_table_rehash(Hash_Table *t, u64 capacity_count) {
+	assert(_hash_table_max_count(capacity_count) >= t->count, "Hash table rehash to a capacity too small for its entries");
+	assert(_hash_table_max_count(capacity_count) <= UINT32_MAX, "Hash table too large");
+
+	u8 *old_memory = t->_control;
+	void *old_entries = t->entries;
+
+	_hash_table_allocate(t, capacity_count);
+
+	if (old_memory) {
+		// We kept the hashes so we don't need to hash the keys again
+		memcpy(t->entries, old_entries, t->count*t->_entry_size);
+		dealloc(t->allocator, old_memory);
+	}
+
+	_hash_table_rebuild_slots(t);
+}
+
+Hash_Table make_hash_table_reserve_raw(u64 key_size, u64 value_size, u64 capacity_count, Allocator allocator, bool key_is_string) {
 
 	Hash_Table t = ZERO(Hash_Table);
-	
+
 	t._key_size = key_size;
 	t._value_size = value_size;
+	t._key_is_string = key_is_string;
+	t._value_offset = align_next(sizeof(u64)+key_size, sizeof(u64));
+	t._entry_size = align_next(t._value_offset+value_size, sizeof(u64));
 	t.allocator = allocator;
-	
-	u64 entry_size = value_size+sizeof(u64);
-	t.entries = alloc(t.allocator, entry_size*capacity_count);
-	memset(t.entries, 0, entry_size*capacity_count);
-	t.capacity_count = capacity_count;
-	
+
+	// Enough slots that capacity_count entries fit without a rehash
+	u64 slot_count = get_next_power_of_two((capacity_count*HASH_TABLE_MAX_LOAD_DENOMINATOR)/HASH_TABLE_MAX_LOAD_NUMERATOR + 1);
+	slot_count = max(slot_count, HASH_TABLE_GROUP_SIZE);
+	_hash_table_allocate(&t, slot_count);
+
 	return t;
 }
 inline Hash_Table make_hash_table_raw(u64 key_size, u64 value_size, Allocator allocator) {
-	return make_hash_table_reserve_raw(key_size, value_size, 128, allocator);
+	return make_hash_table_reserve_raw(key_size, value_size, 128, allocator, false);
+}
+
+void _hash_table_free_keys(Hash_Table *t) {
+	if (!t->_key_is_string) return;
+	for (u64 i = 0; i < t->count; i += 1) {
+		string *key = (string*)(_hash_table_entry(t, i) + sizeof(u64));
+		if (key->count) dealloc_string(t->allocator, *key);
+	}
 }
 
 void hash_table_reset(Hash_Table *t) {
+	_hash_table_free_keys(t);
 	t->count = 0;
+	t->_deleted_count = 0;
+	if (t->_control) memset(t->_control, HASH_TABLE_CONTROL_EMPTY, t->capacity_count);
 }
 void hash_table_destroy(Hash_Table *t) {
-	dealloc(t->allocator, t->entries);
-	
+	_hash_table_free_keys(t);
+	if (t->_control) dealloc(t->allocator, t->_control);
+
 	t->entries = 0;
+	t->_control = 0;
+	t->_slots = 0;
 	t->count = 0;
 	t->capacity_count = 0;
+	t->_deleted_count = 0;
 }
 
 void hash_table_reserve(Hash_Table *t, u64 required_count) {
-	u64 entry_size = t->_value_size+sizeof(u64);
-	
-	u64 required_size = required_count*entry_size;
-	
-	u64 current_size = t->capacity_count*entry_size;
-	
-	if (current_size >= required_size) return;
-	
-	u64 new_count = get_next_power_of_two(required_count);
-	u64 new_size = new_count*entry_size;
-	
-	void *new_entries = alloc(t->allocator, new_size);
-	memcpy(new_entries, t->entries, current_size);
-	
-	dealloc(t->allocator, t->entries);
-	
-	t->entries = new_entries;
-	t->capacity_count = new_count;
-}
-
-// This can add multiple entries of same hash, beware!
+
+	if (_hash_table_max_count(t->capacity_count) >= required_count) return;
+
+	u64 new_count = get_next_power_of_two((required_count*HASH_TABLE_MAX_LOAD_DENOMINATOR)/HASH_TABLE_MAX_LOAD_NUMERATOR + 1);
+	new_count = max(new_count, HASH_TABLE_GROUP_SIZE);
+
+	_hash_table_rehash(t, new_count);
+}
+
+// Returns the slot with the entry for key, or -1
+s64 _hash_table_find_slot(Hash_Table *t, u64 hash, void *k) {
+	if (!t->_control) return -1;
+
+	u64 group_mask = t->capacity_count/HASH_TABLE_GROUP_SIZE - 1;
+	u64 group = _hash_table_h1(hash) & group_mask;
+	u8 h2 = _hash_table_h2(hash);
+
+	for (u64 probe = 1; probe <= group_mask+1; probe += 1) {
+		u8 *control = t->_control + group*HASH_TABLE_GROUP_SIZE;
+
+		u32 match = _hash_table_group_match(control, h2);
+		while (match) {
+			u64 slot = group*HASH_TABLE_GROUP_SIZE + bit_scan_forward_64(match);
+			u8 *entry = _hash_table_entry(t, t->_slots[slot]);
+			if (*(u64*)entry == hash && _hash_table_keys_match(t, entry+sizeof(u64), k)) {
+				return (s64)slot;
+			}
+			match &= match-1;
+		}
+
+		// An empty slot means the key would have been put here, so it's not in the table
+		if (_hash_table_group_match(control, HASH_TABLE_CONTROL_EMPTY)) return -1;
+
+		group = (group + probe) & group_mask;
+	}
+	return -1;
+}
+
+// Returns the slot pointing at entry index
+u64 _hash_table_find_slot_of_entry(Hash_Table *t, u64 hash, u64 index) {
+	u64 group_mask = t->capacity_count/HASH_TABLE_GROUP_SIZE - 1;
+	u64 group = _hash_table_h1(hash) & group_mask;
+	u8 h2 = _hash_table_h2(hash);
+	for (u64 probe = 1; probe <= group_mask+1; probe += 1) {
+		u32 match = _hash_table_group_match(t->_control + group*HASH_TABLE_GROUP_SIZE, h2);
+		while (match) {
+			u64 slot = group*HASH_TABLE_GROUP_SIZE + bit_scan_forward_64(match);
+			if (t->_slots[slot] == index) return slot;
+			match &= match-1;
+		}
+		group = (group + probe) & group_mask;
+	}
+	assert(false, "Internal hash table error: Entry has no slot");
+	return 0;
+}
+
+// This can add multiple entries of same key, beware!
 void hash_table_add_raw(Hash_Table *t, u64 hash, void *k, void *v, u64 key_size, u64 value_size) {
 
 	assert(t->_key_size == key_size, "Key type size does not match hash table initted key type size");
 	assert(t->_value_size == value_size, "Value type size does not match hash table initted value type size");
 
-	hash_table_reserve(t, t->count+1);
-	
-	u64 entry_size = t->_value_size+sizeof(u64);
-	
-	u64 index = entry_size*t->count;
+	if (t->count + t->_deleted_count + 1 > _hash_table_max_count(t->capacity_count)) {
+		// If it's mostly tombstones we can just clean them up instead of growing
+		if (t->count + 1 <= _hash_table_max_count(t->capacity_count)/2) {
+			_hash_table_rehash(t, t->capacity_count);
+		} else {
+			hash_table_reserve(t, max(t->count + 1, t->capacity_count));
+		}
+	}
+
+	u64 slot = _hash_table_find_free_slot(t, hash);
+	if (t->_control[slot] == HASH_TABLE_CONTROL_DELETED) t->_deleted_count -= 1;
+	t->_control[slot] = _hash_table_h2(hash);
+	t->_slots[slot] = (u32)t->count;
+
+	u8 *entry = _hash_table_entry(t, t->count);
 	t->count += 1;
-	
-	u64 hash_offset = 0;
-	u64 value_offset = hash_offset + sizeof(u64);
-	
-	memcpy((u8*)t->entries+index+hash_offset,  &hash, sizeof(u64));
-	memcpy((u8*)t->entries+index+value_offset, v,     value_size);
+
+	memcpy(entry, &hash, sizeof(u64));
+	if (t->_key_is_string) {
+		string key = *(string*)k;
+		string key_copy = key.count ? string_copy(key, t->allocator) : ZERO(string);
+		memcpy(entry+sizeof(u64), &key_copy, sizeof(string));
+	} else {
+		memcpy(entry+sizeof(u64), k, key_size);
+	}
+	memcpy(entry+t->_value_offset, v, value_size);
 }
 
-void *hash_table_find_raw(Hash_Table *t, u64 hash) {
+void *hash_table_find_raw(Hash_Table *t, u64 hash, void *k, u64 key_size) {
+	assert(t->_key_size == key_size, "Key type size does not match hash table initted key type size");
 
-	// #Speed #Incomplete
-	// Do quadratic probe 'triangular numbers'
+	s64 slot = _hash_table_find_slot(t, hash, k);
+	if (slot < 0) return 0;
 
-	u64 entry_size = t->_value_size+sizeof(u64);
-	u64 hash_offset = 0;
-	u64 value_offset = hash_offset + sizeof(u64);
-	
-	for (u64 i = 0; i < t->count; i += 1) {
-		u64 existing_hash = *(u64*)((u8*)t->entries+i*entry_size+hash_offset);
-		if (existing_hash == hash) {
-			void *value = ((u8*)t->entries+i*entry_size+value_offset);
-			return value;
-		}
-	}
-	return 0;
+	return _hash_table_entry(t, t->_slots[slot]) + t->_value_offset;
 }
 
 void *hash_table_get_nth_value(Hash_Table *t, u64 n) {
 	assert(n < t->count, "Hash table n is out of range");
-	
-	u64 entry_size = t->_value_size+sizeof(u64);
-	u64 hash_offset = 0;
-	u64 value_offset = hash_offset + sizeof(u64);
-	
-	return (u8*)t->entries+entry_size*n+value_offset;
+
+	return _hash_table_entry(t, n) + t->_value_offset;
 }
+void *hash_table_get_nth_key(Hash_Table *t, u64 n) {
+	assert(n < t->count, "Hash table n is out of range");
 
-bool hash_table_contains_raw(Hash_Table *t, u64 hash) {
-	return hash_table_find_raw(t, hash) != 0;
+	return _hash_table_entry(t, n) + sizeof(u64);
+}
+
+bool hash_table_contains_raw(Hash_Table *t, u64 hash, void *k, u64 key_size) {
+	return hash_table_find_raw(t, hash, k, key_size) != 0;
 }
 
 // Returns true if key was newly added or false if it already existed
 bool hash_table_set_raw(Hash_Table *t, u64 hash, void *k, void *v, u64 key_size, u64 value_size) {
-	bool newly_added = true;
-	
-	if (hash_table_contains_raw(t, hash)) newly_added = false;
-	
-	if (newly_added) {
-		hash_table_add_raw(t, hash, k, v, key_size, value_size);
-	} else {
-		memcpy(hash_table_find_raw(t, hash), v, value_size);
+	assert(t->_value_size == value_size, "Value type size does not match hash table initted value type size");
+
+	void *existing = hash_table_find_raw(t, hash, k, key_size);
+
+	if (existing) {
+		memcpy(existing, v, value_size);
+		return false;
 	}
-	
-	return newly_added;
+
+	hash_table_add_raw(t, hash, k, v, key_size, value_size);
+	return true;
 }
 
+// Returns true if key was in the table
+bool hash_table_remove_raw(Hash_Table *t, u64 hash, void *k, u64 key_size) {
+	assert(t->_key_size == key_size, "Key type size does not match hash table initted key type size");
+
+	s64 slot = _hash_table_find_slot(t, hash, k);
+	if (slot < 0) return false;
+
+	u64 index = t->_slots[slot];
+	u8 *entry = _hash_table_entry(t, index);
+	if (t->_key_is_string) {
+		string key = *(string*)(entry+sizeof(u64));
+		if (key.count) dealloc_string(t->allocator, key);
+	}
+
+	// If the group still has an empty slot then no probe ever went past it, so we can make
+	// this slot empty too. Otherwise leave a tombstone so probes keep going.
+	u8 *group_control = t->_control + (slot & ~(u64)(HASH_TABLE_GROUP_SIZE-1));
+	if (_hash_table_group_match(group_control, HASH_TABLE_CONTROL_EMPTY)) {
+		t->_control[slot] = HASH_TABLE_CONTROL_EMPTY;
+	} else {
+		t->_control[slot] = HASH_TABLE_CONTROL_DELETED;
+		t->_deleted_count += 1;
+	}
+
+	// Keep entries dense by moving the last one into the hole
+	u64 last = t->count-1;
+	if (index != last) {
+		u8 *last_entry = _hash_table_entry(t, last);
+		u64 last_slot = _hash_table_find_slot_of_entry(t, *(u64*)last_entry, last);
+		t->_slots[last_slot] = (u32)index;
+		memcpy(entry, last_entry, t->_entry_size);
+	}
+	t->count -= 1;
+
+	return true;
+}
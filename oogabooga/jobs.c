@@ -0,0 +1,480 @@
+
+// Job system
+// A worker thread per logical processor (the thread that inits the job system counts as one)
+// running jobs from per-worker work-stealing deques (Chase-Lev).
+// Jobs are pushed and popped at the bottom of the deque of the thread that spawned them, so
+// they mostly run where their data is still in cache. Idle workers steal from the top of other
+// deques, which is where the oldest and usually biggest jobs are.
+// Waiting on a Job_Counter runs jobs while waiting, so nothing deadlocks waiting on a job
+// which is queued behind it.
+
+/*
+
+	Example Usage:
+
+	void update_thing(void *data) {
+		Thing *thing = (Thing*)data;
+		...
+	}
+
+	// Counters count jobs in flight. Zero initialize them.
+	Job_Counter counter = ZERO(Job_Counter);
+	for (u64 i = 0; i < thing_count; i += 1) {
+		job_run(update_thing, &things[i], &counter);
+	}
+	job_wait(&counter);
+
+	// Jobs can wait for other jobs to finish before they start
+	Job_Counter done = ZERO(Job_Counter);
+	job_run_after(&counter, finish_things, things, &done);
+	job_wait(&done);
+
+	// Split up a range into chunks of grain items. Returns when all of it is done.
+	void update_range(u64 first, u64 end, void *data) {
+		for (u64 i = first; i < end; i += 1) ...
+	}
+	parallel_for(thing_count, 256, update_range, things);
+
+	// Per-thread data can be indexed with job_get_worker_index(), which is 0 for the thread that
+	// called job_system_init() and < job_get_worker_count() for all workers.
+
+	Limitations:
+		- Workers reset their temporary storage when they run out of jobs, so don't give back
+		  talloc'd memory from a job.
+		- A Job_Counter needs to stay alive until job_wait() on it has returned.
+		- If a deque is full the job runs right away on the thread that pushed it.
+*/
+
+#ifndef JOB_DEQUE_CAPACITY_LOG2
+	#define JOB_DEQUE_CAPACITY_LOG2 12
+#endif
+#define JOB_DEQUE_CAPACITY (1LL << JOB_DEQUE_CAPACITY_LOG2)
+
+#define JOB_MAX_WORKERS 64
+
+// How many times an idle worker looks for work before it goes to sleep
+#ifndef JOB_SPIN_COUNT
+	#define JOB_SPIN_COUNT 4000
+#endif
+
+typedef void(*Job_Proc)(void *data);
+typedef void(*Parallel_For_Proc)(u64 first, u64 end, void *data);
+
+typedef struct Job_Dependent Job_Dependent;
+
+typedef struct Job_Counter {
+	volatile u64 count;
+	Spinlock lock; // Held while adding dependents, and while the count goes to 0
+	Job_Dependent *dependents;
+} Job_Counter;
+
+typedef struct Job {
+	Job_Proc proc;
+	void *data;
+	Job_Counter *counter;
+} Job;
+
+typedef struct Job_Dependent {
+	Job job;
+	Job_Dependent *next;
+} Job_Dependent;
+
+// Only the owner pushes and pops at the bottom. Anyone can steal from the top.
+typedef struct Job_Deque {
+	alignat(CACHE_LINE_SIZE) volatile s64 top;
+	alignat(CACHE_LINE_SIZE) volatile s64 bottom;
+	alignat(CACHE_LINE_SIZE) Job jobs[JOB_DEQUE_CAPACITY];
+} Job_Deque;
+
+typedef struct Job_Worker {
+	Job_Deque deque;
+	Thread thread;
+	Binary_Semaphore wake_semaphore;
+	u64 index;
+	u64 random_state; // For picking who to steal from
+	alignat(CACHE_LINE_SIZE) volatile bool sleeping;
+} Job_Worker;
+
+typedef struct Job_System {
+	Job_Worker *workers; // 0 is the thread that called job_system_init(), it has no Thread
+	u64 worker_count;
+
+	// Jobs pushed from threads that don't have a deque
+	Spinlock injected_lock;
+	Job *injected;
+	volatile u64 injected_count;
+	u64 injected_capacity;
+
+	volatile u64 sleeping_count;
+	volatile bool running;
+	bool initted;
+} Job_System;
+
+// #Global
+ogb_instance Job_System job_system;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Job_System job_system = {0};
+thread_local s64 job_worker_index = -1;
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+///
+// Deque
+
+// Owner only. Returns false if full.
+bool job_deque_push(Job_Deque *d, Job job) {
+	s64 b = d->bottom;
+	s64 t = d->top;
+	if (b - t >= JOB_DEQUE_CAPACITY) return false;
+
+	d->jobs[b & (JOB_DEQUE_CAPACITY-1)] = job;
+	atomic_store_release_64((volatile u64*)&d->bottom, (u64)(b + 1));
+	return true;
+}
+// Owner only
+bool job_deque_pop(Job_Deque *d, Job *job) {
+	s64 b = d->bottom - 1;
+	d->bottom = b;
+	atomic_full_fence(); // Thieves need to see the new bottom before we look at top
+	s64 t = d->top;
+
+	if (t > b) {
+		d->bottom = b + 1;
+		return false;
+	}
+
+	*job = d->jobs[b & (JOB_DEQUE_CAPACITY-1)];
+	if (t == b) {
+		// Last one, race the thieves for it
+		bool won = compare_and_swap_64((volatile u64*)&d->top, (u64)(t+1), (u64)t);
+		d->bottom = b + 1;
+		return won;
+	}
+	return true;
+}
+bool job_deque_steal(Job_Deque *d, Job *job) {
+	s64 t = (s64)atomic_load_acquire_64((volatile u64*)&d->top);
+	s64 b = (s64)atomic_load_acquire_64((volatile u64*)&d->bottom);
+	if (t >= b) return false;
+
+	*job = d->jobs[t & (JOB_DEQUE_CAPACITY-1)];
+	return compare_and_swap_64((volatile u64*)&d->top, (u64)(t+1), (u64)t);
+}
+
+///
+// Running jobs
+
+bool job_find(Job *job) {
+	s64 self = job_worker_index;
+
+	if (self >= 0 && job_deque_pop(&job_system.workers[self].deque, job)) return true;
+
+	if (job_system.injected_count) {
+		bool found = false;
+		spinlock_acquire_or_wait(&job_system.injected_lock);
+		if (job_system.injected_count) {
+			job_system.injected_count -= 1;
+			*job = job_system.injected[job_system.injected_count];
+			found = true;
+		}
+		spinlock_release(&job_system.injected_lock);
+		if (found) return true;
+	}
+
+	// Start at a random worker so thieves spread out
+	u64 start = 0;
+	if (self >= 0) {
+		u64 *state = &job_system.workers[self].random_state;
+		*state ^= *state << 13;
+		*state ^= *state >> 7;
+		*state ^= *state << 17;
+		start = *state;
+	}
+	for (u64 i = 0; i < job_system.worker_count; i += 1) {
+		u64 victim = (start + i) % job_system.worker_count;
+		if ((s64)victim == self) continue;
+		if (job_deque_steal(&job_system.workers[victim].deque, job)) return true;
+	}
+
+	return false;
+}
+
+void job_push(Job job);
+
+void job_counter_decrement(Job_Counter *c) {
+	while (true) {
+		u64 count = c->count;
+		assert(count > 0, "Job_Counter went below zero");
+
+		if (count == 1) {
+			// Going to 0, so the dependents can run. job_wait() waits for the lock too, so the
+			// counter stays alive until we're done with it.
+			spinlock_acquire_or_wait(&c->lock);
+			Job_Dependent *dependents = c->dependents;
+			if (compare_and_swap_64(&c->count, 0, 1)) {
+				c->dependents = 0;
+				spinlock_release(&c->lock);
+				while (dependents) {
+					Job_Dependent *next = dependents->next;
+					job_push(dependents->job);
+					dealloc(get_heap_allocator(), dependents);
+					dependents = next;
+				}
+				return;
+			}
+			spinlock_release(&c->lock);
+			continue; // Someone added a job while we weren't looking
+		}
+
+		if (compare_and_swap_64(&c->count, count-1, count)) return;
+	}
+}
+
+void job_execute(Job job) {
+	job.proc(job.data);
+	if (job.counter) job_counter_decrement(job.counter);
+}
+
+void job_wake_one() {
+	atomic_full_fence(); // Sleepers need to see the job we just pushed, or we need to see them
+	if (!job_system.sleeping_count) return;
+
+	for (u64 i = 1; i < job_system.worker_count; i += 1) {
+		Job_Worker *w = &job_system.workers[i];
+		if (w->sleeping && compare_and_swap_bool(&w->sleeping, false, true)) {
+			atomic_fetch_add_64(&job_system.sleeping_count, (u64)-1);
+			os_binary_semaphore_signal(&w->wake_semaphore);
+			return;
+		}
+	}
+}
+
+void job_push(Job job) {
+	s64 self = job_worker_index;
+	if (self >= 0) {
+		if (!job_deque_push(&job_system.workers[self].deque, job)) {
+			job_execute(job);
+			return;
+		}
+	} else {
+		spinlock_acquire_or_wait(&job_system.injected_lock);
+		if (job_system.injected_count >= job_system.injected_capacity) {
+			u64 new_capacity = max(job_system.injected_capacity*2, 64);
+			job_system.injected = (Job*)reallocate(get_heap_allocator(), job_system.injected, job_system.injected_capacity*sizeof(Job), new_capacity*sizeof(Job));
+			job_system.injected_capacity = new_capacity;
+		}
+		job_system.injected[job_system.injected_count] = job;
+		job_system.injected_count += 1;
+		spinlock_release(&job_system.injected_lock);
+	}
+
+	job_wake_one();
+}
+
+void job_worker_sleep(Job_Worker *w) {
+	w->sleeping = true;
+	atomic_fetch_add_64(&job_system.sleeping_count, 1); // Also the barrier before we look again
+
+	Job job;
+	bool found = job_system.running ? job_find(&job) : false;
+	if (found || !job_system.running) {
+		if (compare_and_swap_bool(&w->sleeping, false, true)) {
+			atomic_fetch_add_64(&job_system.sleeping_count, (u64)-1);
+		} else {
+			// Someone is already waking us, eat the signal
+			os_binary_semaphore_wait(&w->wake_semaphore);
+		}
+		if (found) job_execute(job);
+		return;
+	}
+
+	os_binary_semaphore_wait(&w->wake_semaphore);
+}
+
+void job_worker_proc(Thread *t) {
+	Job_Worker *w = (Job_Worker*)t->data;
+	job_worker_index = (s64)w->index;
+
+	u64 misses = 0;
+	while (job_system.running) {
+		Job job;
+		if (job_find(&job)) {
+			job_execute(job);
+			misses = 0;
+			continue;
+		}
+
+		misses += 1;
+		if (misses % 64 == 0) os_yield_thread();
+		if (misses < JOB_SPIN_COUNT) continue;
+
+		// Out of work, so nothing can be using our temporary storage
+		reset_temporary_storage();
+		job_worker_sleep(w);
+		misses = 0;
+	}
+}
+
+///
+// API
+
+// thread_count includes the calling thread. 0 means one per logical processor.
+void job_system_init(u64 thread_count) {
+	assert(!job_system.initted, "Job system was already initialized");
+
+	if (thread_count == 0) thread_count = os_get_number_of_logical_processors();
+	thread_count = clamp(thread_count, 1, JOB_MAX_WORKERS);
+
+	job_system.workers = (Job_Worker*)alloc_aligned(get_heap_allocator(), thread_count*sizeof(Job_Worker), CACHE_LINE_SIZE);
+	job_system.worker_count = thread_count;
+	job_system.running = true;
+	job_system.initted = true;
+	spinlock_init(&job_system.injected_lock);
+
+	job_worker_index = 0;
+
+	for (u64 i = 0; i < thread_count; i += 1) {
+		Job_Worker *w = &job_system.workers[i];
+		w->index = i;
+		w->random_state = rdtsc() + i*0x9E3779B97F4A7C15ULL;
+		if (!w->random_state) w->random_state = 1;
+		if (i == 0) continue;
+
+		os_binary_semaphore_init(&w->wake_semaphore, false);
+		os_thread_init(&w->thread, job_worker_proc);
+		w->thread.data = w;
+		w->thread.temporary_storage_size = TEMPORARY_STORAGE_SIZE;
+		os_thread_start(&w->thread);
+	}
+}
+
+// Waits for the workers to run out of jobs and stops them
+void job_system_shutdown() {
+	if (!job_system.initted) return;
+
+	Job job;
+	while (job_find(&job)) job_execute(job);
+
+	job_system.running = false;
+	atomic_full_fence();
+
+	for (u64 i = 1; i < job_system.worker_count; i += 1) {
+		Job_Worker *w = &job_system.workers[i];
+		if (compare_and_swap_bool(&w->sleeping, false, true)) {
+			os_binary_semaphore_signal(&w->wake_semaphore);
+		}
+	}
+	for (u64 i = 1; i < job_system.worker_count; i += 1) {
+		Job_Worker *w = &job_system.workers[i];
+		os_thread_join(&w->thread);
+		os_thread_destroy(&w->thread);
+		os_binary_semaphore_destroy(&w->wake_semaphore);
+	}
+
+	dealloc(get_heap_allocator(), job_system.workers);
+	if (job_system.injected) dealloc(get_heap_allocator(), job_system.injected);
+	job_system = ZERO(Job_System);
+	job_worker_index = -1;
+}
+
+// counter can be 0 if you don't need to wait for it
+void job_run(Job_Proc proc, void *data, Job_Counter *counter) {
+	if (!job_system.initted) job_system_init(0);
+
+	if (counter) atomic_fetch_add_64(&counter->count, 1);
+
+	Job job;
+	job.proc = proc;
+	job.data = data;
+	job.counter = counter;
+	job_push(job);
+}
+
+// Runs the job when dependency gets to 0. Runs it right away if it already is.
+void job_run_after(Job_Counter *dependency, Job_Proc proc, void *data, Job_Counter *counter) {
+	if (!job_system.initted) job_system_init(0);
+
+	if (counter) atomic_fetch_add_64(&counter->count, 1);
+
+	Job job;
+	job.proc = proc;
+	job.data = data;
+	job.counter = counter;
+
+	spinlock_acquire_or_wait(&dependency->lock);
+	if (dependency->count == 0) {
+		spinlock_release(&dependency->lock);
+		job_push(job);
+		return;
+	}
+	Job_Dependent *dependent = (Job_Dependent*)alloc_uninitialized(get_heap_allocator(), sizeof(Job_Dependent));
+	dependent->job = job;
+	dependent->next = dependency->dependents;
+	dependency->dependents = dependent;
+	spinlock_release(&dependency->lock);
+}
+
+// Runs other jobs until everything counted by counter is done
+void job_wait(Job_Counter *counter) {
+	u64 misses = 0;
+	while (counter->count || counter->lock.locked) {
+		Job job;
+		if (job_system.initted && job_find(&job)) {
+			job_execute(job);
+			misses = 0;
+		} else {
+			misses += 1;
+			if (misses % 64 == 0) os_yield_thread();
+		}
+	}
+}
+
+s64 job_get_worker_index() {
+	return job_worker_index;
+}
+u64 job_get_worker_count() {
+	if (!job_system.initted) job_system_init(0);
+	return job_system.worker_count;
+}
+
+typedef struct Parallel_For {
+	Parallel_For_Proc proc;
+	void *data;
+	u64 count;
+	u64 grain;
+	alignat(CACHE_LINE_SIZE) volatile u64 next;
+} Parallel_For;
+
+void parallel_for_job(void *data) {
+	Parallel_For *p = (Parallel_For*)data;
+	while (true) {
+		u64 first = atomic_fetch_add_64(&p->next, p->grain);
+		if (first >= p->count) break;
+		p->proc(first, min(first+p->grain, p->count), p->data);
+	}
+}
+
+// Calls proc on chunks of grain items until count items are done, on as many threads as there
+// are chunks. Chunks are handed out one at a time so uneven chunks balance out.
+void parallel_for(u64 count, u64 grain, Parallel_For_Proc proc, void *data) {
+	if (count == 0) return;
+	if (!job_system.initted) job_system_init(0);
+
+	grain = max(grain, 1);
+
+	Parallel_For p = ZERO(Parallel_For);
+	p.proc = proc;
+	p.data = data;
+	p.count = count;
+	p.grain = grain;
+
+	u64 chunk_count = (count+grain-1)/grain;
+	u64 helper_count = min(chunk_count, job_system.worker_count) - 1;
+
+	Job_Counter counter = ZERO(Job_Counter);
+	for (u64 i = 0; i < helper_count; i += 1) {
+		job_run(parallel_for_job, &p, &counter);
+	}
+	parallel_for_job(&p);
+	job_wait(&counter);
+}
@@ -14,6 +14,9 @@ u8 *init_memory_head = init_memory_arena;
 
 void* initialization_allocator_proc(u64 size, void *p, Allocator_Message message, void *data) {
 	switch (message) {
+		case ALLOCATOR_ALLOCATE_ALIGNED: {
+			init_memory_head = (u8*)align_next((u64)init_memory_head, (u64)p);
+		} // fallthrough
 		case ALLOCATOR_ALLOCATE: {
 			p = init_memory_head;
 			init_memory_head += size;
@@ -38,35 +41,61 @@ void* initialization_allocator_proc(u64 size, void *p, Allocator_Message message
 Allocator get_initialization_allocator() {
 	Allocator a;
 	a.proc = initialization_allocator_proc;
+	a.data = 0;
 	return a;
 }
 
 ///
 ///
-// Basic general heap allocator, free list
+// Basic general heap allocator, segregated fit
 ///
-// Technically thread safe but synchronization is horrible.
-// Fragmentation is catastrophic.
-// We could fix it by merging free nodes every now and then
-// BUT: We aren't really supposed to allocate/deallocate directly on the heap too much anyways...
+// Free chunks are kept in segregated free lists, indexed by a two-level size class:
+// first by power of two, then by HEAP_SL_COUNT linear subdivisions of that power of two.
+// Each level has a bitmap of which lists are non-empty, so finding a list with a chunk
+// that fits is a couple of bit scans. Both heap_alloc and heap_dealloc are O(1).
+//
+// Freed chunks are merged with their neighbours right away. Every free chunk keeps its
+// size in its last 8 bytes, so a chunk can find its previous neighbour if that one is free.
+//
+// Technically thread safe but synchronization is still one big lock.
 
 #define MAX_HEAP_BLOCK_SIZE align_next(MB(500), os.page_size)
 #define DEFAULT_HEAP_BLOCK_SIZE (min(MAX_HEAP_BLOCK_SIZE, program_memory_capacity))
-#define HEAP_ALIGNMENT (sizeof(Heap_Free_Node))
+#define HEAP_ALIGNMENT 16
+
+// Second level: number of linear subdivisions per power of two
+#define HEAP_SL_COUNT_LOG2 4
+#define HEAP_SL_COUNT (1 << HEAP_SL_COUNT_LOG2)
+// Chunks smaller than this all go in the first power of two class, in steps of HEAP_ALIGNMENT
+#define HEAP_FL_SHIFT (HEAP_SL_COUNT_LOG2 + 4)
+#define HEAP_SMALL_CHUNK_SIZE (1ULL << HEAP_FL_SHIFT)
+// First level: number of power of two classes. Fits chunks up to 512GB.
+#define HEAP_FL_COUNT 32
+
+// Flags stored in the lowest bits of Heap_Allocation_Metadata.size
+#define HEAP_CHUNK_FREE      1ULL
+#define HEAP_CHUNK_PREV_FREE 2ULL
+#define HEAP_CHUNK_LARGE     4ULL // Not in a heap block, see heap_alloc_large
+#define HEAP_CHUNK_ZEROED    8ULL // Free chunk is all zero except its Heap_Free_Node and footer
+#define HEAP_CHUNK_FLAGS     (HEAP_CHUNK_FREE | HEAP_CHUNK_PREV_FREE | HEAP_CHUNK_LARGE | HEAP_CHUNK_ZEROED)
+// Index of the thread cache that owns an allocated chunk is stored in the highest bits. 0 means none.
+#define HEAP_CHUNK_OWNER_SHIFT 48
+// Allocation tag for heap instrumentation is stored below that, see heap_get_tag().
+#define HEAP_CHUNK_TAG_SHIFT 40
+#define HEAP_CHUNK_TAG_MASK (0xFFULL << HEAP_CHUNK_TAG_SHIFT)
+#define HEAP_CHUNK_SIZE_MASK (((1ULL << HEAP_CHUNK_TAG_SHIFT)-1) & ~HEAP_CHUNK_FLAGS)
+
 typedef struct Heap_Free_Node Heap_Free_Node;
 typedef struct Heap_Block Heap_Block;
 
-typedef struct Heap_Free_Node {
-	u64 size;
-	Heap_Free_Node *next;
-} Heap_Free_Node;
-
 typedef struct Heap_Block {
 	u64 size;
-	Heap_Free_Node *free_head;
-	void* start;
+	void *start; // First chunk
+	void *end; // Sentinel chunk which is never allocated or merged
 	Heap_Block *next;
-	// 32 bytes !!
+	u64 idle_checks; // How many heap_decommit_idle_blocks() the block has been completely free for
+	bool decommitted;
+	// 48 bytes !!
 #if CONFIGURATION == DEBUG
 	u64 total_allocated;
 	u64 padding;
@@ -74,8 +103,11 @@ typedef struct Heap_Block {
 } Heap_Block;
 
 #define HEAP_META_SIGNATURE 6969694206942069ull
+#define HEAP_FREE_SIGNATURE 4206942069696969ull
+#define HEAP_CACHED_SIGNATURE 6942069696942069ull
+// Every chunk, allocated or free, starts with this.
 typedef alignat(16) struct Heap_Allocation_Metadata {
-	u64 size;
+	u64 size; // Whole chunk including metadata. Lowest bits are HEAP_CHUNK_xxx flags.
 	Heap_Block *block;
 #if CONFIGURATION == DEBUG
 	u64 signature;
@@ -83,15 +115,33 @@ typedef alignat(16) struct Heap_Allocation_Metadata {
 #endif
 } Heap_Allocation_Metadata;
 
+typedef struct Heap_Free_Node {
+	Heap_Allocation_Metadata meta;
+	Heap_Free_Node *next;
+	Heap_Free_Node *previous;
+	// ...
+	// u64 size; at the very end of the chunk
+} Heap_Free_Node;
+
+#define HEAP_MIN_CHUNK_SIZE align_next(sizeof(Heap_Free_Node)+sizeof(u64), HEAP_ALIGNMENT)
+
+typedef struct Heap_Free_Lists {
+	u32 fl_bitmap;
+	u32 sl_bitmaps[HEAP_FL_COUNT];
+	Heap_Free_Node *heads[HEAP_FL_COUNT][HEAP_SL_COUNT];
+} Heap_Free_Lists;
+
 // #Global
 ogb_instance Heap_Block *heap_head;
 ogb_instance bool heap_initted;
 ogb_instance Spinlock heap_lock;
+ogb_instance Heap_Free_Lists heap_free_lists;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 Heap_Block *heap_head;
 bool heap_initted = false;
 Spinlock heap_lock;
+Heap_Free_Lists heap_free_lists;
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 	
 
@@ -113,8 +163,141 @@ bool is_pointer_in_stack(void* p) {
 bool is_pointer_in_static_memory(void* p) {
     return (uintptr_t)p >= (uintptr_t)os.static_memory_start && (uintptr_t)p < (uintptr_t)os.static_memory_end;
 }
+bool heap_is_pointer_in_large_allocation(void *p);
+bool is_pointer_in_temporary_storage(void *p);
 bool is_pointer_valid(void *p) {
-	return is_pointer_in_program_memory(p) || is_pointer_in_stack(p) || is_pointer_in_static_memory(p);
+	return is_pointer_in_program_memory(p) || is_pointer_in_stack(p) || is_pointer_in_static_memory(p) || heap_is_pointer_in_large_allocation(p) || is_pointer_in_temporary_storage(p);
+}
+
+inline u64 heap_chunk_size(Heap_Allocation_Metadata *chunk) {
+	return chunk->size & HEAP_CHUNK_SIZE_MASK;
+}
+inline Heap_Allocation_Metadata *heap_next_chunk(Heap_Allocation_Metadata *chunk) {
+	return (Heap_Allocation_Metadata*)((u8*)chunk + heap_chunk_size(chunk));
+}
+
+void heap_size_to_class(u64 size, u32 *fl, u32 *sl) {
+	if (size < HEAP_SMALL_CHUNK_SIZE) {
+		*fl = 0;
+		*sl = (u32)(size / (HEAP_SMALL_CHUNK_SIZE / HEAP_SL_COUNT));
+	} else {
+		u32 msb = bit_scan_reverse_64(size);
+		*sl = (u32)(size >> (msb - HEAP_SL_COUNT_LOG2)) ^ HEAP_SL_COUNT;
+		*fl = msb - HEAP_FL_SHIFT + 1;
+	}
+}
+
+// Whole pages in a free chunk which are not touched by the header, links or footer
+u64 heap_get_free_chunk_interior_pages(Heap_Free_Node *node, void **first_page) {
+	u64 size = heap_chunk_size(&node->meta);
+	*first_page = (void*)align_next((u8*)node + sizeof(Heap_Free_Node), os.page_size);
+	void *last_page_end = (void*)align_previous((u8*)node + size - sizeof(u64), os.page_size);
+	if ((u8*)last_page_end <= (u8*)*first_page) return 0;
+	return (u64)last_page_end-(u64)*first_page;
+}
+
+// Free chunks have their interior pages locked in debug so use-after-free crashes right away.
+void heap_lock_free_chunk_pages(Heap_Free_Node *node) {
+#if CONFIGURATION == DEBUG
+	void *first_page;
+	u64 size = heap_get_free_chunk_interior_pages(node, &first_page);
+	if (size) os_lock_program_memory_pages(first_page, size);
+#endif
+}
+void heap_unlock_chunk_pages(void *chunk, u64 size) {
+#if CONFIGURATION == DEBUG
+	// Pages partially shared with a neighbour chunk are never locked, so this can't unlock
+	// anything that belongs to another free chunk.
+	void *first_page = (void*)align_previous(chunk, os.page_size);
+	void *last_page_end = (void*)align_next((u8*)chunk + size, os.page_size);
+	os_unlock_program_memory_pages(first_page, (u64)last_page_end-(u64)first_page);
+#endif
+}
+
+void heap_insert_free_chunk(Heap_Free_Node *node) {
+	u32 fl, sl;
+	heap_size_to_class(heap_chunk_size(&node->meta), &fl, &sl);
+	assert(fl < HEAP_FL_COUNT, "Internal heap error");
+	
+	Heap_Free_Node *head = heap_free_lists.heads[fl][sl];
+	node->next = head;
+	node->previous = 0;
+	if (head) head->previous = node;
+	heap_free_lists.heads[fl][sl] = node;
+	
+	heap_free_lists.fl_bitmap      |= 1U << fl;
+	heap_free_lists.sl_bitmaps[fl] |= 1U << sl;
+}
+void heap_remove_free_chunk(Heap_Free_Node *node) {
+	u32 fl, sl;
+	heap_size_to_class(heap_chunk_size(&node->meta), &fl, &sl);
+	
+	if (node->previous) node->previous->next = node->next;
+	else {
+		assert(heap_free_lists.heads[fl][sl] == node, "Internal heap error");
+		heap_free_lists.heads[fl][sl] = node->next;
+	}
+	if (node->next) node->next->previous = node->previous;
+	
+	if (!heap_free_lists.heads[fl][sl]) {
+		heap_free_lists.sl_bitmaps[fl] &= ~(1U << sl);
+		if (!heap_free_lists.sl_bitmaps[fl]) heap_free_lists.fl_bitmap &= ~(1U << fl);
+	}
+}
+
+// Marks chunk as free, writes the footer, tells the next chunk and puts it in its free list.
+Heap_Free_Node *heap_make_free_chunk(void *chunk, u64 size, Heap_Block *block) {
+	Heap_Free_Node *node = (Heap_Free_Node*)chunk;
+	node->meta.size = size | HEAP_CHUNK_FREE;
+	node->meta.block = block;
+#if CONFIGURATION == DEBUG
+	node->meta.signature = HEAP_FREE_SIGNATURE;
+#endif
+	*(u64*)((u8*)node + size - sizeof(u64)) = size;
+	
+	heap_next_chunk(&node->meta)->size |= HEAP_CHUNK_PREV_FREE;
+	
+	heap_insert_free_chunk(node);
+	
+	return node;
+}
+
+Heap_Free_Node *heap_find_free_chunk(u64 size) {
+	// Round up to the next class so any chunk in the list we land on will fit
+	u64 search_size = size;
+	if (search_size >= HEAP_SMALL_CHUNK_SIZE) {
+		search_size += (1ULL << (bit_scan_reverse_64(search_size) - HEAP_SL_COUNT_LOG2)) - 1;
+	}
+	
+	u32 fl, sl;
+	heap_size_to_class(search_size, &fl, &sl);
+	
+	if (fl < HEAP_FL_COUNT) {
+		u32 sl_map = heap_free_lists.sl_bitmaps[fl] & (~0U << sl);
+		if (!sl_map) {
+			u32 fl_map = fl+1 < HEAP_FL_COUNT ? (heap_free_lists.fl_bitmap & (~0U << (fl+1))) : 0;
+			if (fl_map) {
+				fl = bit_scan_forward_64(fl_map);
+				sl_map = heap_free_lists.sl_bitmaps[fl];
+			}
+		}
+		if (sl_map) {
+			sl = bit_scan_forward_64(sl_map);
+			return heap_free_lists.heads[fl][sl];
+		}
+	}
+	
+	// Nothing in the larger classes. There might still be a chunk that fits in the exact
+	// class of size, which we skipped by rounding up. This matters when the request is
+	// large compared to what's left in the heap blocks.
+	heap_size_to_class(size, &fl, &sl);
+	if (fl >= HEAP_FL_COUNT) return 0;
+	Heap_Free_Node *node = heap_free_lists.heads[fl][sl];
+	while (node) {
+		if (heap_chunk_size(&node->meta) >= size) return node;
+		node = node->next;
+	}
+	return 0;
 }
 
 // Meant for debug
@@ -124,98 +307,58 @@ void sanity_check_block(Heap_Block *block) {
 	assert(is_pointer_in_program_memory(block->start), "Heap_Block pointer is corrupt");
 	if(block->next) { assert(is_pointer_in_program_memory(block->next), "Heap_Block next pointer is corrupt"); }
 	assert(block->size < GB(256), "A heap block is corrupt.");
-	assert(block->size >= INITIAL_PROGRAM_MEMORY_SIZE, "A heap block is corrupt.");
 	assert((u64)block->start == (u64)block + sizeof(Heap_Block), "A heap block is corrupt.");
+	assert((u64)block->end == (u64)block + block->size - sizeof(Heap_Allocation_Metadata), "A heap block is corrupt.");
 	
-
-	Heap_Free_Node *node = block->free_head;	
+	Heap_Allocation_Metadata *chunk = (Heap_Allocation_Metadata*)block->start;
 	
 	u64 total_free = 0;
-	while (node != 0) {
-		Heap_Free_Node *other_node = node->next;
+	u64 total_used = 0;
+	bool previous_was_free = false;
+	while ((u8*)chunk < (u8*)block->end) {
+		u64 size = heap_chunk_size(chunk);
 		
-		assert(node->size < GB(256), "Heap is corrupt");
-		assert(is_pointer_in_program_memory(node), "Heap is corrupt");
+		assert(size >= HEAP_MIN_CHUNK_SIZE && size % HEAP_ALIGNMENT == 0, "Heap is corrupt");
+		assert((u8*)chunk + size <= (u8*)block->end, "Heap is corrupt");
+		assert(chunk->block == block, "Heap is corrupt");
+		assert(((chunk->size & HEAP_CHUNK_PREV_FREE) != 0) == previous_was_free, "Heap is corrupt");
 		
-		while (other_node != 0) {
-			assert(is_pointer_in_program_memory(other_node), "Heap is corrupt");
-			assert(other_node != node, "Circular reference in heap free node tree. This is probably an internal error, or an extremely unlucky result from heap corruption.");
-			other_node = other_node->next;
+		if (chunk->size & HEAP_CHUNK_FREE) {
+			assert(!previous_was_free, "Two neighbouring free chunks were not merged. This is probably an internal error.");
+			assert(chunk->signature == HEAP_FREE_SIGNATURE, "Heap is corrupt");
+			assert(*(u64*)((u8*)chunk + size - sizeof(u64)) == size, "Heap is corrupt");
+			total_free += size;
+			previous_was_free = true;
+		} else {
+			assert(chunk->signature == HEAP_META_SIGNATURE || chunk->signature == HEAP_CACHED_SIGNATURE, "Heap is corrupt");
+			total_used += size;
+			previous_was_free = false;
 		}
-		total_free += node->size;
-		assert(total_free <= block->size, "Free nodes are fucky wucky. This might be heap corruption, or possibly an internal error.");
-		node = node->next;
+		
+		chunk = heap_next_chunk(chunk);
 	}
+	assert((u8*)chunk == (u8*)block->end, "Heap is corrupt");
 	
-	u64 expected_size = get_heap_block_size_excluding_metadata(block);
-	assert(block->total_allocated+total_free == expected_size, "Heap is corrupt.")
+	u64 expected_size = (u64)block->end - (u64)block->start;
+	assert(block->total_allocated == total_used, "Heap is corrupt.");
+	assert(total_used+total_free == expected_size, "Heap is corrupt.");
 #endif
 }
 inline void check_meta(Heap_Allocation_Metadata *meta) {
 #if CONFIGURATION == DEBUG
 	assert(meta->signature == HEAP_META_SIGNATURE, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
 #endif
+	assert(!(meta->size & HEAP_CHUNK_FREE), "Heap error. Either 1) You deallocated the same pointer twice, 2) You passed a bad pointer to dealloc or 3) You corrupted the heap.");
 // If > 256GB then prolly not legit lol
-	assert(meta->size < 1024ULL*1024ULL*1024ULL*256ULL, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");	
+	assert(heap_chunk_size(meta) < 1024ULL*1024ULL*1024ULL*256ULL, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");	
 	assert(is_pointer_in_program_memory(meta->block), "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap."); 
 
 	assert((u64)meta >= (u64)meta->block->start && (u64)meta < (u64)meta->block->start+meta->block->size, "Heap error: Pointer is not in it's metadata block. This could be heap corruption but it's more likely an internal error. That's not good.");
 }
 
-typedef struct {
-	Heap_Free_Node *best_fit;
-	Heap_Free_Node *previous;
-	u64 delta;
-} Heap_Search_Result;
-Heap_Search_Result search_heap_block(Heap_Block *block, u64 size) {
-	
-	if (block->free_head == 0)  return (Heap_Search_Result){0, 0, 0};
-		
-	Heap_Free_Node *node = block->free_head;
-	Heap_Free_Node *previous = 0;
-	
-	Heap_Free_Node *best_fit = 0;
-	Heap_Free_Node *before_best_fit = 0;
-	u64 best_fit_delta = 0;
-	
-	while (node != 0) {
-		
-		if (node->size == size) {
-			Heap_Search_Result result;
-			result.best_fit = node;
-			result.previous = previous;
-			result.delta = 0;
-			assert(result.previous != result.best_fit, "Internal goof");
-			return result;
-		}
-		
-		if (node->size >= size) {
-			u64 delta = node->size - size;
-			
-			if (delta < best_fit_delta || !best_fit) {
-				before_best_fit = previous;
-				best_fit = node;
-				best_fit_delta = delta;
-			}
-		}
-		
-		if (node->next) previous = node;
-		node = node->next;
-	}
-	
-	if (!best_fit)  return (Heap_Search_Result){0, 0, 0};
-
-	Heap_Search_Result result;
-	result.best_fit = best_fit;
-	result.previous = before_best_fit;
-	result.delta = best_fit_delta;
-	assert(result.previous != result.best_fit, "Internal goof");
-	return result;
-}
-
 Heap_Block *make_heap_block(Heap_Block *parent, u64 size) {
 
-	size += sizeof(Heap_Block);
+	size += sizeof(Heap_Block) + sizeof(Heap_Allocation_Metadata);
 
 	size = align_next(size, os.page_size);
 
@@ -231,11 +374,24 @@ Heap_Block *make_heap_block(Heap_Block *parent, u64 size) {
 #endif
 	
 	block->start = ((u8*)block)+sizeof(Heap_Block);
+	block->end = ((u8*)block)+size-sizeof(Heap_Allocation_Metadata);
 	block->size = size;
 	block->next = 0;
-	block->free_head = (Heap_Free_Node*)block->start;
-	block->free_head->size = get_heap_block_size_excluding_metadata(block);
-	block->free_head->next = 0;
+	block->idle_checks = 0;
+	block->decommitted = false;
+	
+	// The sentinel looks like an allocated chunk of size 0 so we never merge past the block
+	Heap_Allocation_Metadata *sentinel = (Heap_Allocation_Metadata*)block->end;
+	sentinel->size = 0;
+	sentinel->block = block;
+#if CONFIGURATION == DEBUG
+	sentinel->signature = HEAP_META_SIGNATURE;
+#endif
+	
+	// Fresh pages from the OS are zero
+	Heap_Free_Node *node = heap_make_free_chunk(block->start, (u64)block->end-(u64)block->start, block);
+	node->meta.size |= HEAP_CHUNK_ZEROED;
+	heap_lock_free_chunk_pages(node);
 	
 	return block;
 }
@@ -244,28 +400,18 @@ void heap_init() {
 	if (heap_initted) return;
 	assert(HEAP_ALIGNMENT == 16);
 	assert(sizeof(Heap_Allocation_Metadata) % HEAP_ALIGNMENT == 0);
+	assert(sizeof(Heap_Block) % HEAP_ALIGNMENT == 0);
 	heap_initted = true;
+	memset(&heap_free_lists, 0, sizeof(heap_free_lists));
 	heap_head = make_heap_block(0, DEFAULT_HEAP_BLOCK_SIZE);
 	spinlock_init(&heap_lock);
 }
 
-void *heap_alloc(u64 size) {
-
-	if (!heap_initted) heap_init();
-
-	// #Sync #Speed oof
-	spinlock_acquire_or_wait(&heap_lock);
-	
-
-
-
-	
-	size += sizeof(Heap_Allocation_Metadata);
-	
-	size = (size+HEAP_ALIGNMENT) & ~(HEAP_ALIGNMENT-1);
-	
-	assert(size < MAX_HEAP_BLOCK_SIZE, "Past Charlie has been lazy and did not handle large allocations like this. I apologize on behalf of past Charlie. A quick fix could be to increase the heap block size for now. #Incomplete #Limitation");
+// Takes a chunk of chunk_size bytes from the free lists. heap_lock must be held.
+// If zeroed is not 0 it's set to whether the memory after the metadata is known to be zero.
+Heap_Allocation_Metadata *heap_alloc_chunk_locked(u64 size, bool *zeroed) {
 	
+	assert(size < MAX_HEAP_BLOCK_SIZE, "Internal heap error: this should have been a large allocation");
 	
 #if VERY_DEBUG
 	{
@@ -278,105 +424,69 @@ void *heap_alloc(u64 size) {
 	}
 #endif
 	
-	Heap_Block *block = heap_head;
-	Heap_Block *last_block = 0;
-	Heap_Free_Node *best_fit = 0;
-	Heap_Block *best_fit_block = 0;
-	Heap_Free_Node *previous = 0;
-	u64 best_fit_delta = 0;
-	// #Speed
-	// Maybe instead of going through EVERY free node to find best fit we do a good-enough fit
-	while (block != 0) {
-
-		if (get_heap_block_size_excluding_metadata(block) < size) {
-			last_block = block;
-			block = block->next;
-			continue;
-		}
-	
-		Heap_Search_Result result = search_heap_block(block, size);
-		Heap_Free_Node *node = result.best_fit;
-		if (node) {
-			if (node->size < size) continue;
-			if (node->size == size) {
-				best_fit = node;
-				best_fit_block = block;
-				previous = result.previous;
-				best_fit_delta = 0;
-				break;
-			}
-			
-			u64 delta = node->size-size;
-			if (delta < best_fit_delta || !best_fit) {
-				best_fit = node;
-				best_fit_block = block;
-				previous = result.previous;
-				best_fit_delta = delta;
-			}
-		}
-		
-		last_block = block;
-		block = block->next;
-	}
+	Heap_Free_Node *best_fit = heap_find_free_chunk(size);
 	
 	if (!best_fit) {
-		block = make_heap_block(last_block, max(DEFAULT_HEAP_BLOCK_SIZE, size));
-		previous = 0;
-		best_fit = block->free_head;
-		best_fit_block = block;
-	}
+		Heap_Block *last_block = heap_head;
+		while (last_block->next) last_block = last_block->next;
 		
+		Heap_Block *block = make_heap_block(last_block, max(DEFAULT_HEAP_BLOCK_SIZE, size));
+		best_fit = (Heap_Free_Node*)block->start;
+	}
 	
 	assert(best_fit != 0, "Internal heap error");
+	assert(best_fit->meta.size & HEAP_CHUNK_FREE, "Internal heap error");
 	
-	// Unlock best fit
-	
-	// #Copypaste
-	void *free_tail = (u8*)best_fit + best_fit->size;
-	void *first_page = (void*)align_previous(best_fit, os.page_size);
-	void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-	if ((u8*)last_page_end > (u8*)first_page) {
-		os_unlock_program_memory_pages(first_page, (u64)last_page_end-(u64)first_page);
-	}
+	Heap_Block *block = best_fit->meta.block;
+	u64 chunk_size = heap_chunk_size(&best_fit->meta);
+	assert(chunk_size >= size, "Internal heap error");
 	
-	Heap_Free_Node *new_free_node = 0;
-	if (size != best_fit->size) {
-		u64 remainder = best_fit->size - size;
-		new_free_node = (Heap_Free_Node*)(((u8*)best_fit)+size);
-		new_free_node->size = remainder;
-		new_free_node->next = best_fit->next;
-		
-		// Lock remaining free node
-		// #Copypaste
-		void *free_tail = (u8*)new_free_node + new_free_node->size;
-		void *next_page = (void*)align_next(new_free_node, os.page_size);
-		void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-		if ((u8*)last_page_end > (u8*)next_page) {
-			os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
+	if (block->decommitted) {
+		// Block is one big free chunk, bring its pages back. They come back zero, so clear
+		// the bits around them too and we have a zeroed chunk again.
+		void *first_page;
+		u64 pages_size = heap_get_free_chunk_interior_pages(best_fit, &first_page);
+		u8 *data = (u8*)best_fit + sizeof(Heap_Free_Node);
+		u8 *footer = (u8*)best_fit + chunk_size - sizeof(u64);
+		if (pages_size) {
+			os_commit_pages(first_page, pages_size);
+			memset(data, 0, (u8*)first_page-data);
+			memset((u8*)first_page+pages_size, 0, footer-((u8*)first_page+pages_size));
+		} else {
+			memset(data, 0, footer-data);
 		}
+		best_fit->meta.size |= HEAP_CHUNK_ZEROED;
+		block->decommitted = false;
 	}
+	block->idle_checks = 0;
+	
+	bool is_zeroed = (best_fit->meta.size & HEAP_CHUNK_ZEROED) != 0;
+	
+	heap_remove_free_chunk(best_fit);
 	
+	heap_unlock_chunk_pages(best_fit, chunk_size);
 	
-	if (previous && new_free_node) {
-		assert(previous->next == best_fit, "Internal heap error");
-		previous->next = new_free_node;
-	} else if (previous) {
-		assert(previous->next == best_fit, "Internal heap error");
-		previous->next = best_fit->next;
+	if (chunk_size-size >= HEAP_MIN_CHUNK_SIZE) {
+		// Split, remainder goes back in a free list
+		Heap_Free_Node *remainder = heap_make_free_chunk((u8*)best_fit+size, chunk_size-size, block);
+		if (is_zeroed) remainder->meta.size |= HEAP_CHUNK_ZEROED;
+		heap_lock_free_chunk_pages(remainder);
+	} else {
+		size = chunk_size;
+		heap_next_chunk(&best_fit->meta)->size &= ~HEAP_CHUNK_PREV_FREE;
+		if (is_zeroed && zeroed) *(u64*)((u8*)best_fit + size - sizeof(u64)) = 0; // Footer
 	}
 	
-	if (best_fit_block->free_head == best_fit) {
-		// If we allocated the first free node then replace with new free node or just
-		// remove it if perfect fit.
-		if (new_free_node) {
-			new_free_node->next = best_fit_block->free_head->next;
-			best_fit_block->free_head = new_free_node;
-		} else best_fit_block->free_head = best_fit_block->free_head->next;
+	if (zeroed) {
+		// Free list links are the only thing left in the part we hand out
+		if (is_zeroed) memset((u8*)best_fit+sizeof(Heap_Allocation_Metadata), 0, sizeof(Heap_Free_Node)-sizeof(Heap_Allocation_Metadata));
+		*zeroed = is_zeroed;
 	}
 	
+	// Previous chunk can't be free, it would have been merged with this one
 	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)best_fit;
 	meta->size = size;
-	meta->block = best_fit_block;
+	meta->block = block;
 #if CONFIGURATION == DEBUG
 	meta->signature = HEAP_META_SIGNATURE;
 	meta->block->total_allocated += size;
@@ -388,356 +498,1347 @@ void *heap_alloc(u64 size) {
 	sanity_check_block(meta->block);
 #endif
 	
-	// #Sync #Speed oof
-	spinlock_release(&heap_lock);
-	
-	
-	void *p = ((u8*)meta)+sizeof(Heap_Allocation_Metadata);
-	assert((u64)p % HEAP_ALIGNMENT == 0, "Internal heap error. Result pointer is not aligned to HEAP_ALIGNMENT");
-	return p;
+	return meta;
 }
-void heap_dealloc(void *p) {
-	// #Sync #Speed oof
-	
-	if (!heap_initted) heap_init();
 
-	spinlock_acquire_or_wait(&heap_lock);
-	
-	assert(is_pointer_in_program_memory(p), "A bad pointer was passed tp heap_dealloc: it is out of program memory bounds!"); 
-	p = (u8*)p-sizeof(Heap_Allocation_Metadata);
-	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(p);
-	check_meta(meta);
+// Gives a chunk back to the free lists and merges it with its neighbours. heap_lock must be held.
+void heap_free_chunk_locked(Heap_Allocation_Metadata *meta) {
 	
 	// Yoink meta data before we start overwriting it
 	Heap_Block *block = meta->block;
-	u64 size = meta->size;
-	
-#if CONFIGURATION == DEBUG
-	memset(p, 0x69696969, size);
-#endif
+	u64 size = heap_chunk_size(meta);
+	bool previous_is_free = (meta->size & HEAP_CHUNK_PREV_FREE) != 0;
 	
 	#if VERY_DEBUG
 		sanity_check_block(block);
 	#endif
 	
-	Heap_Free_Node *new_node = cast(Heap_Free_Node*)p;
-	new_node->size = size;
+#if CONFIGURATION == DEBUG
+	memset((u8*)meta+sizeof(Heap_Allocation_Metadata), 0x69696969, size-sizeof(Heap_Allocation_Metadata));
+	block->total_allocated -= size;
+#endif
 	
-	if (new_node < block->free_head) {
-		// #Copypaste
-		void *free_tail = (u8*)new_node + new_node->size;
-		void *next_page = (void*)align_next(new_node, os.page_size);
-		void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-		if ((u8*)last_page_end > (u8*)next_page) {
-			os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
-		}
-		
-		if ((u8*)new_node+size == (u8*)block->free_head) {
-			new_node->size = size + block->free_head->size;
-			new_node->next = block->free_head->next;
-			block->free_head = new_node;
-		} else {
-			new_node->next = block->free_head;
-			block->free_head = new_node;
-		}
-		
-	} else {
+	void *chunk = meta;
 	
-		if (!block->free_head) {
-			block->free_head = new_node;
-			new_node->next = 0;
-			
-			// #Copypaste
-			void *free_tail = (u8*)new_node + new_node->size;
-			void *next_page = (void*)align_next(new_node, os.page_size);
-			void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-			if ((u8*)last_page_end > (u8*)next_page) {
-				os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
-			}
-			
-		} else {
-			Heap_Free_Node *node = block->free_head;
-		
-			while (true) {
-			
-				assert(node != 0, "We didn't find where the free node should be! This is likely heap corruption (or, hopefully not, an internal error)");
-				
-				// In retrospect, I don't remember a good reason to care about where the
-				// free nodes are... maybe I'm just dumb right now? #Speed #Memory
-				// ... ACtually, it's probably to easily know when to merge free nodes.
-				// BUT. Maybe it's not worth the performance hit? Then again, if the heap
-				// allocator slows down your program you should rethink your memory management
-				// anyways...
-				
-				if (new_node >= node) {
-					u8* node_tail = (u8*)node + node->size;
-					if (cast(u8*)new_node == node_tail) {
-						
-						// We need to account for the cases where we coalesce free blocks with start/end in the middle
-						// of a page.
-						
-						u64 new_node_size = new_node->size;
-						
-						// #Copypaste
-						void *free_tail = (u8*)new_node + new_node->size;
-						void *next_page = (void*)align_previous(node_tail, os.page_size);
-						void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-
-						if ((u8*)next_page < (u8*)node) next_page = (u8*)next_page + os.page_size;
-						
-						if ((u8*)last_page_end > (u8*)next_page) {
-							os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
-						}
-						
-						node->size += new_node_size;
-						
-						break;
-					} else {
-						new_node->next = node->next;
-						node->next = new_node;
-						
-						u8* new_node_tail = (u8*)new_node + new_node->size;
-						if (new_node->next && (u8*)new_node->next == new_node_tail) {
-							new_node->size += new_node->next->size;
-							new_node->next = new_node->next->next;
-						}
-						
-						// #Copypaste
-						void *free_tail = (u8*)new_node + new_node->size;
-						void *next_page = (void*)align_next(new_node, os.page_size);
-						void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-						if ((u8*)last_page_end > (u8*)next_page) {
-							os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
-						}
-						
-						break;
-					}
-				}
-				
-				node = node->next;
-			}
-		}
+	Heap_Allocation_Metadata *next = (Heap_Allocation_Metadata*)((u8*)chunk + size);
+	if (next->size & HEAP_CHUNK_FREE) {
+		heap_remove_free_chunk((Heap_Free_Node*)next);
+		size += heap_chunk_size(next);
 	}
 	
-
-#if CONFIGURATION == DEBUG
-	block->total_allocated -= size;
-#endif
+	if (previous_is_free) {
+		u64 previous_size = *(u64*)((u8*)chunk - sizeof(u64));
+		Heap_Free_Node *previous = (Heap_Free_Node*)((u8*)chunk - previous_size);
+		assert(previous->meta.size & HEAP_CHUNK_FREE, "Heap is corrupt");
+		assert(heap_chunk_size(&previous->meta) == previous_size, "Heap is corrupt");
+		heap_remove_free_chunk(previous);
+		size += previous_size;
+		chunk = previous;
+	}
+	
+	Heap_Free_Node *node = heap_make_free_chunk(chunk, size, block);
+	heap_lock_free_chunk_pages(node);
 
 #if VERY_DEBUG
 	sanity_check_block(block);
 #endif
-	// #Sync #Speed oof
-	spinlock_release(&heap_lock);
 }
 
-void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
-	switch (message) {
-		case ALLOCATOR_ALLOCATE: {
-			return heap_alloc(size);
-			break;
-		}
-		case ALLOCATOR_DEALLOCATE: {
-			heap_dealloc(p);
-			return 0;
-		}
-		case ALLOCATOR_REALLOCATE: {
-			if (!p) {
-				return heap_alloc(size);
-			}
-			assert(is_pointer_valid(p), "Invalid pointer passed to heap allocator reallocate");
-			Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(((u64)p)-sizeof(Heap_Allocation_Metadata));
-			check_meta(meta);
-			void *new = heap_alloc(size);
-			memcpy(new, p, min(size, meta->size));
-			heap_dealloc(p);
-			return new;
-		}
+// Like heap_alloc_chunk_locked(), but the memory after the metadata is aligned to alignment.
+// We take a chunk with enough slack to fit an aligned spot with room for a free chunk in
+// front of it, and give back the front and the tail. heap_lock must be held.
+Heap_Allocation_Metadata *heap_alloc_chunk_aligned_locked(u64 size, u64 alignment) {
+	if (alignment <= HEAP_ALIGNMENT) return heap_alloc_chunk_locked(size, 0);
+	
+	Heap_Allocation_Metadata *meta = heap_alloc_chunk_locked(size + alignment + HEAP_MIN_CHUNK_SIZE, 0);
+	Heap_Block *block = meta->block;
+	u64 chunk_size = heap_chunk_size(meta);
+	
+	u8 *p = (u8*)meta + sizeof(Heap_Allocation_Metadata);
+	if ((u64)p % alignment != 0) {
+		u8 *aligned = (u8*)align_next((u64)p + HEAP_MIN_CHUNK_SIZE, alignment);
+		u64 front_size = (u64)(aligned - p);
+		
+		Heap_Allocation_Metadata *front = meta;
+		meta = (Heap_Allocation_Metadata*)(aligned - sizeof(Heap_Allocation_Metadata));
+		meta->size = chunk_size - front_size;
+		meta->block = block;
+#if CONFIGURATION == DEBUG
+		meta->signature = HEAP_META_SIGNATURE;
+#endif
+		front->size = front_size;
+		heap_free_chunk_locked(front);
+		chunk_size -= front_size;
 	}
-	return 0;
-}
-
-Allocator get_heap_allocator() {
-	Allocator heap_allocator;
 	
-	heap_allocator.proc = heap_allocator_proc;
-	heap_allocator.data = 0;
+	if (chunk_size - size >= HEAP_MIN_CHUNK_SIZE) {
+		meta->size = (meta->size & ~HEAP_CHUNK_SIZE_MASK) | size;
+		Heap_Allocation_Metadata *tail = heap_next_chunk(meta);
+		tail->size = chunk_size - size;
+		tail->block = block;
+#if CONFIGURATION == DEBUG
+		tail->signature = HEAP_META_SIGNATURE;
+#endif
+		heap_free_chunk_locked(tail);
+	}
 	
-	return heap_allocator;
+	check_meta(meta);
+	
+	return meta;
 }
 
 ///
+// Large allocations
 ///
-// Temporary storage
-///
+// Anything at least HEAP_LARGE_ALLOCATION_SIZE skips the heap blocks and gets its own pages
+// straight from the OS, which are given right back to the OS on free.
+// The mappings are kept in a side table so we can validate pointers passed to heap_dealloc.
 
-#ifndef TEMPORARY_STORAGE_SIZE
-	#define TEMPORARY_STORAGE_SIZE (1024ULL*1024ULL*2ULL) // 2mb
+#ifndef HEAP_LARGE_ALLOCATION_SIZE
+	#define HEAP_LARGE_ALLOCATION_SIZE MB(4)
 #endif
 
-ogb_instance void* talloc(u64);
-ogb_instance void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void*);
+typedef struct Heap_Large_Allocation {
+	void *base; // The Heap_Allocation_Metadata is at the start
+	u64 offset; // From the start of the mapping to base. Not 0 for aligned allocations.
+	u64 size; // Committed, from the start of the mapping
+	u64 reserved_size;
+} Heap_Large_Allocation;
+
+typedef struct Heap_Large_Allocation_Table {
+	Heap_Large_Allocation *entries;
+	u64 count;
+	u64 capacity;
+	u64 total_size;
+	Spinlock lock;
+} Heap_Large_Allocation_Table;
+
+// We reserve this many times the committed size for large allocations so they can grow in
+// place when reallocated. Address space is cheap.
+// Once something had to move because it grew past its reservation it will probably keep
+// growing, so then we reserve a lot more.
+#ifndef HEAP_LARGE_ALLOCATION_RESERVE_FACTOR
+	#define HEAP_LARGE_ALLOCATION_RESERVE_FACTOR 8
+#endif
+#ifndef HEAP_LARGE_REALLOCATION_RESERVE_FACTOR
+	#define HEAP_LARGE_REALLOCATION_RESERVE_FACTOR 64
+#endif
 
 // #Global
-ogb_instance Allocator 
-get_temporary_allocator();
+ogb_instance Heap_Large_Allocation_Table heap_large_allocations;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-thread_local void * temporary_storage = 0;
-thread_local void * temporary_storage_pointer = 0;
-thread_local bool   has_warned_temporary_storage_overflow = false;
-thread_local Allocator temp_allocator;
+Heap_Large_Allocation_Table heap_large_allocations;
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
-ogb_instance Allocator 
-get_temporary_allocator() {
-	if (!temporary_storage) return get_initialization_allocator();
-	return temp_allocator;
+// heap_large_allocations.lock must be held. Returns -1 if not found.
+s64 heap_find_large_allocation_locked(void *base) {
+	for (u64 i = 0; i < heap_large_allocations.count; i += 1) {
+		if (heap_large_allocations.entries[i].base == base) return (s64)i;
+	}
+	return -1;
 }
-#endif
-
-ogb_instance void* 
-temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data);
-
-ogb_instance void 
-temporary_storage_init(u64 arena_size);
-
-ogb_instance void* 
-talloc(u64 size);
-
-ogb_instance void 
-reset_temporary_storage();
 
-
-#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
-	switch (message) {
-		case ALLOCATOR_ALLOCATE: {
-			return talloc(size);
+bool heap_is_pointer_in_large_allocation(void *p) {
+	spinlock_acquire_or_wait(&heap_large_allocations.lock);
+	bool found = false;
+	for (u64 i = 0; i < heap_large_allocations.count; i += 1) {
+		Heap_Large_Allocation a = heap_large_allocations.entries[i];
+		if ((u8*)p >= (u8*)a.base && (u8*)p < (u8*)a.base-a.offset+a.size) {
+			found = true;
 			break;
 		}
-		case ALLOCATOR_DEALLOCATE: {
-			return 0;
-		}
-		case ALLOCATOR_REALLOCATE: {
-			panic("Temporary allocator cannot 'reallocate'");
-			return 0;
-		}
 	}
-	return 0;
-}
-
-void temporary_storage_init(u64 arena_size) {
-	
-	temporary_storage = heap_alloc(arena_size);
-	assert(temporary_storage, "Failed allocating temporary storage");
-	temporary_storage_pointer = temporary_storage;
-
-	temp_allocator.proc = temp_allocator_proc;
-	temp_allocator.data = 0;
-	
-	temp_allocator.proc = temp_allocator_proc;
+	spinlock_release(&heap_large_allocations.lock);
+	return found;
 }
 
-void* talloc(u64 size) {
-	
-	assert(size < TEMPORARY_STORAGE_SIZE, "Bruddah this is too large for temp allocator");
+// Mappings start at os.granularity, so for bigger alignments the metadata is pushed in
+// until the pointer after it lands on the alignment.
+void *heap_alloc_large(u64 size, u64 alignment, u64 reserve_factor) {
+	assert(alignment <= os.granularity, "Large heap allocations can't be aligned to more than %llu bytes (asked for %llu)", os.granularity, alignment);
+	u64 offset = align_next(sizeof(Heap_Allocation_Metadata), alignment) - sizeof(Heap_Allocation_Metadata);
+	u64 mapping_size = align_next(offset + size + sizeof(Heap_Allocation_Metadata), os.page_size);
+	u64 reserved_size = align_next(mapping_size*reserve_factor, os.granularity);
 	
-	void* p = temporary_storage_pointer;
+	void *mapping = os_reserve_pages(reserved_size);
+	assert(mapping, "Failed reserving %llu bytes from the OS for a large allocation. Out of address space?", reserved_size);
+	os_commit_pages(mapping, mapping_size);
+	void *base = (u8*)mapping + offset;
 	
-	temporary_storage_pointer = (u8*)temporary_storage_pointer + size;
+	spinlock_acquire_or_wait(&heap_large_allocations.lock);
 	
-	if ((u8*)temporary_storage_pointer >= (u8*)temporary_storage+TEMPORARY_STORAGE_SIZE) {
-		if (!has_warned_temporary_storage_overflow) {
-			os_write_string_to_stdout(STR("WARNING: temporary storage was overflown, we wrap around at the start.\n"));
-			has_warned_temporary_storage_overflow = true;
+	if (heap_large_allocations.count >= heap_large_allocations.capacity) {
+		u64 old_capacity = heap_large_allocations.capacity;
+		u64 old_size = align_next(old_capacity*sizeof(Heap_Large_Allocation), os.page_size);
+		u64 new_capacity = max(old_capacity*2, os.page_size/sizeof(Heap_Large_Allocation));
+		u64 new_size = align_next(new_capacity*sizeof(Heap_Large_Allocation), os.page_size);
+		Heap_Large_Allocation *new_entries = (Heap_Large_Allocation*)os_reserve_pages(new_size);
+		assert(new_entries, "Failed growing the large allocation table");
+		os_commit_pages(new_entries, new_size);
+		if (heap_large_allocations.entries) {
+			memcpy(new_entries, heap_large_allocations.entries, old_capacity*sizeof(Heap_Large_Allocation));
+			os_release_pages(heap_large_allocations.entries, old_size);
 		}
-		temporary_storage_pointer = temporary_storage;
-		return talloc(size);;
+		heap_large_allocations.entries = new_entries;
+		heap_large_allocations.capacity = new_capacity;
 	}
 	
-	return p;
+	Heap_Large_Allocation *a = &heap_large_allocations.entries[heap_large_allocations.count];
+	a->base = base;
+	a->offset = offset;
+	a->size = mapping_size;
+	a->reserved_size = reserved_size;
+	heap_large_allocations.count += 1;
+	heap_large_allocations.total_size += mapping_size;
+	
+	spinlock_release(&heap_large_allocations.lock);
+	
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)base;
+	meta->size = (mapping_size-offset) | HEAP_CHUNK_LARGE;
+	meta->block = 0;
+#if CONFIGURATION == DEBUG
+	meta->signature = HEAP_META_SIGNATURE;
+#endif
+	
+	return (u8*)base + sizeof(Heap_Allocation_Metadata);
 }
 
-void reset_temporary_storage() {
-	temporary_storage_pointer = temporary_storage;	
-	has_warned_temporary_storage_overflow = false;
+void heap_dealloc_large(void *p) {
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+	
+	spinlock_acquire_or_wait(&heap_large_allocations.lock);
+	
+	s64 index = heap_find_large_allocation_locked(meta);
+	assert(index >= 0, "A bad pointer was passed to heap_dealloc: it's not in program memory and it's not a large allocation either. Maybe you deallocated it twice?");
+	
+	Heap_Large_Allocation a = heap_large_allocations.entries[index];
+	heap_large_allocations.entries[index] = heap_large_allocations.entries[heap_large_allocations.count-1];
+	heap_large_allocations.count -= 1;
+	heap_large_allocations.total_size -= a.size;
+	
+	spinlock_release(&heap_large_allocations.lock);
+	
+#if CONFIGURATION == DEBUG
+	assert(meta->signature == HEAP_META_SIGNATURE, "Heap error. Large allocation header was corrupted.");
+#endif
+	assert((meta->size & HEAP_CHUNK_LARGE) && heap_chunk_size(meta) == a.size-a.offset, "Heap error. Large allocation header was corrupted.");
+	
+	os_release_pages((u8*)a.base-a.offset, a.reserved_size);
+}
+
+// Commits or decommits pages at the end of a large allocation. Returns false if it would
+// need more than what's reserved.
+bool heap_resize_large_in_place(void *p, u64 size) {
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+	
+	spinlock_acquire_or_wait(&heap_large_allocations.lock);
+	
+	s64 index = heap_find_large_allocation_locked(meta);
+	assert(index >= 0, "A bad pointer was passed to heap reallocate: it's not in program memory and it's not a large allocation either.");
+	Heap_Large_Allocation *a = &heap_large_allocations.entries[index];
+	u8 *mapping = (u8*)a->base - a->offset;
+	u64 mapping_size = align_next(a->offset + size + sizeof(Heap_Allocation_Metadata), os.page_size);
+	
+	bool ok = mapping_size <= a->reserved_size;
+	if (ok) {
+		if (mapping_size > a->size) {
+			os_commit_pages(mapping + a->size, mapping_size - a->size);
+		} else if (mapping_size < a->size) {
+			os_decommit_pages(mapping + mapping_size, a->size - mapping_size);
+		}
+		heap_large_allocations.total_size += mapping_size;
+		heap_large_allocations.total_size -= a->size;
+		a->size = mapping_size;
+		meta->size = (meta->size & HEAP_CHUNK_TAG_MASK) | (mapping_size - a->offset) | HEAP_CHUNK_LARGE;
+	}
+	
+	spinlock_release(&heap_large_allocations.lock);
+	
+	return ok;
+}
+
+///
+// Decommitting idle heap blocks
+///
+// If a heap block has been completely free for HEAP_BLOCK_IDLE_CHECKS_BEFORE_DECOMMIT calls
+// to heap_decommit_idle_blocks() we give its pages back to the OS. They are committed again
+// if we allocate from the block. This is called every os_update() so by default that's a
+// couple of seconds.
+
+#ifndef HEAP_BLOCK_IDLE_CHECKS_BEFORE_DECOMMIT
+	#define HEAP_BLOCK_IDLE_CHECKS_BEFORE_DECOMMIT 120
+#endif
+
+void heap_decommit_idle_blocks() {
+	if (!heap_initted) return;
+	
+	spinlock_acquire_or_wait(&heap_lock);
+	
+	Heap_Block *block = heap_head;
+	while (block) {
+		Heap_Allocation_Metadata *first = (Heap_Allocation_Metadata*)block->start;
+		bool is_completely_free = (first->size & HEAP_CHUNK_FREE) && heap_chunk_size(first) == (u64)block->end-(u64)block->start;
+		
+		if (!is_completely_free) {
+			block->idle_checks = 0;
+		} else if (!block->decommitted) {
+			block->idle_checks += 1;
+			if (block->idle_checks >= HEAP_BLOCK_IDLE_CHECKS_BEFORE_DECOMMIT) {
+				void *first_page;
+				u64 pages_size = heap_get_free_chunk_interior_pages((Heap_Free_Node*)first, &first_page);
+				if (pages_size) os_decommit_pages(first_page, pages_size);
+				block->decommitted = true;
+			}
+		}
+		
+		block = block->next;
+	}
+	
+	spinlock_release(&heap_lock);
 }
 
+///
+// Thread caches
+///
+// Small allocations are served from a per-thread cache of chunks so most heap_alloc and
+// heap_dealloc calls never touch heap_lock. As far as the free lists know, cached chunks
+// are allocated. Bins are refilled and flushed in batches so we take the lock once per batch.
+// The owning cache is stored in the top bits of the chunk size, so if a chunk is freed on
+// another thread it's pushed to the owner's remote free list (lock-free) and the owner
+// picks it up next time it runs out of chunks.
+// Caches are never freed. When a thread exits its cache is flushed and can be adopted by
+// the next thread, so remote frees that arrive late are never lost. That happens at the end
+// of os_thread_start threads, and for any other thread from a TLS callback in the os impl.
+
+#ifndef HEAP_ENABLE_THREAD_CACHE
+	#define HEAP_ENABLE_THREAD_CACHE 1
+#endif
+
+#define HEAP_CACHE_MAX_CHUNK_SIZE 1024
+#define HEAP_CACHE_BIN_COUNT (HEAP_CACHE_MAX_CHUNK_SIZE/HEAP_ALIGNMENT)
+#define HEAP_CACHE_BIN_CAPACITY 32
+#define HEAP_CACHE_BATCH_COUNT 16
+#define HEAP_MAX_THREAD_CACHES 512
+
+typedef struct Heap_Cache_Bin {
+	void *head; // Linked through the first 8 bytes of the user memory
+	u64 count;
+} Heap_Cache_Bin;
+
+typedef struct Heap_Thread_Cache {
+	Heap_Cache_Bin bins[HEAP_CACHE_BIN_COUNT];
+	u64 index;
+	volatile bool owned;
+	alignat(CACHE_LINE_SIZE) void *volatile remote_free_head;
+} Heap_Thread_Cache;
+
+// #Global
+ogb_instance Heap_Thread_Cache *heap_thread_caches[HEAP_MAX_THREAD_CACHES];
+ogb_instance u64 heap_thread_cache_count;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Heap_Thread_Cache *heap_thread_caches[HEAP_MAX_THREAD_CACHES];
+u64 heap_thread_cache_count = 1; // 0 means no owner
+thread_local Heap_Thread_Cache *heap_thread_cache = 0;
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
+inline u64 heap_chunk_owner(Heap_Allocation_Metadata *meta) {
+	return meta->size >> HEAP_CHUNK_OWNER_SHIFT;
+}
 
-typedef struct Arena {
-	void *start;
-	void *next;
+// Takes a new cache or adopts one from an exited thread. heap_lock must be held.
+Heap_Thread_Cache *heap_acquire_thread_cache_locked() {
+	for (u64 i = 1; i < heap_thread_cache_count; i += 1) {
+		Heap_Thread_Cache *cache = heap_thread_caches[i];
+		if (!cache->owned) {
+			cache->owned = true;
+			return cache;
+		}
+	}
+	
+	if (heap_thread_cache_count >= HEAP_MAX_THREAD_CACHES) return 0;
+	
+	Heap_Allocation_Metadata *meta = heap_alloc_chunk_aligned_locked(align_next(sizeof(Heap_Allocation_Metadata)+sizeof(Heap_Thread_Cache), HEAP_ALIGNMENT), CACHE_LINE_SIZE);
+	Heap_Thread_Cache *cache = (Heap_Thread_Cache*)((u8*)meta+sizeof(Heap_Allocation_Metadata));
+	memset(cache, 0, sizeof(Heap_Thread_Cache));
+	cache->index = heap_thread_cache_count;
+	cache->owned = true;
+	
+	heap_thread_caches[cache->index] = cache;
+	heap_thread_cache_count += 1;
+	
+	return cache;
+}
+
+void heap_cache_bin_push(Heap_Cache_Bin *bin, Heap_Allocation_Metadata *meta) {
+#if CONFIGURATION == DEBUG
+	meta->signature = HEAP_CACHED_SIGNATURE;
+#endif
+	void *p = (u8*)meta+sizeof(Heap_Allocation_Metadata);
+	*(void**)p = bin->head;
+	bin->head = p;
+	bin->count += 1;
+}
+Heap_Allocation_Metadata *heap_cache_bin_pop(Heap_Cache_Bin *bin) {
+	void *p = bin->head;
+	bin->head = *(void**)p;
+	bin->count -= 1;
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+#if CONFIGURATION == DEBUG
+	assert(meta->signature == HEAP_CACHED_SIGNATURE, "Heap error: a cached chunk was corrupted. You probably wrote to memory after freeing it.");
+	meta->signature = HEAP_META_SIGNATURE;
+#endif
+	return meta;
+}
+
+// Moves count chunks from the bin back to the free lists. heap_lock must be held.
+void heap_cache_bin_flush_locked(Heap_Cache_Bin *bin, u64 count) {
+	for (u64 i = 0; i < count && bin->head; i += 1) {
+		Heap_Allocation_Metadata *meta = heap_cache_bin_pop(bin);
+		heap_free_chunk_locked(meta);
+	}
+}
+
+// Puts chunks freed by other threads in the bins, or back in the free lists if bins are full.
+void heap_thread_cache_drain_remote_frees(Heap_Thread_Cache *cache) {
+	void *p;
+	do {
+		p = cache->remote_free_head;
+	} while (p && !compare_and_swap_64((volatile u64*)&cache->remote_free_head, 0, (u64)p));
+	
+	bool locked = false;
+	while (p) {
+		void *next = *(void**)p;
+		Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+		Heap_Cache_Bin *bin = &cache->bins[heap_chunk_size(meta)/HEAP_ALIGNMENT-1];
+		
+#if CONFIGURATION == DEBUG
+		meta->signature = HEAP_CACHED_SIGNATURE;
+#endif
+		if (bin->count < HEAP_CACHE_BIN_CAPACITY) {
+			*(void**)p = bin->head;
+			bin->head = p;
+			bin->count += 1;
+		} else {
+			if (!locked) {
+				spinlock_acquire_or_wait(&heap_lock);
+				locked = true;
+			}
+#if CONFIGURATION == DEBUG
+			meta->signature = HEAP_META_SIGNATURE;
+#endif
+			heap_free_chunk_locked(meta);
+		}
+		
+		p = next;
+	}
+	if (locked) spinlock_release(&heap_lock);
+}
+
+// Flushes everything in this thread's cache back to the heap and lets another thread adopt it.
+// Called when a Thread exits.
+void heap_thread_cache_release() {
+	Heap_Thread_Cache *cache = heap_thread_cache;
+	if (!cache) return;
+	
+	heap_thread_cache_drain_remote_frees(cache);
+	
+	spinlock_acquire_or_wait(&heap_lock);
+	for (u64 i = 0; i < HEAP_CACHE_BIN_COUNT; i += 1) {
+		heap_cache_bin_flush_locked(&cache->bins[i], cache->bins[i].count);
+	}
+	cache->owned = false;
+	spinlock_release(&heap_lock);
+	
+	heap_thread_cache = 0;
+}
+
+///
+// Heap instrumentation
+///
+// Define HEAP_INSTRUMENTATION 1 to track how many allocations and bytes are live per
+// allocation tag. Allocations get the tag of the innermost heap_tag_scope() on the thread.
+// Counters are per thread so the hot paths don't need atomics, heap_get_tag_stats() sums them.
+// heap_get_stats() also walks the heap blocks for free space and fragmentation, so call it
+// now and then rather than every allocation. With ENABLE_PROFILING the stats are written as
+// counter events to google_trace.json every HEAP_INSTRUMENTATION_TRACE_INTERVAL seconds.
+//
+// Bytes are counted in whole chunks, so a bit more than what was asked for.
+// Peak bytes are the peak seen by heap_get_stats(), which os_update() calls through
+// heap_instrumentation_update() when profiling.
+
+#ifndef HEAP_INSTRUMENTATION
+	#define HEAP_INSTRUMENTATION 0
+#endif
+#ifndef HEAP_INSTRUMENTATION_TRACE_INTERVAL
+	#define HEAP_INSTRUMENTATION_TRACE_INTERVAL 0.1
+#endif
+
+#define HEAP_MAX_TAGS 64
+
+typedef struct Heap_Tag_Stats {
+	string name;
+	s64 allocation_count; // Live
+	s64 allocated_bytes; // Live
+	u64 peak_bytes;
+	u64 total_allocations; // Ever
+	u64 temporary_bytes; // Ever, from talloc
+} Heap_Tag_Stats;
+
+typedef struct Heap_Block_Stats {
 	u64 size;
+	u64 free_bytes;
+	u64 free_chunk_count;
+	u64 largest_free_chunk;
+	bool decommitted;
+} Heap_Block_Stats;
+
+typedef struct Heap_Stats {
+	s64 allocation_count;
+	s64 allocated_bytes;
+	u64 peak_bytes;
+	u64 total_allocations;
+	u64 temporary_bytes;
+	
+	u64 large_allocation_count;
+	u64 large_allocation_bytes;
+	
+	u64 block_count;
+	u64 block_bytes;
+	u64 free_bytes;
+	u64 free_chunk_count;
+	u64 largest_free_chunk;
+	// 0 when all free space is in one chunk, close to 1 when it's in many small ones
+	float64 fragmentation;
+} Heap_Stats;
+
+typedef struct Heap_Tag_Counters {
+	s64 allocation_count;
+	s64 allocated_bytes;
+	u64 total_allocations;
+	u64 temporary_bytes;
+} Heap_Tag_Counters;
+
+// Threads take one of these and give it back when they exit. Counters are kept so
+// the sums stay right when something is freed on another thread than it was allocated on.
+typedef struct Heap_Instrumentation_Thread {
+	Heap_Tag_Counters tags[HEAP_MAX_TAGS];
+	volatile bool owned;
+} Heap_Instrumentation_Thread;
+
+// #Global
+ogb_instance string heap_tag_names[HEAP_MAX_TAGS];
+ogb_instance u64 heap_tag_count;
+ogb_instance Heap_Instrumentation_Thread *heap_instrumentation_threads[HEAP_MAX_THREAD_CACHES];
+ogb_instance u64 heap_instrumentation_thread_count;
+ogb_instance Spinlock heap_instrumentation_lock;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+string heap_tag_names[HEAP_MAX_TAGS] = { {8, (u8*)"untagged"} };
+u64 heap_tag_count = 1;
+Heap_Instrumentation_Thread *heap_instrumentation_threads[HEAP_MAX_THREAD_CACHES];
+u64 heap_instrumentation_thread_count = 1; // 0 is shared by threads that couldn't get their own
+Heap_Instrumentation_Thread heap_instrumentation_shared;
+Spinlock heap_instrumentation_lock;
+u64 heap_tag_peak_bytes[HEAP_MAX_TAGS];
+u64 heap_peak_bytes = 0;
+thread_local u64 heap_current_tag = 0;
+thread_local Heap_Instrumentation_Thread *heap_instrumentation_thread = 0;
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+// Finds or registers a tag. name needs to stay alive, so a string literal.
+// Names are written before the count that makes them visible, so the first look can skip the lock.
+u64 heap_get_tag(string name) {
+	u64 count = atomic_load_acquire_64((volatile u64*)&heap_tag_count);
+	for (u64 i = 0; i < count; i += 1) {
+		if (strings_match(heap_tag_names[i], name)) return i;
+	}
+	
+	spinlock_acquire_or_wait(&heap_instrumentation_lock);
+	u64 tag = 0;
+	for (; tag < heap_tag_count; tag += 1) {
+		if (strings_match(heap_tag_names[tag], name)) break;
+	}
+	if (tag == heap_tag_count) {
+		assert(heap_tag_count < HEAP_MAX_TAGS, "Too many heap tags. Max is %d.", HEAP_MAX_TAGS);
+		heap_tag_names[tag] = name;
+		atomic_store_release_64((volatile u64*)&heap_tag_count, heap_tag_count + 1);
+	}
+	spinlock_release(&heap_instrumentation_lock);
+	return tag;
+}
+// Returns the previous tag
+u64 heap_set_tag(u64 tag) {
+	assert(tag < heap_tag_count, "Bad heap tag");
+	u64 previous = heap_current_tag;
+	heap_current_tag = tag;
+	return previous;
+}
+
+#if HEAP_INSTRUMENTATION
+#define heap_tag_scope(name) \
+	for (u64 _heap_previous_tag = heap_set_tag(heap_get_tag(STR(name))), _heap_tag_done = 0; \
+		_heap_tag_done == 0; \
+		_heap_tag_done = 1, heap_set_tag(_heap_previous_tag))
+#else
+	#define heap_tag_scope(...)
+#endif
+
+Heap_Instrumentation_Thread *heap_instrumentation_thread_acquire() {
+	spinlock_acquire_or_wait(&heap_instrumentation_lock);
+	
+	Heap_Instrumentation_Thread *t = 0;
+	for (u64 i = 1; i < heap_instrumentation_thread_count; i += 1) {
+		if (!heap_instrumentation_threads[i]->owned) {
+			t = heap_instrumentation_threads[i];
+			break;
+		}
+	}
+	if (!t && heap_instrumentation_thread_count < HEAP_MAX_THREAD_CACHES) {
+		// Not from the heap, we are in the middle of a heap_alloc
+		u64 size = align_next(sizeof(Heap_Instrumentation_Thread), os.page_size);
+		t = (Heap_Instrumentation_Thread*)os_reserve_pages(size);
+		assert(t, "Failed reserving memory for heap instrumentation");
+		os_commit_pages(t, size);
+		heap_instrumentation_threads[heap_instrumentation_thread_count] = t;
+		heap_instrumentation_thread_count += 1;
+	}
+	if (t) t->owned = true;
+	
+	spinlock_release(&heap_instrumentation_lock);
+	
+	return t;
+}
+// Called when a Thread exits
+void heap_instrumentation_thread_release() {
+	if (heap_instrumentation_thread) heap_instrumentation_thread->owned = false;
+	heap_instrumentation_thread = 0;
+}
+
+void heap_instrument_count(u64 tag, s64 count, s64 bytes, u64 temporary_bytes) {
+	Heap_Instrumentation_Thread *t = heap_instrumentation_thread;
+	if (!t) t = heap_instrumentation_thread = heap_instrumentation_thread_acquire();
+	
+	bool shared = !t;
+	if (shared) {
+		t = &heap_instrumentation_shared;
+		spinlock_acquire_or_wait(&heap_instrumentation_lock);
+	}
+	
+	Heap_Tag_Counters *c = &t->tags[tag];
+	c->allocation_count += count;
+	c->allocated_bytes += bytes;
+	if (count > 0) c->total_allocations += count;
+	c->temporary_bytes += temporary_bytes;
+	
+	if (shared) spinlock_release(&heap_instrumentation_lock);
+}
+
+inline void heap_instrument_alloc(Heap_Allocation_Metadata *meta) {
+#if HEAP_INSTRUMENTATION
+	u64 tag = heap_current_tag;
+	meta->size = (meta->size & ~HEAP_CHUNK_TAG_MASK) | (tag << HEAP_CHUNK_TAG_SHIFT);
+	heap_instrument_count(tag, 1, (s64)heap_chunk_size(meta), 0);
+#endif
+}
+inline void heap_instrument_dealloc(Heap_Allocation_Metadata *meta) {
+#if HEAP_INSTRUMENTATION
+	u64 tag = (meta->size & HEAP_CHUNK_TAG_MASK) >> HEAP_CHUNK_TAG_SHIFT;
+	heap_instrument_count(tag, -1, -(s64)heap_chunk_size(meta), 0);
+#endif
+}
+inline void heap_instrument_resize(Heap_Allocation_Metadata *meta, u64 old_size) {
+#if HEAP_INSTRUMENTATION
+	u64 tag = (meta->size & HEAP_CHUNK_TAG_MASK) >> HEAP_CHUNK_TAG_SHIFT;
+	heap_instrument_count(tag, 0, (s64)heap_chunk_size(meta)-(s64)old_size, 0);
+#endif
+}
+
+Heap_Tag_Stats heap_get_tag_stats(u64 tag) {
+	assert(tag < heap_tag_count, "Bad heap tag");
+	
+	Heap_Tag_Stats stats = ZERO(Heap_Tag_Stats);
+	stats.name = heap_tag_names[tag];
+	
+	// Other threads keep counting while we read, this is only a snapshot
+	spinlock_acquire_or_wait(&heap_instrumentation_lock);
+	for (u64 i = 0; i < heap_instrumentation_thread_count; i += 1) {
+		Heap_Instrumentation_Thread *t = i == 0 ? &heap_instrumentation_shared : heap_instrumentation_threads[i];
+		Heap_Tag_Counters c = t->tags[tag];
+		stats.allocation_count  += c.allocation_count;
+		stats.allocated_bytes   += c.allocated_bytes;
+		stats.total_allocations += c.total_allocations;
+		stats.temporary_bytes   += c.temporary_bytes;
+	}
+	spinlock_release(&heap_instrumentation_lock);
+	
+	if (stats.allocated_bytes > 0 && (u64)stats.allocated_bytes > heap_tag_peak_bytes[tag]) {
+		heap_tag_peak_bytes[tag] = (u64)stats.allocated_bytes;
+	}
+	stats.peak_bytes = heap_tag_peak_bytes[tag];
+	
+	return stats;
+}
+
+// Fills block_stats with up to max_blocks blocks, block_stats can be 0.
+Heap_Stats heap_get_stats(Heap_Block_Stats *block_stats, u64 max_blocks) {
+	Heap_Stats stats = ZERO(Heap_Stats);
+	
+	for (u64 tag = 0; tag < heap_tag_count; tag += 1) {
+		Heap_Tag_Stats t = heap_get_tag_stats(tag);
+		stats.allocation_count  += t.allocation_count;
+		stats.allocated_bytes   += t.allocated_bytes;
+		stats.total_allocations += t.total_allocations;
+		stats.temporary_bytes   += t.temporary_bytes;
+	}
+	if (stats.allocated_bytes > 0 && (u64)stats.allocated_bytes > heap_peak_bytes) {
+		heap_peak_bytes = (u64)stats.allocated_bytes;
+	}
+	stats.peak_bytes = heap_peak_bytes;
+	
+	spinlock_acquire_or_wait(&heap_large_allocations.lock);
+	stats.large_allocation_count = heap_large_allocations.count;
+	stats.large_allocation_bytes = heap_large_allocations.total_size;
+	spinlock_release(&heap_large_allocations.lock);
+	
+	if (!heap_initted) return stats;
+	
+	// #Sync #Speed walks every chunk
+	spinlock_acquire_or_wait(&heap_lock);
+	for (Heap_Block *block = heap_head; block; block = block->next) {
+		Heap_Block_Stats b = ZERO(Heap_Block_Stats);
+		b.size = block->size;
+		b.decommitted = block->decommitted;
+		
+		Heap_Allocation_Metadata *chunk = (Heap_Allocation_Metadata*)block->start;
+		while ((u8*)chunk < (u8*)block->end) {
+			u64 size = heap_chunk_size(chunk);
+			if (chunk->size & HEAP_CHUNK_FREE) {
+				b.free_bytes += size;
+				b.free_chunk_count += 1;
+				b.largest_free_chunk = max(b.largest_free_chunk, size);
+			}
+			chunk = heap_next_chunk(chunk);
+		}
+		
+		if (block_stats && stats.block_count < max_blocks) block_stats[stats.block_count] = b;
+		stats.block_count += 1;
+		stats.block_bytes += b.size;
+		stats.free_bytes += b.free_bytes;
+		stats.free_chunk_count += b.free_chunk_count;
+		stats.largest_free_chunk = max(stats.largest_free_chunk, b.largest_free_chunk);
+	}
+	spinlock_release(&heap_lock);
+	
+	if (stats.free_bytes) {
+		stats.fragmentation = 1.0 - (float64)stats.largest_free_chunk/(float64)stats.free_bytes;
+	}
+	
+	return stats;
+}
+
+// Writes heap counters to the profiler trace now and then. Called by os_update().
+void heap_instrumentation_update() {
+#if HEAP_INSTRUMENTATION && ENABLE_PROFILING
+	local_persist float64 last_trace_time = 0;
+	float64 now = os_get_elapsed_seconds();
+	if (now - last_trace_time < HEAP_INSTRUMENTATION_TRACE_INTERVAL) return;
+	last_trace_time = now;
+	
+	Heap_Stats stats = heap_get_stats(0, 0);
+	
+	string heap_keys[] = { STR("allocated"), STR("peak"), STR("free"), STR("largest free chunk"), STR("large allocations") };
+	float64 heap_values[] = { (float64)stats.allocated_bytes, (float64)stats.peak_bytes, (float64)stats.free_bytes, (float64)stats.largest_free_chunk, (float64)stats.large_allocation_bytes };
+	_profiler_report_counters(STR("Heap bytes"), now, heap_keys, heap_values, sizeof(heap_values)/sizeof(float64));
+	
+	string count_keys[] = { STR("live"), STR("free chunks") };
+	float64 count_values[] = { (float64)stats.allocation_count, (float64)stats.free_chunk_count };
+	_profiler_report_counters(STR("Heap allocations"), now, count_keys, count_values, 2);
+	
+	string fragmentation_key = STR("percent");
+	float64 fragmentation = stats.fragmentation*100.0;
+	_profiler_report_counters(STR("Heap fragmentation"), now, &fragmentation_key, &fragmentation, 1);
+	
+	string tag_keys[HEAP_MAX_TAGS];
+	float64 tag_values[HEAP_MAX_TAGS];
+	u64 tag_count = heap_tag_count;
+	for (u64 tag = 0; tag < tag_count; tag += 1) {
+		Heap_Tag_Stats t = heap_get_tag_stats(tag);
+		tag_keys[tag] = t.name;
+		tag_values[tag] = (float64)t.allocated_bytes;
+	}
+	_profiler_report_counters(STR("Heap bytes per tag"), now, tag_keys, tag_values, tag_count);
+#endif
+}
+
+void *heap_alloc(u64 size) {
+
+	if (!heap_initted) heap_init();
+	
+	if (size >= HEAP_LARGE_ALLOCATION_SIZE) {
+		void *p = heap_alloc_large(size, HEAP_ALIGNMENT, HEAP_LARGE_ALLOCATION_RESERVE_FACTOR);
+		heap_instrument_alloc((Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata)));
+		return p;
+	}
+	
+	size += sizeof(Heap_Allocation_Metadata);
+	
+	size = align_next(size, HEAP_ALIGNMENT);
+	size = max(size, HEAP_MIN_CHUNK_SIZE);
+	
+	Heap_Allocation_Metadata *meta = 0;
+	
+#if HEAP_ENABLE_THREAD_CACHE
+	if (size <= HEAP_CACHE_MAX_CHUNK_SIZE) {
+		Heap_Thread_Cache *cache = heap_thread_cache;
+		
+		if (cache) {
+			Heap_Cache_Bin *bin = &cache->bins[size/HEAP_ALIGNMENT-1];
+			if (!bin->head && cache->remote_free_head) {
+				heap_thread_cache_drain_remote_frees(cache);
+			}
+			if (bin->head) {
+				meta = heap_cache_bin_pop(bin);
+			}
+		}
+		
+		if (!meta) {
+			// #Sync
+			spinlock_acquire_or_wait(&heap_lock);
+			
+			if (!cache) cache = heap_thread_cache = heap_acquire_thread_cache_locked();
+			
+			meta = heap_alloc_chunk_locked(size, 0);
+			
+			// Chunks that got some slack from not being split still go in the bin of their
+			// real size, so heap_dealloc always finds the same bin. Unless they got too big.
+			if (cache && heap_chunk_size(meta) <= HEAP_CACHE_MAX_CHUNK_SIZE) {
+				meta->size |= cache->index << HEAP_CHUNK_OWNER_SHIFT;
+				
+				// Refill with a batch of chunks of the same size while we have the lock.
+				Heap_Cache_Bin *bin = &cache->bins[size/HEAP_ALIGNMENT-1];
+				for (u64 i = 0; i < HEAP_CACHE_BATCH_COUNT && bin->count < HEAP_CACHE_BIN_CAPACITY; i += 1) {
+					Heap_Allocation_Metadata *extra = heap_alloc_chunk_locked(size, 0);
+					u64 extra_size = heap_chunk_size(extra);
+					if (extra_size > HEAP_CACHE_MAX_CHUNK_SIZE) {
+						heap_free_chunk_locked(extra);
+						break;
+					}
+					extra->size |= cache->index << HEAP_CHUNK_OWNER_SHIFT;
+					heap_cache_bin_push(&cache->bins[extra_size/HEAP_ALIGNMENT-1], extra);
+				}
+			}
+			
+			spinlock_release(&heap_lock);
+		}
+	} else
+#endif // HEAP_ENABLE_THREAD_CACHE
+	{
+		// #Sync #Speed oof
+		spinlock_acquire_or_wait(&heap_lock);
+		meta = heap_alloc_chunk_locked(size, 0);
+		spinlock_release(&heap_lock);
+	}
+	
+	heap_instrument_alloc(meta);
+	
+	void *p = ((u8*)meta)+sizeof(Heap_Allocation_Metadata);
+	assert((u64)p % HEAP_ALIGNMENT == 0, "Internal heap error. Result pointer is not aligned to HEAP_ALIGNMENT");
+	return p;
+}
+// Same as heap_alloc() but the memory is zero. We only memset what we don't already know is
+// zero: large allocations and chunks from untouched parts of heap blocks are fresh from the OS.
+void *heap_alloc_zeroed(u64 size) {
+	
+	if (!heap_initted) heap_init();
+	
+	if (size >= HEAP_LARGE_ALLOCATION_SIZE) {
+		void *p = heap_alloc_large(size, HEAP_ALIGNMENT, HEAP_LARGE_ALLOCATION_RESERVE_FACTOR);
+		heap_instrument_alloc((Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata)));
+		return p;
+	}
+	
+	u64 chunk_size = align_next(size + sizeof(Heap_Allocation_Metadata), HEAP_ALIGNMENT);
+	chunk_size = max(chunk_size, HEAP_MIN_CHUNK_SIZE);
+	
+#if HEAP_ENABLE_THREAD_CACHE
+	// Cached chunks have been used, and they are small anyway
+	if (chunk_size <= HEAP_CACHE_MAX_CHUNK_SIZE) {
+		void *p = heap_alloc(size);
+		memset(p, 0, size);
+		return p;
+	}
+#endif
+	
+	bool zeroed;
+	// #Sync
+	spinlock_acquire_or_wait(&heap_lock);
+	Heap_Allocation_Metadata *meta = heap_alloc_chunk_locked(chunk_size, &zeroed);
+	spinlock_release(&heap_lock);
+	
+	heap_instrument_alloc(meta);
+	
+	void *p = ((u8*)meta)+sizeof(Heap_Allocation_Metadata);
+	if (!zeroed) memset(p, 0, size);
+	return p;
+}
+// For alignments over HEAP_ALIGNMENT. These skip the thread caches, so they're slower than
+// heap_alloc(), but heap_dealloc() and heap_reallocate_in_place() work on them like normal.
+void *heap_alloc_aligned(u64 size, u64 alignment) {
+	assert(alignment && (alignment & (alignment-1)) == 0, "Heap alignment must be a power of two, got %llu", alignment);
+	
+	if (alignment <= HEAP_ALIGNMENT) return heap_alloc(size);
+
+	if (!heap_initted) heap_init();
+	
+	if (size >= HEAP_LARGE_ALLOCATION_SIZE) {
+		void *p = heap_alloc_large(size, alignment, HEAP_LARGE_ALLOCATION_RESERVE_FACTOR);
+		heap_instrument_alloc((Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata)));
+		return p;
+	}
+	
+	size += sizeof(Heap_Allocation_Metadata);
+	size = align_next(size, HEAP_ALIGNMENT);
+	size = max(size, HEAP_MIN_CHUNK_SIZE);
+	
+	// #Sync
+	spinlock_acquire_or_wait(&heap_lock);
+	Heap_Allocation_Metadata *meta = heap_alloc_chunk_aligned_locked(size, alignment);
+	spinlock_release(&heap_lock);
+	
+	heap_instrument_alloc(meta);
+	
+	void *p = ((u8*)meta)+sizeof(Heap_Allocation_Metadata);
+	assert((u64)p % alignment == 0, "Internal heap error. Result pointer is not aligned to %llu", alignment);
+	return p;
+}
+void heap_dealloc(void *p) {
+	
+	if (!heap_initted) heap_init();
+	
+	if (!is_pointer_in_program_memory(p)) {
+		// Header is only safe to read if it really is a large allocation
+		if (HEAP_INSTRUMENTATION && heap_is_pointer_in_large_allocation(p)) {
+			heap_instrument_dealloc((Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata)));
+		}
+		heap_dealloc_large(p);
+		return;
+	}
+	
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+	check_meta(meta);
+	
+	heap_instrument_dealloc(meta);
+	
+	u64 owner = heap_chunk_owner(meta);
+	
+	if (owner) {
+		u64 size = heap_chunk_size(meta);
+		Heap_Thread_Cache *cache = heap_thread_caches[owner];
+#if CONFIGURATION == DEBUG
+		memset(p, 0x69696969, size-sizeof(Heap_Allocation_Metadata));
+#endif
+		
+		if (cache == heap_thread_cache) {
+			Heap_Cache_Bin *bin = &cache->bins[size/HEAP_ALIGNMENT-1];
+			heap_cache_bin_push(bin, meta);
+			if (bin->count > HEAP_CACHE_BIN_CAPACITY) {
+				// #Sync
+				spinlock_acquire_or_wait(&heap_lock);
+				heap_cache_bin_flush_locked(bin, HEAP_CACHE_BATCH_COUNT);
+				spinlock_release(&heap_lock);
+			}
+		} else {
+			// Not ours, give it back to the owning thread
+#if CONFIGURATION == DEBUG
+			meta->signature = HEAP_CACHED_SIGNATURE;
+#endif
+			void *head;
+			do {
+				head = cache->remote_free_head;
+				*(void**)p = head;
+			} while (!compare_and_swap_64((volatile u64*)&cache->remote_free_head, (u64)p, (u64)head));
+		}
+		return;
+	}
+	
+	// #Sync #Speed oof
+	spinlock_acquire_or_wait(&heap_lock);
+	heap_free_chunk_locked(meta);
+	spinlock_release(&heap_lock);
+}
+
+// Tries to grow or shrink an allocation without moving it.
+// Growing works if the next chunk is free and big enough.
+bool heap_reallocate_in_place(void *p, u64 size) {
+	
+	if (!heap_initted) heap_init();
+	
+	if (!is_pointer_in_program_memory(p)) {
+		// Header is only safe to read if it really is a large allocation
+		assert(heap_is_pointer_in_large_allocation(p), "A bad pointer was passed to heap reallocate: it's not in program memory and it's not a large allocation either.");
+		Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+		u64 old_size = heap_chunk_size(meta);
+		bool ok = heap_resize_large_in_place(p, size);
+		if (ok) heap_instrument_resize(meta, old_size);
+		return ok;
+	}
+	
+	// Should move to its own pages
+	if (size >= HEAP_LARGE_ALLOCATION_SIZE) return false;
+	
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+	check_meta(meta);
+	
+	u64 new_size = align_next(size + sizeof(Heap_Allocation_Metadata), HEAP_ALIGNMENT);
+	new_size = max(new_size, HEAP_MIN_CHUNK_SIZE);
+	u64 old_size = heap_chunk_size(meta);
+	
+	// Cached chunks need to keep their size so they go back to the right bin
+	if (heap_chunk_owner(meta)) return new_size <= old_size;
+	
+	// #Sync
+	spinlock_acquire_or_wait(&heap_lock);
+	
+	Heap_Block *block = meta->block;
+	bool ok = false;
+	
+	if (new_size <= old_size) {
+		if (old_size-new_size >= HEAP_MIN_CHUNK_SIZE) {
+			// Cut off the tail and free it like any other chunk so it merges with the next one
+			meta->size = (meta->size & ~HEAP_CHUNK_SIZE_MASK) | new_size;
+			Heap_Allocation_Metadata *tail = heap_next_chunk(meta);
+			tail->size = old_size-new_size;
+			tail->block = block;
+#if CONFIGURATION == DEBUG
+			tail->signature = HEAP_META_SIGNATURE;
+#endif
+			heap_free_chunk_locked(tail);
+		}
+		ok = true;
+	} else {
+		Heap_Allocation_Metadata *next = heap_next_chunk(meta);
+		u64 next_size = heap_chunk_size(next);
+		
+		if ((next->size & HEAP_CHUNK_FREE) && old_size+next_size >= new_size) {
+			heap_remove_free_chunk((Heap_Free_Node*)next);
+			heap_unlock_chunk_pages(next, next_size);
+			
+			u64 combined_size = old_size+next_size;
+			if (combined_size-new_size >= HEAP_MIN_CHUNK_SIZE) {
+				Heap_Free_Node *remainder = heap_make_free_chunk((u8*)meta+new_size, combined_size-new_size, block);
+				heap_lock_free_chunk_pages(remainder);
+			} else {
+				new_size = combined_size;
+			}
+			
+			meta->size = (meta->size & ~HEAP_CHUNK_SIZE_MASK) | new_size;
+			if (new_size == combined_size) heap_next_chunk(meta)->size &= ~HEAP_CHUNK_PREV_FREE;
+#if CONFIGURATION == DEBUG
+			block->total_allocated += new_size-old_size;
+#endif
+			ok = true;
+		}
+	}
+	
+#if VERY_DEBUG
+	sanity_check_block(block);
+#endif
+	
+	spinlock_release(&heap_lock);
+	
+	if (ok) heap_instrument_resize(meta, old_size);
+	
+	return ok;
+}
+
+// Number of bytes usable in the allocation (may be slightly more than what was requested)
+u64 heap_get_allocation_size(void *p) {
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+	if (!is_pointer_in_program_memory(p)) {
+		assert(heap_is_pointer_in_large_allocation(p), "Bad pointer passed to heap_get_allocation_size");
+		return heap_chunk_size(meta)-sizeof(Heap_Allocation_Metadata);
+	}
+	check_meta(meta);
+	return heap_chunk_size(meta)-sizeof(Heap_Allocation_Metadata);
+}
+
+void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
+	switch (message) {
+		case ALLOCATOR_ALLOCATE: {
+			return heap_alloc(size);
+			break;
+		}
+		case ALLOCATOR_ALLOCATE_ALIGNED: {
+			return heap_alloc_aligned(size, (u64)p);
+		}
+		case ALLOCATOR_ALLOCATE_ZEROED: {
+			return heap_alloc_zeroed(size);
+		}
+		case ALLOCATOR_DEALLOCATE: {
+			heap_dealloc(p);
+			return 0;
+		}
+		case ALLOCATOR_REALLOCATE: {
+			if (!p) {
+				return heap_alloc(size);
+			}
+			assert(is_pointer_valid(p), "Invalid pointer passed to heap allocator reallocate");
+			if (heap_reallocate_in_place(p, size)) return p;
+			u64 old_size = heap_get_allocation_size(p);
+			void *new;
+			if (size >= HEAP_LARGE_ALLOCATION_SIZE) {
+				new = heap_alloc_large(size, HEAP_ALIGNMENT, HEAP_LARGE_REALLOCATION_RESERVE_FACTOR);
+			} else {
+				new = heap_alloc(size);
+			}
+			memcpy(new, p, min(size, old_size));
+			heap_dealloc(p);
+			return new;
+		}
+	}
+	return 0;
+}
+
+Allocator get_heap_allocator() {
+	Allocator heap_allocator;
+	
+	heap_allocator.proc = heap_allocator_proc;
+	heap_allocator.data = 0;
+	
+	return heap_allocator;
+}
+
+///
+///
+// Arena
+///
+// Reserves a big range of address space up front and commits pages as pushes reach them.
+// When the reservation runs out we chain on a new one, so pointers from an arena never move.
+// arena_reset() releases chained reservations and decommits everything above
+// arena->high_water_mark so a big level load doesn't keep its memory forever.
+//
+// Memory is zero when it's first committed, but not after it has been reset or popped.
+// make_arena_allocator_with_memory() makes an arena in a fixed buffer which can't grow.
+
+#ifndef ARENA_DEFAULT_ALIGNMENT
+	#define ARENA_DEFAULT_ALIGNMENT 16
+#endif
+// Pages are committed this much at a time
+#define ARENA_COMMIT_SIZE KB(64)
+#ifndef ARENA_DEFAULT_HIGH_WATER_MARK
+	#define ARENA_DEFAULT_HIGH_WATER_MARK MB(1)
+#endif
+
+typedef struct Arena_Region Arena_Region;
+// At the start of every reservation
+typedef struct Arena_Region {
+	Arena_Region *previous;
+	u64 reserved_size;
+	u64 committed_size;
+	u64 dirty_size; // Furthest we've been before popping back. Committed memory past this and past Arena.next is zero.
+	bool is_fixed; // Memory was given to us, we can't commit or chain
+} Arena_Region;
+
+typedef struct Arena {
+	Arena_Region *region; // Current region
+	u64 next; // Offset in current region
+	
+	Arena_Region *first_region;
+	u64 first_next; // Where the arena starts over on reset
+	
+	u64 reserve_size; // For each region
+	u64 high_water_mark; // How much stays committed after arena_reset()
 } Arena;
 
+typedef struct Arena_Mark {
+	Arena_Region *region;
+	u64 next;
+} Arena_Mark;
 
+Arena_Region *arena_reserve_region(Arena_Region *previous, u64 reserve_size) {
+	reserve_size = align_next(reserve_size, os.granularity);
+	
+	Arena_Region *region = (Arena_Region*)os_reserve_pages(reserve_size);
+	assert(region, "Failed reserving %llu bytes for arena. Out of address space?", reserve_size);
+	os_commit_pages(region, min(ARENA_COMMIT_SIZE, reserve_size));
+	
+	region->previous = previous;
+	region->reserved_size = reserve_size;
+	region->committed_size = min(ARENA_COMMIT_SIZE, reserve_size);
+	region->dirty_size = 0;
+	region->is_fixed = false;
+	
+	return region;
+}
 
-// Allocates arena from heap
-Arena make_arena(u64 size) {
-	size = align_next(size, 8);
-	Arena arena;
+// Reserves reserve_size bytes of address space and chains on more of that when needed.
+Arena make_arena(u64 reserve_size) {
+	Arena arena = ZERO(Arena);
 	
-	arena.start = alloc(get_heap_allocator(), size);
-	arena.next = arena.start;
-	arena.size = size;
+	arena.reserve_size = max(align_next(reserve_size, os.granularity), os.granularity);
+	arena.high_water_mark = ARENA_DEFAULT_HIGH_WATER_MARK;
+	arena.region = arena_reserve_region(0, arena.reserve_size);
+	arena.next = sizeof(Arena_Region);
+	
+	arena.first_region = arena.region;
+	arena.first_next = arena.next;
 	
 	return arena;
 }
 
+// Gives all memory back to the OS. Fixed arenas have nothing to give back.
+void arena_destroy(Arena *arena) {
+	// The arena might live inside its own first region, so don't touch it after releasing that
+	Arena_Region *region = arena->region;
+	while (region) {
+		Arena_Region *previous = region->previous;
+		if (!region->is_fixed) os_release_pages(region, region->reserved_size);
+		region = previous;
+	}
+}
+
+void *arena_push_aligned(Arena *arena, u64 size, u64 alignment) {
+	assert(alignment && (alignment & (alignment-1)) == 0, "Arena alignment must be a power of two");
+	
+	Arena_Region *region = arena->region;
+	u64 offset = align_next((u64)region + arena->next, alignment) - (u64)region;
+	
+	if (offset + size > region->reserved_size) {
+		assert(!region->is_fixed, "Arena ran out of memory. It was made with fixed memory so it can't grow.");
+		
+		region = arena_reserve_region(region, max(arena->reserve_size, sizeof(Arena_Region)+size+alignment));
+		arena->region = region;
+		offset = align_next((u64)region + sizeof(Arena_Region), alignment) - (u64)region;
+	}
+	
+	if (offset + size > region->committed_size) {
+		u64 new_committed_size = min(align_next(offset + size, ARENA_COMMIT_SIZE), region->reserved_size);
+		os_commit_pages((u8*)region + region->committed_size, new_committed_size - region->committed_size);
+		region->committed_size = new_committed_size;
+	}
+	
+	arena->next = offset + size;
+	
+	return (u8*)region + offset;
+}
 void *arena_push(Arena *arena, u64 size) {
-	void *p = arena->next;
-	arena->next = (u8*)arena->next + size;
+	return arena_push_aligned(arena, size, ARENA_DEFAULT_ALIGNMENT);
+}
+// Only clears memory that was used before the arena was last reset or popped
+void *arena_push_aligned_zeroed(Arena *arena, u64 size, u64 alignment) {
+	Arena_Region *region = arena->region;
+	u64 zero_from = max(region->dirty_size, arena->next);
+	
+	u8 *p = (u8*)arena_push_aligned(arena, size, alignment);
+	
+	u64 offset = (u64)(p - (u8*)region);
+	if (arena->region == region && offset < zero_from) {
+		memset(p, 0, min(size, zero_from-offset));
+	}
 	return p;
 }
 #define arena_push_struct(parena, type) arena_push((parena), sizeof(type))
 
+Arena_Mark arena_mark(Arena *arena) {
+	Arena_Mark mark;
+	mark.region = arena->region;
+	mark.next = arena->next;
+	return mark;
+}
+
+// Everything pushed after the mark is gone. Regions chained after the mark are released.
+void arena_pop_to_mark(Arena *arena, Arena_Mark mark) {
+	while (arena->region != mark.region) {
+		Arena_Region *region = arena->region;
+		assert(region->previous, "Arena mark is not from this arena, or it was already popped");
+		arena->region = region->previous;
+		arena->region->dirty_size = arena->region->committed_size; // We don't know how far it got before chaining
+		os_release_pages(region, region->reserved_size);
+	}
+	assert(mark.next <= arena->next, "Arena mark is past the current position. It was probably already popped.");
+	arena->region->dirty_size = max(arena->region->dirty_size, arena->next);
+	arena->next = mark.next;
+}
+
+void arena_reset(Arena *arena) {
+	Arena_Mark start;
+	start.region = arena->first_region;
+	start.next = arena->first_next;
+	arena_pop_to_mark(arena, start);
+	
+	Arena_Region *region = arena->region;
+	if (region->is_fixed) return;
+	
+	u64 keep_committed_size = align_next(max(arena->next, arena->high_water_mark), ARENA_COMMIT_SIZE);
+	if (region->committed_size > keep_committed_size) {
+		os_decommit_pages((u8*)region + keep_committed_size, region->committed_size - keep_committed_size);
+		region->committed_size = keep_committed_size;
+		region->dirty_size = min(region->dirty_size, keep_committed_size);
+	}
+}
+
 void* arena_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
-	if (size > 8) size = align_next(size, 8);
 	Arena *arena = (Arena*)data;
 	switch (message) {
 		case ALLOCATOR_ALLOCATE: {
 			return arena_push(arena, size);
 		}
+		case ALLOCATOR_ALLOCATE_ALIGNED: {
+			return arena_push_aligned(arena, size, (u64)p);
+		}
+		case ALLOCATOR_ALLOCATE_ZEROED: {
+			return arena_push_aligned_zeroed(arena, size, ARENA_DEFAULT_ALIGNMENT);
+		}
 		case ALLOCATOR_DEALLOCATE: {
 			return 0;
 		}
 		case ALLOCATOR_REALLOCATE: {
-			panic("Arena allocator cannot 'reallocate'");
-			return 0;
+			return 0; // Can't, reallocate() falls back to alloc & copy
 		}
 	}
 	return 0;
 }
 
-// Allocates arena from heap
-Allocator make_arena_allocator(u64 size) {
-	void *mem = alloc(get_heap_allocator(), size + sizeof(Arena));
-	
-	Arena *arena = (Arena*)mem;
+// The Arena lives in its own first region. Free with arena_destroy((Arena*)allocator.data).
+Allocator make_arena_allocator(u64 reserve_size) {
+	Arena arena = make_arena(reserve_size);
 	
-	arena->start = (u8*)mem + sizeof(Arena);
-	arena->next = arena->start;
-	arena->size = size;
+	Arena *p = (Arena*)arena_push_struct(&arena, Arena);
+	*p = arena;
+	p->first_next = p->next;
 	
 	Allocator allocator;
-	allocator.data = arena;
+	allocator.data = p;
 	allocator.proc = arena_allocator_proc;
 	
 	return allocator;
 }
+// Arena in a fixed buffer. The Arena itself lives at the start of the buffer.
 Allocator make_arena_allocator_with_memory(u64 size, void *p) {
-	void *mem = alloc(get_heap_allocator(), size + sizeof(Arena));
+	assert(size >= sizeof(Arena_Region)+sizeof(Arena), "Not enough memory for an arena");
+	assert((u64)p % 8 == 0, "Memory for an arena needs to be 8 byte aligned");
+	
+	Arena_Region *region = (Arena_Region*)p;
+	region->previous = 0;
+	region->reserved_size = size;
+	region->committed_size = size;
+	region->dirty_size = size; // Don't know what's in there
+	region->is_fixed = true;
 	
-	Arena *arena = (Arena*)alloc(get_heap_allocator(), sizeof(Arena));
+	Arena arena = ZERO(Arena);
+	arena.region = region;
+	arena.next = sizeof(Arena_Region);
+	arena.reserve_size = size;
 	
-	arena->start = p;
-	arena->next = arena->start;
-	arena->size = size;
+	Arena *arena_p = (Arena*)arena_push_struct(&arena, Arena);
+	*arena_p = arena;
+	arena_p->first_region = region;
+	arena_p->first_next = arena_p->next;
 	
 	Allocator allocator;
-	allocator.data = arena;
+	allocator.data = arena_p;
 	allocator.proc = arena_allocator_proc;
 	
 	return allocator;
@@ -749,3 +1850,223 @@ Allocator make_arena_allocator_from_arena(Arena *arena) {
 	
 	return allocator;
 }
+
+
+///
+///
+// Temporary storage
+///
+// Per-thread scratch memory for stuff that only needs to live until the next
+// reset_temporary_storage(), which should be called at frame boundaries.
+// It's an Arena, so when it runs out it chains on more memory instead of wrapping
+// around and stomping on stuff that is still in use.
+// If a frame had to chain, the next reset swaps in one reservation that fits what that frame
+// used, so the steady state is one bump pointer again.
+// Peak usage is tracked per thread in temporary_storage_stats, and for all threads in
+// temporary_storage_peak_usage_all_threads, so TEMPORARY_STORAGE_SIZE can be sized from that.
+
+#ifndef TEMPORARY_STORAGE_SIZE
+	#define TEMPORARY_STORAGE_SIZE (1024ULL*1024ULL*2ULL) // 2mb
+#endif
+
+typedef struct Temporary_Storage_Stats {
+	u64 peak_usage; // Most bytes used between two resets
+	u64 last_usage; // Bytes used between the last two resets
+	u64 overflow_count; // How many times we had to chain on more memory
+	u64 reset_count;
+} Temporary_Storage_Stats;
+
+ogb_instance void* talloc(u64);
+ogb_instance void* talloc_aligned(u64, u64);
+ogb_instance void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void*);
+
+// #Global
+ogb_instance Allocator 
+get_temporary_allocator();
+
+ogb_instance Temporary_Storage_Stats 
+get_temporary_storage_stats();
+
+ogb_instance u64 
+get_temporary_storage_usage();
+
+ogb_instance volatile u64 temporary_storage_peak_usage_all_threads;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+thread_local Arena temporary_storage_arena = {0};
+thread_local u64 temporary_storage_chained_usage = 0; // Used in regions before the current one
+thread_local Temporary_Storage_Stats temporary_storage_stats = {0};
+thread_local Allocator temp_allocator;
+volatile u64 temporary_storage_peak_usage_all_threads = 0;
+
+ogb_instance Allocator 
+get_temporary_allocator() {
+	if (!temporary_storage_arena.region) return get_initialization_allocator();
+	return temp_allocator;
+}
+ogb_instance Temporary_Storage_Stats 
+get_temporary_storage_stats() {
+	return temporary_storage_stats;
+}
+ogb_instance u64 
+get_temporary_storage_usage() {
+	Arena *arena = &temporary_storage_arena;
+	if (!arena->region) return 0;
+	return temporary_storage_chained_usage + arena->next - (arena->region == arena->first_region ? arena->first_next : sizeof(Arena_Region));
+}
+#endif
+
+ogb_instance void* 
+temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data);
+
+ogb_instance void 
+temporary_storage_init(u64 arena_size);
+
+ogb_instance void 
+temporary_storage_deinit();
+
+ogb_instance void* 
+talloc(u64 size);
+
+ogb_instance void* 
+talloc_aligned(u64 size, u64 alignment);
+
+ogb_instance void 
+reset_temporary_storage();
+
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
+	switch (message) {
+		case ALLOCATOR_ALLOCATE: {
+			return talloc(size);
+			break;
+		}
+		case ALLOCATOR_ALLOCATE_ALIGNED: {
+			return talloc_aligned(size, (u64)p);
+		}
+		case ALLOCATOR_DEALLOCATE: {
+			return 0;
+		}
+		case ALLOCATOR_REALLOCATE: {
+			return 0; // Can't, reallocate() falls back to alloc & copy
+		}
+	}
+	return 0;
+}
+
+void temporary_storage_init(u64 arena_size) {
+	
+	temporary_storage_arena = make_arena(arena_size);
+	// Frames tend to use about the same amount every time, so don't decommit on reset
+	temporary_storage_arena.high_water_mark = temporary_storage_arena.reserve_size;
+	temporary_storage_chained_usage = 0;
+
+	temp_allocator.proc = temp_allocator_proc;
+	temp_allocator.data = 0;
+}
+
+// Only for this thread's temporary storage
+bool is_pointer_in_temporary_storage(void *p) {
+	for (Arena_Region *region = temporary_storage_arena.region; region; region = region->previous) {
+		if ((u8*)p >= (u8*)region && (u8*)p < (u8*)region + region->committed_size) return true;
+	}
+	return false;
+}
+
+void temporary_storage_record_usage() {
+	u64 usage = get_temporary_storage_usage();
+	
+	temporary_storage_stats.last_usage = usage;
+	if (usage > temporary_storage_stats.peak_usage) {
+		temporary_storage_stats.peak_usage = usage;
+		
+		u64 peak = temporary_storage_peak_usage_all_threads;
+		while (usage > peak) {
+			if (compare_and_swap_64(&temporary_storage_peak_usage_all_threads, usage, peak)) break;
+			peak = temporary_storage_peak_usage_all_threads;
+		}
+	}
+}
+
+void temporary_storage_deinit() {
+	if (!temporary_storage_arena.region) return;
+	
+	temporary_storage_record_usage();
+	arena_destroy(&temporary_storage_arena);
+	temporary_storage_arena = ZERO(Arena);
+	temporary_storage_chained_usage = 0;
+}
+
+// Slow path: commit more pages or chain on a new region
+void* talloc_grow(u64 size, u64 alignment) {
+	Arena *arena = &temporary_storage_arena;
+	
+	Arena_Region *region = arena->region;
+	u64 region_usage = arena->next - (region == arena->first_region ? arena->first_next : sizeof(Arena_Region));
+	
+	void *p = arena_push_aligned(arena, size, alignment);
+	
+	if (arena->region != region) {
+		temporary_storage_chained_usage += region_usage;
+		temporary_storage_stats.overflow_count += 1;
+	}
+	
+	return p;
+}
+
+void* talloc(u64 size) {
+	Arena *arena = &temporary_storage_arena;
+	
+#if HEAP_INSTRUMENTATION
+	heap_instrument_count(heap_current_tag, 0, 0, size);
+#endif
+	
+	// Regions are page aligned so aligning the offset aligns the pointer
+	u64 offset = align_next(arena->next, ARENA_DEFAULT_ALIGNMENT);
+	if (offset + size <= arena->region->committed_size) {
+		arena->next = offset + size;
+		return (u8*)arena->region + offset;
+	}
+	
+	return talloc_grow(size, ARENA_DEFAULT_ALIGNMENT);
+}
+void* talloc_aligned(u64 size, u64 alignment) {
+	assert(alignment && (alignment & (alignment-1)) == 0, "Alignment must be a power of two, got %llu", alignment);
+	Arena *arena = &temporary_storage_arena;
+	
+#if HEAP_INSTRUMENTATION
+	heap_instrument_count(heap_current_tag, 0, 0, size);
+#endif
+	
+	u64 offset = align_next((u64)arena->region + arena->next, alignment) - (u64)arena->region;
+	if (offset + size <= arena->region->committed_size) {
+		arena->next = offset + size;
+		return (u8*)arena->region + offset;
+	}
+	
+	return talloc_grow(size, alignment);
+}
+
+void reset_temporary_storage() {
+	Arena *arena = &temporary_storage_arena;
+	if (!arena->region) return;
+	
+	temporary_storage_record_usage();
+	temporary_storage_stats.reset_count += 1;
+	
+	if (arena->region != arena->first_region) {
+		// Last frame didn't fit, so make the first reservation big enough for it.
+		u64 reserve_size = get_next_power_of_two(temporary_storage_stats.last_usage + sizeof(Arena_Region));
+		
+		arena_destroy(arena);
+		*arena = make_arena(reserve_size);
+		arena->high_water_mark = arena->reserve_size;
+	} else {
+		arena_reset(arena);
+	}
+	
+	temporary_storage_chained_usage = 0;
+}
+
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
@@ -125,6 +125,21 @@
 					tm_scope
 					tm_scope_var
 					tm_scope_accum
+					tm_lock_stats (Mutex/RW_Lock contention counters)
+					
+		- HEAP_INSTRUMENTATION
+			Track live heap allocations and bytes per allocation tag, see heap_tag_scope() in memory.c.
+			With ENABLE_PROFILING the heap stats are also written to google_trace.json as counters.
+		
+			0: Disable
+			1: Enable
+			
+			Example:
+			
+				#define HEAP_INSTRUMENTATION 1
+				
+			Note:
+				Query with heap_get_stats() and heap_get_tag_stats().
 					
 		- OOGABOOGA_HEADLESS
             Run oogabooga in headless mode, i.e. no window, no graphics, no audio.
@@ -327,11 +342,21 @@ typedef u8 bool;
 /////
 
 #include "concurrency.c"
+#include "concurrent_hash_table.c"
 
 #include "profiling.c"
 #include "random.c"
 #include "color.c"
 #include "memory.c"
+#include "generational_handle.c"
+#include "pool.c"
+#include "slot_map.c"
+#include "deque.c"
+#include "priority_queue.c"
+#include "timers.c"
+#include "string_intern.c"
+#include "jobs.c"
+#include "sort.c"
 #include "input.c"
 
 #ifndef OOGABOOGA_HEADLESS
@@ -8,6 +8,7 @@
 #include <avrt.h>
 #include <xinput.h>
 #include <shellscalingapi.h>
+#include <psapi.h>
 
 // #Cleanup
 #if COMPILER_CLANG
@@ -21,6 +22,9 @@
 #define VIRTUAL_MEMORY_BASE ((void*)0x0000690000000000ULL)
 void* heap_alloc(u64);
 void heap_dealloc(void*);
+void heap_decommit_idle_blocks();
+void heap_instrumentation_update();
+void heap_instrumentation_thread_release();
 
 u16 *win32_fixed_utf8_to_null_terminated_wide(string utf8, Allocator allocator) {
 
@@ -618,11 +622,33 @@ DWORD WINAPI win32_thread_invoker(LPVOID param) {
 	
 	t->proc(t);
 	
-	heap_dealloc(temporary_storage);
+	temporary_storage_deinit();
+	
+	heap_thread_cache_release();
+	heap_instrumentation_thread_release();
 	
 	return 0;
 }
 
+// Threads we didn't start (OS callback threads, threads from other libraries) can still
+// claim a heap thread cache, so the loader calls this when any thread exits to give it back.
+// For our own threads win32_thread_invoker already did it and this does nothing.
+void NTAPI win32_tls_callback(PVOID module, DWORD reason, PVOID reserved) {
+	if (reason != DLL_THREAD_DETACH) return;
+	heap_thread_cache_release();
+	heap_instrumentation_thread_release();
+}
+#if COMPILER_MSVC
+	#pragma comment(linker, "/INCLUDE:_tls_used")
+	#pragma comment(linker, "/INCLUDE:win32_tls_callback_entry")
+	#pragma const_seg(".CRT$XLB")
+	const PIMAGE_TLS_CALLBACK win32_tls_callback_entry = win32_tls_callback;
+	#pragma const_seg()
+#else
+	// We use thread_local, so the TLS directory that runs .CRT$XL* is linked in anyway
+	__attribute__((section(".CRT$XLB"), used)) const PIMAGE_TLS_CALLBACK win32_tls_callback_entry = win32_tls_callback;
+#endif
+
 
 ////// DEPRECATED   vvvvvvvvvvvvvvvvv
 Thread* os_make_thread(Thread_Proc proc, Allocator allocator) {
@@ -742,6 +768,44 @@ void os_binary_semaphore_signal(Binary_Semaphore *sem) {
 	SetEvent(sem->os_event);
 }
 
+// WaitOnAddress is Windows 8+ and lives in synchronization.lib, so we load it ourselves instead
+// of making everyone link another library. Without it waiters just yield.
+typedef BOOL (WINAPI *Win32_Wait_On_Address_Proc)(volatile VOID *address, PVOID compare_address, SIZE_T address_size, DWORD milliseconds);
+typedef VOID (WINAPI *Win32_Wake_By_Address_Proc)(PVOID address);
+Win32_Wait_On_Address_Proc win32_wait_on_address = 0;
+Win32_Wake_By_Address_Proc win32_wake_by_address_single = 0;
+Win32_Wake_By_Address_Proc win32_wake_by_address_all = 0;
+volatile bool win32_wait_on_address_loaded = false;
+
+void win32_load_wait_on_address() {
+	HMODULE synch = LoadLibraryW(L"api-ms-win-core-synch-l1-2-0.dll");
+	if (synch) {
+		win32_wake_by_address_single = (Win32_Wake_By_Address_Proc)GetProcAddress(synch, "WakeByAddressSingle");
+		win32_wake_by_address_all    = (Win32_Wake_By_Address_Proc)GetProcAddress(synch, "WakeByAddressAll");
+		win32_wait_on_address        = (Win32_Wait_On_Address_Proc)GetProcAddress(synch, "WaitOnAddress");
+	}
+	MEMORY_BARRIER;
+	win32_wait_on_address_loaded = true;
+}
+
+void os_wait_on_address(volatile u32 *address, u32 expected) {
+	if (!win32_wait_on_address_loaded) win32_load_wait_on_address();
+	
+	if (win32_wait_on_address) {
+		win32_wait_on_address(address, &expected, sizeof(u32), INFINITE);
+	} else {
+		os_yield_thread();
+	}
+}
+void os_wake_one_on_address(volatile u32 *address) {
+	if (!win32_wait_on_address_loaded) win32_load_wait_on_address();
+	if (win32_wake_by_address_single) win32_wake_by_address_single((PVOID)address);
+}
+void os_wake_all_on_address(volatile u32 *address) {
+	if (!win32_wait_on_address_loaded) win32_load_wait_on_address();
+	if (win32_wake_by_address_all) win32_wake_by_address_all((PVOID)address);
+}
+
 
 void os_sleep(u32 ms) {
     Sleep(ms);
@@ -1029,7 +1093,7 @@ bool os_read_entire_file_handle(File f, string *result, Allocator allocator) {
     }
     
     u64 actual_read = 0;
-    result->data = (u8*)alloc(allocator, file_size.QuadPart);
+    result->data = (u8*)alloc_uninitialized(allocator, file_size.QuadPart);
     result->count = file_size.QuadPart;
     
     bool ok = os_file_read(f, result->data, file_size.QuadPart, &actual_read);
@@ -1455,6 +1519,70 @@ os_lock_program_memory_pages(void *start, u64 size) {
 #endif
 }
 
+void*
+os_reserve_pages(u64 size) {
+	assert(size % os.page_size == 0, "size was not aligned to page size in os_reserve_pages");
+	return VirtualAlloc(0, size, MEM_RESERVE, PAGE_READWRITE);
+}
+
+void
+os_release_pages(void *p, u64 size) {
+	(void)size;
+	BOOL ok = VirtualFree(p, 0, MEM_RELEASE);
+	assert(ok, "VirtualFree Failed with error %d", GetLastError());
+}
+
+void
+os_commit_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When committing memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When committing memory pages, the size must be aligned to page_size");
+	
+	// Program memory is made of several regions and VirtualAlloc/VirtualFree can't cross those,
+	// so we go one run of pages at a time. A run from VirtualQuery never crosses regions.
+	u8 *p = (u8*)start;
+	u8 *end = (u8*)start+size;
+	while (p < end) {
+		MEMORY_BASIC_INFORMATION info;
+		SIZE_T ok = VirtualQuery(p, &info, sizeof(info));
+		assert(ok, "VirtualQuery Failed with error %d", GetLastError());
+		u8 *run_end = min((u8*)info.BaseAddress+info.RegionSize, end);
+		
+		void *result = VirtualAlloc(p, (SIZE_T)(run_end-p), MEM_COMMIT, PAGE_READWRITE);
+		assert(result, "VirtualAlloc Failed with error %d", GetLastError());
+		
+		p = run_end;
+	}
+}
+
+void
+os_decommit_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When decommitting memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When decommitting memory pages, the size must be aligned to page_size");
+	
+	u8 *p = (u8*)start;
+	u8 *end = (u8*)start+size;
+	while (p < end) {
+		MEMORY_BASIC_INFORMATION info;
+		SIZE_T ok = VirtualQuery(p, &info, sizeof(info));
+		assert(ok, "VirtualQuery Failed with error %d", GetLastError());
+		u8 *run_end = min((u8*)info.BaseAddress+info.RegionSize, end);
+		
+		if (info.State == MEM_COMMIT) {
+			BOOL freed = VirtualFree(p, (SIZE_T)(run_end-p), MEM_DECOMMIT);
+			assert(freed, "VirtualFree Failed with error %d", GetLastError());
+		}
+		
+		p = run_end;
+	}
+}
+
+u64
+os_get_resident_memory_size() {
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return (u64)counters.WorkingSetSize;
+}
+
 ///
 ///
 // Mouse pointer
@@ -1930,6 +2058,9 @@ void os_update() {
 	}
 
 	has_os_update_been_called_at_all = true;
+	
+	heap_decommit_idle_blocks();
+	heap_instrumentation_update();
 
 	win32_do_handle_raw_input = true;
 #ifndef OOGABOOGA_HEADLESS
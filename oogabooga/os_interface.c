@@ -188,6 +188,21 @@ os_binary_semaphore_wait(Binary_Semaphore *sem);
 void ogb_instance
 os_binary_semaphore_signal(Binary_Semaphore *sem);
 
+///
+// Wait on address (futex)
+// The building block for locks that only go to the kernel when they actually need to sleep.
+// os_wait_on_address sleeps while *address == expected. It can wake up for no reason, so
+// check the value again in a loop.
+
+void ogb_instance
+os_wait_on_address(volatile u32 *address, u32 expected);
+
+void ogb_instance
+os_wake_one_on_address(volatile u32 *address);
+
+void ogb_instance
+os_wake_all_on_address(volatile u32 *address);
+
 ///
 // Threading utilities
 
@@ -487,6 +502,27 @@ os_unlock_program_memory_pages(void *start, u64 size);
 void ogb_instance
 os_lock_program_memory_pages(void *start, u64 size);
 
+// Pages straight from the OS, outside of program memory. Used for big allocations which we
+// want to give back to the OS when they're freed.
+// Reserved pages are only address space. They need to be committed before use.
+// - sizes and start addresses must be aligned to os.page_size
+ogb_instance void*
+os_reserve_pages(u64 size);
+void ogb_instance
+os_release_pages(void *p, u64 size);
+
+// Committed pages are zero initialized.
+// Decommitted pages stay reserved but their physical memory is given back to the OS.
+// Works on program memory as well as pages from os_reserve_pages().
+void ogb_instance
+os_commit_pages(void *start, u64 size);
+void ogb_instance
+os_decommit_pages(void *start, u64 size);
+
+// Physical memory currently used by the process (working set on windows)
+u64 ogb_instance
+os_get_resident_memory_size();
+
 ///
 ///
 // Mouse pointer
@@ -0,0 +1,261 @@
+
+// Pool of fixed size objects.
+// Acquire and release are O(1), objects never move, and the live objects
+// can be iterated densely.
+
+/*
+
+	Example Usage:
+
+	// Make a pool of Entity, with memory from the heap
+	Pool pool = make_pool(Entity, get_heap_allocator());
+
+	// Get a new entity. Memory is zero initialized if DO_ZERO_INITIALIZATION.
+	Pool_Handle handle;
+	Entity *e = pool_acquire(&pool, &handle);
+
+	// Handles are 32 bits with a generation, so they are safe to keep around after
+	// the object is released. Returns 0 if the object was released.
+	Entity *same = pool_get(&pool, handle);
+
+	// Release by handle or by pointer
+	pool_release(&pool, handle);
+	pool_release_pointer(&pool, e);
+
+	// Iterate over the live objects. Releasing while iterating is fine if you go backwards.
+	for (s64 i = pool.count-1; i >= 0; i -= 1) {
+		Entity *e = pool_get_live(&pool, i);
+	}
+
+	// Or as an allocator, alloc() size must be <= the object size
+	Allocator entity_allocator = make_pool_allocator(&pool);
+	
+	// Objects aligned to more than 16 bytes, f.ex. for SIMD or to keep them on their own cache lines
+	Pool particle_pool = make_pool_aligned(Particle, CACHE_LINE_SIZE, get_heap_allocator());
+
+	pool_destroy(&pool);
+
+	Limitations:
+		- Objects are 16 byte aligned unless made with make_pool_aligned().
+		  There is a 16 byte header in front of every object.
+		- Max 2^POOL_HANDLE_INDEX_BITS objects per pool.
+		- Generation wraps after 2^(31-POOL_HANDLE_INDEX_BITS) releases of the same slot,
+		  so a very old handle could be seen as valid again (see generational_handle.c).
+		- Not thread safe.
+*/
+
+#ifndef POOL_HANDLE_INDEX_BITS
+	#define POOL_HANDLE_INDEX_BITS 20
+#endif
+#define POOL_MAX_OBJECTS (1u << POOL_HANDLE_INDEX_BITS)
+
+// Slots per block. Blocks are allocated when the pool runs out, and never moved.
+#ifndef POOL_BLOCK_SLOT_COUNT_LOG2
+	#define POOL_BLOCK_SLOT_COUNT_LOG2 10
+#endif
+#define POOL_BLOCK_SLOT_COUNT (1u << POOL_BLOCK_SLOT_COUNT_LOG2)
+
+#define POOL_NOT_LIVE 0xFFFFFFFFu
+#define POOL_NO_FREE_SLOT 0xFFFFFFFFu
+
+// Index and generation. 0 is never a valid handle.
+DEFINE_GENERATIONAL_HANDLE(Pool_Handle, pool, POOL_HANDLE_INDEX_BITS);
+
+typedef struct Pool_Slot_Header {
+	u32 index;
+	u32 generation; // Odd while live, even while free
+	u32 live_index; // POOL_NOT_LIVE if free
+	u32 reserved;
+} Pool_Slot_Header;
+
+typedef struct Pool {
+	u64 object_size;
+	u64 slot_size;
+	u64 alignment;
+	u64 header_offset; // Padding in front of the header in each slot, so the object is aligned
+
+	u8 **blocks;
+	u64 block_count;
+	u64 block_capacity;
+
+	// Indices of live slots, this is what you iterate
+	u32 *live;
+	u64 count;
+	u64 live_capacity;
+
+	// The free list goes through the objects of free slots
+	u32 first_free;
+	u64 slot_count;
+
+	Allocator allocator;
+} Pool;
+
+Pool make_pool_aligned_raw(u64 object_size, u64 alignment, Allocator allocator) {
+	assert(object_size > 0, "Pool object size must be more than 0");
+	assert(alignment && (alignment & (alignment-1)) == 0, "Pool alignment must be a power of two");
+	alignment = max(alignment, 16);
+	Pool pool = ZERO(Pool);
+	pool.object_size = object_size;
+	pool.alignment = alignment;
+	pool.header_offset = align_next(sizeof(Pool_Slot_Header), alignment) - sizeof(Pool_Slot_Header);
+	pool.slot_size = align_next(pool.header_offset + sizeof(Pool_Slot_Header) + max(object_size, sizeof(u32)), alignment);
+	pool.first_free = POOL_NO_FREE_SLOT;
+	pool.allocator = allocator;
+	return pool;
+}
+Pool make_pool_raw(u64 object_size, Allocator allocator) {
+	return make_pool_aligned_raw(object_size, 16, allocator);
+}
+#define make_pool(type, allocator) make_pool_raw(sizeof(type), allocator)
+#define make_pool_aligned(type, alignment, allocator) make_pool_aligned_raw(sizeof(type), alignment, allocator)
+
+void pool_destroy(Pool *pool) {
+	for (u64 i = 0; i < pool->block_count; i += 1) {
+		dealloc(pool->allocator, pool->blocks[i]);
+	}
+	if (pool->blocks) dealloc(pool->allocator, pool->blocks);
+	if (pool->live)   dealloc(pool->allocator, pool->live);
+
+	*pool = make_pool_aligned_raw(pool->object_size, pool->alignment, pool->allocator);
+}
+
+inline Pool_Slot_Header *pool_get_slot(Pool *pool, u32 index) {
+	return (Pool_Slot_Header*)(pool->blocks[index >> POOL_BLOCK_SLOT_COUNT_LOG2] + (index & (POOL_BLOCK_SLOT_COUNT-1))*pool->slot_size + pool->header_offset);
+}
+
+void pool_add_block(Pool *pool) {
+	assert(pool->slot_count + POOL_BLOCK_SLOT_COUNT <= POOL_MAX_OBJECTS, "Pool is full. Max objects is %u, change POOL_HANDLE_INDEX_BITS if you need more.", POOL_MAX_OBJECTS);
+
+	if (pool->block_count >= pool->block_capacity) {
+		u64 new_capacity = max(pool->block_capacity*2, 8);
+		pool->blocks = (u8**)reallocate(pool->allocator, pool->blocks, pool->block_capacity*sizeof(u8*), new_capacity*sizeof(u8*));
+		pool->block_capacity = new_capacity;
+	}
+
+	u8 *block = (u8*)alloc_aligned_uninitialized(pool->allocator, POOL_BLOCK_SLOT_COUNT*pool->slot_size, pool->alignment);
+	pool->blocks[pool->block_count] = block;
+	pool->block_count += 1;
+
+	// Chain the new slots onto the free list, in order so they are handed out front to back
+	u32 first_index = (u32)pool->slot_count;
+	for (u32 i = 0; i < POOL_BLOCK_SLOT_COUNT; i += 1) {
+		Pool_Slot_Header *slot = (Pool_Slot_Header*)(block + i*pool->slot_size + pool->header_offset);
+		slot->index = first_index + i;
+		slot->generation = 0;
+		slot->live_index = POOL_NOT_LIVE;
+		*(u32*)(slot+1) = i == POOL_BLOCK_SLOT_COUNT-1 ? pool->first_free : first_index+i+1;
+	}
+	pool->first_free = first_index;
+	pool->slot_count += POOL_BLOCK_SLOT_COUNT;
+}
+
+// handle can be 0 if you don't need it
+void *pool_acquire_uninitialized(Pool *pool, Pool_Handle *handle) {
+	if (pool->first_free == POOL_NO_FREE_SLOT) pool_add_block(pool);
+
+	if (pool->count >= pool->live_capacity) {
+		u64 new_capacity = max(pool->live_capacity*2, 64);
+		pool->live = (u32*)reallocate(pool->allocator, pool->live, pool->live_capacity*sizeof(u32), new_capacity*sizeof(u32));
+		pool->live_capacity = new_capacity;
+	}
+
+	Pool_Slot_Header *slot = pool_get_slot(pool, pool->first_free);
+	void *object = slot+1;
+	pool->first_free = *(u32*)object;
+
+	slot->generation += 1; // Now odd, live
+	slot->live_index = (u32)pool->count;
+	pool->live[pool->count] = slot->index;
+	pool->count += 1;
+
+	if (handle) *handle = pool_make_handle(slot->index, slot->generation);
+
+	return object;
+}
+void *pool_acquire(Pool *pool, Pool_Handle *handle) {
+	void *object = pool_acquire_uninitialized(pool, handle);
+#if DO_ZERO_INITIALIZATION
+	memset(object, 0, pool->object_size);
+#endif
+	return object;
+}
+
+// Returns 0 if the handle is stale or null
+void *pool_get(Pool *pool, Pool_Handle handle) {
+	u32 index = pool_handle_index(handle);
+	if (index >= pool->slot_count) return 0;
+	Pool_Slot_Header *slot = pool_get_slot(pool, index);
+	if (!pool_handle_matches(handle, slot->generation)) return 0;
+	return slot+1;
+}
+Pool_Handle pool_get_handle(Pool *pool, void *object) {
+	Pool_Slot_Header *slot = ((Pool_Slot_Header*)object)-1;
+	assert(slot->live_index != POOL_NOT_LIVE, "Object in pool was already released");
+	return pool_make_handle(slot->index, slot->generation);
+}
+// i < pool->count
+void *pool_get_live(Pool *pool, u64 i) {
+	assert(i < pool->count, "Pool live index %llu out of range (count %llu)", i, pool->count);
+	return pool_get_slot(pool, pool->live[i])+1;
+}
+
+void pool_release_pointer(Pool *pool, void *object) {
+	Pool_Slot_Header *slot = ((Pool_Slot_Header*)object)-1;
+	assert(slot->index < pool->slot_count && pool_get_slot(pool, slot->index) == slot, "Pointer is not from this pool");
+	assert(slot->live_index != POOL_NOT_LIVE, "Object in pool was already released");
+
+	// Swap the last live one in
+	u32 last = pool->live[pool->count-1];
+	pool->live[slot->live_index] = last;
+	pool_get_slot(pool, last)->live_index = slot->live_index;
+	pool->count -= 1;
+
+	slot->live_index = POOL_NOT_LIVE;
+	slot->generation += 1; // Now even, free
+
+	*(u32*)object = pool->first_free;
+	pool->first_free = slot->index;
+}
+// Does nothing if the handle is stale. Returns whether something was released.
+bool pool_release(Pool *pool, Pool_Handle handle) {
+	void *object = pool_get(pool, handle);
+	if (!object) return false;
+	pool_release_pointer(pool, object);
+	return true;
+}
+
+// Releases everything but keeps the memory. All handles become stale.
+void pool_clear(Pool *pool) {
+	while (pool->count) {
+		pool_release_pointer(pool, pool_get_live(pool, pool->count-1));
+	}
+}
+
+void* pool_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
+	Pool *pool = (Pool*)data;
+	switch (message) {
+		case ALLOCATOR_ALLOCATE: {
+			assert(size <= pool->object_size, "Allocation of %llu bytes does not fit in pool with object size %llu", size, pool->object_size);
+			return pool_acquire_uninitialized(pool, 0);
+		}
+		case ALLOCATOR_ALLOCATE_ALIGNED: {
+			assert(size <= pool->object_size, "Allocation of %llu bytes does not fit in pool with object size %llu", size, pool->object_size);
+			if ((u64)p > pool->alignment) return 0;
+			return pool_acquire_uninitialized(pool, 0);
+		}
+		case ALLOCATOR_DEALLOCATE: {
+			pool_release_pointer(pool, p);
+			return 0;
+		}
+		case ALLOCATOR_REALLOCATE: {
+			return size <= pool->object_size ? p : 0;
+		}
+	}
+	return 0;
+}
+Allocator make_pool_allocator(Pool *pool) {
+	Allocator allocator;
+	allocator.data = pool;
+	allocator.proc = pool_allocator_proc;
+	return allocator;
+}
@@ -0,0 +1,242 @@
+// Priority queue
+// Min-heap of values with a float64 priority, lowest priority comes out first. Every push gives
+// you a handle so you can change the priority of something already in the queue (decrease-key)
+// or remove it, which a plain heap can't do. It's a 4-ary heap, so half as deep as a binary one,
+// and the heap array only has priority + id (16 bytes) so sifting moves little memory. Values live
+// in a separate array that never moves while they're in the queue.
+// Only allocates when it grows, so once it has been as big as it gets it doesn't allocate.
+
+/*
+
+	Example Usage:
+
+	Priority_Queue q;
+	priority_queue_init(&q, sizeof(Path_Node), 1024, get_heap_allocator());
+
+	Priority_Queue_Handle h = priority_queue_push(&q, 5.0, &node);
+	priority_queue_push(&q, 1.0, &other_node);
+
+	// Found a shorter path to node
+	priority_queue_set_priority(&q, h, 2.0);
+
+	Path_Node next;
+	float64 cost;
+	while (priority_queue_pop(&q, &next, &cost)) {
+		// 1.0 (other_node) then 2.0 (node)
+	}
+
+	// Peek without popping, 0 if empty
+	Path_Node *first = (Path_Node*)priority_queue_peek(&q, &cost);
+
+	priority_queue_remove(&q, h); // false if h was already popped or removed
+
+	priority_queue_destroy(&q);
+
+	Limitations:
+		- Max 2^PRIORITY_QUEUE_HANDLE_INDEX_BITS items at once.
+		- Same priority comes out in no particular order.
+		- Not thread safe.
+*/
+
+#ifndef PRIORITY_QUEUE_HANDLE_INDEX_BITS
+	#define PRIORITY_QUEUE_HANDLE_INDEX_BITS 20
+#endif
+#define PRIORITY_QUEUE_MAX_ITEMS (1u << PRIORITY_QUEUE_HANDLE_INDEX_BITS)
+
+#define PRIORITY_QUEUE_NO_FREE_ID 0xFFFFFFFFu
+
+// Id and generation, like Pool_Handle. 0 is never a valid handle.
+DEFINE_GENERATIONAL_HANDLE(Priority_Queue_Handle, priority_queue, PRIORITY_QUEUE_HANDLE_INDEX_BITS);
+
+typedef struct Priority_Queue_Node {
+	float64 priority;
+	u32 id;
+	u32 _pad;
+} Priority_Queue_Node;
+
+typedef struct Priority_Queue_Id {
+	u32 heap_index; // Where it is in the heap, or the next free id if this one is free
+	u32 generation; // Odd while in the queue, even while free
+} Priority_Queue_Id;
+
+typedef struct Priority_Queue {
+	Priority_Queue_Node *heap;
+	u64 count;
+	u64 capacity;
+
+	Priority_Queue_Id *ids;
+	u8 *values; // value_size bytes per id
+	u64 value_size;
+	u64 id_count;
+	u32 first_free_id;
+
+	Allocator allocator;
+} Priority_Queue;
+
+void priority_queue_reserve(Priority_Queue *q, u64 capacity) {
+	assert(capacity <= PRIORITY_QUEUE_MAX_ITEMS, "Priority queue is full. Max items is %u, change PRIORITY_QUEUE_HANDLE_INDEX_BITS if you need more.", PRIORITY_QUEUE_MAX_ITEMS);
+	if (capacity <= q->capacity) return;
+
+	u64 new_capacity = max(get_next_power_of_two(capacity), 64);
+	q->heap = (Priority_Queue_Node*)reallocate(q->allocator, q->heap, q->capacity*sizeof(Priority_Queue_Node), new_capacity*sizeof(Priority_Queue_Node));
+	// There are never more ids than the most items we've had at once
+	q->ids  = (Priority_Queue_Id*)reallocate(q->allocator, q->ids, q->capacity*sizeof(Priority_Queue_Id), new_capacity*sizeof(Priority_Queue_Id));
+	if (q->value_size) {
+		q->values = (u8*)reallocate(q->allocator, q->values, q->capacity*q->value_size, new_capacity*q->value_size);
+	}
+	q->capacity = new_capacity;
+}
+
+// value_size can be 0 if you only need the handles
+void priority_queue_init(Priority_Queue *q, u64 value_size, u64 capacity, Allocator allocator) {
+	*q = ZERO(Priority_Queue);
+	q->value_size = value_size;
+	q->first_free_id = PRIORITY_QUEUE_NO_FREE_ID;
+	q->allocator = allocator;
+	if (capacity) priority_queue_reserve(q, capacity);
+}
+void priority_queue_destroy(Priority_Queue *q) {
+	if (q->heap)   dealloc(q->allocator, q->heap);
+	if (q->ids)    dealloc(q->allocator, q->ids);
+	if (q->values) dealloc(q->allocator, q->values);
+	*q = ZERO(Priority_Queue);
+}
+
+// The id, if the handle is still in the queue. -1 if not.
+inline s64 _priority_queue_get_id(Priority_Queue *q, Priority_Queue_Handle h) {
+	u32 id = priority_queue_handle_index(h);
+	if (id >= q->id_count || !priority_queue_handle_matches(h, q->ids[id].generation)) return -1;
+	return id;
+}
+inline void *_priority_queue_value(Priority_Queue *q, u32 id) {
+	return q->value_size ? q->values + (u64)id*q->value_size : 0;
+}
+
+inline void _priority_queue_place(Priority_Queue *q, u64 i, Priority_Queue_Node node) {
+	q->heap[i] = node;
+	q->ids[node.id].heap_index = (u32)i;
+}
+void _priority_queue_sift_up(Priority_Queue *q, u64 i) {
+	Priority_Queue_Node node = q->heap[i];
+	while (i > 0) {
+		u64 parent = (i-1)/4;
+		if (q->heap[parent].priority <= node.priority) break;
+		_priority_queue_place(q, i, q->heap[parent]);
+		i = parent;
+	}
+	_priority_queue_place(q, i, node);
+}
+void _priority_queue_sift_down(Priority_Queue *q, u64 i) {
+	Priority_Queue_Node node = q->heap[i];
+	while (true) {
+		u64 first_child = i*4 + 1;
+		if (first_child >= q->count) break;
+		u64 last_child = min(first_child + 4, q->count);
+		u64 smallest = first_child;
+		for (u64 c = first_child+1; c < last_child; c += 1) {
+			if (q->heap[c].priority < q->heap[smallest].priority) smallest = c;
+		}
+		if (node.priority <= q->heap[smallest].priority) break;
+		_priority_queue_place(q, i, q->heap[smallest]);
+		i = smallest;
+	}
+	_priority_queue_place(q, i, node);
+}
+// Takes the item at heap index i out
+void _priority_queue_remove_at(Priority_Queue *q, u64 i) {
+	u32 id = q->heap[i].id;
+	q->count -= 1;
+	if (i != q->count) {
+		float64 removed_priority = q->heap[i].priority;
+		q->heap[i] = q->heap[q->count];
+		if (q->heap[i].priority < removed_priority) _priority_queue_sift_up(q, i);
+		else                                        _priority_queue_sift_down(q, i);
+	}
+	q->ids[id].generation += 1; // Now even, free
+	q->ids[id].heap_index = q->first_free_id;
+	q->first_free_id = id;
+}
+
+// value can be 0 if value_size is 0
+Priority_Queue_Handle priority_queue_push(Priority_Queue *q, float64 priority, void *value) {
+	if (q->count >= q->capacity) priority_queue_reserve(q, q->count+1);
+
+	u32 id;
+	if (q->first_free_id != PRIORITY_QUEUE_NO_FREE_ID) {
+		id = q->first_free_id;
+		q->first_free_id = q->ids[id].heap_index;
+	} else {
+		id = (u32)q->id_count;
+		q->id_count += 1;
+		q->ids[id].generation = 0;
+	}
+	q->ids[id].generation += 1; // Now odd, in the queue
+	if (q->value_size) memcpy(_priority_queue_value(q, id), value, q->value_size);
+
+	Priority_Queue_Node node = ZERO(Priority_Queue_Node);
+	node.priority = priority;
+	node.id = id;
+	q->heap[q->count] = node;
+	q->count += 1;
+	_priority_queue_sift_up(q, q->count-1);
+
+	return priority_queue_make_handle(id, q->ids[id].generation);
+}
+
+// The value with the lowest priority, or 0 if empty. priority and handle can be 0.
+void *priority_queue_peek_ex(Priority_Queue *q, float64 *priority, Priority_Queue_Handle *handle) {
+	if (q->count == 0) return 0;
+	u32 id = q->heap[0].id;
+	if (priority) *priority = q->heap[0].priority;
+	if (handle)   *handle = priority_queue_make_handle(id, q->ids[id].generation);
+	return _priority_queue_value(q, id);
+}
+void *priority_queue_peek(Priority_Queue *q, float64 *priority) {
+	return priority_queue_peek_ex(q, priority, 0);
+}
+
+// Copies out the value with the lowest priority. value and priority can be 0.
+bool priority_queue_pop(Priority_Queue *q, void *value, float64 *priority) {
+	if (q->count == 0) return false;
+	u32 id = q->heap[0].id;
+	if (priority) *priority = q->heap[0].priority;
+	if (value && q->value_size) memcpy(value, _priority_queue_value(q, id), q->value_size);
+	_priority_queue_remove_at(q, 0);
+	return true;
+}
+
+// 0 if the handle isn't in the queue anymore
+void *priority_queue_get(Priority_Queue *q, Priority_Queue_Handle h, float64 *priority) {
+	s64 id = _priority_queue_get_id(q, h);
+	if (id < 0) return 0;
+	if (priority) *priority = q->heap[q->ids[id].heap_index].priority;
+	return _priority_queue_value(q, (u32)id);
+}
+inline bool priority_queue_contains(Priority_Queue *q, Priority_Queue_Handle h) {
+	return _priority_queue_get_id(q, h) >= 0;
+}
+
+// Works both ways, lower (decrease-key) or higher. False if the handle isn't in the queue.
+bool priority_queue_set_priority(Priority_Queue *q, Priority_Queue_Handle h, float64 priority) {
+	s64 id = _priority_queue_get_id(q, h);
+	if (id < 0) return false;
+	u64 i = q->ids[id].heap_index;
+	float64 old_priority = q->heap[i].priority;
+	q->heap[i].priority = priority;
+	if (priority < old_priority) _priority_queue_sift_up(q, i);
+	else                         _priority_queue_sift_down(q, i);
+	return true;
+}
+
+// False if the handle isn't in the queue
+bool priority_queue_remove(Priority_Queue *q, Priority_Queue_Handle h) {
+	s64 id = _priority_queue_get_id(q, h);
+	if (id < 0) return false;
+	_priority_queue_remove_at(q, q->ids[id].heap_index);
+	return true;
+}
+
+// All handles become invalid
+void priority_queue_clear(Priority_Queue *q) {
+	while (q->count) _priority_queue_remove_at(q, q->count-1);
+}
@@ -44,7 +44,33 @@ void _profiler_report_time(string name, f64 count, f64 start) {
     );
 	spinlock_release(&_profiler_lock);
 }
+// Counter event, shows up as a graph. time is in seconds like os_get_elapsed_seconds().
+void _profiler_report_counters(string name, f64 time, string *keys, f64 *values, u64 count) {
+	if (!profiler_initted) {
+		spinlock_init(&_profiler_lock);
+		profiler_initted = true;
+		
+		string_builder_init_reserve(&_profile_output, 1024*1000, get_heap_allocator());	
+	}
+	
+	spinlock_acquire_or_wait(&_profiler_lock);
+	
+	string_builder_print(&_profile_output, STR("{\"cat\":\"counter\",\"name\":\"%s\",\"ph\":\"C\",\"pid\":0,\"tid\":0,\"ts\":%.3f,\"args\":{"), name, time * 1000000);
+	for (u64 i = 0; i < count; i += 1) {
+		string_builder_print(&_profile_output, STR("\"%s\":%.3f%s"), keys[i], values[i], i+1 < count ? STR(",") : STR(""));
+	}
+	string_builder_append(&_profile_output, STR("}},"));
+	
+	spinlock_release(&_profiler_lock);
+}
+// Writes the contention counters of a Mutex or RW_Lock. Call it now and then, like once a frame.
+void _profiler_report_lock_stats(string name, Lock_Stats *stats) {
+	string keys[] = { STR("acquires"), STR("contended"), STR("parks") };
+	f64 values[] = { (f64)stats->acquire_count, (f64)stats->contended_count, (f64)stats->park_count };
+	_profiler_report_counters(name, os_get_elapsed_seconds(), keys, values, 3);
+}
 #if ENABLE_PROFILING
+#define tm_lock_stats(name, stats) _profiler_report_lock_stats(STR(name), stats)
 #define tm_scope(name) \
     for (f64 start_time = os_get_elapsed_seconds(), end_time = start_time, elapsed_time = 0; \
          elapsed_time == 0; \
@@ -58,6 +84,7 @@ void _profiler_report_time(string name, f64 count, f64 start) {
          elapsed_time == 0; \
          elapsed_time = (end_time = os_get_elapsed_seconds()) - start_time, var+=elapsed_time)
 #else
+	#define tm_lock_stats(...)
 	#define tm_scope(...)
 	#define tm_scope_var(...)
 	#define tm_scope_accum(...)
@@ -0,0 +1,186 @@
+// Slot map (sparse set) of fixed size objects.
+// The live objects are packed at the front of one array, so iterating them is a plain for loop
+// over memory in order, without skipping dead ones. Handles go through a slot with a generation
+// to find where the object is now, since removing moves the last object into the hole.
+// Compared to Pool: iterating is faster, but objects move, so keep handles rather than pointers.
+
+/*
+
+	Example Usage:
+
+	Slot_Map entities = make_slot_map(Entity, get_heap_allocator());
+
+	// Add one. Memory is zero initialized if DO_ZERO_INITIALIZATION.
+	Slot_Map_Handle handle;
+	Entity *e = slot_map_add(&entities, &handle);
+
+	// Returns 0 if the object was removed
+	Entity *same = slot_map_get(&entities, handle);
+
+	// Iterate. The live objects are entities.objects[0..count-1].
+	Entity *all = (Entity*)entities.objects;
+	for (u64 i = 0; i < entities.count; i += 1) {
+		update_entity(&all[i]);
+	}
+
+	// Remove while iterating: removing i moves the last one into i, so go backwards
+	for (s64 i = entities.count-1; i >= 0; i -= 1) {
+		if (all[i].dead) slot_map_remove_at(&entities, i);
+	}
+
+	slot_map_remove(&entities, handle);
+	Slot_Map_Handle handle_of_first = slot_map_get_handle_at(&entities, 0);
+
+	slot_map_destroy(&entities);
+
+	Limitations:
+		- Pointers to objects are only good until the next add or remove. Handles are forever.
+		- Max 2^SLOT_MAP_HANDLE_INDEX_BITS objects.
+		- Generation wraps after 2^(31-SLOT_MAP_HANDLE_INDEX_BITS) removes of the same slot,
+		  so a very old handle could be seen as valid again (see generational_handle.c).
+		- Not thread safe.
+*/
+
+#ifndef SLOT_MAP_HANDLE_INDEX_BITS
+	#define SLOT_MAP_HANDLE_INDEX_BITS 20
+#endif
+#define SLOT_MAP_MAX_OBJECTS (1u << SLOT_MAP_HANDLE_INDEX_BITS)
+
+#define SLOT_MAP_NO_FREE_SLOT 0xFFFFFFFFu
+
+// Index and generation. 0 is never a valid handle.
+DEFINE_GENERATIONAL_HANDLE(Slot_Map_Handle, slot_map, SLOT_MAP_HANDLE_INDEX_BITS);
+
+typedef struct Slot_Map_Slot {
+	u32 dense_index; // Where the object is, or the next free slot if this one is free
+	u32 generation;  // Odd while live, even while free
+} Slot_Map_Slot;
+
+typedef struct Slot_Map {
+	u64 object_size;
+
+	// Live objects, packed. This is what you iterate.
+	u8 *objects;
+	u32 *dense_to_slot; // Which slot each object belongs to, so we can fix it up when it moves
+	u64 count;
+	u64 capacity;
+
+	Slot_Map_Slot *slots;
+	u64 slot_count;
+	u32 first_free;
+
+	Allocator allocator;
+} Slot_Map;
+
+Slot_Map make_slot_map_raw(u64 object_size, Allocator allocator) {
+	assert(object_size > 0, "Slot map object size must be more than 0");
+	Slot_Map map = ZERO(Slot_Map);
+	map.object_size = object_size;
+	map.first_free = SLOT_MAP_NO_FREE_SLOT;
+	map.allocator = allocator;
+	return map;
+}
+#define make_slot_map(type, allocator) make_slot_map_raw(sizeof(type), allocator)
+
+void slot_map_destroy(Slot_Map *map) {
+	if (map->objects)       dealloc(map->allocator, map->objects);
+	if (map->dense_to_slot) dealloc(map->allocator, map->dense_to_slot);
+	if (map->slots)         dealloc(map->allocator, map->slots);
+	*map = make_slot_map_raw(map->object_size, map->allocator);
+}
+
+inline void *slot_map_get_at(Slot_Map *map, u64 i) {
+	return map->objects + i*map->object_size;
+}
+
+// Makes room for count objects without growing again
+void slot_map_reserve(Slot_Map *map, u64 count) {
+	assert(count <= SLOT_MAP_MAX_OBJECTS, "Slot map is full. Max objects is %u, change SLOT_MAP_HANDLE_INDEX_BITS if you need more.", SLOT_MAP_MAX_OBJECTS);
+	if (count <= map->capacity) return;
+
+	u64 new_capacity = max(get_next_power_of_two(count), 64);
+	map->objects       = (u8*)reallocate(map->allocator, map->objects, map->capacity*map->object_size, new_capacity*map->object_size);
+	map->dense_to_slot = (u32*)reallocate(map->allocator, map->dense_to_slot, map->capacity*sizeof(u32), new_capacity*sizeof(u32));
+	// There are never more slots than the most objects we've had at once
+	map->slots         = (Slot_Map_Slot*)reallocate(map->allocator, map->slots, map->capacity*sizeof(Slot_Map_Slot), new_capacity*sizeof(Slot_Map_Slot));
+	map->capacity = new_capacity;
+}
+
+// handle can be 0 if you don't need it
+void *slot_map_add_uninitialized(Slot_Map *map, Slot_Map_Handle *handle) {
+	if (map->count >= map->capacity) slot_map_reserve(map, map->count+1);
+
+	u32 slot_index;
+	if (map->first_free != SLOT_MAP_NO_FREE_SLOT) {
+		slot_index = map->first_free;
+		map->first_free = map->slots[slot_index].dense_index;
+	} else {
+		slot_index = (u32)map->slot_count;
+		map->slot_count += 1;
+		map->slots[slot_index].generation = 0;
+	}
+
+	Slot_Map_Slot *slot = &map->slots[slot_index];
+	slot->generation += 1; // Now odd, live
+	slot->dense_index = (u32)map->count;
+	map->dense_to_slot[map->count] = slot_index;
+	map->count += 1;
+
+	if (handle) *handle = slot_map_make_handle(slot_index, slot->generation);
+
+	return slot_map_get_at(map, slot->dense_index);
+}
+void *slot_map_add(Slot_Map *map, Slot_Map_Handle *handle) {
+	void *object = slot_map_add_uninitialized(map, handle);
+#if DO_ZERO_INITIALIZATION
+	memset(object, 0, map->object_size);
+#endif
+	return object;
+}
+
+// Returns 0 if the handle is stale or null
+void *slot_map_get(Slot_Map *map, Slot_Map_Handle handle) {
+	u32 index = slot_map_handle_index(handle);
+	if (index >= map->slot_count) return 0;
+	Slot_Map_Slot *slot = &map->slots[index];
+	if (!slot_map_handle_matches(handle, slot->generation)) return 0;
+	return slot_map_get_at(map, slot->dense_index);
+}
+// i < map->count
+Slot_Map_Handle slot_map_get_handle_at(Slot_Map *map, u64 i) {
+	assert(i < map->count, "Slot map index %llu out of range (count %llu)", i, map->count);
+	u32 slot_index = map->dense_to_slot[i];
+	return slot_map_make_handle(slot_index, map->slots[slot_index].generation);
+}
+
+// Moves the last object into i
+void slot_map_remove_at(Slot_Map *map, u64 i) {
+	assert(i < map->count, "Slot map index %llu out of range (count %llu)", i, map->count);
+
+	u32 slot_index = map->dense_to_slot[i];
+	u64 last = map->count-1;
+	if (i != last) {
+		memcpy(slot_map_get_at(map, i), slot_map_get_at(map, last), map->object_size);
+		u32 moved_slot = map->dense_to_slot[last];
+		map->dense_to_slot[i] = moved_slot;
+		map->slots[moved_slot].dense_index = (u32)i;
+	}
+	map->count -= 1;
+
+	Slot_Map_Slot *slot = &map->slots[slot_index];
+	slot->generation += 1; // Now even, free
+	slot->dense_index = map->first_free;
+	map->first_free = slot_index;
+}
+// Does nothing if the handle is stale. Returns whether something was removed.
+bool slot_map_remove(Slot_Map *map, Slot_Map_Handle handle) {
+	void *object = slot_map_get(map, handle);
+	if (!object) return false;
+	slot_map_remove_at(map, ((u8*)object - map->objects)/map->object_size);
+	return true;
+}
+
+// Removes everything but keeps the memory. All handles become stale.
+void slot_map_clear(Slot_Map *map) {
+	while (map->count) slot_map_remove_at(map, map->count-1);
+}
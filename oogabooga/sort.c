@@ -0,0 +1,677 @@
+// Sorting
+// DEFINE_SORT makes typed comparison sorts, see further down.
+// Parallel LSD radix sort of (key, index) pairs. Sort the pairs, then use the indices to get to
+// your items, so big items never move (see radix_sort_indices() in utility.c for why that matters).
+// Each pass splits the pairs into one block per thread. Every thread counts the digits in its
+// block, one prefix sum over all the counts says where each block writes each digit, and every
+// thread scatters its own block. Blocks write in order, so it's stable like the serial one.
+// Below RADIX_SORT_PARALLEL_MIN_COUNT it doesn't touch the job system at all.
+
+/*
+
+	Example Usage:
+
+	Radix_Pair32 *pairs = alloc(get_heap_allocator(), count*2*sizeof(Radix_Pair32));
+	Radix_Pair32 *help_buffer = pairs + count;
+	for (u64 i = 0; i < count; i++) {
+		pairs[i].key = things[i].sort_value;
+		pairs[i].index = (u32)i;
+	}
+
+	// Sort by the first 24 bits of the key on all worker threads (max_threads 0)
+	Radix_Pair32 *sorted = radix_sort_pairs32(pairs, help_buffer, count, 24, 0);
+	for (u64 i = 0; i < count; i++) {
+		Thing *thing = &things[sorted[i].index];
+	}
+
+	// 64 bit keys, at most 4 threads
+	Radix_Pair64 *sorted64 = radix_sort_pairs64(pairs64, help_buffer64, count, 64, 4);
+
+	Limitations:
+		- Keys are unsigned. For signed keys, flip the top bit (or add half the range) first.
+		- The result is in pairs or help_buffer, use the returned pointer.
+		- Don't call it from a job with max_threads != 1 if you're waiting on something the
+		  sort's jobs could end up waiting for. (Same as parallel_for).
+*/
+
+#ifndef RADIX_SORT_PARALLEL_MIN_COUNT
+	#define RADIX_SORT_PARALLEL_MIN_COUNT 65536
+#endif
+// A block per thread, but no smaller than this
+#define RADIX_SORT_MIN_BLOCK_SIZE 16384
+
+typedef struct Radix_Pair32 {
+	u32 key;
+	u32 index;
+} Radix_Pair32;
+
+typedef struct Radix_Pair64 {
+	u64 key;
+	u64 index;
+} Radix_Pair64;
+
+typedef struct Radix_Sort {
+	u8 *from;
+	u8 *to;
+	bool wide; // Radix_Pair64
+	u64 count;
+	u64 block_size;
+	u64 block_count;
+	u64 pass_count;
+	u64 number_of_bits;
+
+	// [block][pass][digit]. At first every pass is counted so we can skip passes that wouldn't
+	// do anything. After the first scatter the blocks hold different pairs, so only the
+	// current pass is counted again.
+	u64 *counts;
+	u64 first_pass_to_count;
+	u64 end_pass_to_count;
+
+	u64 shift;
+	u64 mask;
+	u64 pass;
+} Radix_Sort;
+
+inline u64 *_radix_sort_counts(Radix_Sort *s, u64 block, u64 pass) {
+	return s->counts + (block*s->pass_count + pass)*256;
+}
+// The last pass can have less than 8 bits
+inline u64 _radix_sort_mask(Radix_Sort *s, u64 pass) {
+	u64 bits = min(s->number_of_bits - pass*8, 8);
+	return (1ull << bits) - 1;
+}
+
+void _radix_sort_count(u64 first_block, u64 end_block, void *data) {
+	Radix_Sort *s = (Radix_Sort*)data;
+	for (u64 b = first_block; b < end_block; b++) {
+		u64 first = b*s->block_size;
+		u64 end = min(first + s->block_size, s->count);
+
+		for (u64 pass = s->first_pass_to_count; pass < s->end_pass_to_count; pass++) {
+			u64 *counts = _radix_sort_counts(s, b, pass);
+			memset(counts, 0, 256*sizeof(u64));
+			u64 shift = pass*8;
+			u64 mask = _radix_sort_mask(s, pass);
+			if (s->wide) {
+				Radix_Pair64 *pairs = (Radix_Pair64*)s->from;
+				for (u64 i = first; i < end; i++) counts[(pairs[i].key >> shift) & mask] += 1;
+			} else {
+				Radix_Pair32 *pairs = (Radix_Pair32*)s->from;
+				for (u64 i = first; i < end; i++) counts[(pairs[i].key >> shift) & mask] += 1;
+			}
+		}
+	}
+}
+
+// Expects the counts of the block for this pass to have been turned into where it writes each digit
+void _radix_sort_scatter(u64 first_block, u64 end_block, void *data) {
+	Radix_Sort *s = (Radix_Sort*)data;
+	for (u64 b = first_block; b < end_block; b++) {
+		u64 first = b*s->block_size;
+		u64 end = min(first + s->block_size, s->count);
+
+		u64 offset[256];
+		memcpy(offset, _radix_sort_counts(s, b, s->pass), sizeof(offset));
+		u64 shift = s->shift;
+		u64 mask = s->mask;
+
+		if (s->wide) {
+			Radix_Pair64 *from = (Radix_Pair64*)s->from;
+			Radix_Pair64 *to = (Radix_Pair64*)s->to;
+			for (u64 i = first; i < end; i++) {
+				Radix_Pair64 pair = from[i];
+				to[offset[(pair.key >> shift) & mask]++] = pair;
+			}
+		} else {
+			Radix_Pair32 *from = (Radix_Pair32*)s->from;
+			Radix_Pair32 *to = (Radix_Pair32*)s->to;
+			for (u64 i = first; i < end; i++) {
+				Radix_Pair32 pair = from[i];
+				to[offset[(pair.key >> shift) & mask]++] = pair;
+			}
+		}
+	}
+}
+
+void _radix_sort_run(Radix_Sort *s, Parallel_For_Proc proc) {
+	if (s->block_count == 1) proc(0, 1, s);
+	else                     parallel_for(s->block_count, 1, proc, s);
+}
+
+void *_radix_sort_pairs(void *pairs, void *help_buffer, u64 count, bool wide, u64 number_of_bits, u64 max_threads) {
+	u64 max_bits = wide ? 64 : 32;
+	assert(number_of_bits > 0 && number_of_bits <= max_bits, "Radix sort of %llu bit keys by %llu bits", max_bits, number_of_bits);
+
+	if (count < 2) return pairs;
+
+	Radix_Sort s = ZERO(Radix_Sort);
+	s.from = (u8*)pairs;
+	s.to = (u8*)help_buffer;
+	s.wide = wide;
+	s.count = count;
+	s.pass_count = (number_of_bits + 7)/8;
+	s.number_of_bits = number_of_bits;
+
+	u64 thread_count = 1;
+	if (count >= RADIX_SORT_PARALLEL_MIN_COUNT && max_threads != 1) {
+		thread_count = job_get_worker_count();
+		if (max_threads) thread_count = min(thread_count, max_threads);
+	}
+	s.block_count = clamp(count/RADIX_SORT_MIN_BLOCK_SIZE, 1, thread_count);
+	s.block_size = (count + s.block_count - 1)/s.block_count;
+
+	// #Memory #Heapalloc
+	s.counts = (u64*)alloc_uninitialized(get_heap_allocator(), s.block_count*s.pass_count*256*sizeof(u64));
+
+	s.first_pass_to_count = 0;
+	s.end_pass_to_count = s.pass_count;
+	_radix_sort_run(&s, _radix_sort_count);
+
+	bool scattered = false;
+	for (u64 pass = 0; pass < s.pass_count; pass++) {
+		// Every pair has the same digit, nothing would move
+		bool skip = false;
+		for (u64 d = 0; d < 256 && !skip; d++) {
+			u64 total = 0;
+			for (u64 b = 0; b < s.block_count; b++) total += _radix_sort_counts(&s, b, pass)[d];
+			if (total == count) skip = true;
+			if (total) break;
+		}
+		if (skip) continue;
+
+		s.pass = pass;
+		s.shift = pass*8;
+		s.mask = _radix_sort_mask(&s, pass);
+
+		if (scattered && s.block_count > 1) {
+			s.first_pass_to_count = pass;
+			s.end_pass_to_count = pass+1;
+			_radix_sort_run(&s, _radix_sort_count);
+		}
+
+		// Digit by digit, block by block, so block 0 writes its 0's first, then block 1 etc.
+		u64 sum = 0;
+		for (u64 d = 0; d < 256; d++) {
+			for (u64 b = 0; b < s.block_count; b++) {
+				u64 *counts = _radix_sort_counts(&s, b, pass);
+				u64 n = counts[d];
+				counts[d] = sum;
+				sum += n;
+			}
+		}
+
+		_radix_sort_run(&s, _radix_sort_scatter);
+		scattered = true;
+
+		u8 *temp = s.from;
+		s.from = s.to;
+		s.to = temp;
+	}
+
+	dealloc(get_heap_allocator(), s.counts);
+
+	return s.from;
+}
+
+// Sorts by the first number_of_bits of key. help_buffer needs to be as big as pairs.
+// max_threads 0 means all worker threads, 1 means on this thread only.
+// Returns where the sorted pairs are, which is pairs or help_buffer.
+Radix_Pair32 *radix_sort_pairs32(Radix_Pair32 *pairs, Radix_Pair32 *help_buffer, u64 count, u64 number_of_bits, u64 max_threads) {
+	return (Radix_Pair32*)_radix_sort_pairs(pairs, help_buffer, count, false, number_of_bits, max_threads);
+}
+Radix_Pair64 *radix_sort_pairs64(Radix_Pair64 *pairs, Radix_Pair64 *help_buffer, u64 count, u64 number_of_bits, u64 max_threads) {
+	return (Radix_Pair64*)_radix_sort_pairs(pairs, help_buffer, count, true, number_of_bits, max_threads);
+}
+
+
+///
+// Typed comparison sorts
+//
+// DEFINE_SORT(name, type, is_less) makes these for arrays of type:
+//     void name_sort(type *items, u64 count);                           // Not stable
+//     void name_stable_sort(type *items, type *help_buffer, u64 count); // help_buffer of count items
+//     void name_partial_sort(type *items, u64 count, u64 k);            // Only the k smallest, sorted
+//     void name_nth_element(type *items, u64 count, u64 n);
+// is_less(a, b) gets two type* and says if *a goes before *b. It can be a function or a macro,
+// either way it gets inlined, unlike the compare function of merge_sort(). Items are moved with
+// plain assignment, so no memcpy per item either.
+// name_sort is pattern-defeating quicksort (pdqsort, Orson Peters): quicksort with insertion sort
+// for small ranges, and heapsort when it keeps picking bad pivots, so it's never worse than
+// n*log(n). Sorted, reversed and all equal input is close to linear.
+// name_stable_sort is a merge sort which goes back and forth between items and help_buffer.
+// name_nth_element puts the item that would be at n if sorted at n, smaller before it, bigger
+// after it, in no particular order. It's what partial_sort uses, so both are linear-ish.
+
+/*
+
+	Example Usage:
+
+	// Once, at file scope
+	#define enemy_is_closer(a, b) ((a)->distance < (b)->distance)
+	DEFINE_SORT(enemy_by_distance, Enemy_Distance, enemy_is_closer);
+
+	enemy_by_distance_sort(enemies, enemy_count);
+
+	// Nearest 5, sorted. The rest are in enemies[5..] in some order.
+	enemy_by_distance_partial_sort(enemies, enemy_count, 5);
+
+	// Equal distances stay in the order they were in
+	enemy_by_distance_stable_sort(enemies, help_buffer, enemy_count);
+
+	// Median
+	enemy_by_distance_nth_element(enemies, enemy_count, enemy_count/2);
+	Enemy_Distance median = enemies[enemy_count/2];
+
+	Limitations:
+		- is_less can be a macro which uses its arguments more than once, they're never
+		  expressions with side effects.
+		- name_sort and name_partial_sort aren't stable.
+*/
+
+#define SORT_INSERTION_SORT_THRESHOLD 24
+#define SORT_NINTHER_THRESHOLD 128
+#define SORT_PARTIAL_INSERTION_SORT_LIMIT 8
+#define SORT_STABLE_RUN_SIZE 32
+#define SORT_BLOCK_SIZE 64
+// Items bigger than this use the plain partition, moving them around costs more than the
+// mispredicted branches
+#ifndef SORT_BRANCHLESS_MAX_ITEM_SIZE
+	#define SORT_BRANCHLESS_MAX_ITEM_SIZE 32
+#endif
+
+#define DEFINE_SORT(name, type, is_less) \
+	\
+	inline void _##name##_swap(type *a, type *b) { \
+		type t = *a; *a = *b; *b = t; \
+	} \
+	inline void _##name##_sort2(type *a, type *b) { \
+		if (is_less(b, a)) _##name##_swap(a, b); \
+	} \
+	inline void _##name##_sort3(type *a, type *b, type *c) { \
+		_##name##_sort2(a, b); \
+		_##name##_sort2(b, c); \
+		_##name##_sort2(a, b); \
+	} \
+	\
+	/* [first, end) */ \
+	void _##name##_insertion_sort(type *first, type *end) { \
+		if (end - first < 2) return; \
+		for (type *cur = first + 1; cur != end; cur++) { \
+			if (!is_less(cur, cur - 1)) continue; \
+			type item = *cur; \
+			type *sift = cur; \
+			do { \
+				*sift = *(sift - 1); \
+				sift--; \
+			} while (sift != first && is_less(&item, sift - 1)); \
+			*sift = item; \
+		} \
+	} \
+	/* Same, but there's something at first-1 which is <= everything in the range, so we don't check for first */ \
+	void _##name##_unguarded_insertion_sort(type *first, type *end) { \
+		if (end - first < 2) return; \
+		for (type *cur = first + 1; cur != end; cur++) { \
+			if (!is_less(cur, cur - 1)) continue; \
+			type item = *cur; \
+			type *sift = cur; \
+			do { \
+				*sift = *(sift - 1); \
+				sift--; \
+			} while (is_less(&item, sift - 1)); \
+			*sift = item; \
+		} \
+	} \
+	/* Gives up and returns false if it had to move too many, in which case it's only partly sorted */ \
+	bool _##name##_partial_insertion_sort(type *first, type *end) { \
+		if (end - first < 2) return true; \
+		u64 moved = 0; \
+		for (type *cur = first + 1; cur != end; cur++) { \
+			if (!is_less(cur, cur - 1)) continue; \
+			type item = *cur; \
+			type *sift = cur; \
+			do { \
+				*sift = *(sift - 1); \
+				sift--; \
+			} while (sift != first && is_less(&item, sift - 1)); \
+			*sift = item; \
+			moved += (u64)(cur - sift); \
+			if (moved > SORT_PARTIAL_INSERTION_SORT_LIMIT) return false; \
+		} \
+		return true; \
+	} \
+	\
+	void _##name##_sift_down(type *first, u64 count, u64 i) { \
+		type item = first[i]; \
+		while (true) { \
+			u64 child = i*2 + 1; \
+			if (child >= count) break; \
+			if (child + 1 < count && is_less(&first[child], &first[child + 1])) child += 1; \
+			if (!is_less(&item, &first[child])) break; \
+			first[i] = first[child]; \
+			i = child; \
+		} \
+		first[i] = item; \
+	} \
+	void _##name##_heap_sort(type *first, type *end) { \
+		u64 count = (u64)(end - first); \
+		if (count < 2) return; \
+		for (u64 i = count/2; i > 0; i--) _##name##_sift_down(first, count, i - 1); \
+		for (u64 n = count - 1; n > 0; n--) { \
+			_##name##_swap(&first[0], &first[n]); \
+			_##name##_sift_down(first, n, 0); \
+		} \
+	} \
+	\
+	/* Median of 3, or of 3 medians of 3 for big ranges, into *first */ \
+	void _##name##_choose_pivot(type *first, type *end) { \
+		u64 count = (u64)(end - first); \
+		u64 half = count/2; \
+		if (count > SORT_NINTHER_THRESHOLD) { \
+			_##name##_sort3(first, first + half, end - 1); \
+			_##name##_sort3(first + 1, first + (half - 1), end - 2); \
+			_##name##_sort3(first + 2, first + (half + 1), end - 3); \
+			_##name##_sort3(first + (half - 1), first + half, first + (half + 1)); \
+			_##name##_swap(first, first + half); \
+		} else { \
+			_##name##_sort3(first + half, first, end - 1); \
+		} \
+	} \
+	/* Pivot is *first. Things equal to the pivot go right. Returns where the pivot ended up. */ \
+	/* already_partitioned is set if nothing had to be swapped. */ \
+	type *_##name##_partition_right(type *first, type *end, bool *already_partitioned) { \
+		type pivot = *first; \
+		type *left = first + 1; \
+		type *right = end; \
+		while (is_less(left, &pivot)) left++; \
+		/* If the first one was already >= pivot we need a bounds check, there might not be anything < pivot */ \
+		if (left - 1 == first) { \
+			while (left < right) { right--; if (is_less(right, &pivot)) break; } \
+		} else { \
+			do { right--; } while (!is_less(right, &pivot)); \
+		} \
+		*already_partitioned = left >= right; \
+		while (left < right) { \
+			_##name##_swap(left, right); \
+			do { left++;  } while (is_less(left, &pivot)); \
+			do { right--; } while (!is_less(right, &pivot)); \
+		} \
+		type *pivot_pos = left - 1; \
+		*first = *pivot_pos; \
+		*pivot_pos = pivot; \
+		return pivot_pos; \
+	} \
+	/* Same as partition_right, but without unpredictable branches. It goes through blocks from */ \
+	/* both ends, writes down which items are on the wrong side, then swaps those. Branch */ \
+	/* mispredictions are most of the time in quicksort on random input, but this does more */ \
+	/* work per item, so it's only worth it for small items. */ \
+	type *_##name##_partition_right_branchless(type *first, type *end, bool *already_partitioned) { \
+		type pivot = *first; \
+		type *left = first + 1; \
+		type *right = end; \
+		while (is_less(left, &pivot)) left++; \
+		if (left - 1 == first) { \
+			while (left < right) { right--; if (is_less(right, &pivot)) break; } \
+		} else { \
+			do { right--; } while (!is_less(right, &pivot)); \
+		} \
+		*already_partitioned = left >= right; \
+		if (!*already_partitioned) { \
+			_##name##_swap(left, right); \
+			left++; \
+		} \
+		\
+		u8 offsets_left[SORT_BLOCK_SIZE]; \
+		u8 offsets_right[SORT_BLOCK_SIZE]; \
+		type *left_base = left; \
+		type *right_base = right; \
+		u64 left_count = 0, right_count = 0, left_start = 0, right_start = 0; \
+		while (left < right) { \
+			/* Fill up whichever side ran out, split what's left if both did */ \
+			u64 unknown = (u64)(right - left); \
+			u64 left_split = left_count == 0 ? (right_count == 0 ? unknown/2 : unknown) : 0; \
+			u64 right_split = right_count == 0 ? (unknown - left_split) : 0; \
+			left_split = min(left_split, SORT_BLOCK_SIZE); \
+			right_split = min(right_split, SORT_BLOCK_SIZE); \
+			\
+			for (u64 i = 0; i < left_split; i++) { \
+				offsets_left[left_count] = (u8)i; \
+				left_count += !is_less(left, &pivot); \
+				left++; \
+			} \
+			for (u64 i = 0; i < right_split; i++) { \
+				right--; \
+				offsets_right[right_count] = (u8)(i + 1); \
+				right_count += is_less(right, &pivot); \
+			} \
+			\
+			/* Swap as many pairs as we have. If both sides are the same, plain swaps keep things like */ \
+			/* reversed input in a pattern the next partition can see. Otherwise moving them in a */ \
+			/* cycle does half the moves. */ \
+			u64 n = min(left_count, right_count); \
+			u8 *l_offsets = offsets_left + left_start; \
+			u8 *r_offsets = offsets_right + right_start; \
+			if (left_count == right_count) { \
+				for (u64 i = 0; i < n; i++) _##name##_swap(left_base + l_offsets[i], right_base - r_offsets[i]); \
+			} else if (n > 0) { \
+				type *l = left_base + l_offsets[0]; \
+				type *r = right_base - r_offsets[0]; \
+				type temp = *l; \
+				*l = *r; \
+				for (u64 i = 1; i < n; i++) { \
+					l = left_base + l_offsets[i]; \
+					*r = *l; \
+					r = right_base - r_offsets[i]; \
+					*l = *r; \
+				} \
+				*r = temp; \
+			} \
+			left_count -= n; right_count -= n; \
+			left_start += n; right_start += n; \
+			if (left_count == 0)  { left_start = 0;  left_base = left; } \
+			if (right_count == 0) { right_start = 0; right_base = right; } \
+		} \
+		\
+		/* One side has leftovers, move them next to the middle */ \
+		if (left_count) { \
+			u8 *l_offsets = offsets_left + left_start; \
+			while (left_count) { \
+				left_count--; \
+				right--; \
+				_##name##_swap(left_base + l_offsets[left_count], right); \
+			} \
+			left = right; \
+		} \
+		if (right_count) { \
+			u8 *r_offsets = offsets_right + right_start; \
+			while (right_count) { \
+				right_count--; \
+				_##name##_swap(right_base - r_offsets[right_count], left); \
+				left++; \
+			} \
+		} \
+		\
+		type *pivot_pos = left - 1; \
+		*first = *pivot_pos; \
+		*pivot_pos = pivot; \
+		return pivot_pos; \
+	} \
+	/* Pivot is *first. Things equal to the pivot go left. Only used when the item before first is */ \
+	/* equal to the pivot, so everything that ends up left of the pivot is equal to it. */ \
+	type *_##name##_partition_left(type *first, type *end) { \
+		type pivot = *first; \
+		type *left = first; \
+		type *right = end; \
+		do { right--; } while (is_less(&pivot, right)); \
+		if (right + 1 == end) { \
+			while (left < right) { left++; if (is_less(&pivot, left)) break; } \
+		} else { \
+			do { left++; } while (!is_less(&pivot, left)); \
+		} \
+		while (left < right) { \
+			_##name##_swap(left, right); \
+			do { right--; } while (is_less(&pivot, right)); \
+			do { left++;  } while (!is_less(&pivot, left)); \
+		} \
+		*first = *right; \
+		*right = pivot; \
+		return right; \
+	} \
+	\
+	void _##name##_pdqsort(type *first, type *end, u64 bad_allowed, bool leftmost) { \
+		while (true) { \
+			u64 count = (u64)(end - first); \
+			if (count < SORT_INSERTION_SORT_THRESHOLD) { \
+				if (leftmost) _##name##_insertion_sort(first, end); \
+				else          _##name##_unguarded_insertion_sort(first, end); \
+				return; \
+			} \
+			\
+			_##name##_choose_pivot(first, end); \
+			\
+			/* Lots of things equal to the one before us (which was a pivot), take them all at once */ \
+			if (!leftmost && !is_less(first - 1, first)) { \
+				first = _##name##_partition_left(first, end) + 1; \
+				continue; \
+			} \
+			\
+			bool already_partitioned; \
+			type *pivot_pos; \
+			if (sizeof(type) <= SORT_BRANCHLESS_MAX_ITEM_SIZE) pivot_pos = _##name##_partition_right_branchless(first, end, &already_partitioned); \
+			else                                               pivot_pos = _##name##_partition_right(first, end, &already_partitioned); \
+			u64 left_count = (u64)(pivot_pos - first); \
+			u64 right_count = (u64)(end - (pivot_pos + 1)); \
+			\
+			if (left_count < count/8 || right_count < count/8) { \
+				/* Bad pivot. Too many of those and it's heapsort. Otherwise shuffle some things around */ \
+				/* so the same pattern doesn't give a bad pivot again. */ \
+				bad_allowed -= 1; \
+				if (bad_allowed == 0) { \
+					_##name##_heap_sort(first, end); \
+					return; \
+				} \
+				if (left_count >= SORT_INSERTION_SORT_THRESHOLD) { \
+					u64 q = left_count/4; \
+					_##name##_swap(first, first + q); \
+					_##name##_swap(pivot_pos - 1, pivot_pos - q); \
+					if (left_count > SORT_NINTHER_THRESHOLD) { \
+						_##name##_swap(first + 1, first + (q + 1)); \
+						_##name##_swap(first + 2, first + (q + 2)); \
+						_##name##_swap(pivot_pos - 2, pivot_pos - (q + 1)); \
+						_##name##_swap(pivot_pos - 3, pivot_pos - (q + 2)); \
+					} \
+				} \
+				if (right_count >= SORT_INSERTION_SORT_THRESHOLD) { \
+					u64 q = right_count/4; \
+					_##name##_swap(pivot_pos + 1, pivot_pos + (1 + q)); \
+					_##name##_swap(end - 1, end - q); \
+					if (right_count > SORT_NINTHER_THRESHOLD) { \
+						_##name##_swap(pivot_pos + 2, pivot_pos + (2 + q)); \
+						_##name##_swap(pivot_pos + 3, pivot_pos + (3 + q)); \
+						_##name##_swap(end - 2, end - (1 + q)); \
+						_##name##_swap(end - 3, end - (2 + q)); \
+					} \
+				} \
+			} else if (already_partitioned) { \
+				/* Might be (nearly) sorted already, try to finish with insertion sort */ \
+				if (_##name##_partial_insertion_sort(first, pivot_pos) && \
+				    _##name##_partial_insertion_sort(pivot_pos + 1, end)) return; \
+			} \
+			\
+			/* Recurse into the left side, loop on the right */ \
+			_##name##_pdqsort(first, pivot_pos, bad_allowed, leftmost); \
+			first = pivot_pos + 1; \
+			leftmost = false; \
+		} \
+	} \
+	\
+	void name##_sort(type *items, u64 count) { \
+		if (count < 2) return; \
+		_##name##_pdqsort(items, items + count, bit_scan_reverse_64(count) + 1, true); \
+	} \
+	\
+	void name##_nth_element(type *items, u64 count, u64 n) { \
+		if (n >= count) return; \
+		type *first = items; \
+		type *end = items + count; \
+		type *nth = items + n; \
+		u64 bad_allowed = bit_scan_reverse_64(count) + 1; \
+		while (true) { \
+			u64 range_count = (u64)(end - first); \
+			if (range_count < SORT_INSERTION_SORT_THRESHOLD) { \
+				_##name##_insertion_sort(first, end); \
+				return; \
+			} \
+			_##name##_choose_pivot(first, end); \
+			\
+			if (first != items && !is_less(first - 1, first)) { \
+				/* Everything up to the pivot is equal to the one before */ \
+				type *pivot_pos = _##name##_partition_left(first, end); \
+				if (nth <= pivot_pos) return; \
+				first = pivot_pos + 1; \
+				continue; \
+			} \
+			\
+			bool already_partitioned; \
+			type *pivot_pos; \
+			if (sizeof(type) <= SORT_BRANCHLESS_MAX_ITEM_SIZE) pivot_pos = _##name##_partition_right_branchless(first, end, &already_partitioned); \
+			else                                               pivot_pos = _##name##_partition_right(first, end, &already_partitioned); \
+			if (pivot_pos == nth) return; \
+			\
+			u64 left_count = (u64)(pivot_pos - first); \
+			u64 right_count = (u64)(end - (pivot_pos + 1)); \
+			if (left_count < range_count/8 || right_count < range_count/8) { \
+				bad_allowed -= 1; \
+				if (bad_allowed == 0) { \
+					_##name##_heap_sort(first, end); \
+					return; \
+				} \
+			} \
+			\
+			if (nth < pivot_pos) end = pivot_pos; \
+			else                 first = pivot_pos + 1; \
+		} \
+	} \
+	\
+	void name##_partial_sort(type *items, u64 count, u64 k) { \
+		k = min(k, count); \
+		if (k < count) name##_nth_element(items, count, k); \
+		name##_sort(items, k); \
+	} \
+	\
+	/* Merges sorted [0, left_count) and [left_count, count) of from into to. Left first on ties. */ \
+	void _##name##_merge(type *from, type *to, u64 left_count, u64 count) { \
+		u64 l = 0; \
+		u64 r = left_count; \
+		u64 k = 0; \
+		if (left_count == 0 || r == count || !is_less(&from[r], &from[r - 1])) { \
+			/* Already in order */ \
+			memcpy(to, from, count*sizeof(type)); \
+			return; \
+		} \
+		while (l < left_count && r < count) { \
+			if (is_less(&from[r], &from[l])) to[k++] = from[r++]; \
+			else                             to[k++] = from[l++]; \
+		} \
+		while (l < left_count) to[k++] = from[l++]; \
+		while (r < count)      to[k++] = from[r++]; \
+	} \
+	void name##_stable_sort(type *items, type *help_buffer, u64 count) { \
+		if (count < 2) return; \
+		for (u64 i = 0; i < count; i += SORT_STABLE_RUN_SIZE) { \
+			_##name##_insertion_sort(items + i, items + min(i + SORT_STABLE_RUN_SIZE, count)); \
+		} \
+		type *from = items; \
+		type *to = help_buffer; \
+		for (u64 width = SORT_STABLE_RUN_SIZE; width < count; width *= 2) { \
+			for (u64 i = 0; i < count; i += width*2) { \
+				u64 left_count = min(width, count - i); \
+				u64 merge_count = min(width*2, count - i); \
+				_##name##_merge(from + i, to + i, left_count, merge_count); \
+			} \
+			type *temp = from; \
+			from = to; \
+			to = temp; \
+		} \
+		if (from != items) memcpy(items, from, count*sizeof(type)); \
+	}
+
@@ -54,14 +54,14 @@ string_concat(const string left, const string right, Allocator allocator) {
 
 	string result;
 	result.count = left.count + right.count;
-	result.data = cast(u8*)alloc(allocator, result.count);
+	result.data = cast(u8*)alloc_uninitialized(allocator, result.count);
 	memcpy(result.data, left.data, left.count);
 	memcpy(result.data+left.count, right.data, right.count);
 	return result;
 }
 char *
 convert_to_null_terminated_string(const string s, Allocator allocator) {
-	char *cstring = cast(char*)alloc(allocator, s.count+1);
+	char *cstring = cast(char*)alloc_uninitialized(allocator, s.count+1);
 	memcpy(cstring, s.data, s.count);
 	cstring[s.count] = 0;
 	return cstring;
@@ -151,12 +151,7 @@ string_builder_reserve(String_Builder *b, u64 required_capacity) {
 	if (b->buffer_capacity >= required_capacity) return;
 	
 	u64 new_capacity = max(b->buffer_capacity*2, (u64)(required_capacity*1.5));
-	u8 *new_buffer = alloc(b->allocator, new_capacity);
-	if (b->buffer) {
-		memcpy(new_buffer, b->buffer, b->count);
-		dealloc(b->allocator, b->buffer);
-	}
-	b->buffer = new_buffer;
+	b->buffer = reallocate(b->allocator, b->buffer, b->count, new_capacity);
 	b->buffer_capacity = new_capacity;
 }
 void 
@@ -165,8 +160,8 @@ string_builder_init_reserve(String_Builder *b, u64 reserved_capacity, Allocator
 	b->allocator = allocator;
 	b->buffer_capacity = 0;
 	b->buffer = 0;
-	string_builder_reserve(b, reserved_capacity);
 	b->count = 0;
+	string_builder_reserve(b, reserved_capacity);
 }
 void 
 string_builder_init(String_Builder *b, Allocator allocator) {
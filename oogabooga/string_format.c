@@ -228,7 +228,7 @@ string sprint_va_list(Allocator allocator, const string fmt, va_list args) {
 
     char* buffer = NULL;
 
-    buffer = (char*)alloc(allocator, count);
+    buffer = (char*)alloc_uninitialized(allocator, count);
 
     return sprint_null_terminated_string_va_list_to_buffer(fmt_cstring, args, buffer, count);
 }
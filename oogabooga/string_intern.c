@@ -0,0 +1,184 @@
+// String interning
+// Maps string contents to an Atom, a 32 bit number which is the same for the same contents, so
+// paths and names can be compared and hashed as integers. The bytes are copied once into an
+// arena and never move or get freed, so atom_get_string() strings are good forever.
+// Looking up a string which is already interned doesn't take any locks. Adding a new one takes a
+// mutex, so intern things at load time (string_intern_many()) rather than in the middle of a
+// frame if you can.
+
+/*
+
+	Example Usage:
+
+	Atom a = string_intern(STR("sounds/jump.wav"));
+	Atom b = string_intern(some_path_we_read_from_a_file);
+	if (a == b) {
+		// Same contents
+	}
+
+	// Get the interned bytes back. Don't modify them.
+	string path = atom_get_string(a);
+
+	// 0 if it was never interned. Doesn't add it.
+	Atom c = string_find_atom(STR("not interned"));
+
+	// Intern a whole bunch at once, only takes the lock once
+	string names[] = { STR("player"), STR("enemy"), STR("bullet") };
+	Atom atoms[3];
+	string_intern_many(names, atoms, 3);
+
+	Limitations:
+		- Nothing is ever un-interned. It's meant for a limited set of names and paths, not for
+		  arbitrary strings built every frame.
+		- The empty string is ATOM_NONE (0).
+		- Contents are compared byte by byte, so "a/b" and "A\\b" are different atoms even if
+		  they are the same file.
+*/
+
+typedef u32 Atom;
+#define ATOM_NONE 0
+
+// Atoms are stored in chunks which never move, so readers don't need a lock
+#define STRING_INTERN_CHUNK_SIZE 4096
+#define STRING_INTERN_MAX_CHUNKS 4096
+#define STRING_INTERN_INITIAL_SLOT_COUNT 1024
+
+// Open addressing, linear probing. Each slot is (top 32 bits of the hash << 32) | atom, 0 is
+// empty. When it fills up we make a bigger one and switch to it, and threads that are still
+// looking in the old one just see it without the newest strings.
+typedef struct String_Intern_Slots {
+	u64 mask; // Slot count - 1
+	u64 _pad;
+	volatile u64 slots[];
+} String_Intern_Slots;
+
+typedef struct String_Interner {
+	Once init;
+	Mutex insert_mutex; // For adding, lookups don't need it
+	Arena arena; // Bytes, chunks and slots. Never freed.
+	String_Intern_Slots *volatile slots;
+	volatile u32 count; // Number of atoms, not counting ATOM_NONE
+	u64 byte_count;
+	string *chunks[STRING_INTERN_MAX_CHUNKS];
+} String_Interner;
+
+// #Global
+ogb_instance String_Interner string_interner;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+String_Interner string_interner = {0};
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+String_Intern_Slots *_string_intern_make_slots(u64 slot_count) {
+	String_Intern_Slots *slots = (String_Intern_Slots*)arena_push_aligned_zeroed(&string_interner.arena, sizeof(String_Intern_Slots) + slot_count*sizeof(u64), CACHE_LINE_SIZE);
+	slots->mask = slot_count-1;
+	return slots;
+}
+void _string_intern_init() {
+	if (once_begin(&string_interner.init)) {
+		string_interner.arena = make_arena(MB(16));
+		mutex_init(&string_interner.insert_mutex);
+		string_interner.slots = _string_intern_make_slots(STRING_INTERN_INITIAL_SLOT_COUNT);
+		once_end(&string_interner.init, true);
+	}
+}
+inline String_Intern_Slots *_string_intern_get_slots() {
+	return (String_Intern_Slots*)atomic_load_acquire_64((volatile u64*)&string_interner.slots);
+}
+
+string atom_get_string(Atom atom) {
+	if (atom == ATOM_NONE) return null_string;
+	assert(atom <= atomic_load_acquire_32(&string_interner.count), "Invalid atom %u", atom);
+	return string_interner.chunks[atom / STRING_INTERN_CHUNK_SIZE][atom % STRING_INTERN_CHUNK_SIZE];
+}
+
+Atom _string_intern_find(String_Intern_Slots *slots, string s, u64 hash) {
+	u64 tag = hash >> 32;
+	for (u64 i = hash & slots->mask; ; i = (i+1) & slots->mask) {
+		u64 slot = atomic_load_acquire_64(&slots->slots[i]);
+		if (slot == 0) return ATOM_NONE;
+		if ((slot >> 32) == tag) {
+			Atom atom = (Atom)slot;
+			// The acquire above means the atom's string is there for us to read
+			string other = string_interner.chunks[atom / STRING_INTERN_CHUNK_SIZE][atom % STRING_INTERN_CHUNK_SIZE];
+			if (strings_match(other, s)) return atom;
+		}
+	}
+}
+// Needs insert_mutex
+void _string_intern_place(String_Intern_Slots *slots, u64 hash, Atom atom) {
+	u64 i = hash & slots->mask;
+	while (slots->slots[i] != 0) i = (i+1) & slots->mask;
+	atomic_store_release_64(&slots->slots[i], ((hash >> 32) << 32) | (u64)atom);
+}
+// Needs insert_mutex. Keeps the slots at most half full.
+void _string_intern_reserve(u64 atom_count) {
+	String_Intern_Slots *slots = string_interner.slots;
+	if (atom_count*2 <= slots->mask+1) return;
+
+	u64 slot_count = slots->mask+1;
+	while (atom_count*2 > slot_count) slot_count *= 2;
+
+	String_Intern_Slots *new_slots = _string_intern_make_slots(slot_count);
+	for (Atom atom = 1; atom <= string_interner.count; atom += 1) {
+		_string_intern_place(new_slots, string_get_hash(atom_get_string(atom)), atom);
+	}
+	// The old slots stay in the arena in case someone is still looking through them
+	atomic_store_release_64((volatile u64*)&string_interner.slots, (u64)new_slots);
+}
+// Needs insert_mutex
+Atom _string_intern_insert(string s, u64 hash) {
+	Atom atom = _string_intern_find(string_interner.slots, s, hash);
+	if (atom) return atom;
+
+	atom = string_interner.count + 1;
+	assert(atom < (u64)STRING_INTERN_MAX_CHUNKS*STRING_INTERN_CHUNK_SIZE, "Too many interned strings");
+	_string_intern_reserve(atom);
+
+	u64 chunk = atom / STRING_INTERN_CHUNK_SIZE;
+	if (!string_interner.chunks[chunk]) {
+		string_interner.chunks[chunk] = (string*)arena_push_aligned_zeroed(&string_interner.arena, STRING_INTERN_CHUNK_SIZE*sizeof(string), CACHE_LINE_SIZE);
+	}
+	string copy;
+	copy.count = s.count;
+	copy.data = (u8*)arena_push_aligned(&string_interner.arena, s.count, 1);
+	memcpy(copy.data, s.data, s.count);
+	string_interner.chunks[chunk][atom % STRING_INTERN_CHUNK_SIZE] = copy;
+	string_interner.byte_count += s.count;
+
+	atomic_store_release_32(&string_interner.count, atom);
+	_string_intern_place(string_interner.slots, hash, atom);
+	return atom;
+}
+
+Atom string_intern(string s) {
+	if (s.count == 0) return ATOM_NONE;
+	_string_intern_init();
+
+	u64 hash = string_get_hash(s);
+	Atom atom = _string_intern_find(_string_intern_get_slots(), s, hash);
+	if (atom) return atom;
+
+	mutex_acquire_or_wait(&string_interner.insert_mutex);
+	atom = _string_intern_insert(s, hash);
+	mutex_release(&string_interner.insert_mutex);
+	return atom;
+}
+
+// ATOM_NONE if s was never interned
+Atom string_find_atom(string s) {
+	if (s.count == 0) return ATOM_NONE;
+	_string_intern_init();
+	return _string_intern_find(_string_intern_get_slots(), s, string_get_hash(s));
+}
+
+void string_intern_many(string *strings, Atom *atoms, u64 count) {
+	_string_intern_init();
+
+	mutex_acquire_or_wait(&string_interner.insert_mutex);
+	_string_intern_reserve(string_interner.count + count);
+	for (u64 i = 0; i < count; i += 1) {
+		atoms[i] = strings[i].count ? _string_intern_insert(strings[i], string_get_hash(strings[i])) : ATOM_NONE;
+	}
+	mutex_release(&string_interner.insert_mutex);
+}
@@ -14,17 +14,19 @@ void log_heap() {
 		
 		print("\tBLOCK @ 0x%I64x, %llu bytes\n", (u64)block, block->size);
 		
-		Heap_Free_Node *node = block->free_head;
+		Heap_Allocation_Metadata *chunk = (Heap_Allocation_Metadata*)block->start;
 
 		u64 total_free = 0;
 		
-		while (node != 0) {
+		while ((u8*)chunk < (u8*)block->end) {
 		
-			print("\t\tFREE NODE @ 0x%I64x, %llu bytes\n", (u64)node, node->size);
+			if (chunk->size & HEAP_CHUNK_FREE) {
+				print("\t\tFREE NODE @ 0x%I64x, %llu bytes\n", (u64)chunk, heap_chunk_size(chunk));
 			
-			total_free += node->size;
+				total_free += heap_chunk_size(chunk);
+			}
 		
-			node = node->next;
+			chunk = heap_next_chunk(chunk);
 		}
 		
 		print("\t TOTAL FREE: %llu\n\n", total_free);
@@ -192,6 +194,21 @@ void test_allocator(bool do_log_heap) {
         dealloc(heap, blocks[i]);
     }
     
+    // Reallocation keeps contents, and shrinking never moves
+    u8 *r = (u8*)alloc(heap, KB(4));
+    for (int i = 0; i < KB(4); ++i) r[i] = (u8)i;
+    r = (u8*)reallocate(heap, r, KB(4), KB(64));
+    for (int i = 0; i < KB(4); ++i) assert(r[i] == (u8)i, "Reallocate lost contents");
+    for (int i = KB(4); i < KB(64); ++i) r[i] = (u8)i;
+    u8 *shrunk = (u8*)reallocate(heap, r, KB(64), KB(2));
+    assert(shrunk == r, "Shrinking reallocation moved");
+    for (int i = 0; i < KB(2); ++i) assert(shrunk[i] == (u8)i, "Reallocate lost contents");
+    void *after_shrunk = alloc(heap, KB(16));
+    u8 *grown = (u8*)reallocate(heap, shrunk, KB(2), KB(4));
+    for (int i = 0; i < KB(2); ++i) assert(grown[i] == (u8)i, "Reallocate lost contents");
+    dealloc(heap, grown);
+    dealloc(heap, after_shrunk);
+    
     assert(bytes_match(check_bytes, check_bytes_copy, 1024), "Memory corrupt");
     
     if (do_log_heap) log_heap();
@@ -225,37 +242,1313 @@ void test_threads() {
 	os_unlock_mutex(m);
 }
 
+#define ALLOCATOR_THREADED_ROUNDS 50
+#define ALLOCATOR_THREADED_REMOTE_COUNT 1000
+typedef struct Allocator_Threaded_Work {
+	void **remote_blocks; // Allocated by another thread, freed by this thread
+	u64 allocations;
+} Allocator_Threaded_Work;
 void test_allocator_threaded(Thread *t) {
 
 	Allocator heap = get_heap_allocator();
+	
+	Allocator_Threaded_Work *work = (Allocator_Threaded_Work*)t->data;
+	
+	for (int round = 0; round < ALLOCATOR_THREADED_ROUNDS; round += 1) {
+	    for (int i = 0; i < 1000; ++i) {
+	        void* temp = alloc(heap, 128);
+	        assert(temp != NULL && "Repeated allocation failed");
+	        dealloc(heap, temp);
+	    }
+	
+	    void* mixed_blocks[40];
+	    for (int i = 0; i < 40; ++i) {
+	        if (i % 2 == 0) {
+	            mixed_blocks[i] = alloc(heap, 128);
+	        } else {
+	            mixed_blocks[i] = alloc(heap, 1024 * 1024); // 1MB blocks
+	        }
+	        assert(mixed_blocks[i] != NULL && "Mixed size allocation failed");
+	    }
+	
+	    for (int i = 0; i < 40; ++i) {
+	        if (i % 2 == 0) {
+	            dealloc(heap, mixed_blocks[i]);
+	        }
+	    }
+	
+	    for (int i = 0; i < 40; ++i) {
+	        if (i % 2 != 0) {
+	            dealloc(heap, mixed_blocks[i]);
+	        }
+	    }
+	    
+	    // Lots of small allocations of different sizes alive at the same time
+	    void* small_blocks[256];
+	    for (int i = 0; i < 256; ++i) {
+	    	small_blocks[i] = alloc(heap, 8 + (i*24)%900);
+	    	*(u64*)small_blocks[i] = (u64)i;
+	    }
+	    for (int i = 0; i < 256; ++i) {
+	    	assert(*(u64*)small_blocks[i] == (u64)i, "Memory corrupted");
+	    	dealloc(heap, small_blocks[i]);
+	    }
+	    
+	    if (work) work->allocations += 1000 + 40 + 256;
+	}
+	
+	// Free memory that was allocated on another thread
+	if (work && work->remote_blocks) {
+		for (int i = 0; i < ALLOCATOR_THREADED_REMOTE_COUNT; ++i) {
+			dealloc(heap, work->remote_blocks[i]);
+		}
+		work->allocations += ALLOCATOR_THREADED_REMOTE_COUNT;
+	}
+}
 
-    for (int i = 0; i < 1000; ++i) {
-        void* temp = alloc(heap, 128);
-        assert(temp != NULL && "Repeated allocation failed");
-        dealloc(heap, temp);
-    }
+void test_allocator_threaded_scaling() {
+	Allocator heap = get_heap_allocator();
+	
+	u64 thread_counts[] = {1, 2, 4, 8, os_get_number_of_logical_processors()};
+	
+	for (u64 c = 0; c < sizeof(thread_counts)/sizeof(u64); c += 1) {
+		u64 thread_count = thread_counts[c];
+		
+		Thread *threads = (Thread*)alloc(heap, sizeof(Thread)*thread_count);
+		Allocator_Threaded_Work *work = (Allocator_Threaded_Work*)alloc(heap, sizeof(Allocator_Threaded_Work)*thread_count);
+		
+		for (u64 i = 0; i < thread_count; i += 1) {
+			work[i].allocations = 0;
+			work[i].remote_blocks = (void**)alloc(heap, sizeof(void*)*ALLOCATOR_THREADED_REMOTE_COUNT);
+			for (u64 j = 0; j < ALLOCATOR_THREADED_REMOTE_COUNT; j += 1) {
+				work[i].remote_blocks[j] = alloc(heap, 16 + (j*16)%512);
+			}
+			os_thread_init(&threads[i], test_allocator_threaded);
+			threads[i].data = &work[i];
+		}
+		
+		float64 start_seconds = os_get_elapsed_seconds();
+		for (u64 i = 0; i < thread_count; i += 1) os_thread_start(&threads[i]);
+		for (u64 i = 0; i < thread_count; i += 1) os_thread_join(&threads[i]);
+		float64 seconds = os_get_elapsed_seconds() - start_seconds;
+		
+		u64 allocations = 0;
+		for (u64 i = 0; i < thread_count; i += 1) {
+			allocations += work[i].allocations;
+			dealloc(heap, work[i].remote_blocks);
+			os_thread_destroy(&threads[i]);
+		}
+		
+		print("%llu threads: %llu heap allocations took %.2f ms (%.2f million allocs/sec)\n", thread_count, allocations, seconds*1000.0, ((float64)allocations/seconds)/1000000.0);
+		
+		dealloc(heap, threads);
+		dealloc(heap, work);
+	}
+}
 
-    void* mixed_blocks[40];
-    for (int i = 0; i < 40; ++i) {
-        if (i % 2 == 0) {
-            mixed_blocks[i] = alloc(heap, 128);
-        } else {
-            mixed_blocks[i] = alloc(heap, 1024 * 1024); // 1MB blocks
-        }
-        assert(mixed_blocks[i] != NULL && "Mixed size allocation failed");
-    }
+void test_large_allocations() {
+	Allocator heap = get_heap_allocator();
+	
+	// 1GB blobs should go straight back to the OS so resident memory doesn't keep growing
+	u64 rss_before = os_get_resident_memory_size();
+	for (int i = 0; i < 8; i += 1) {
+		u8 *blob = (u8*)alloc_uninitialized(heap, GB(1));
+		assert(blob != 0, "Large allocation failed");
+		for (u64 j = 0; j < GB(1); j += os.page_size) {
+			blob[j] = (u8)i;
+		}
+		assert(blob[GB(1)-os.page_size] == (u8)i, "Large allocation corrupted");
+		assert(heap_get_allocation_size(blob) >= GB(1), "Large allocation has wrong size");
+		u64 rss_during = os_get_resident_memory_size();
+		
+		dealloc(heap, blob);
+		u64 rss_after = os_get_resident_memory_size();
+		
+		print("\n\t1GB blob %d: resident %llu MB while allocated, %llu MB after free", i, rss_during/MB(1), rss_after/MB(1));
+		assert(rss_after < rss_before + MB(64), "Resident memory keeps growing after freeing large allocations");
+	}
+	print("\n");
+	
+	// Large allocations need to work with realloc and string formatting like everything else
+	u8 *big = (u8*)alloc(heap, MB(16));
+	big[MB(16)-1] = 69;
+	big = (u8*)heap_allocator_proc(MB(32), big, ALLOCATOR_REALLOCATE, 0);
+	assert(big[MB(16)-1] == 69, "Large allocation realloc failed");
+	memcpy(big, "Large", 5);
+	string s = sprint(get_temporary_allocator(), STR("%s"), (string){5, big});
+	assert(strings_match(s, STR("Large")), "Formatting a string in a large allocation failed");
+	dealloc(heap, big);
+	
+	// Heap blocks which are completely free should have their pages given back to the OS
+	void *blocks[20];
+	for (int i = 0; i < 20; i += 1) {
+		blocks[i] = alloc(heap, MB(3));
+	}
+	for (int i = 0; i < 20; i += 1) {
+		dealloc(heap, blocks[i]);
+	}
+	for (int i = 0; i < HEAP_BLOCK_IDLE_CHECKS_BEFORE_DECOMMIT; i += 1) {
+		heap_decommit_idle_blocks();
+	}
+	u64 decommitted_blocks = 0;
+	Heap_Block *block = heap_head;
+	while (block) {
+		if (block->decommitted) decommitted_blocks += 1;
+		block = block->next;
+	}
+	assert(decommitted_blocks > 0, "No idle heap blocks were decommitted");
+	
+	// And they should be usable again
+	for (int i = 0; i < 20; i += 1) {
+		blocks[i] = alloc(heap, MB(3));
+		memset(blocks[i], i, MB(3));
+	}
+	for (int i = 0; i < 20; i += 1) {
+		assert(((u8*)blocks[i])[MB(3)-1] == (u8)i, "Memory corrupted after recommitting heap block");
+		dealloc(heap, blocks[i]);
+	}
+}
 
-    for (int i = 0; i < 40; ++i) {
-        if (i % 2 == 0) {
-            dealloc(heap, mixed_blocks[i]);
-        }
-    }
+void test_arena() {
+	
+	// Pages are committed as pushes reach them
+	Arena arena = make_arena(MB(64));
+	assert(arena.region->reserved_size >= MB(64), "Arena did not reserve enough");
+	assert(arena.region->committed_size <= ARENA_COMMIT_SIZE, "Arena committed too much up front");
+	
+	u8 *small = (u8*)arena_push(&arena, 100);
+	assert((u64)small % ARENA_DEFAULT_ALIGNMENT == 0, "Arena push not aligned");
+	assert(arena.region->committed_size <= ARENA_COMMIT_SIZE, "Arena committed too much for a small push");
+	
+	u64 rss_before = os_get_resident_memory_size();
+	u8 *big = (u8*)arena_push(&arena, MB(16));
+	assert(arena.region->committed_size >= MB(16), "Arena did not commit on demand");
+	assert(arena.region->committed_size <= MB(16) + 2*ARENA_COMMIT_SIZE, "Arena committed too much");
+	for (u64 i = 0; i < MB(16); i += os.page_size) {
+		assert(big[i] == 0, "Freshly committed arena memory is not zero");
+		big[i] = 1;
+	}
+	u64 rss_during = os_get_resident_memory_size();
+	
+	// Aligned pushes
+	for (u64 alignment = 1; alignment <= KB(4); alignment *= 2) {
+		void *p = arena_push_aligned(&arena, 3, alignment);
+		assert((u64)p % alignment == 0, "Arena aligned push is not aligned");
+	}
+	
+	// Marks
+	Arena_Mark mark = arena_mark(&arena);
+	u8 *a = (u8*)arena_push(&arena, 128);
+	arena_push(&arena, KB(100));
+	arena_pop_to_mark(&arena, mark);
+	u8 *b = (u8*)arena_push(&arena, 128);
+	assert(a == b, "Arena did not pop to mark");
+	
+	// Reset decommits down to the high water mark
+	arena.high_water_mark = MB(1);
+	arena_reset(&arena);
+	assert(arena.region->committed_size <= MB(1) + ARENA_COMMIT_SIZE, "Arena did not decommit on reset");
+	u64 rss_after = os_get_resident_memory_size();
+	assert(rss_after + MB(8) < rss_during, "Arena reset did not give memory back to the OS");
+	(void)rss_before;
+	
+	u8 *again = (u8*)arena_push(&arena, 100);
+	assert(again == small, "Arena did not reset");
+	
+	// Running out of reserved memory chains on another reservation
+	Arena small_arena = make_arena(MB(1));
+	u8 *chunks[10];
+	for (int i = 0; i < 10; i += 1) {
+		chunks[i] = (u8*)arena_push(&small_arena, KB(400));
+		memset(chunks[i], i, KB(400));
+	}
+	for (int i = 0; i < 10; i += 1) {
+		assert(chunks[i][0] == (u8)i && chunks[i][KB(400)-1] == (u8)i, "Chained arena memory corrupted");
+	}
+	assert(small_arena.region != small_arena.first_region, "Arena did not chain");
+	mark = arena_mark(&small_arena);
+	arena_push(&small_arena, MB(4)); // Bigger than a reservation
+	arena_pop_to_mark(&small_arena, mark);
+	arena_reset(&small_arena);
+	assert(small_arena.region == small_arena.first_region, "Arena did not release chained regions on reset");
+	arena_destroy(&small_arena);
+	arena_destroy(&arena);
+	
+	// As an allocator
+	Allocator arena_allocator = make_arena_allocator(MB(8));
+	int *ints = (int*)alloc(arena_allocator, sizeof(int)*1000);
+	for (int i = 0; i < 1000; i += 1) ints[i] = i;
+	ints = (int*)reallocate(arena_allocator, ints, sizeof(int)*1000, sizeof(int)*2000);
+	for (int i = 0; i < 1000; i += 1) assert(ints[i] == i, "Arena reallocate lost contents");
+	arena_reset((Arena*)arena_allocator.data);
+	arena_destroy((Arena*)arena_allocator.data);
+	
+	u8 fixed_memory[KB(4)];
+	Allocator fixed = make_arena_allocator_with_memory(KB(4), fixed_memory);
+	void *in_fixed = alloc(fixed, 256);
+	assert((u8*)in_fixed >= fixed_memory && (u8*)in_fixed+256 <= fixed_memory+KB(4), "Fixed arena allocated outside its memory");
+	
+	// Bursts of small objects, arena vs heap
+	const u64 burst_count = 100000;
+	const u64 num_bursts = 20;
+	void **pointers = (void**)alloc(get_heap_allocator(), burst_count*sizeof(void*));
+	arena = make_arena(MB(64));
+	
+	float64 start_seconds = os_get_elapsed_seconds();
+	u64 start_cycles = rdtsc();
+	for (u64 burst = 0; burst < num_bursts; burst += 1) {
+		for (u64 i = 0; i < burst_count; i += 1) pointers[i] = heap_alloc(16 + (i*8)%240);
+		for (u64 i = 0; i < burst_count; i += 1) heap_dealloc(pointers[i]);
+	}
+	u64 heap_cycles = rdtsc() - start_cycles;
+	float64 heap_seconds = os_get_elapsed_seconds() - start_seconds;
+	
+	start_seconds = os_get_elapsed_seconds();
+	start_cycles = rdtsc();
+	for (u64 burst = 0; burst < num_bursts; burst += 1) {
+		for (u64 i = 0; i < burst_count; i += 1) pointers[i] = arena_push(&arena, 16 + (i*8)%240);
+		arena_reset(&arena);
+	}
+	u64 arena_cycles = rdtsc() - start_cycles;
+	float64 arena_seconds = os_get_elapsed_seconds() - start_seconds;
+	
+	u64 total = burst_count*num_bursts;
+	print("\n\t%llu small objects: heap %.2f ms (%llu cycles each), arena %.2f ms (%llu cycles each)\n", total, heap_seconds*1000.0, heap_cycles/total, arena_seconds*1000.0, arena_cycles/total);
+	
+	arena_destroy(&arena);
+	dealloc(get_heap_allocator(), pointers);
+}
 
-    for (int i = 0; i < 40; ++i) {
-        if (i % 2 != 0) {
-            dealloc(heap, mixed_blocks[i]);
-        }
-    }
+// What talloc used to be, to compare against
+thread_local u8 *old_temporary_storage = 0;
+thread_local u8 *old_temporary_storage_pointer = 0;
+void *old_talloc(u64 size) {
+	void *p = old_temporary_storage_pointer;
+	old_temporary_storage_pointer += size;
+	if (old_temporary_storage_pointer >= old_temporary_storage+TEMPORARY_STORAGE_SIZE) {
+		old_temporary_storage_pointer = old_temporary_storage;
+		return old_talloc(size);
+	}
+	return p;
+}
+void test_temporary_storage() {
+	Allocator temp = get_temporary_allocator();
+	
+	reset_temporary_storage();
+	Temporary_Storage_Stats stats_before = get_temporary_storage_stats();
+	
+	// Overflowing chains on more memory instead of wrapping around
+	const u64 chunk_size = TEMPORARY_STORAGE_SIZE/2;
+	u8 *chunks[5];
+	for (int i = 0; i < 5; i += 1) {
+		chunks[i] = (u8*)alloc(temp, chunk_size);
+		assert((u64)chunks[i] % ARENA_DEFAULT_ALIGNMENT == 0, "Temp allocation not aligned");
+		memset(chunks[i], i+1, chunk_size);
+	}
+	for (int i = 0; i < 5; i += 1) {
+		assert(chunks[i][0] == i+1 && chunks[i][chunk_size-1] == i+1, "Temporary storage overflow stomped on memory in use");
+	}
+	assert(get_temporary_storage_usage() >= chunk_size*5, "Temporary storage usage is wrong");
+	
+	Temporary_Storage_Stats stats = get_temporary_storage_stats();
+	assert(stats.overflow_count > stats_before.overflow_count, "Temporary storage did not record the overflow");
+	
+	// Reset records the usage and makes the next frame fit in one reservation
+	reset_temporary_storage();
+	stats = get_temporary_storage_stats();
+	assert(stats.last_usage >= chunk_size*5, "Temporary storage did not record the last usage");
+	assert(stats.peak_usage >= stats.last_usage, "Temporary storage peak is wrong");
+	assert(temporary_storage_peak_usage_all_threads >= stats.peak_usage, "Temporary storage global peak is wrong");
+	assert(stats.reset_count == stats_before.reset_count+1, "Temporary storage did not count the reset");
+	assert(temporary_storage_arena.reserve_size >= chunk_size*5, "Temporary storage did not grow after overflowing");
+	assert(get_temporary_storage_usage() == 0, "Temporary storage did not reset");
+	
+	for (int i = 0; i < 5; i += 1) chunks[i] = (u8*)alloc(temp, chunk_size);
+	stats_before = stats;
+	stats = get_temporary_storage_stats();
+	assert(stats.overflow_count == stats_before.overflow_count, "Temporary storage overflowed after growing");
+	
+	// Back to the normal size so the other tests see the usual setup
+	temporary_storage_deinit();
+	assert(get_temporary_allocator().proc != temp_allocator_proc, "Temporary storage deinit did not fall back");
+	temporary_storage_init(TEMPORARY_STORAGE_SIZE);
+	
+	// Bump pointer vs talloc, in frames like a game would use it
+	const u64 frame_count = 1000;
+	const u64 allocations_per_frame = 4000;
+	old_temporary_storage = (u8*)alloc(get_heap_allocator(), TEMPORARY_STORAGE_SIZE);
+	old_temporary_storage_pointer = old_temporary_storage;
+	
+	u64 sink = 0;
+	float64 start_seconds = os_get_elapsed_seconds();
+	u64 start_cycles = rdtsc();
+	for (u64 frame = 0; frame < frame_count; frame += 1) {
+		for (u64 i = 0; i < allocations_per_frame; i += 1) {
+			u8 *p = (u8*)old_talloc(16 + (i*8)%240);
+			*p = (u8)i;
+			sink += (u64)p;
+		}
+		old_temporary_storage_pointer = old_temporary_storage;
+	}
+	u64 old_cycles = rdtsc() - start_cycles;
+	float64 old_seconds = os_get_elapsed_seconds() - start_seconds;
+	
+	start_seconds = os_get_elapsed_seconds();
+	start_cycles = rdtsc();
+	for (u64 frame = 0; frame < frame_count; frame += 1) {
+		for (u64 i = 0; i < allocations_per_frame; i += 1) {
+			u8 *p = (u8*)talloc(16 + (i*8)%240);
+			*p = (u8)i;
+			sink += (u64)p;
+		}
+		reset_temporary_storage();
+	}
+	u64 new_cycles = rdtsc() - start_cycles;
+	float64 new_seconds = os_get_elapsed_seconds() - start_seconds;
+	
+	u64 total = frame_count*allocations_per_frame;
+	print("\n\t%llu temp allocations: bump pointer %.2f ms (%.2f cycles each), talloc %.2f ms (%.2f cycles each)\n", total, old_seconds*1000.0, (float64)old_cycles/(float64)total, new_seconds*1000.0, (float64)new_cycles/(float64)total);
+	print("\tTemporary storage peak: %llu bytes this thread, %llu bytes all threads ", get_temporary_storage_stats().peak_usage, temporary_storage_peak_usage_all_threads);
+	
+	(void)sink;
+	dealloc(get_heap_allocator(), old_temporary_storage);
+}
+
+typedef struct Pool_Test_Object {
+	u64 id;
+	Vector3 pos;
+	float32 life;
+} Pool_Test_Object;
+void test_pool() {
+	Pool pool = make_pool(Pool_Test_Object, get_heap_allocator());
+	
+	const u64 object_count = 5000;
+	Pool_Handle *handles = (Pool_Handle*)alloc(get_heap_allocator(), object_count*sizeof(Pool_Handle));
+	Pool_Test_Object **pointers = (Pool_Test_Object**)alloc(get_heap_allocator(), object_count*sizeof(Pool_Test_Object*));
+	
+	for (u64 i = 0; i < object_count; i += 1) {
+		Pool_Test_Object *o = (Pool_Test_Object*)pool_acquire(&pool, &handles[i]);
+		assert((u64)o % 16 == 0, "Pool object not aligned");
+		assert(handles[i].value != 0, "Pool gave a null handle");
+		o->id = i;
+		pointers[i] = o;
+	}
+	assert(pool.count == object_count, "Pool count is wrong");
+	
+	for (u64 i = 0; i < object_count; i += 1) {
+		assert(pool_get(&pool, handles[i]) == pointers[i], "Pool handle lookup is wrong");
+		assert(pool_get_handle(&pool, pointers[i]).value == handles[i].value, "Pool pointer to handle is wrong");
+	}
+	
+	// Release every other one, the rest must not move
+	for (u64 i = 0; i < object_count; i += 2) {
+		assert(pool_release(&pool, handles[i]), "Pool release failed");
+	}
+	assert(pool.count == object_count/2, "Pool count is wrong after release");
+	for (u64 i = 0; i < object_count; i += 1) {
+		if (i % 2 == 0) {
+			assert(pool_get(&pool, handles[i]) == 0, "Stale pool handle was valid");
+			assert(!pool_release(&pool, handles[i]), "Stale pool handle was released");
+		} else {
+			assert(pool_get(&pool, handles[i]) == pointers[i] && pointers[i]->id == i, "Pool object moved or got corrupted");
+		}
+	}
+	
+	// Dense iteration only sees live objects
+	u64 id_sum = 0;
+	for (u64 i = 0; i < pool.count; i += 1) {
+		Pool_Test_Object *o = (Pool_Test_Object*)pool_get_live(&pool, i);
+		assert(o->id % 2 == 1, "Pool iterated a released object");
+		id_sum += o->id;
+	}
+	assert(id_sum == (object_count/2)*(object_count/2), "Pool iteration missed objects");
+	
+	// Slots are reused, with a new generation
+	Pool_Handle reused;
+	pool_acquire(&pool, &reused);
+	u64 slot_count = pool.slot_count;
+	assert(pool_handle_index(reused) < object_count, "Pool did not reuse a free slot");
+	assert(pool_get(&pool, handles[pool_handle_index(reused)]) == 0, "Pool handle generation did not change");
+	
+	// Backwards release while iterating
+	for (s64 i = (s64)pool.count-1; i >= 0; i -= 1) {
+		pool_release_pointer(&pool, pool_get_live(&pool, i));
+	}
+	assert(pool.count == 0, "Pool did not release everything");
+	assert(pool.slot_count == slot_count, "Pool grew when it had free slots");
+	
+	// As an allocator
+	Allocator pool_allocator = make_pool_allocator(&pool);
+	Pool_Test_Object *a = (Pool_Test_Object*)alloc(pool_allocator, sizeof(Pool_Test_Object));
+	Pool_Test_Object *b = (Pool_Test_Object*)alloc(pool_allocator, sizeof(u64));
+	assert(a != b && pool.count == 2, "Pool allocator did not allocate");
+	dealloc(pool_allocator, a);
+	dealloc(pool_allocator, b);
+	assert(pool.count == 0, "Pool allocator did not deallocate");
+	
+	pool_destroy(&pool);
+	
+	// Backed by an arena
+	Allocator arena_allocator = make_arena_allocator(MB(16));
+	pool = make_pool(Pool_Test_Object, arena_allocator);
+	for (u64 i = 0; i < object_count; i += 1) pool_acquire(&pool, 0);
+	assert(pool.count == object_count, "Arena backed pool failed");
+	arena_destroy((Arena*)arena_allocator.data);
+	
+	// Spawn and despawn 100k objects per frame, pool vs heap
+	const u64 spawn_count = 100000;
+	const u64 frame_count = 20;
+	pool = make_pool(Pool_Test_Object, get_heap_allocator());
+	pointers = (Pool_Test_Object**)reallocate(get_heap_allocator(), pointers, object_count*sizeof(Pool_Test_Object*), spawn_count*sizeof(Pool_Test_Object*));
+	
+	float64 start_seconds = os_get_elapsed_seconds();
+	u64 start_cycles = rdtsc();
+	for (u64 frame = 0; frame < frame_count; frame += 1) {
+		for (u64 i = 0; i < spawn_count; i += 1) {
+			pointers[i] = (Pool_Test_Object*)alloc(get_heap_allocator(), sizeof(Pool_Test_Object));
+			pointers[i]->id = i;
+		}
+		for (u64 i = 0; i < spawn_count; i += 1) dealloc(get_heap_allocator(), pointers[i]);
+	}
+	u64 heap_cycles = rdtsc() - start_cycles;
+	float64 heap_seconds = os_get_elapsed_seconds() - start_seconds;
+	
+	start_seconds = os_get_elapsed_seconds();
+	start_cycles = rdtsc();
+	for (u64 frame = 0; frame < frame_count; frame += 1) {
+		for (u64 i = 0; i < spawn_count; i += 1) {
+			Pool_Test_Object *o = (Pool_Test_Object*)pool_acquire(&pool, 0);
+			o->id = i;
+		}
+		for (s64 i = (s64)pool.count-1; i >= 0; i -= 1) {
+			pool_release_pointer(&pool, pool_get_live(&pool, i));
+		}
+	}
+	u64 pool_cycles = rdtsc() - start_cycles;
+	float64 pool_seconds = os_get_elapsed_seconds() - start_seconds;
+	
+	u64 total = spawn_count*frame_count;
+	print("\n\t%llu spawns & despawns: heap %.2f ms (%llu cycles each), pool %.2f ms (%llu cycles each) ", total, heap_seconds*1000.0, heap_cycles/total, pool_seconds*1000.0, pool_cycles/total);
+	
+	pool_destroy(&pool);
+	dealloc(get_heap_allocator(), handles);
+	dealloc(get_heap_allocator(), pointers);
+}
+
+typedef struct Slot_Map_Test_Entity {
+	bool valid; // For the flag scan comparison
+	u32 id;
+	Vector2 pos;
+	Vector2 velocity;
+	float32 life;
+	u8 other_stuff[36];
+} Slot_Map_Test_Entity;
+// Every live object's slot points back at it
+void test_slot_map_check_dense(Slot_Map *map) {
+	for (u64 i = 0; i < map->count; i += 1) {
+		u32 slot_index = map->dense_to_slot[i];
+		assert(slot_index < map->slot_count, "Slot map dense_to_slot points past the slots");
+		assert(map->slots[slot_index].dense_index == i, "Slot map slot %u points at %u, but object %llu is in it", slot_index, map->slots[slot_index].dense_index, i);
+		assert(generation_is_live(map->slots[slot_index].generation), "Slot map object %llu has a free slot", i);
+	}
+}
+void test_slot_map() {
+	Slot_Map map = make_slot_map(Slot_Map_Test_Entity, get_heap_allocator());
+	Slot_Map_Test_Entity *all;
+	
+	Slot_Map_Handle handles[10];
+	for (u32 i = 0; i < 10; i += 1) {
+		Slot_Map_Test_Entity *e = (Slot_Map_Test_Entity*)slot_map_add(&map, &handles[i]);
+		assert(handles[i].value != 0, "Slot map gave a null handle");
+		e->id = i;
+	}
+	all = (Slot_Map_Test_Entity*)map.objects;
+	for (u32 i = 0; i < 10; i += 1) {
+		assert(all[i].id == i, "Slot map objects are not packed in the order they were added");
+	}
+	test_slot_map_check_dense(&map);
+	
+	// Removing from the middle moves the last object into the hole
+	assert(slot_map_remove(&map, handles[3]), "Slot map remove failed");
+	assert(map.count == 9, "Slot map count is wrong after remove");
+	assert(all[3].id == 9, "Slot map did not move the last object into the hole (got %u)", all[3].id);
+	assert(map.dense_to_slot[3] == slot_map_handle_index(handles[9]), "Slot map dense_to_slot was not updated for the moved object");
+	assert(slot_map_get(&map, handles[9]) == &all[3], "Handle of the moved object does not find it");
+	assert(slot_map_get_handle_at(&map, 3).value == handles[9].value, "Slot map index to handle is wrong after a move");
+	assert(slot_map_get(&map, handles[3]) == 0, "Removed slot map handle is still valid");
+	assert(!slot_map_remove(&map, handles[3]), "Removed slot map handle was removed again");
+	test_slot_map_check_dense(&map);
+	
+	// Removing the last one moves nothing
+	assert(slot_map_remove(&map, handles[8]), "Slot map remove failed");
+	for (u32 i = 0; i < 8; i += 1) {
+		assert(all[i].id == (i == 3 ? 9 : i), "Removing the last object moved another one");
+	}
+	test_slot_map_check_dense(&map);
+	
+	// Removing by index
+	slot_map_remove_at(&map, 0);
+	assert(all[0].id == 7, "slot_map_remove_at did not move the last object into the hole");
+	assert(slot_map_get(&map, handles[7]) == &all[0], "Handle of the object moved by remove_at does not find it");
+	test_slot_map_check_dense(&map);
+	
+	// Adding reuses the slot freed last and puts the object at the end. The old handle of that
+	// slot stays dead.
+	Slot_Map_Handle reused;
+	Slot_Map_Test_Entity *e = (Slot_Map_Test_Entity*)slot_map_add(&map, &reused);
+	e->id = 100;
+	assert(map.slot_count == 10, "Slot map made a new slot when it had free ones");
+	assert(slot_map_handle_index(reused) == slot_map_handle_index(handles[0]), "Slot map did not reuse the last freed slot");
+	assert(e == &all[map.count-1], "Slot map did not add at the end");
+	assert(slot_map_get(&map, handles[0]) == 0, "Old handle to a reused slot is valid");
+	assert(slot_map_get(&map, reused) == e, "Handle to a reused slot does not find it");
+	test_slot_map_check_dense(&map);
+	
+	// Random adds and removes against a plain array of what should be alive
+	const u64 max_live = 500;
+	Slot_Map_Handle *live_handles = (Slot_Map_Handle*)alloc(get_heap_allocator(), max_live*sizeof(Slot_Map_Handle));
+	u32 *live_ids = (u32*)alloc(get_heap_allocator(), max_live*sizeof(u32));
+	u64 live_count = 0;
+	u64 most_live = map.count;
+	slot_map_clear(&map);
+	assert(map.count == 0, "Slot map did not clear");
+	assert(slot_map_get(&map, reused) == 0, "Slot map handle valid after clear");
+	for (u32 step = 0; step < 20000; step += 1) {
+		bool add = live_count == 0 || (live_count < max_live && get_random_int_in_range(0, 99) < 55);
+		if (add) {
+			Slot_Map_Test_Entity *added = (Slot_Map_Test_Entity*)slot_map_add(&map, &live_handles[live_count]);
+			added->id = step;
+			live_ids[live_count] = step;
+			live_count += 1;
+			most_live = max(most_live, live_count);
+		} else {
+			u64 i = get_random_int_in_range(0, live_count-1);
+			assert(slot_map_remove(&map, live_handles[i]), "Slot map remove of a live handle failed");
+			assert(slot_map_get(&map, live_handles[i]) == 0, "Removed slot map handle is still valid");
+			live_count -= 1;
+			live_handles[i] = live_handles[live_count];
+			live_ids[i] = live_ids[live_count];
+		}
+		if (step % 97 == 0) {
+			assert(map.count == live_count, "Slot map count is wrong");
+			test_slot_map_check_dense(&map);
+			for (u64 i = 0; i < live_count; i += 1) {
+				Slot_Map_Test_Entity *found = (Slot_Map_Test_Entity*)slot_map_get(&map, live_handles[i]);
+				assert(found && found->id == live_ids[i], "Slot map handle found the wrong object");
+			}
+		}
+	}
+	assert(map.slot_count <= most_live, "Slot map has more slots (%llu) than it ever had objects (%llu)", map.slot_count, most_live);
+	
+	slot_map_destroy(&map);
+	dealloc(get_heap_allocator(), live_handles);
+	dealloc(get_heap_allocator(), live_ids);
+	
+	// Update 100k live entities out of 1M slots: scanning a valid flag vs slot map vs pool
+	const u64 slot_total = 1000000;
+	const u64 live_total = 100000;
+	const u64 frame_count = 20;
+	
+	Slot_Map_Test_Entity *flat = (Slot_Map_Test_Entity*)alloc(get_heap_allocator(), slot_total*sizeof(Slot_Map_Test_Entity));
+	memset(flat, 0, slot_total*sizeof(Slot_Map_Test_Entity));
+	map = make_slot_map(Slot_Map_Test_Entity, get_heap_allocator());
+	Pool pool = make_pool(Slot_Map_Test_Entity, get_heap_allocator());
+	
+	// Fill everything, then kill 9 out of 10 at random so the live ones are scattered like after
+	// a while of playing.
+	Pool_Handle *pool_handles = (Pool_Handle*)alloc(get_heap_allocator(), slot_total*sizeof(Pool_Handle));
+	Slot_Map_Handle *map_handles = (Slot_Map_Handle*)alloc(get_heap_allocator(), slot_total*sizeof(Slot_Map_Handle));
+	for (u64 i = 0; i < slot_total; i += 1) {
+		flat[i].valid = true;
+		flat[i].id = (u32)i;
+		((Slot_Map_Test_Entity*)slot_map_add(&map, &map_handles[i]))->id = (u32)i;
+		((Slot_Map_Test_Entity*)pool_acquire(&pool, &pool_handles[i]))->id = (u32)i;
+	}
+	u64 alive = slot_total;
+	while (alive > live_total) {
+		u64 i = get_random_int_in_range(0, slot_total-1);
+		if (!flat[i].valid) continue;
+		flat[i].valid = false;
+		slot_map_remove(&map, map_handles[i]);
+		pool_release(&pool, pool_handles[i]);
+		alive -= 1;
+	}
+	assert(map.count == live_total && pool.count == live_total, "Slot map benchmark setup is wrong");
+	
+	float64 start = os_get_elapsed_seconds();
+	for (u64 frame = 0; frame < frame_count; frame += 1) {
+		for (u64 i = 0; i < slot_total; i += 1) {
+			if (!flat[i].valid) continue;
+			flat[i].pos = v2_add(flat[i].pos, flat[i].velocity);
+			flat[i].life += 1.0f;
+		}
+	}
+	float64 flag_seconds = os_get_elapsed_seconds() - start;
+	
+	start = os_get_elapsed_seconds();
+	for (u64 frame = 0; frame < frame_count; frame += 1) {
+		Slot_Map_Test_Entity *live = (Slot_Map_Test_Entity*)map.objects;
+		for (u64 i = 0; i < map.count; i += 1) {
+			live[i].pos = v2_add(live[i].pos, live[i].velocity);
+			live[i].life += 1.0f;
+		}
+	}
+	float64 slot_map_seconds = os_get_elapsed_seconds() - start;
+	
+	start = os_get_elapsed_seconds();
+	for (u64 frame = 0; frame < frame_count; frame += 1) {
+		for (u64 i = 0; i < pool.count; i += 1) {
+			Slot_Map_Test_Entity *e = (Slot_Map_Test_Entity*)pool_get_live(&pool, i);
+			e->pos = v2_add(e->pos, e->velocity);
+			e->life += 1.0f;
+		}
+	}
+	float64 pool_seconds = os_get_elapsed_seconds() - start;
+	
+	// Keep the loops from being optimized away
+	float32 life_sum = 0;
+	for (u64 i = 0; i < slot_total; i += 1) if (flat[i].valid) life_sum += flat[i].life;
+	for (u64 i = 0; i < map.count; i += 1) life_sum += ((Slot_Map_Test_Entity*)map.objects)[i].life;
+	for (u64 i = 0; i < pool.count; i += 1) life_sum += ((Slot_Map_Test_Entity*)pool_get_live(&pool, i))->life;
+	assert(life_sum == (float32)(live_total*frame_count*3), "Slot map benchmark updated the wrong objects");
+	
+	print("\n\tUpdate %llu live out of %llu slots, per frame: flag scan %.3f ms, slot map %.3f ms, pool %.3f ms (life sum %.0f) ", live_total, slot_total, flag_seconds*1000.0/frame_count, slot_map_seconds*1000.0/frame_count, pool_seconds*1000.0/frame_count, life_sum);
+	
+	slot_map_destroy(&map);
+	pool_destroy(&pool);
+	dealloc(get_heap_allocator(), flat);
+	dealloc(get_heap_allocator(), map_handles);
+	dealloc(get_heap_allocator(), pool_handles);
+}
+
+void test_deque() {
+	Deque d;
+	deque_init(&d, sizeof(u64), 5, get_heap_allocator());
+	assert(d.capacity == 8, "Deque capacity should round up to a power of two");
+	assert(deque_peek_front(&d) == 0 && deque_peek_back(&d) == 0, "Empty deque peek should be 0");
+	assert(!deque_pop_front(&d, 0) && !deque_pop_back(&d, 0), "Pop from empty deque succeeded");
+	
+	// Push at both ends so it wraps: 4 3 2 1 | 5 6 7 8
+	for (u64 i = 1; i <= 4; i += 1) assert(deque_push_front(&d, &i), "Deque push front failed");
+	for (u64 i = 5; i <= 8; i += 1) assert(deque_push_back(&d, &i), "Deque push back failed");
+	u64 x = 9;
+	assert(!deque_push_back(&d, &x) && !deque_push_front(&d, &x), "Push to full deque succeeded");
+	u64 expected[] = {4, 3, 2, 1, 5, 6, 7, 8};
+	for (u64 i = 0; i < 8; i += 1) assert(*(u64*)deque_get(&d, i) == expected[i], "Deque order is wrong");
+	assert(deque_get(&d, 8) == 0, "Deque get out of range should be 0");
+	
+	// Growing keeps the order
+	deque_reserve(&d, 9);
+	assert(d.capacity == 16 && d.count == 8, "Deque reserve is wrong");
+	for (u64 i = 0; i < 8; i += 1) assert(*(u64*)deque_get(&d, i) == expected[i], "Deque order is wrong after reserve");
+	
+	assert(deque_pop_front(&d, &x) && x == 4, "Deque pop front is wrong");
+	assert(deque_pop_back(&d, &x) && x == 8, "Deque pop back is wrong");
+	assert(*(u64*)deque_peek_front(&d) == 3 && *(u64*)deque_peek_back(&d) == 7, "Deque peek is wrong");
+	
+	// Many, across the wrap
+	u64 many[20];
+	for (u64 i = 0; i < 20; i += 1) many[i] = 100 + i;
+	assert(deque_push_back_many(&d, many, 20) == 10, "Deque push many should stop when full");
+	u64 out[32];
+	assert(deque_pop_front_many(&d, out, 32) == 16, "Deque pop many is wrong");
+	assert(out[0] == 3 && out[5] == 7 && out[6] == 100 && out[15] == 109, "Deque pop many order is wrong");
+	assert(d.count == 0, "Deque should be empty");
+	
+	// Random against an array
+	u64 *reference = (u64*)alloc(get_heap_allocator(), 2048*sizeof(u64));
+	u64 ref_first = 1024, ref_count = 0;
+	deque_destroy(&d);
+	deque_init(&d, sizeof(u64), 512, get_heap_allocator());
+	for (u64 i = 0; i < 100000; i += 1) {
+		u64 op = get_random_int_in_range(0, 3);
+		if (op == 0 && ref_first > 0 && d.count < d.capacity) {
+			ref_first -= 1; reference[ref_first] = i; ref_count += 1;
+			deque_push_front(&d, &i);
+		} else if (op == 1 && ref_first + ref_count < 2048 && d.count < d.capacity) {
+			reference[ref_first + ref_count] = i; ref_count += 1;
+			deque_push_back(&d, &i);
+		} else if (op == 2 && ref_count) {
+			assert(deque_pop_front(&d, &x) && x == reference[ref_first], "Deque random pop front is wrong");
+			ref_first += 1; ref_count -= 1;
+		} else if (op == 3 && ref_count) {
+			assert(deque_pop_back(&d, &x) && x == reference[ref_first + ref_count - 1], "Deque random pop back is wrong");
+			ref_count -= 1;
+		}
+		if (ref_count == 0) ref_first = 1024;
+		assert(d.count == ref_count, "Deque random count is wrong");
+	}
+	dealloc(get_heap_allocator(), reference);
+	deque_destroy(&d);
+}
+
+void test_priority_queue() {
+	Priority_Queue q;
+	priority_queue_init(&q, sizeof(u64), 0, get_heap_allocator());
+	assert(!priority_queue_pop(&q, 0, 0) && priority_queue_peek(&q, 0) == 0, "Empty priority queue popped");
+	
+	// Random pushes, pops, priority changes and removes, checked against a brute force search
+	const u64 max_items = 3000;
+	Priority_Queue_Handle *handles = (Priority_Queue_Handle*)alloc(get_heap_allocator(), max_items*sizeof(Priority_Queue_Handle));
+	float64 *priorities = (float64*)alloc(get_heap_allocator(), max_items*sizeof(float64));
+	u64 *values = (u64*)alloc(get_heap_allocator(), max_items*sizeof(u64));
+	u64 live = 0;
+	u64 next_value = 1;
+	for (u64 step = 0; step < 200000; step += 1) {
+		u64 op = get_random_int_in_range(0, 9);
+		if (op < 4 && live < max_items) {
+			priorities[live] = (float64)get_random_int_in_range(0, 100000);
+			values[live] = next_value++;
+			handles[live] = priority_queue_push(&q, priorities[live], &values[live]);
+			assert(handles[live].value != 0, "Priority queue gave a null handle");
+			live += 1;
+		} else if (op < 6 && live) {
+			u64 lowest = 0;
+			for (u64 i = 1; i < live; i += 1) if (priorities[i] < priorities[lowest]) lowest = i;
+			u64 value; float64 priority;
+			assert(priority_queue_pop(&q, &value, &priority), "Priority queue pop failed");
+			assert(priority == priorities[lowest], "Priority queue popped the wrong priority");
+			// Ties can come out in any order, so find which one it was
+			u64 popped = lowest;
+			for (u64 i = 0; i < live; i += 1) if (values[i] == value) popped = i;
+			assert(priorities[popped] == priority, "Priority queue popped the wrong value");
+			assert(!priority_queue_contains(&q, handles[popped]), "Popped handle is still in the priority queue");
+			live -= 1;
+			handles[popped] = handles[live]; priorities[popped] = priorities[live]; values[popped] = values[live];
+		} else if (op < 8 && live) {
+			u64 i = get_random_int_in_range(0, live-1);
+			priorities[i] = (float64)get_random_int_in_range(0, 100000);
+			assert(priority_queue_set_priority(&q, handles[i], priorities[i]), "Priority queue set priority failed");
+		} else if (live) {
+			u64 i = get_random_int_in_range(0, live-1);
+			float64 priority;
+			u64 *value = (u64*)priority_queue_get(&q, handles[i], &priority);
+			assert(value && *value == values[i] && priority == priorities[i], "Priority queue get is wrong");
+			assert(priority_queue_remove(&q, handles[i]), "Priority queue remove failed");
+			assert(!priority_queue_remove(&q, handles[i]) && !priority_queue_get(&q, handles[i], 0), "Removed handle is still in the priority queue");
+			live -= 1;
+			handles[i] = handles[live]; priorities[i] = priorities[live]; values[i] = values[live];
+		}
+		assert(q.count == live, "Priority queue count is wrong");
+	}
+	
+	// Drains in order
+	float64 last = -1;
+	float64 priority;
+	while (priority_queue_pop(&q, 0, &priority)) {
+		assert(priority >= last, "Priority queue drained out of order");
+		last = priority;
+	}
+	u64 capacity = q.capacity;
+	for (u64 i = 0; i < 100; i += 1) priority_queue_push(&q, (float64)i, &i);
+	priority_queue_clear(&q);
+	assert(q.count == 0 && q.capacity == capacity, "Priority queue clear is wrong");
+	
+	dealloc(get_heap_allocator(), handles);
+	dealloc(get_heap_allocator(), priorities);
+	dealloc(get_heap_allocator(), values);
+	priority_queue_destroy(&q);
+}
+
+void _test_timer_count(Timer_Scheduler *s, Timer_Handle timer, void *data) {
+	*(u64*)data += 1;
+}
+void _test_timer_stop_self(Timer_Scheduler *s, Timer_Handle timer, void *data) {
+	*(u64*)data += 1;
+	assert(timer_is_running(s, timer), "Repeating timer should be running in its proc");
+	timer_stop(s, timer);
+}
+// counts[0] is how many times this fired, counts[1] how many of the timers it starts fired
+void _test_timer_restart_now(Timer_Scheduler *s, Timer_Handle timer, void *data) {
+	u64 *counts = (u64*)data;
+	counts[0] += 1;
+	timer_restart(s, timer, 0);
+	timer_start(s, 0, _test_timer_count, &counts[1]);
+}
+typedef struct Timer_Test_Cooldown {
+	float64 cooldown_left;
+	u64 fired;
+	u8 other_entity_stuff[112]; // Cooldowns usually live in a big entity struct
+} Timer_Test_Cooldown;
+void test_timers() {
+	Timer_Scheduler s;
+	timer_scheduler_init(&s, 16, get_heap_allocator());
+	
+	u64 once = 0, repeating = 0, stops_self = 0;
+	Timer_Handle a = timer_start(&s, 1.0, _test_timer_count, &once);
+	Timer_Handle b = timer_start_repeating(&s, 0.25, _test_timer_count, &repeating);
+	Timer_Handle c = timer_start_repeating(&s, 0.5, _test_timer_stop_self, &stops_self);
+	Timer_Handle cooldown = timer_start(&s, 0.6, 0, 0);
+	
+	assert(timer_scheduler_update(&s, 0.2) == 0, "Timer fired early");
+	assert(timer_get_time_left(&s, a) > 0.79 && timer_get_time_left(&s, a) < 0.81, "Timer time left is wrong");
+	timer_scheduler_update(&s, 0.4);
+	assert(repeating == 2 && stops_self == 1 && once == 0, "Timers fired wrong after 0.6s");
+	assert(!timer_is_running(&s, c) && timer_is_running(&s, b), "Timer stop from proc failed");
+	assert(!timer_is_running(&s, cooldown), "Timer without proc did not finish");
+	
+	timer_restart(&s, a, 2.0); // Now at 2.6
+	timer_scheduler_update(&s, 1.0);
+	assert(once == 0 && repeating == 6, "Timer restart is wrong");
+	// Fell behind a lot, catches up in one go
+	timer_scheduler_update(&s, 2.0);
+	assert(once == 1 && repeating == 14, "Timers did not catch up");
+	assert(!timer_is_running(&s, a) && !timer_stop(&s, a), "One shot timer still running after firing");
+	assert(timer_stop(&s, b) && s.queue.count == 0, "Timer stop failed");
+	
+	// Restarting itself and starting timers with 0 seconds from a proc must not fire them again
+	// in the same update (used to loop forever)
+	u64 now_counts[2] = {0};
+	Timer_Handle d = timer_start_repeating(&s, 0.5, _test_timer_restart_now, now_counts);
+	assert(timer_scheduler_update(&s, 0.5) == 1, "Timer started from a proc fired in the same update");
+	assert(now_counts[0] == 1 && now_counts[1] == 0 && timer_is_running(&s, d) && s.queue.count == 2, "Timers started from a proc are wrong");
+	assert(timer_scheduler_update(&s, 0.1) == 2, "Timers started from a proc did not fire in the next update");
+	assert(now_counts[0] == 2 && now_counts[1] == 1 && s.queue.count == 2, "Timers started from a proc are wrong after the next update");
+	assert(timer_stop(&s, d), "Timer stop failed");
+	assert(timer_scheduler_update(&s, 0) == 1 && now_counts[1] == 2 && s.queue.count == 0, "Timer started from a proc did not fire");
+	
+	// 100k entities with cooldowns between 1 and 30 seconds. Ticking every cooldown every frame
+	// vs only looking at the ones that are due.
+	const u64 entity_count = 100000;
+	const u64 frame_count = 600;
+	const float64 dt = 1.0/60.0;
+	Timer_Test_Cooldown *entities = (Timer_Test_Cooldown*)alloc(get_heap_allocator(), entity_count*sizeof(Timer_Test_Cooldown));
+	float64 *intervals = (float64*)alloc(get_heap_allocator(), entity_count*sizeof(float64));
+	for (u64 i = 0; i < entity_count; i += 1) {
+		intervals[i] = 1.0 + get_random_float64()*29.0;
+		entities[i].cooldown_left = intervals[i];
+		entities[i].fired = 0;
+	}
+	
+	float64 start = os_get_elapsed_seconds();
+	for (u64 frame = 0; frame < frame_count; frame += 1) {
+		for (u64 i = 0; i < entity_count; i += 1) {
+			entities[i].cooldown_left -= dt;
+			if (entities[i].cooldown_left <= 0) {
+				entities[i].cooldown_left += intervals[i];
+				entities[i].fired += 1;
+			}
+		}
+	}
+	float64 polling_seconds = os_get_elapsed_seconds() - start;
+	u64 polled_fires = 0;
+	for (u64 i = 0; i < entity_count; i += 1) polled_fires += entities[i].fired;
+	
+	timer_scheduler_destroy(&s);
+	timer_scheduler_init(&s, entity_count, get_heap_allocator());
+	for (u64 i = 0; i < entity_count; i += 1) {
+		entities[i].fired = 0;
+		timer_start_repeating(&s, intervals[i], _test_timer_count, &entities[i].fired);
+	}
+	start = os_get_elapsed_seconds();
+	u64 scheduled_fires = 0;
+	for (u64 frame = 0; frame < frame_count; frame += 1) {
+		scheduled_fires += timer_scheduler_update(&s, dt);
+	}
+	float64 scheduler_seconds = os_get_elapsed_seconds() - start;
+	
+	// Float rounding can put a few on the other side of a frame
+	assert(scheduled_fires + entity_count/100 > polled_fires && polled_fires + entity_count/100 > scheduled_fires, "Timer scheduler fired %llu times, polling %llu", scheduled_fires, polled_fires);
+	print("\n\t%llu cooldowns for %llu frames, per frame: polling %.3f ms, scheduler %.3f ms (%llu, %llu fired) ", entity_count, frame_count, polling_seconds*1000.0/frame_count, scheduler_seconds*1000.0/frame_count, polled_fires, scheduled_fires);
+	
+	dealloc(get_heap_allocator(), entities);
+	dealloc(get_heap_allocator(), intervals);
+	timer_scheduler_destroy(&s);
+}
+
+void test_heap_instrumentation_free_proc(Thread *t) {
+	void **pointers = (void**)t->data;
+	for (int i = 0; i < 100; i += 1) dealloc(get_heap_allocator(), pointers[i]);
+}
+void test_heap_instrumentation() {
+	Allocator heap = get_heap_allocator();
+	
+	Heap_Block_Stats blocks[16];
+	Heap_Stats before = heap_get_stats(blocks, 16);
+	assert(before.block_count >= 1, "Heap stats found no blocks");
+	assert(before.free_bytes <= before.block_bytes, "Heap stats free bytes is wrong");
+	assert(before.fragmentation >= 0.0 && before.fragmentation <= 1.0, "Heap fragmentation out of range");
+	for (u64 i = 0; i < min(before.block_count, 16); i += 1) {
+		assert(blocks[i].largest_free_chunk <= blocks[i].free_bytes, "Heap block stats are wrong");
+		assert(blocks[i].free_bytes <= blocks[i].size, "Heap block stats are wrong");
+	}
+	
+	// Punch holes, too big for the thread cache so they really go back to the free lists
+	const u64 hole_count = 1000;
+	void **pointers = (void**)alloc(heap, hole_count*sizeof(void*));
+	for (u64 i = 0; i < hole_count; i += 1) pointers[i] = alloc(heap, KB(2));
+	for (u64 i = 0; i < hole_count; i += 2) dealloc(heap, pointers[i]);
+	
+	Heap_Stats holes = heap_get_stats(0, 0);
+	assert(holes.fragmentation > 0.0 && holes.fragmentation <= 1.0, "Heap fragmentation out of range");
+	
+	// Filling the holes merges them away. Some holes may have merged with free chunks that
+	// were already there, so we don't know exactly how many.
+	for (u64 i = 1; i < hole_count; i += 2) dealloc(heap, pointers[i]);
+	Heap_Stats merged = heap_get_stats(0, 0);
+	assert(holes.free_chunk_count >= merged.free_chunk_count + hole_count/4, "Heap stats did not see the free chunks");
+	assert(merged.free_bytes >= holes.free_bytes + (hole_count/2)*KB(2), "Heap stats free bytes is wrong");
+	dealloc(heap, pointers);
+	
+#if HEAP_INSTRUMENTATION
+	u64 tag = heap_get_tag(STR("Instrumentation test"));
+	assert(heap_get_tag(STR("Instrumentation test")) == tag, "Heap tag was registered twice");
+	Heap_Tag_Stats tag_before = heap_get_tag_stats(tag);
+	Heap_Tag_Stats untagged_before = heap_get_tag_stats(0);
+	
+	void *small[100];
+	void *large;
+	heap_tag_scope("Instrumentation test") {
+		for (int i = 0; i < 100; i += 1) small[i] = alloc(heap, 100);
+		large = alloc(heap, MB(8));
+		talloc(1000);
+	}
+	assert(heap_current_tag == 0, "heap_tag_scope did not restore the tag");
+	
+	Heap_Tag_Stats tag_after = heap_get_tag_stats(tag);
+	assert(tag_after.allocation_count == tag_before.allocation_count + 101, "Heap tag allocation count is wrong");
+	assert(tag_after.allocated_bytes >= tag_before.allocated_bytes + 100*100 + MB(8), "Heap tag bytes is wrong");
+	assert(tag_after.total_allocations == tag_before.total_allocations + 101, "Heap tag total allocations is wrong");
+	assert(tag_after.temporary_bytes >= tag_before.temporary_bytes + 1000, "Heap tag temporary bytes is wrong");
+	
+	// Growing in place keeps the tag
+	large = reallocate(heap, large, MB(8), MB(16));
+	assert(heap_get_tag_stats(tag).allocated_bytes >= tag_before.allocated_bytes + 100*100 + MB(16), "Heap tag did not follow reallocate");
+	
+	Heap_Stats during = heap_get_stats(0, 0);
+	assert(during.peak_bytes >= (u64)during.allocated_bytes, "Heap peak is wrong");
+	
+	// Freed on another thread than it was allocated on, or untagged, still goes to the right tag
+	Thread freer;
+	os_thread_init(&freer, test_heap_instrumentation_free_proc);
+	freer.data = small;
+	os_thread_start(&freer);
+	os_thread_join(&freer);
+	os_thread_destroy(&freer);
+	dealloc(heap, large);
+	tag_after = heap_get_tag_stats(tag);
+	assert(tag_after.allocation_count == tag_before.allocation_count, "Heap tag allocation count did not go back down");
+	assert(tag_after.allocated_bytes == tag_before.allocated_bytes, "Heap tag bytes did not go back down");
+	
+#if HEAP_ENABLE_THREAD_CACHE
+	// The small ones went back to this thread's cache as remote frees. Picking them up must
+	// not count them again.
+	if (heap_thread_cache) {
+		assert(heap_thread_cache->remote_free_head != 0, "Frees from another thread did not go to the owner");
+		heap_thread_cache_drain_remote_frees(heap_thread_cache);
+		assert(heap_thread_cache->remote_free_head == 0, "Remote frees were not drained");
+		tag_after = heap_get_tag_stats(tag);
+		assert(tag_after.allocation_count == tag_before.allocation_count, "Draining remote frees changed the heap tag count");
+		assert(tag_after.allocated_bytes == tag_before.allocated_bytes, "Draining remote frees changed the heap tag bytes");
+	}
+#endif
+	assert(tag_after.peak_bytes >= MB(16), "Heap tag peak is wrong");
+	assert(heap_get_tag_stats(0).total_allocations >= untagged_before.total_allocations, "Untagged stats went backwards");
+	
+	heap_instrumentation_update();
+#endif
+}
+
+void test_aligned_allocations() {
+	Allocator heap = get_heap_allocator();
+	
+	// Heap, mixed with normal allocations so the aligned ones come from all over the free lists
+	const u64 count = 300;
+	void *pointers[300];
+	void *normal[300];
+	u64 sizes[] = {1, 17, 100, 1000, 5000, 70000};
+	for (u64 i = 0; i < count; i += 1) {
+		u64 alignment = 1ULL << (i % 13); // Up to 4096
+		u64 size = sizes[i % (sizeof(sizes)/sizeof(u64))];
+		pointers[i] = alloc_aligned(heap, size, alignment);
+		assert((u64)pointers[i] % alignment == 0, "Heap aligned allocation is not aligned");
+		memset(pointers[i], (int)i, size);
+		normal[i] = alloc(heap, size);
+	}
+	for (u64 i = 0; i < count; i += 1) {
+		u64 size = sizes[i % (sizeof(sizes)/sizeof(u64))];
+		assert(((u8*)pointers[i])[0] == (u8)i && ((u8*)pointers[i])[size-1] == (u8)i, "Heap aligned allocations overlap");
+		if (i % 2) dealloc(heap, pointers[i]);
+		dealloc(heap, normal[i]);
+	}
+	for (u64 i = 0; i < count; i += 2) dealloc(heap, pointers[i]);
+	
+	// Large allocations
+	void *large = alloc_aligned(heap, MB(5), 4096);
+	assert((u64)large % 4096 == 0, "Large aligned allocation is not aligned");
+	assert(heap_get_allocation_size(large) >= MB(5), "Large aligned allocation is too small");
+	memset(large, 0x42, MB(5));
+	large = reallocate_aligned(heap, large, MB(5), MB(9), 4096);
+	assert((u64)large % 4096 == 0 && ((u8*)large)[MB(5)-1] == 0x42, "Large aligned reallocation is wrong");
+	dealloc(heap, large);
+	
+	// Reallocate keeps the alignment even if it has to move
+	u8 *grow = (u8*)alloc_aligned(heap, 100, 64);
+	void *blocker = alloc(heap, 100);
+	for (u64 i = 0; i < 100; i += 1) grow[i] = (u8)i;
+	grow = (u8*)reallocate_aligned(heap, grow, 100, 20000, 64);
+	assert((u64)grow % 64 == 0, "Aligned reallocation lost the alignment");
+	for (u64 i = 0; i < 100; i += 1) assert(grow[i] == (u8)i, "Aligned reallocation lost the data");
+	dealloc(heap, grow);
+	dealloc(heap, blocker);
+	
+	// Arena & temporary storage
+	Allocator arena = make_arena_allocator(MB(1));
+	for (u64 i = 0; i < 100; i += 1) {
+		u64 alignment = 1ULL << (i % 9);
+		void *p = alloc_aligned(arena, 3+i, alignment);
+		assert((u64)p % alignment == 0, "Arena aligned allocation is not aligned");
+		void *t = alloc_aligned(get_temporary_allocator(), 3+i, alignment);
+		assert((u64)t % alignment == 0, "Temporary aligned allocation is not aligned");
+	}
+	void *t = talloc_aligned(TEMPORARY_STORAGE_SIZE, 256); // Has to chain
+	assert((u64)t % 256 == 0, "Temporary aligned allocation is not aligned after growing");
+	arena_destroy((Arena*)arena.data);
+	
+	// Pool
+	Pool pool = make_pool_aligned(Pool_Test_Object, CACHE_LINE_SIZE, heap);
+	Allocator pool_allocator = make_pool_allocator(&pool);
+	for (u64 i = 0; i < 2000; i += 1) {
+		Pool_Test_Object *o = (Pool_Test_Object*)pool_acquire(&pool, 0);
+		assert((u64)o % CACHE_LINE_SIZE == 0, "Aligned pool object is not aligned");
+		o->id = i;
+	}
+	for (u64 i = 0; i < pool.count; i += 1) {
+		assert(((Pool_Test_Object*)pool_get_live(&pool, i))->id == i, "Aligned pool objects overlap");
+	}
+	void *from_allocator = alloc_aligned(pool_allocator, sizeof(Pool_Test_Object), 32);
+	assert((u64)from_allocator % 32 == 0, "Pool allocator aligned allocation is not aligned");
+	pool_destroy(&pool);
+	
+	// Growing array items stay aligned when the array grows
+	Vector4 *vectors;
+	growing_array_init_reserve_aligned((void**)&vectors, sizeof(Vector4), 4, 64, heap);
+	for (u64 i = 0; i < 1000; i += 1) {
+		Vector4 v = v4(i, i, i, i);
+		growing_array_add((void**)&vectors, &v);
+		assert((u64)vectors % 64 == 0, "Aligned growing array items are not aligned");
+	}
+	for (u64 i = 0; i < 1000; i += 1) {
+		assert(vectors[i].x == (f32)i, "Aligned growing array lost items");
+	}
+	growing_array_deinit((void**)&vectors);
+	
+#if HEAP_ENABLE_THREAD_CACHE
+	// Heap thread caches don't share cache lines
+	assert((u64)heap_thread_cache % CACHE_LINE_SIZE == 0, "Heap thread cache is not cache line aligned");
+#endif
+}
+
+bool is_memory_zero(void *p, u64 size) {
+	for (u64 i = 0; i < size; i += 1) {
+		if (((u8*)p)[i] != 0) return false;
+	}
+	return true;
+}
+// Treats anything that isn't a dealloc as an allocation, and hands out dirty memory
+void* test_naive_allocator_proc(u64 size, void *p, Allocator_Message message, void *data) {
+	assert(message != ALLOCATOR_ALLOCATE_ZEROED, "alloc() asked an allocator that doesn't know about it for zeroed memory");
+	if (message == ALLOCATOR_DEALLOCATE) {
+		heap_dealloc(p);
+		return 0;
+	}
+	p = heap_alloc(size);
+	memset(p, 0xAB, size);
+	return p;
+}
+// Real allocator underneath, but new memory is never zero
+void* test_dirty_allocator_proc(u64 size, void *p, Allocator_Message message, void *data) {
+	void *result = heap_allocator_proc(size, p, message, data);
+	if (result && (message == ALLOCATOR_ALLOCATE || message == ALLOCATOR_ALLOCATE_ALIGNED)) {
+		memset(result, 0xAB, size);
+	}
+	return result;
+}
+void test_zero_initialization() {
+	Allocator heap = get_heap_allocator();
+	
+	// Mix of fresh and dirty chunks, every size has to come back zero either way
+	const u64 count = 200;
+	u8 *pointers[200];
+	for (u64 i = 0; i < count; i += 1) {
+		u64 size = KB(2) + i*KB(1);
+		pointers[i] = (u8*)heap_alloc_zeroed(size);
+		assert(is_memory_zero(pointers[i], size), "heap_alloc_zeroed gave memory that is not zero");
+		memset(pointers[i], 0xCD, size);
+	}
+	for (u64 i = 0; i < count; i += 2) dealloc(heap, pointers[i]);
+	for (u64 i = 0; i < count; i += 2) {
+		u64 size = KB(2) + i*KB(1);
+		pointers[i] = (u8*)heap_alloc_zeroed(size);
+		assert(is_memory_zero(pointers[i], size), "heap_alloc_zeroed gave dirty memory");
+	}
+	for (u64 i = 0; i < count; i += 1) dealloc(heap, pointers[i]);
+	
+	u8 *small = (u8*)heap_alloc_zeroed(24);
+	assert(is_memory_zero(small, 24), "heap_alloc_zeroed gave dirty memory");
+	dealloc(heap, small);
+	
+	u8 *large = (u8*)heap_alloc_zeroed(MB(6));
+	assert(is_memory_zero(large, MB(6)), "Large heap_alloc_zeroed is not zero");
+	dealloc(heap, large);
+	
+	// Blocks that were decommitted come back zero
+	void *blocks[20];
+	for (int i = 0; i < 20; i += 1) {
+		blocks[i] = alloc_uninitialized(heap, MB(3));
+		memset(blocks[i], 0xEE, MB(3));
+	}
+	for (int i = 0; i < 20; i += 1) dealloc(heap, blocks[i]);
+	for (int i = 0; i < HEAP_BLOCK_IDLE_CHECKS_BEFORE_DECOMMIT; i += 1) heap_decommit_idle_blocks();
+	for (int i = 0; i < 20; i += 1) {
+		blocks[i] = heap_alloc_zeroed(MB(3));
+		assert(is_memory_zero(blocks[i], MB(3)), "Recommitted heap block is not zero");
+	}
+	for (int i = 0; i < 20; i += 1) dealloc(heap, blocks[i]);
+	
+	// Arena only clears what was used before a reset
+	Arena arena = make_arena(MB(4));
+	u8 *a = (u8*)arena_push_aligned_zeroed(&arena, KB(300), 16);
+	assert(is_memory_zero(a, KB(300)), "Arena zeroed push is not zero");
+	memset(a, 0x77, KB(300));
+	Arena_Mark mark = arena_mark(&arena);
+	u8 *b = (u8*)arena_push(&arena, KB(100));
+	memset(b, 0x77, KB(100));
+	arena_pop_to_mark(&arena, mark);
+	b = (u8*)arena_push_aligned_zeroed(&arena, KB(200), 16);
+	assert(is_memory_zero(b, KB(200)), "Arena zeroed push after pop is not zero");
+	arena_reset(&arena);
+	a = (u8*)arena_push_aligned_zeroed(&arena, MB(3), 16); // Chains on
+	assert(is_memory_zero(a, MB(3)), "Arena zeroed push after reset is not zero");
+	arena_destroy(&arena);
+	
+#if DO_ZERO_INITIALIZATION
+	u8 *dirty = (u8*)alloc(heap, KB(64));
+	memset(dirty, 0xAB, KB(64));
+	dealloc(heap, dirty);
+	dirty = (u8*)alloc(heap, KB(64));
+	assert(is_memory_zero(dirty, KB(64)), "alloc() gave dirty memory");
+	dealloc(heap, dirty);
+	
+	// Built field by field like most allocators are, so whatever else is in the struct is garbage
+	Allocator naive;
+	memset(&naive, 0xAB, sizeof(naive));
+	naive.proc = test_naive_allocator_proc;
+	naive.data = 0;
+	dirty = (u8*)alloc(naive, KB(4));
+	assert(is_memory_zero(dirty, KB(4)), "alloc() with an allocator that can't allocate zeroed gave dirty memory");
+	dealloc(naive, dirty);
+	
+	// The big buffers renderer_stress_test (40000 quads) ends up with: vbo staging, index
+	// buffer, z sort buffer, font atlas and some images. The first write is included because
+	// that's when the pages actually get faulted in when we skip the memset.
+	u64 sizes[] = {MB(16), MB(1), MB(8), MB(4), KB(256), KB(256), KB(256), KB(256), KB(64), KB(64)};
+	const u64 size_count = sizeof(sizes)/sizeof(u64);
+	void *buffers[sizeof(sizes)/sizeof(u64)];
+	
+	float64 start_seconds = os_get_elapsed_seconds();
+	u64 start_cycles = rdtsc();
+	for (u64 i = 0; i < size_count; i += 1) {
+		buffers[i] = alloc_uninitialized(heap, sizes[i]);
+		memset(buffers[i], 0, sizes[i]);
+		memset(buffers[i], 1, sizes[i]);
+	}
+	u64 memset_cycles = rdtsc() - start_cycles;
+	float64 memset_seconds = os_get_elapsed_seconds() - start_seconds;
+	for (u64 i = 0; i < size_count; i += 1) dealloc(heap, buffers[i]);
+	
+	start_seconds = os_get_elapsed_seconds();
+	start_cycles = rdtsc();
+	for (u64 i = 0; i < size_count; i += 1) {
+		buffers[i] = alloc(heap, sizes[i]);
+		memset(buffers[i], 1, sizes[i]);
+	}
+	u64 known_zero_cycles = rdtsc() - start_cycles;
+	float64 known_zero_seconds = os_get_elapsed_seconds() - start_seconds;
+	for (u64 i = 0; i < size_count; i += 1) dealloc(heap, buffers[i]);
+	
+	print("\n\tStartup buffers: always memset %.2f ms (%llu cycles), skipping known zero %.2f ms (%llu cycles)", memset_seconds*1000.0, memset_cycles, known_zero_seconds*1000.0, known_zero_cycles);
+	
+	// A frame that grows a quad buffer and a sort buffer from scratch, like when the quad
+	// count jumps. Large allocations go back to the OS on free so they are fresh every time.
+	const u64 frame_count = 60;
+	start_seconds = os_get_elapsed_seconds();
+	for (u64 f = 0; f < frame_count; f += 1) {
+		for (u64 i = 0; i < 3; i += 1) {
+			buffers[i] = alloc_uninitialized(heap, sizes[i]);
+			memset(buffers[i], 0, sizes[i]);
+			memset(buffers[i], 1, sizes[i]);
+		}
+		for (u64 i = 0; i < 3; i += 1) dealloc(heap, buffers[i]);
+	}
+	memset_seconds = os_get_elapsed_seconds() - start_seconds;
+	start_seconds = os_get_elapsed_seconds();
+	for (u64 f = 0; f < frame_count; f += 1) {
+		for (u64 i = 0; i < 3; i += 1) {
+			buffers[i] = alloc(heap, sizes[i]);
+			memset(buffers[i], 1, sizes[i]);
+		}
+		for (u64 i = 0; i < 3; i += 1) dealloc(heap, buffers[i]);
+	}
+	known_zero_seconds = os_get_elapsed_seconds() - start_seconds;
+	print("\n\tGrowth frame: always memset %.3f ms, skipping known zero %.3f ms ", memset_seconds*1000.0/frame_count, known_zero_seconds*1000.0/frame_count);
+#endif
+}
+
+// Replays the allocation patterns from test_allocator a bunch of times to measure heap throughput
+void test_allocator_churn() {
+	Allocator heap = get_heap_allocator();
+	
+	const int num_rounds = 50;
+	u64 allocations = 0;
+	
+	void* blocks[100];
+	void* mixed_blocks[200];
+	
+	float64 start_seconds = os_get_elapsed_seconds();
+	u64 start_cycles = rdtsc();
+	
+	for (int round = 0; round < num_rounds; round += 1) {
+		for (int i = 0; i < 100; ++i) blocks[i] = alloc(heap, 128);
+		for (int i = 0; i < 100; ++i) dealloc(heap, blocks[i]);
+		allocations += 100;
+		
+		for (int i = 1; i <= 1000; ++i) {
+			void* p = alloc(heap, i * 64);
+			assert(p != NULL, "Failed to allocate varying size block");
+			dealloc(heap, p);
+		}
+		allocations += 1000;
+		
+		for (int i = 0; i < 100; ++i) blocks[i] = alloc(heap, 128);
+		for (int i = 99; i >= 0; --i) dealloc(heap, blocks[i]);
+		allocations += 100;
+		
+		for (int i = 0; i < 10000; ++i) {
+			void* temp = alloc(heap, 128);
+			dealloc(heap, temp);
+		}
+		allocations += 10000;
+		
+		for (int i = 0; i < 200; ++i) {
+			mixed_blocks[i] = alloc(heap, i % 2 == 0 ? 128 : 1024 * 1024);
+		}
+		for (int i = 0; i < 200; i += 2) dealloc(heap, mixed_blocks[i]);
+		for (int i = 1; i < 200; i += 2) dealloc(heap, mixed_blocks[i]);
+		allocations += 200;
+		
+		for (int i = 0; i < 50; ++i) blocks[i] = alloc(heap, 256);
+		for (int i = 0; i < 50; i += 2) dealloc(heap, blocks[i]);
+		for (int i = 50; i < 100; ++i) blocks[i] = alloc(heap, 128);
+		for (int i = 50; i < 100; ++i) dealloc(heap, blocks[i]);
+		for (int i = 1; i < 50; i += 2) dealloc(heap, blocks[i]);
+		allocations += 100;
+	}
+	
+	u64 cycles = rdtsc() - start_cycles;
+	float64 seconds = os_get_elapsed_seconds() - start_seconds;
+	
+	print("%llu heap allocations took %.2f ms (%llu cycles per alloc+free, %.2f million allocs/sec)\n", allocations, seconds*1000.0, cycles/allocations, ((float64)allocations/seconds)/1000000.0);
 }
 
 void test_strings() {
@@ -1307,6 +2600,201 @@ void test_intmath() {
     assert(v4i_result.x == 1 && v4i_result.y == 2 && v4i_result.z == 3 && v4i_result.w == 4, "v4i_divi incorrect");
 }
 
+// How many keys land in a bucket someone else is already in, for bucket_bits worth of buckets
+// taken from the low or the high bits of the hash
+u64 _test_hash_bucket_collisions(u64 *hashes, u64 count, u64 bucket_bits, bool high_bits) {
+	u64 bucket_count = 1ULL << bucket_bits;
+	u8 *used = (u8*)alloc(get_heap_allocator(), bucket_count);
+	memset(used, 0, bucket_count);
+	u64 collisions = 0;
+	for (u64 i = 0; i < count; i += 1) {
+		u64 bucket = high_bits ? (hashes[i] >> (64 - bucket_bits)) : (hashes[i] & (bucket_count-1));
+		if (used[bucket]) collisions += 1;
+		used[bucket] = 1;
+	}
+	dealloc(get_heap_allocator(), used);
+	return collisions;
+}
+void test_hash() {
+	Allocator heap = get_heap_allocator();
+	
+	const u64 data_size = 20000;
+	u8 *data = (u8*)alloc(heap, data_size);
+	for (u64 i = 0; i < data_size; i += 1) data[i] = (u8)get_random_int_in_range(0, 255);
+	
+	// Every byte matters, at every length
+	for (u64 count = 1; count <= 600; count += 1) {
+		u64 h = hash_bytes(data, count, 0);
+		assert(h == hash_bytes(data, count, 0), "Hash is not deterministic");
+		assert(h != hash_bytes(data, count, 1), "Seed did not change the hash");
+		assert(h != hash_bytes(data, count-1, 0), "Length did not change the hash");
+		for (u64 i = 0; i < count; i += 1) {
+			data[i] ^= 1;
+			assert(hash_bytes(data, count, 0) != h, "Changing byte %llu of %llu did not change the hash", i, count);
+			data[i] ^= 1;
+		}
+	}
+	// Test vectors from the wyhash repo (seed is the index), plus a multiple of 48 bytes.
+	// hash_bytes() only differs from wyhash over HASH_SHORT_MAX.
+	const char *vector_messages[] = {
+		"", "a", "abc", "message digest", "abcdefghijklmnopqrstuvwxyz",
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+		"12345678901234567890123456789012345678901234567890123456789012345678901234567890",
+		"123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456",
+	};
+	u64 vector_hashes[] = {
+		0x93228a4de0eec5a2ULL, 0xc5bac3db178713c4ULL, 0xa97f2f7b1d9b3314ULL, 0x786d1f1df3801df4ULL,
+		0xdca5a8138ad37c87ULL, 0xb9e734f117cfaf70ULL, 0x6cc5eab49a92d617ULL, 0xb906d72c05216af7ULL,
+	};
+	for (u64 i = 0; i < sizeof(vector_hashes)/sizeof(vector_hashes[0]); i += 1) {
+		u64 h = hash_bytes((void*)vector_messages[i], strlen(vector_messages[i]), i);
+		assert(h == vector_hashes[i], "hash_bytes does not match wyhash for '%cs'", vector_messages[i]);
+	}
+	
+	string s = STR("assets/sprites/enemies/slug/slug_walk_0003.png");
+	assert(get_hash(s) == hash_bytes(s.data, s.count, 0), "get_hash(string) should be hash_bytes");
+	assert(string_get_hash(STR("")) == hash_bytes(0, 0, 0), "Empty string hash is wrong");
+	
+	// Hasher in random pieces gives the same as one go, around all the edges
+	u64 sizes[] = {0, 1, 3, 4, 8, 15, 16, 17, 31, 32, 33, 47, 48, 49, 63, 64, 65, 95, 96, 97, 144, 145, 255, 256, 257, 300, 319, 320, 321, 383, 384, 385, 512, 513, 1023, 1024, 1025, 1088, 2047, 2048, 2049, 4096, 5000, 9999, 20000};
+	u64 seeds[] = {0, 12345};
+	for (u64 seed_index = 0; seed_index < 2; seed_index += 1) {
+		u64 seed = seeds[seed_index];
+		for (u64 size_index = 0; size_index < sizeof(sizes)/sizeof(sizes[0]); size_index += 1) {
+			u64 size = sizes[size_index];
+			u64 expected = hash_bytes(data, size, seed);
+			for (u64 attempt = 0; attempt < 20; attempt += 1) {
+				Hasher hasher;
+				hasher_init(&hasher, seed);
+				u64 done = 0;
+				while (done < size) {
+					// Mostly small pieces, sometimes big ones
+					u64 max_piece = attempt % 3 == 0 ? size : (attempt % 3 == 1 ? 70 : 5);
+					u64 piece = (u64)get_random_int_in_range(0, max_piece);
+					piece = min(piece, size - done);
+					hasher_update(&hasher, data + done, piece);
+					done += piece;
+				}
+				assert(hasher_finish(&hasher) == expected, "Hasher in pieces gave a different hash than hash_bytes, size %llu seed %llu", size, seed);
+				assert(hasher_finish(&hasher) == expected, "hasher_finish changed the hasher");
+			}
+		}
+	}
+	
+	// Avalanche: flipping any input bit should flip each output bit half the time
+	u64 avalanche_sizes[] = {4, 8, 16, 24, 50, 100, 256, 300, 2000};
+	float64 worst_bias = 0;
+	for (u64 size_index = 0; size_index < sizeof(avalanche_sizes)/sizeof(avalanche_sizes[0]); size_index += 1) {
+		u64 size = avalanche_sizes[size_index];
+		u64 flips[64] = {0};
+		u64 samples = 0;
+		u64 bit_count = min(size*8, 256);
+		u64 trial_count = 32768 / bit_count; // Enough samples that 2% off is way past chance
+		for (u64 trial = 0; trial < trial_count; trial += 1) {
+			u8 *input = data + get_random_int_in_range(0, data_size - size);
+			u64 h = hash_bytes(input, size, trial);
+			for (u64 j = 0; j < bit_count; j += 1) {
+				u64 bit = bit_count == size*8 ? j : (u64)get_random_int_in_range(0, size*8-1);
+				input[bit/8] ^= (u8)(1 << (bit%8));
+				u64 diff = h ^ hash_bytes(input, size, trial);
+				input[bit/8] ^= (u8)(1 << (bit%8));
+				
+				u32 flipped = 0;
+				for (u64 k = 0; k < 64; k += 1) {
+					if (diff & (1ULL << k)) { flips[k] += 1; flipped += 1; }
+				}
+				assert(flipped >= 8 && flipped <= 56, "Flipping one bit of %llu bytes flipped %u output bits", size, flipped);
+				samples += 1;
+			}
+		}
+		for (u64 k = 0; k < 64; k += 1) {
+			float64 bias = fabs((float64)flips[k]/(float64)samples - 0.5);
+			worst_bias = max(worst_bias, bias);
+			assert(bias < 0.02, "Output bit %llu flips %.3f of the time at %llu bytes", k, (float64)flips[k]/(float64)samples, size);
+		}
+	}
+	
+	// Collisions on path-like strings, against what random numbers would give
+	const u64 path_count = 300000;
+	u64 *hashes = (u64*)alloc(heap, path_count*sizeof(u64));
+	u64 *old_hashes = (u64*)alloc(heap, path_count*sizeof(u64));
+	u64 *sort_buffer = (u64*)alloc(heap, path_count*sizeof(u64));
+	const char *folders[] = {"characters", "enemies", "props", "tiles", "ui", "effects", "weapons", "items"};
+	const char *names[] = {"idle", "walk", "run", "attack", "hurt", "death", "jump", "fall", "spawn", "glow"};
+	u64 paths_made = 0;
+	for (u64 folder = 0; folder < 8; folder += 1) {
+		for (u64 name = 0; name < 10; name += 1) {
+			for (u64 frame = 0; frame < 3750; frame += 1) {
+				string path = tprint("assets/sprites/%cs/%cs/%cs_%04llu.png", folders[folder], names[name], names[name], frame);
+				hashes[paths_made] = string_get_hash(path);
+				old_hashes[paths_made] = djb2_hash(path);
+				paths_made += 1;
+			}
+			reset_temporary_storage();
+		}
+	}
+	assert(paths_made == path_count, "Made the wrong number of paths");
+	
+	memcpy(sort_buffer, hashes, path_count*sizeof(u64));
+	u64 *sorted = (u64*)alloc(heap, path_count*sizeof(u64));
+	memcpy(sorted, hashes, path_count*sizeof(u64));
+	radix_sort(sorted, sort_buffer, path_count, sizeof(u64), 0, 64);
+	u64 full_collisions = 0;
+	for (u64 i = 1; i < path_count; i += 1) if (sorted[i] == sorted[i-1]) full_collisions += 1;
+	assert(full_collisions == 0, "%llu full 64 bit collisions in %llu paths", full_collisions, path_count);
+	
+	const u64 bucket_bits = 20;
+	float64 m = (float64)(1ULL << bucket_bits);
+	float64 expected = (float64)path_count - m*(1.0 - pow(1.0 - 1.0/m, (float64)path_count));
+	u64 low  = _test_hash_bucket_collisions(hashes, path_count, bucket_bits, false);
+	u64 high = _test_hash_bucket_collisions(hashes, path_count, bucket_bits, true);
+	u64 old_low  = _test_hash_bucket_collisions(old_hashes, path_count, bucket_bits, false);
+	u64 old_high = _test_hash_bucket_collisions(old_hashes, path_count, bucket_bits, true);
+	assert(fabs((float64)low  - expected) < expected*0.03, "Low bits collide too much: %llu, random would be %.0f", low, expected);
+	assert(fabs((float64)high - expected) < expected*0.03, "High bits collide too much: %llu, random would be %.0f", high, expected);
+	
+	print("\n\tAvalanche worst output bit bias %.4f", worst_bias);
+	print("\n\t%llu paths into %llu buckets: %llu low / %llu high bit collisions (random: %.0f, djb2: %llu / %llu)", path_count, 1ULL << bucket_bits, low, high, expected, old_low, old_high);
+	
+	dealloc(heap, hashes);
+	dealloc(heap, old_hashes);
+	dealloc(heap, sort_buffer);
+	dealloc(heap, sorted);
+	dealloc(heap, data);
+	
+	// Throughput from 4 bytes to 1 MB
+	const u64 buffer_size = MB(1) + 64;
+	u8 *buffer = (u8*)alloc(heap, buffer_size);
+	for (u64 i = 0; i < buffer_size; i += 1) buffer[i] = (u8)(i*31 + 7);
+	u64 bench_sizes[] = {4, 8, 16, 32, 50, 64, 128, 256, 257, 1024, KB(4), KB(64), MB(1)};
+	u64 sink = 0;
+	for (u64 size_index = 0; size_index < sizeof(bench_sizes)/sizeof(bench_sizes[0]); size_index += 1) {
+		u64 size = bench_sizes[size_index];
+		u64 iterations = max(MB(64) / size, 16);
+		iterations = min(iterations, 4000000);
+		
+		float64 start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < iterations; i += 1) {
+			sink += hash_bytes(buffer + (i & 63), size, 0);
+		}
+		float64 hash_seconds = os_get_elapsed_seconds() - start;
+		
+		u64 djb2_iterations = max(iterations/8, 4);
+		start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < djb2_iterations; i += 1) {
+			string bytes = {size, buffer + (i & 63)};
+			sink += djb2_hash(bytes);
+		}
+		float64 djb2_seconds = os_get_elapsed_seconds() - start;
+		
+		float64 hash_ns = hash_seconds*1e9/(float64)iterations;
+		float64 djb2_ns = djb2_seconds*1e9/(float64)djb2_iterations;
+		print("\n\t%7llu bytes: hash_bytes %10.1f ns (%6.2f GB/s), djb2 %10.1f ns (%5.2f GB/s)", size, hash_ns, (float64)size/hash_ns, djb2_ns, (float64)size/djb2_ns);
+	}
+	print("\n\t(sink %llu) ", sink & 0xF);
+	dealloc(heap, buffer);
+}
+
 void test_hash_table() {
     Hash_Table table = make_hash_table(string, int, get_heap_allocator());
     
@@ -1342,6 +2830,161 @@ void test_hash_table() {
     assert(table.entries == NULL, "Failed: Hash table entries should be NULL after destroy");
     assert(table.count == 0, "Failed: Hash table count should be 0 after destroy");
     assert(table.capacity_count == 0, "Failed: Hash table capacity count should be 0 after destroy");
+    
+    // Keys with the same hash must not find each other
+    table = make_hash_table(string, int, get_heap_allocator());
+    string a = STR("a");
+    string b = STR("b");
+    int va = 1;
+    int vb = 2;
+    hash_table_set_raw(&table, 1234, &a, &va, sizeof(string), sizeof(int));
+    assert(hash_table_find_raw(&table, 1234, &b, sizeof(string)) == 0, "Failed: Colliding hash found the wrong key");
+    hash_table_set_raw(&table, 1234, &b, &vb, sizeof(string), sizeof(int));
+    assert(table.count == 2, "Failed: Colliding keys should be separate entries");
+    assert(*(int*)hash_table_find_raw(&table, 1234, &a, sizeof(string)) == 1, "Failed: Colliding key a");
+    assert(*(int*)hash_table_find_raw(&table, 1234, &b, sizeof(string)) == 2, "Failed: Colliding key b");
+    
+    // String keys are copied, so the key memory can go away
+    string temp_key = string_copy(STR("Temporary"), get_heap_allocator());
+    int vt = 3;
+    hash_table_set(&table, temp_key, vt);
+    memset(temp_key.data, 'x', temp_key.count);
+    dealloc_string(get_heap_allocator(), temp_key);
+    string same_key = STR("Temporary");
+    assert(hash_table_find(&table, same_key) && *(int*)hash_table_find(&table, same_key) == 3, "Failed: String key was not copied");
+    
+    assert(hash_table_remove_raw(&table, 1234, &a, sizeof(string)), "Failed: Remove existing key");
+    assert(!hash_table_remove_raw(&table, 1234, &a, sizeof(string)), "Failed: Remove missing key");
+    assert(!hash_table_contains_raw(&table, 1234, &a, sizeof(string)), "Failed: Removed key still found");
+    assert(*(int*)hash_table_find_raw(&table, 1234, &b, sizeof(string)) == 2, "Failed: Remove broke colliding key");
+    hash_table_destroy(&table);
+    
+    // Custom allocators don't need to do aligned allocations
+    Allocator naive = ZERO(Allocator);
+    naive.proc = test_naive_allocator_proc;
+    Hash_Table naive_table = make_hash_table(u64, u64, naive);
+    for (u64 i = 0; i < 1000; i += 1) {
+        u64 value = i*3;
+        hash_table_set(&naive_table, i, value);
+    }
+    for (u64 i = 0; i < 1000; i += 1) {
+        u64 *v = (u64*)hash_table_find(&naive_table, i);
+        assert(v && *v == i*3, "Failed: Hash table with a custom allocator lost key %llu", i);
+    }
+    hash_table_destroy(&naive_table);
+    
+    // Lots of adds and removes checked against a plain array, so tombstones and rehashes happen
+    Hash_Table numbers = make_hash_table_reserve(u64, u64, 4, get_heap_allocator());
+    assert(numbers.capacity_count >= 4, "Failed: make_hash_table_reserve capacity");
+    const u64 key_range = 5000;
+    u64 *expected = (u64*)alloc(get_heap_allocator(), key_range*sizeof(u64)); // 0 = not in the table
+    memset(expected, 0, key_range*sizeof(u64));
+    u64 expected_count = 0;
+    seed_for_random = 69;
+    for (u64 i = 0; i < 200000; i += 1) {
+    	u64 key = get_random_int_in_range(0, key_range-1);
+    	u64 value = i+1;
+    	if (get_random_int_in_range(0, 2) == 0) {
+    		bool removed = hash_table_remove(&numbers, key);
+    		assert(removed == (expected[key] != 0), "Failed: Remove returned %d for key %llu", removed, key);
+    		if (removed) expected_count -= 1;
+    		expected[key] = 0;
+    	} else {
+    		bool added = hash_table_set(&numbers, key, value);
+    		assert(added == (expected[key] == 0), "Failed: Set returned %d for key %llu", added, key);
+    		if (added) expected_count += 1;
+    		expected[key] = value;
+    	}
+    	assert(numbers.count == expected_count, "Failed: Count is %llu, expected %llu", numbers.count, expected_count);
+    }
+    for (u64 key = 0; key < key_range; key += 1) {
+    	u64 *value = hash_table_find(&numbers, key);
+    	if (expected[key]) {
+    		assert(value && *value == expected[key], "Failed: Wrong value for key %llu", key);
+    	} else {
+    		assert(!value, "Failed: Removed key %llu still found", key);
+    	}
+    }
+    
+    // Iteration sees every entry once
+    u64 iterated = 0;
+    for (u64 i = 0; i < numbers.count; i += 1) {
+    	u64 key = *(u64*)hash_table_get_nth_key(&numbers, i);
+    	u64 value = *(u64*)hash_table_get_nth_value(&numbers, i);
+    	assert(expected[key] == value, "Failed: Iterated wrong value for key %llu", key);
+    	iterated += 1;
+    }
+    assert(iterated == expected_count, "Failed: Iteration count");
+    
+    dealloc(get_heap_allocator(), expected);
+    hash_table_destroy(&numbers);
+}
+
+// How the hash table worked before: an array of hash-value pairs that find scans from the start
+typedef struct Linear_Hash_Entry {
+	u64 hash;
+	u64 value;
+} Linear_Hash_Entry;
+u64 *linear_hash_find(Linear_Hash_Entry *entries, u64 count, u64 hash) {
+	for (u64 i = 0; i < count; i += 1) {
+		if (entries[i].hash == hash) return &entries[i].value;
+	}
+	return 0;
+}
+void test_hash_table_benchmark() {
+	Allocator heap = get_heap_allocator();
+	u64 sizes[] = {1000, 100000, 10000000};
+	const u64 lookup_count = 1000000;
+	
+	print("\n");
+	for (u64 s = 0; s < sizeof(sizes)/sizeof(u64); s += 1) {
+		u64 n = sizes[s];
+		
+		Hash_Table table = make_hash_table(u64, u64, heap);
+		float64 start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < n; i += 1) {
+			u64 key = i*7919;
+			hash_table_set(&table, key, i);
+		}
+		float64 insert_seconds = os_get_elapsed_seconds() - start;
+		
+		u64 found = 0;
+		seed_for_random = 1;
+		start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < lookup_count; i += 1) {
+			// Half hits, half misses
+			u64 key = get_random_int_in_range(0, n-1)*7919 + (i & 1);
+			u64 *v = hash_table_find(&table, key);
+			if (v) found += 1;
+		}
+		float64 lookup_seconds = os_get_elapsed_seconds() - start;
+		assert(found > lookup_count/3 && found < lookup_count-lookup_count/3, "Failed: Unexpected hit count %llu", found);
+		
+		print("\t%llu entries: insert %.1f ns, find %.1f ns (%llu hits)", n, (insert_seconds*1000000000.0)/(float64)n, (lookup_seconds*1000000000.0)/(float64)lookup_count, found);
+		
+		// The old one is O(n) per find, so only do a few finds and leave out 10M, that would take hours
+		if (n <= 100000) {
+			Linear_Hash_Entry *linear = (Linear_Hash_Entry*)alloc(heap, n*sizeof(Linear_Hash_Entry));
+			for (u64 i = 0; i < n; i += 1) {
+				u64 key = i*7919;
+				linear[i].hash = get_hash(key);
+				linear[i].value = i;
+			}
+			u64 linear_lookups = n <= 1000 ? lookup_count : 2000;
+			u64 linear_found = 0;
+			start = os_get_elapsed_seconds();
+			for (u64 i = 0; i < linear_lookups; i += 1) {
+				u64 key = get_random_int_in_range(0, n-1)*7919 + (i & 1);
+				if (linear_hash_find(linear, n, get_hash(key))) linear_found += 1;
+			}
+			float64 linear_seconds = os_get_elapsed_seconds() - start;
+			print(", old linear find %.1f ns (%llu hits)", (linear_seconds*1000000000.0)/(float64)linear_lookups, linear_found);
+			dealloc(heap, linear);
+		}
+		print("\n");
+		
+		hash_table_destroy(&table);
+	}
 }
 
 #define NUM_BINS 100
@@ -1385,54 +3028,1380 @@ void mutex_test_increment_counter(Thread* t) {
         mutex_release(&data->mutex);
     }
 }
-void test_mutex() {
-    Mutex m;
-    
-    // Test initialization
-    mutex_init(&m);
-    assert(m.spin_time_microseconds == MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS, "Failed: Default spin time incorrect");
-    assert(!m.spinlock_acquired, "Failed: Spinlock should not be acquired after initialization");
-
-    // Test acquire and release without contention
-    mutex_acquire_or_wait(&m);
-    assert(m.spinlock_acquired, "Failed: Mutex should be acquired after mutex_acquire_or_wait");
-    
-    mutex_release(&m);
-    assert(!m.spinlock_acquired, "Failed: Spinlock should not be acquired after mutex_release");
-
-    // Clean up
-    mutex_destroy(&m);
-    
-    Mutex_Test_Shared_Data data;
-    data.counter = 0;
-    data.any_active_thread = false;
-    mutex_init(&data.mutex);
+void test_mutex() {
+    Mutex m;
+    
+    // Test initialization
+    mutex_init(&m);
+    assert(m.spin_count == MUTEX_DEFAULT_SPIN_COUNT, "Failed: Default spin count incorrect");
+    assert(m.state == 0, "Failed: Mutex should not be acquired after initialization");
+
+    // Test acquire and release without contention
+    mutex_acquire_or_wait(&m);
+    assert(m.state != 0, "Failed: Mutex should be acquired after mutex_acquire_or_wait");
+    assert(!mutex_acquire_or_fail(&m), "Failed: mutex_acquire_or_fail should fail on an acquired mutex");
+    
+    mutex_release(&m);
+    assert(m.state == 0, "Failed: Mutex should not be acquired after mutex_release");
+    assert(m.stats.acquire_count == 1 && m.stats.contended_count == 0, "Failed: Uncontended acquire should not count as contended");
+    
+    assert(mutex_acquire_or_fail(&m), "Failed: mutex_acquire_or_fail on a free mutex");
+    mutex_release(&m);
+
+    // Clean up
+    mutex_destroy(&m);
+    
+    Mutex_Test_Shared_Data data;
+    data.counter = 0;
+    data.any_active_thread = false;
+    mutex_init(&data.mutex);
+
+    Allocator allocator = get_heap_allocator();
+
+	const int num_threads = 100;
+
+	Thread *threads = alloc(allocator, sizeof(Thread)*num_threads);
+	for (u64 i = 0; i < num_threads; i++) {
+		os_thread_init(&threads[i], mutex_test_increment_counter);
+		threads[i].data = &data;
+	}
+	for (u64 i = 0; i < num_threads; i++) {
+    	os_thread_start(&threads[i]);
+	}
+	for (u64 i = 0; i < num_threads; i++) {
+    	os_thread_join(&threads[i]);
+	}
+
+    assert(data.counter == num_threads * MUTEX_TEST_TASK_COUNT, "Failed: Counter does not match expected value after threading tasks");
+    assert(data.mutex.stats.acquire_count == num_threads * MUTEX_TEST_TASK_COUNT, "Failed: Mutex acquire count is wrong");
+
+    mutex_destroy(&data.mutex);
+    
+    for (u64 i = 0; i < num_threads; i++) {
+    	os_thread_destroy(&threads[i]);
+    }
+    dealloc(allocator, threads);
+}
+
+#define RW_LOCK_TEST_TASK_COUNT 2000
+typedef struct RW_Lock_Test_Shared_Data {
+	RW_Lock lock;
+	volatile u64 readers_inside;
+	volatile bool writer_inside;
+	u64 values[16]; // Writers keep these all equal, readers check that they are
+	volatile u64 reads;
+} RW_Lock_Test_Shared_Data;
+void rw_lock_test_proc(Thread *t) {
+	RW_Lock_Test_Shared_Data *data = (RW_Lock_Test_Shared_Data*)t->data;
+	for (u64 i = 0; i < RW_LOCK_TEST_TASK_COUNT; i += 1) {
+		if (i % 8 == 0) {
+			rw_lock_write_acquire_or_wait(&data->lock);
+			assert(!data->writer_inside, "Failed: Two writers in RW_Lock");
+			assert(data->readers_inside == 0, "Failed: Writer and readers in RW_Lock");
+			data->writer_inside = true;
+			for (u64 j = 0; j < 16; j += 1) data->values[j] += 1;
+			data->writer_inside = false;
+			rw_lock_write_release(&data->lock);
+		} else {
+			rw_lock_read_acquire_or_wait(&data->lock);
+			atomic_fetch_add_64(&data->readers_inside, 1);
+			assert(!data->writer_inside, "Failed: Reader and writer in RW_Lock");
+			for (u64 j = 1; j < 16; j += 1) {
+				assert(data->values[j] == data->values[0], "Failed: Reader saw a half written value");
+			}
+			atomic_fetch_add_64(&data->readers_inside, (u64)-1);
+			atomic_fetch_add_64(&data->reads, 1);
+			rw_lock_read_release(&data->lock);
+		}
+	}
+}
+void test_rw_lock() {
+	RW_Lock_Test_Shared_Data data = ZERO(RW_Lock_Test_Shared_Data);
+	rw_lock_init(&data.lock);
+	
+	// Several readers at once
+	rw_lock_read_acquire_or_wait(&data.lock);
+	rw_lock_read_acquire_or_wait(&data.lock);
+	assert((data.lock.state & RW_LOCK_READER_MASK) == 2, "Failed: Expected 2 readers");
+	rw_lock_read_release(&data.lock);
+	rw_lock_read_release(&data.lock);
+	assert(data.lock.state == 0, "Failed: RW_Lock should be free");
+	
+	rw_lock_write_acquire_or_wait(&data.lock);
+	assert(data.lock.state & RW_LOCK_WRITER, "Failed: Expected writer");
+	rw_lock_write_release(&data.lock);
+	assert(data.lock.state == 0, "Failed: RW_Lock should be free");
+	
+	const u64 num_threads = 16;
+	Thread *threads = alloc(get_heap_allocator(), sizeof(Thread)*num_threads);
+	for (u64 i = 0; i < num_threads; i += 1) {
+		os_thread_init(&threads[i], rw_lock_test_proc);
+		threads[i].data = &data;
+	}
+	for (u64 i = 0; i < num_threads; i += 1) os_thread_start(&threads[i]);
+	for (u64 i = 0; i < num_threads; i += 1) os_thread_join(&threads[i]);
+	
+	u64 writes = num_threads*(RW_LOCK_TEST_TASK_COUNT/8);
+	for (u64 j = 0; j < 16; j += 1) {
+		assert(data.values[j] == writes, "Failed: Expected %llu writes, got %llu", writes, data.values[j]);
+	}
+	assert(data.reads == num_threads*RW_LOCK_TEST_TASK_COUNT - writes, "Failed: Wrong number of reads");
+	assert(data.lock.state == 0, "Failed: RW_Lock should be free");
+	
+	for (u64 i = 0; i < num_threads; i += 1) os_thread_destroy(&threads[i]);
+	dealloc(get_heap_allocator(), threads);
+}
+
+#define QUEUE_TEST_ITEM_COUNT 200000
+#define QUEUE_TEST_PRODUCER_COUNT 8
+typedef struct Queue_Test_Item {
+	u32 producer;
+	u32 sequence;
+	u32 check; // Makes the item an odd size, and catches torn copies
+} Queue_Test_Item;
+void spsc_queue_test_producer(Thread *t) {
+	Spsc_Queue *q = (Spsc_Queue*)t->data;
+	Queue_Test_Item batch[17];
+	u32 next = 0;
+	while (next < QUEUE_TEST_ITEM_COUNT) {
+		u32 n = min(1 + next % 17, QUEUE_TEST_ITEM_COUNT - next);
+		for (u32 i = 0; i < n; i += 1) {
+			batch[i].producer = 0;
+			batch[i].sequence = next + i;
+			batch[i].check = ~(next + i);
+		}
+		u64 pushed = spsc_queue_push_many(q, batch, n);
+		if (pushed == 0) os_yield_thread();
+		next += (u32)pushed;
+	}
+}
+typedef struct Mpsc_Queue_Test_Producer {
+	Mpsc_Queue *q;
+	u32 index;
+} Mpsc_Queue_Test_Producer;
+void mpsc_queue_test_producer(Thread *t) {
+	Mpsc_Queue_Test_Producer *p = (Mpsc_Queue_Test_Producer*)t->data;
+	Queue_Test_Item batch[5];
+	u32 next = 0;
+	while (next < QUEUE_TEST_ITEM_COUNT) {
+		// Mix single and batch pushes
+		u32 n = next % 3 == 0 ? 1 : min(5, QUEUE_TEST_ITEM_COUNT - next);
+		for (u32 i = 0; i < n; i += 1) {
+			batch[i].producer = p->index;
+			batch[i].sequence = next + i;
+			batch[i].check = ~(next + i) ^ p->index;
+		}
+		u64 pushed = n == 1 ? (u64)mpsc_queue_push(p->q, batch) : mpsc_queue_push_many(p->q, batch, n);
+		if (pushed == 0) os_yield_thread();
+		next += (u32)pushed;
+	}
+}
+void test_lock_free_queues() {
+	Allocator heap = get_heap_allocator();
+	
+	// Atomics
+	volatile u64 a64 = 5;
+	assert(atomic_fetch_add_64(&a64, 3) == 5 && a64 == 8, "Failed: atomic_fetch_add_64");
+	assert(atomic_exchange_64(&a64, 1) == 8 && a64 == 1, "Failed: atomic_exchange_64");
+	assert(atomic_compare_exchange_64(&a64, 2, 7) == 1 && a64 == 1, "Failed: atomic_compare_exchange_64 should fail");
+	assert(atomic_compare_exchange_64(&a64, 2, 1) == 1 && a64 == 2, "Failed: atomic_compare_exchange_64 should succeed");
+	volatile u32 a32 = 0;
+	assert(atomic_fetch_add_32(&a32, (u32)-1) == 0 && a32 == 0xFFFFFFFF, "Failed: atomic_fetch_add_32");
+	atomic_store_release_32(&a32, 69);
+	assert(atomic_load_acquire_32(&a32) == 69, "Failed: atomic_load_acquire_32");
+	assert(sizeof(Atomic_Counter) == CACHE_LINE_SIZE, "Failed: Atomic_Counter should fill a cache line");
+	
+	// Single thread, wrapping around and full/empty
+	Spsc_Queue spsc;
+	spsc_queue_init(&spsc, sizeof(Queue_Test_Item), 6, heap);
+	assert(spsc.capacity == 8, "Failed: capacity should round up to a power of two");
+	Queue_Test_Item items[16];
+	for (u32 round = 0; round < 5; round += 1) {
+		for (u32 i = 0; i < 16; i += 1) items[i] = (Queue_Test_Item){0, round*100+i, 0};
+		assert(spsc_queue_push_many(&spsc, items, 16) == 8, "Failed: push_many should stop when full");
+		assert(!spsc_queue_push(&spsc, items), "Failed: push to a full queue");
+		Queue_Test_Item out[16];
+		assert(spsc_queue_pop_many(&spsc, out, 3) == 3, "Failed: pop_many");
+		assert(spsc_queue_pop_many(&spsc, out+3, 16) == 5, "Failed: pop_many should stop when empty");
+		for (u32 i = 0; i < 8; i += 1) assert(out[i].sequence == round*100+i, "Failed: SPSC queue order");
+		assert(!spsc_queue_pop(&spsc, out), "Failed: pop from an empty queue");
+		// Move the start so the next round wraps
+		assert(spsc_queue_push(&spsc, items) && spsc_queue_pop(&spsc, out), "Failed: single push/pop");
+	}
+	
+	Mpsc_Queue mpsc;
+	mpsc_queue_init(&mpsc, sizeof(Queue_Test_Item), 8, heap);
+	for (u32 round = 0; round < 5; round += 1) {
+		for (u32 i = 0; i < 16; i += 1) items[i] = (Queue_Test_Item){0, round*100+i, 0};
+		assert(mpsc_queue_push_many(&mpsc, items, 16) == 8, "Failed: push_many should stop when full");
+		assert(!mpsc_queue_push(&mpsc, items), "Failed: push to a full queue");
+		Queue_Test_Item out[16];
+		assert(mpsc_queue_pop_many(&mpsc, out, 3) == 3, "Failed: pop_many");
+		assert(mpsc_queue_pop_many(&mpsc, out+3, 16) == 5, "Failed: pop_many should stop when empty");
+		for (u32 i = 0; i < 8; i += 1) assert(out[i].sequence == round*100+i, "Failed: MPSC queue order");
+		assert(!mpsc_queue_pop(&mpsc, out), "Failed: pop from an empty queue");
+		assert(mpsc_queue_push(&mpsc, items) && mpsc_queue_pop(&mpsc, out), "Failed: single push/pop");
+	}
+	
+	// SPSC stress: everything arrives once, in order
+	spsc_queue_destroy(&spsc);
+	spsc_queue_init(&spsc, sizeof(Queue_Test_Item), 64, heap);
+	Thread producer;
+	os_thread_init(&producer, spsc_queue_test_producer);
+	producer.data = &spsc;
+	
+	float64 start_seconds = os_get_elapsed_seconds();
+	os_thread_start(&producer);
+	u32 expected = 0;
+	while (expected < QUEUE_TEST_ITEM_COUNT) {
+		Queue_Test_Item out[13];
+		u64 n = spsc_queue_pop_many(&spsc, out, 13);
+		if (n == 0) os_yield_thread();
+		for (u64 i = 0; i < n; i += 1) {
+			assert(out[i].sequence == expected, "Failed: SPSC expected %u, got %u", expected, out[i].sequence);
+			assert(out[i].check == ~expected, "Failed: SPSC item was torn");
+			expected += 1;
+		}
+	}
+	float64 spsc_seconds = os_get_elapsed_seconds() - start_seconds;
+	os_thread_join(&producer);
+	os_thread_destroy(&producer);
+	assert(!spsc_queue_pop(&spsc, items), "Failed: SPSC queue should be empty");
+	
+	// MPSC stress: each producer's items arrive once, in the order that producer pushed them
+	mpsc_queue_destroy(&mpsc);
+	mpsc_queue_init(&mpsc, sizeof(Queue_Test_Item), 256, heap);
+	Thread producers[QUEUE_TEST_PRODUCER_COUNT];
+	Mpsc_Queue_Test_Producer producer_data[QUEUE_TEST_PRODUCER_COUNT];
+	u32 expected_per_producer[QUEUE_TEST_PRODUCER_COUNT] = {0};
+	for (u32 i = 0; i < QUEUE_TEST_PRODUCER_COUNT; i += 1) {
+		producer_data[i].q = &mpsc;
+		producer_data[i].index = i;
+		os_thread_init(&producers[i], mpsc_queue_test_producer);
+		producers[i].data = &producer_data[i];
+	}
+	
+	start_seconds = os_get_elapsed_seconds();
+	for (u32 i = 0; i < QUEUE_TEST_PRODUCER_COUNT; i += 1) os_thread_start(&producers[i]);
+	u64 received = 0;
+	while (received < QUEUE_TEST_ITEM_COUNT*QUEUE_TEST_PRODUCER_COUNT) {
+		Queue_Test_Item out[32];
+		u64 n = mpsc_queue_pop_many(&mpsc, out, 32);
+		if (n == 0) os_yield_thread();
+		for (u64 i = 0; i < n; i += 1) {
+			u32 p = out[i].producer;
+			assert(p < QUEUE_TEST_PRODUCER_COUNT, "Failed: MPSC item from unknown producer %u", p);
+			assert(out[i].sequence == expected_per_producer[p], "Failed: MPSC producer %u expected %u, got %u", p, expected_per_producer[p], out[i].sequence);
+			assert(out[i].check == (~out[i].sequence ^ p), "Failed: MPSC item was torn");
+			expected_per_producer[p] += 1;
+		}
+		received += n;
+	}
+	float64 mpsc_seconds = os_get_elapsed_seconds() - start_seconds;
+	for (u32 i = 0; i < QUEUE_TEST_PRODUCER_COUNT; i += 1) {
+		os_thread_join(&producers[i]);
+		os_thread_destroy(&producers[i]);
+	}
+	assert(!mpsc_queue_pop(&mpsc, items), "Failed: MPSC queue should be empty");
+	
+	print("SPSC %d items in %.2f ms, MPSC %d items from %d threads in %.2f ms\n",
+		QUEUE_TEST_ITEM_COUNT, spsc_seconds*1000.0,
+		QUEUE_TEST_ITEM_COUNT*QUEUE_TEST_PRODUCER_COUNT, QUEUE_TEST_PRODUCER_COUNT, mpsc_seconds*1000.0);
+	
+	spsc_queue_destroy(&spsc);
+	mpsc_queue_destroy(&mpsc);
+}
+
+#define SYNC_TEST_PHASE_COUNT 1000
+typedef struct Sync_Test_Data {
+	Semaphore items;
+	volatile u64 consumed;
+	Latch latch;
+	volatile u64 counted_down;
+	Barrier barrier;
+	u32 thread_count;
+	u32 *phases; // Each thread writes which phase it's in
+	volatile u64 serial_count;
+} Sync_Test_Data;
+void semaphore_test_consumer(Thread *t) {
+	Sync_Test_Data *d = (Sync_Test_Data*)t->data;
+	for (u64 i = 0; i < 1000; i += 1) {
+		semaphore_wait(&d->items);
+		atomic_fetch_add_64(&d->consumed, 1);
+	}
+}
+void latch_test_proc(Thread *t) {
+	Sync_Test_Data *d = (Sync_Test_Data*)t->data;
+	atomic_fetch_add_64(&d->counted_down, 1);
+	latch_count_down_and_wait(&d->latch);
+	assert(d->counted_down == d->thread_count, "Failed: Got through the latch before everyone counted down");
+}
+typedef struct Barrier_Test_Thread {
+	Sync_Test_Data *d;
+	u32 index;
+} Barrier_Test_Thread;
+void barrier_test_proc(Thread *t) {
+	Sync_Test_Data *d = ((Barrier_Test_Thread*)t->data)->d;
+	u32 index = ((Barrier_Test_Thread*)t->data)->index;
+	for (u32 phase = 1; phase <= SYNC_TEST_PHASE_COUNT; phase += 1) {
+		d->phases[index] = phase;
+		if (barrier_wait(&d->barrier)) atomic_fetch_add_64(&d->serial_count, 1);
+		for (u32 i = 0; i < d->thread_count; i += 1) {
+			assert(d->phases[i] == phase, "Failed: Thread %u was in phase %u, expected %u", i, d->phases[i], phase);
+		}
+		barrier_wait(&d->barrier);
+	}
+}
+
+typedef struct Barrier_Benchmark_Thread {
+	Barrier *barrier;
+	Binary_Semaphore start_sem;
+	Binary_Semaphore done_sem;
+	u64 phase_count;
+	bool use_semaphores;
+} Barrier_Benchmark_Thread;
+void barrier_benchmark_proc(Thread *t) {
+	Barrier_Benchmark_Thread *b = (Barrier_Benchmark_Thread*)t->data;
+	for (u64 i = 0; i < b->phase_count; i += 1) {
+		if (b->use_semaphores) {
+			os_binary_semaphore_wait(&b->start_sem);
+			os_binary_semaphore_signal(&b->done_sem);
+		} else {
+			barrier_wait(b->barrier);
+		}
+	}
+}
+
+void test_sync_primitives() {
+	Allocator heap = get_heap_allocator();
+	Sync_Test_Data d = ZERO(Sync_Test_Data);
+	d.thread_count = 8;
+	
+	// Semaphore
+	semaphore_init(&d.items, 2);
+	assert(semaphore_try_wait(&d.items) && semaphore_try_wait(&d.items), "Failed: semaphore_try_wait with count");
+	assert(!semaphore_try_wait(&d.items), "Failed: semaphore_try_wait should fail at 0");
+	
+	Thread threads[8];
+	for (u32 i = 0; i < d.thread_count; i += 1) {
+		os_thread_init(&threads[i], semaphore_test_consumer);
+		threads[i].data = &d;
+		os_thread_start(&threads[i]);
+	}
+	for (u64 i = 0; i < 1000; i += 1) {
+		semaphore_signal(&d.items, i % 2 == 0 ? 1 : 15);
+	}
+	for (u32 i = 0; i < d.thread_count; i += 1) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+	}
+	assert(d.consumed == 8000, "Failed: Semaphore consumers got %llu items, expected 8000", d.consumed);
+	assert(d.items.count == 0, "Failed: Semaphore should be empty, has %u", d.items.count);
+	
+	// Latch
+	latch_init(&d.latch, d.thread_count);
+	for (u32 i = 0; i < d.thread_count; i += 1) {
+		os_thread_init(&threads[i], latch_test_proc);
+		threads[i].data = &d;
+		os_thread_start(&threads[i]);
+	}
+	latch_wait(&d.latch);
+	assert(d.counted_down == d.thread_count, "Failed: latch_wait returned early");
+	for (u32 i = 0; i < d.thread_count; i += 1) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+	}
+	
+	// Barrier
+	barrier_init(&d.barrier, d.thread_count);
+	d.phases = (u32*)alloc(heap, d.thread_count*sizeof(u32));
+	Barrier_Test_Thread barrier_threads[8];
+	for (u32 i = 0; i < d.thread_count; i += 1) {
+		d.phases[i] = 0;
+		barrier_threads[i].d = &d;
+		barrier_threads[i].index = i;
+		os_thread_init(&threads[i], barrier_test_proc);
+		threads[i].data = &barrier_threads[i];
+		os_thread_start(&threads[i]);
+	}
+	for (u32 i = 0; i < d.thread_count; i += 1) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+	}
+	assert(d.serial_count == SYNC_TEST_PHASE_COUNT, "Failed: barrier_wait should return true once per phase");
+	dealloc(heap, d.phases);
+	
+	// Benchmark: round trip of one phase across all cores, barrier vs a pair of binary semaphores
+	// per thread like threaded_drawing.c used. The calling thread takes part in both.
+	u64 thread_count = max(os_get_number_of_logical_processors(), 2);
+	const u64 phase_count = 5000;
+	Barrier barrier;
+	barrier_init(&barrier, (u32)thread_count);
+	Thread *bench_threads = (Thread*)alloc(heap, thread_count*sizeof(Thread));
+	Barrier_Benchmark_Thread *bench = (Barrier_Benchmark_Thread*)alloc(heap, thread_count*sizeof(Barrier_Benchmark_Thread));
+	
+	float64 results[2];
+	for (u64 use_semaphores = 0; use_semaphores < 2; use_semaphores += 1) {
+		for (u64 i = 1; i < thread_count; i += 1) {
+			bench[i].barrier = &barrier;
+			bench[i].phase_count = phase_count;
+			bench[i].use_semaphores = use_semaphores;
+			os_binary_semaphore_init(&bench[i].start_sem, false);
+			os_binary_semaphore_init(&bench[i].done_sem, false);
+			os_thread_init(&bench_threads[i], barrier_benchmark_proc);
+			bench_threads[i].data = &bench[i];
+			os_thread_start(&bench_threads[i]);
+		}
+		
+		float64 start_seconds = os_get_elapsed_seconds();
+		for (u64 p = 0; p < phase_count; p += 1) {
+			if (use_semaphores) {
+				for (u64 i = 1; i < thread_count; i += 1) os_binary_semaphore_signal(&bench[i].start_sem);
+				for (u64 i = 1; i < thread_count; i += 1) os_binary_semaphore_wait(&bench[i].done_sem);
+			} else {
+				barrier_wait(&barrier);
+			}
+		}
+		results[use_semaphores] = os_get_elapsed_seconds() - start_seconds;
+		
+		for (u64 i = 1; i < thread_count; i += 1) {
+			os_thread_join(&bench_threads[i]);
+			os_thread_destroy(&bench_threads[i]);
+			os_binary_semaphore_destroy(&bench[i].start_sem);
+			os_binary_semaphore_destroy(&bench[i].done_sem);
+		}
+	}
+	
+	print("Phase round trip on %llu threads: barrier %.2f us, binary semaphores %.2f us\n", thread_count,
+		(results[0]*1000000.0)/(float64)phase_count, (results[1]*1000000.0)/(float64)phase_count);
+	
+	dealloc(heap, bench_threads);
+	dealloc(heap, bench);
+}
+
+#define LOCK_SCALING_ITERATIONS 100000
+typedef enum Lock_Scaling_Kind {
+	LOCK_SCALING_MUTEX,
+	LOCK_SCALING_OS_MUTEX,
+	LOCK_SCALING_RW_LOCK_READ,
+	LOCK_SCALING_RW_LOCK_MIXED,
+	
+	LOCK_SCALING_KIND_COUNT
+} Lock_Scaling_Kind;
+typedef struct Lock_Scaling_Work {
+	Lock_Scaling_Kind kind;
+	Mutex *mutex;
+	Mutex_Handle os_mutex;
+	RW_Lock *rw_lock;
+	u64 *counter;
+} Lock_Scaling_Work;
+void lock_scaling_proc(Thread *t) {
+	Lock_Scaling_Work *w = (Lock_Scaling_Work*)t->data;
+	for (u64 i = 0; i < LOCK_SCALING_ITERATIONS; i += 1) {
+		switch (w->kind) {
+			case LOCK_SCALING_MUTEX:
+				mutex_acquire_or_wait(w->mutex);
+				*w->counter += 1;
+				mutex_release(w->mutex);
+				break;
+			case LOCK_SCALING_OS_MUTEX:
+				os_lock_mutex(w->os_mutex);
+				*w->counter += 1;
+				os_unlock_mutex(w->os_mutex);
+				break;
+			case LOCK_SCALING_RW_LOCK_READ: {
+				rw_lock_read_acquire_or_wait(w->rw_lock);
+				volatile u64 x = *w->counter;
+				(void)x;
+				rw_lock_read_release(w->rw_lock);
+				break;
+			}
+			case LOCK_SCALING_RW_LOCK_MIXED:
+				if (i % 16 == 0) {
+					rw_lock_write_acquire_or_wait(w->rw_lock);
+					*w->counter += 1;
+					rw_lock_write_release(w->rw_lock);
+				} else {
+					rw_lock_read_acquire_or_wait(w->rw_lock);
+					volatile u64 y = *w->counter;
+					(void)y;
+					rw_lock_read_release(w->rw_lock);
+				}
+				break;
+			default: break;
+		}
+	}
+}
+// Acquire & release throughput from 1 to N threads, compared to the plain OS mutex
+void test_lock_scaling() {
+	Allocator heap = get_heap_allocator();
+	
+	u64 thread_counts[] = {1, 2, 4, 8, os_get_number_of_logical_processors()};
+	string kind_names[] = { STR("Mutex"), STR("OS mutex"), STR("RW_Lock read"), STR("RW_Lock 1/16 write") };
+	
+	print("\n");
+	for (u64 k = 0; k < LOCK_SCALING_KIND_COUNT; k += 1) {
+		for (u64 c = 0; c < sizeof(thread_counts)/sizeof(u64); c += 1) {
+			u64 thread_count = thread_counts[c];
+			
+			Mutex mutex;
+			mutex_init(&mutex);
+			RW_Lock rw_lock;
+			rw_lock_init(&rw_lock);
+			Mutex_Handle os_mutex = os_make_mutex();
+			u64 counter = 0;
+			
+			Thread *threads = (Thread*)alloc(heap, sizeof(Thread)*thread_count);
+			Lock_Scaling_Work work;
+			work.kind = (Lock_Scaling_Kind)k;
+			work.mutex = &mutex;
+			work.os_mutex = os_mutex;
+			work.rw_lock = &rw_lock;
+			work.counter = &counter;
+			for (u64 i = 0; i < thread_count; i += 1) {
+				os_thread_init(&threads[i], lock_scaling_proc);
+				threads[i].data = &work;
+			}
+			
+			float64 start_seconds = os_get_elapsed_seconds();
+			for (u64 i = 0; i < thread_count; i += 1) os_thread_start(&threads[i]);
+			for (u64 i = 0; i < thread_count; i += 1) os_thread_join(&threads[i]);
+			float64 seconds = os_get_elapsed_seconds() - start_seconds;
+			
+			u64 total = thread_count*LOCK_SCALING_ITERATIONS;
+			if (k == LOCK_SCALING_MUTEX || k == LOCK_SCALING_OS_MUTEX) {
+				assert(counter == total, "Failed: %s lost increments", kind_names[k]);
+			}
+			
+			Lock_Stats stats = k == LOCK_SCALING_MUTEX ? mutex.stats : rw_lock.stats;
+			print("\t%s, %llu threads: %.1f ns per acquire", kind_names[k], thread_count, (seconds*1000000000.0)/(float64)total);
+			if (k != LOCK_SCALING_OS_MUTEX) print(" (%llu contended, %llu parks)", stats.contended_count, stats.park_count);
+			print("\n");
+			
+			for (u64 i = 0; i < thread_count; i += 1) os_thread_destroy(&threads[i]);
+			dealloc(heap, threads);
+			mutex_destroy(&mutex);
+			os_destroy_mutex(os_mutex);
+		}
+	}
+}
+
+#define CONCURRENT_HASH_TABLE_TEST_KEYS 500
+typedef struct Concurrent_Hash_Table_Test {
+	Concurrent_Hash_Table *table;
+	volatile u64 *create_counts; // Per key
+	u64 thread_index;
+} Concurrent_Hash_Table_Test;
+bool concurrent_hash_table_test_create(void *key, void *value, void *data) {
+	Concurrent_Hash_Table_Test *d = (Concurrent_Hash_Table_Test*)data;
+	u64 k = *(u64*)key;
+	atomic_fetch_add_64(&d->create_counts[k], 1);
+	os_yield_thread(); // So other threads are more likely to ask for the same key meanwhile
+	*(u64*)value = k*3;
+	return true;
+}
+bool concurrent_hash_table_test_fail_first(void *key, void *value, void *data) {
+	u64 *attempts = (u64*)data;
+	*attempts += 1;
+	assert(*(u64*)value == 0, "Failed: Value should be zeroed before create");
+	*(u64*)value = 123;
+	return *attempts > 1;
+}
+bool concurrent_hash_table_test_sum(void *key, void *value, void *data) {
+	*(u64*)data += *(u64*)value;
+	return true;
+}
+// Adds key+1000 for every key it visits, which would deadlock if the shard was still locked
+bool concurrent_hash_table_test_add_while_walking(void *key, void *value, void *data) {
+	Concurrent_Hash_Table *t = (Concurrent_Hash_Table*)data;
+	u64 new_key = *(u64*)key + 1000;
+	if (*(u64*)key < 1000) concurrent_hash_table_add(t, new_key, new_key);
+	return true;
+}
+void concurrent_hash_table_test_proc(Thread *t) {
+	Concurrent_Hash_Table_Test *d = (Concurrent_Hash_Table_Test*)t->data;
+	for (u64 i = 0; i < CONCURRENT_HASH_TABLE_TEST_KEYS*4; i += 1) {
+		// Every thread goes through the keys in a different order
+		u64 key = (i*7 + d->thread_index*131) % CONCURRENT_HASH_TABLE_TEST_KEYS;
+		u64 *value = (u64*)concurrent_hash_table_get_or_create(d->table, key, concurrent_hash_table_test_create, d);
+		assert(value && *value == key*3, "Failed: Wrong value for key %llu", key);
+		u64 *found = (u64*)concurrent_hash_table_find(d->table, key);
+		assert(found == value, "Failed: Value moved");
+	}
+}
+
+typedef enum Concurrent_Hash_Table_Bench_Kind {
+	CONCURRENT_HASH_TABLE_BENCH_SHARDED,
+	CONCURRENT_HASH_TABLE_BENCH_MUTEX,
+	
+	CONCURRENT_HASH_TABLE_BENCH_KIND_COUNT,
+} Concurrent_Hash_Table_Bench_Kind;
+#define CONCURRENT_HASH_TABLE_BENCH_KEYS 10000
+#define CONCURRENT_HASH_TABLE_BENCH_OPS 200000
+typedef struct Concurrent_Hash_Table_Bench {
+	Concurrent_Hash_Table_Bench_Kind kind;
+	Concurrent_Hash_Table *table;
+	Hash_Table *locked_table;
+	Mutex *mutex;
+	u64 thread_index;
+	u64 found;
+} Concurrent_Hash_Table_Bench;
+bool concurrent_hash_table_bench_create(void *key, void *value, void *data) {
+	*(u64*)value = *(u64*)key;
+	return true;
+}
+void concurrent_hash_table_bench_proc(Thread *t) {
+	Concurrent_Hash_Table_Bench *b = (Concurrent_Hash_Table_Bench*)t->data;
+	u64 rng = b->thread_index*0x9E3779B97F4A7C15ULL + 1;
+	u64 found = 0;
+	for (u64 i = 0; i < CONCURRENT_HASH_TABLE_BENCH_OPS; i += 1) {
+		rng = rng*6364136223846793005ULL + 1442695040888963407ULL;
+		// 1 in 16 adds a new key, the rest look up existing ones
+		bool add = (i & 15) == 0;
+		u64 key = add ? CONCURRENT_HASH_TABLE_BENCH_KEYS + b->thread_index*CONCURRENT_HASH_TABLE_BENCH_OPS + i : (rng >> 33) % CONCURRENT_HASH_TABLE_BENCH_KEYS;
+		
+		if (b->kind == CONCURRENT_HASH_TABLE_BENCH_SHARDED) {
+			u64 *v = add ? (u64*)concurrent_hash_table_get_or_create(b->table, key, concurrent_hash_table_bench_create, 0)
+			             : (u64*)concurrent_hash_table_find(b->table, key);
+			if (v) found += 1;
+		} else {
+			mutex_acquire_or_wait(b->mutex);
+			u64 *v = (u64*)hash_table_find(b->locked_table, key);
+			if (!v && add) {
+				hash_table_add(b->locked_table, key, key);
+				v = (u64*)hash_table_find(b->locked_table, key);
+			}
+			if (v) found += 1;
+			mutex_release(b->mutex);
+		}
+	}
+	b->found = found;
+}
+
+void test_concurrent_hash_table() {
+	Allocator heap = get_heap_allocator();
+	
+	// Single threaded basics, with string keys
+	Concurrent_Hash_Table names = make_concurrent_hash_table(string, u64, heap);
+	assert(names.shard_count == CONCURRENT_HASH_TABLE_DEFAULT_SHARD_COUNT, "Failed: Shard count");
+	string a = STR("a");
+	string b = STR("b");
+	u64 va = 1;
+	u64 vb = 2;
+	assert(concurrent_hash_table_find(&names, a) == 0, "Failed: Found key in empty table");
+	assert(concurrent_hash_table_add(&names, a, va), "Failed: Add new key");
+	assert(!concurrent_hash_table_add(&names, a, vb), "Failed: Add existing key");
+	assert(*(u64*)concurrent_hash_table_find(&names, a) == 1, "Failed: Add should not overwrite");
+	assert(concurrent_hash_table_add(&names, b, vb), "Failed: Add another key");
+	assert(concurrent_hash_table_count(&names) == 2, "Failed: Count");
+	
+	// A failed create isn't added, and the next get_or_create tries again
+	string c = STR("c");
+	u64 attempts = 0;
+	assert(concurrent_hash_table_get_or_create(&names, c, concurrent_hash_table_test_fail_first, &attempts) == 0, "Failed: Failed create should return NULL");
+	assert(concurrent_hash_table_find(&names, c) == 0, "Failed: Failed create should not be found");
+	u64 *vc = (u64*)concurrent_hash_table_get_or_create(&names, c, concurrent_hash_table_test_fail_first, &attempts);
+	assert(vc && *vc == 123 && attempts == 2, "Failed: Create retry");
+	assert(concurrent_hash_table_get_or_create(&names, c, concurrent_hash_table_test_fail_first, &attempts) == vc && attempts == 2, "Failed: Created value should not be created again");
+	
+	u64 sum = 0;
+	concurrent_hash_table_walk(&names, concurrent_hash_table_test_sum, &sum);
+	assert(sum == 1+2+123, "Failed: Walk sum %llu", sum);
+	concurrent_hash_table_destroy(&names);
+	assert(names.shards == 0, "Failed: Shards should be NULL after destroy");
+	
+	// The walk proc can add to the table it's walking, even to the shard being walked
+	Concurrent_Hash_Table numbers = make_concurrent_hash_table(u64, u64, heap);
+	for (u64 key = 0; key < 500; key += 1) concurrent_hash_table_add(&numbers, key, key);
+	concurrent_hash_table_walk(&numbers, concurrent_hash_table_test_add_while_walking, &numbers);
+	assert(concurrent_hash_table_count(&numbers) == 1000, "Failed: Adding while walking, count %llu", concurrent_hash_table_count(&numbers));
+	for (u64 key = 0; key < 500; key += 1) {
+		u64 added_key = key + 1000;
+		u64 *v = (u64*)concurrent_hash_table_find(&numbers, added_key);
+		assert(v && *v == added_key, "Failed: Key added while walking is missing");
+	}
+	concurrent_hash_table_destroy(&numbers);
+	
+	// Nodes and shards are set up without relying on alloc() zeroing them
+	Allocator dirty;
+	dirty.proc = test_dirty_allocator_proc;
+	dirty.data = 0;
+	Concurrent_Hash_Table dirty_table = make_concurrent_hash_table(u64, u64, dirty);
+	for (u64 key = 0; key < 1000; key += 1) {
+		u64 key_attempts = 0;
+		assert(concurrent_hash_table_find(&dirty_table, key) == 0, "Failed: Found key that was never added");
+		assert(concurrent_hash_table_get_or_create(&dirty_table, key, concurrent_hash_table_test_fail_first, &key_attempts) == 0, "Failed: Failed create should return NULL");
+		u64 *v = (u64*)concurrent_hash_table_get_or_create(&dirty_table, key, concurrent_hash_table_test_fail_first, &key_attempts);
+		assert(v && *v == 123 && key_attempts == 2, "Failed: Create in a table from dirty memory");
+	}
+	assert(concurrent_hash_table_count(&dirty_table) == 1000, "Failed: Count in a table from dirty memory");
+	sum = 0;
+	concurrent_hash_table_walk(&dirty_table, concurrent_hash_table_test_sum, &sum);
+	assert(sum == 1000*123, "Failed: Walk sum in a table from dirty memory %llu", sum);
+	concurrent_hash_table_destroy(&dirty_table);
+	
+	// Many threads asking for the same keys. Each key is created exactly once and the value
+	// pointers never change.
+	const u64 thread_count = 8;
+	Concurrent_Hash_Table table = make_concurrent_hash_table(u64, u64, heap);
+	volatile u64 *create_counts = (volatile u64*)alloc(heap, CONCURRENT_HASH_TABLE_TEST_KEYS*sizeof(u64));
+	memset((void*)create_counts, 0, CONCURRENT_HASH_TABLE_TEST_KEYS*sizeof(u64));
+	Thread *threads = (Thread*)alloc(heap, sizeof(Thread)*thread_count);
+	Concurrent_Hash_Table_Test *tests = (Concurrent_Hash_Table_Test*)alloc(heap, sizeof(Concurrent_Hash_Table_Test)*thread_count);
+	for (u64 i = 0; i < thread_count; i += 1) {
+		tests[i].table = &table;
+		tests[i].create_counts = create_counts;
+		tests[i].thread_index = i;
+		os_thread_init(&threads[i], concurrent_hash_table_test_proc);
+		threads[i].data = &tests[i];
+	}
+	for (u64 i = 0; i < thread_count; i += 1) os_thread_start(&threads[i]);
+	for (u64 i = 0; i < thread_count; i += 1) os_thread_join(&threads[i]);
+	for (u64 i = 0; i < CONCURRENT_HASH_TABLE_TEST_KEYS; i += 1) {
+		assert(create_counts[i] == 1, "Failed: Key %llu was created %llu times", i, create_counts[i]);
+	}
+	assert(concurrent_hash_table_count(&table) == CONCURRENT_HASH_TABLE_TEST_KEYS, "Failed: Count after threads");
+	for (u64 i = 0; i < thread_count; i += 1) os_thread_destroy(&threads[i]);
+	dealloc(heap, threads);
+	dealloc(heap, tests);
+	dealloc(heap, (void*)create_counts);
+	concurrent_hash_table_destroy(&table);
+	
+	// Read-heavy benchmark: sharded table vs one Hash_Table behind a Mutex
+	u64 thread_counts[] = {1, 2, 4, 8, os_get_number_of_logical_processors()};
+	string kind_names[] = { STR("Sharded"), STR("Mutex + Hash_Table") };
+	print("\n");
+	for (u64 k = 0; k < CONCURRENT_HASH_TABLE_BENCH_KIND_COUNT; k += 1) {
+		for (u64 t = 0; t < sizeof(thread_counts)/sizeof(u64); t += 1) {
+			u64 count = thread_counts[t];
+			
+			Concurrent_Hash_Table sharded = make_concurrent_hash_table(u64, u64, heap);
+			Hash_Table locked = make_hash_table(u64, u64, heap);
+			Mutex mutex;
+			mutex_init(&mutex);
+			for (u64 key = 0; key < CONCURRENT_HASH_TABLE_BENCH_KEYS; key += 1) {
+				if (k == CONCURRENT_HASH_TABLE_BENCH_SHARDED) concurrent_hash_table_add(&sharded, key, key);
+				else                                          hash_table_add(&locked, key, key);
+			}
+			
+			Thread *threads = (Thread*)alloc(heap, sizeof(Thread)*count);
+			Concurrent_Hash_Table_Bench *benches = (Concurrent_Hash_Table_Bench*)alloc(heap, sizeof(Concurrent_Hash_Table_Bench)*count);
+			for (u64 i = 0; i < count; i += 1) {
+				benches[i] = ZERO(Concurrent_Hash_Table_Bench);
+				benches[i].kind = (Concurrent_Hash_Table_Bench_Kind)k;
+				benches[i].table = &sharded;
+				benches[i].locked_table = &locked;
+				benches[i].mutex = &mutex;
+				benches[i].thread_index = i;
+				os_thread_init(&threads[i], concurrent_hash_table_bench_proc);
+				threads[i].data = &benches[i];
+			}
+			
+			float64 start_seconds = os_get_elapsed_seconds();
+			for (u64 i = 0; i < count; i += 1) os_thread_start(&threads[i]);
+			for (u64 i = 0; i < count; i += 1) os_thread_join(&threads[i]);
+			float64 seconds = os_get_elapsed_seconds() - start_seconds;
+			
+			u64 total = count*CONCURRENT_HASH_TABLE_BENCH_OPS;
+			u64 found = 0;
+			for (u64 i = 0; i < count; i += 1) found += benches[i].found;
+			assert(found == total, "Failed: %s missed %llu lookups", kind_names[k], total-found);
+			print("\t%s, %llu threads: %.1f ns per op, %.1f million ops/sec\n", kind_names[k], count, (seconds*1000000000.0)/(float64)total, ((float64)total/seconds)/1000000.0);
+			
+			for (u64 i = 0; i < count; i += 1) os_thread_destroy(&threads[i]);
+			dealloc(heap, threads);
+			dealloc(heap, benches);
+			mutex_destroy(&mutex);
+			hash_table_destroy(&locked);
+			concurrent_hash_table_destroy(&sharded);
+		}
+	}
+}
+
+#define STRING_INTERN_TEST_STRINGS 2000
+typedef struct String_Intern_Test {
+	string *strings;
+	Atom *atoms;
+	u64 thread_index;
+} String_Intern_Test;
+void string_intern_test_proc(Thread *t) {
+	String_Intern_Test *d = (String_Intern_Test*)t->data;
+	for (u64 i = 0; i < STRING_INTERN_TEST_STRINGS; i += 1) {
+		// Every thread goes through them in a different order
+		u64 n = (i*7 + d->thread_index*331) % STRING_INTERN_TEST_STRINGS;
+		d->atoms[n] = string_intern(d->strings[n]);
+	}
+}
+
+void test_string_intern() {
+	Allocator heap = get_heap_allocator();
+	
+	assert(string_intern(STR("")) == ATOM_NONE, "Failed: Empty string should be ATOM_NONE");
+	assert(atom_get_string(ATOM_NONE).count == 0, "Failed: ATOM_NONE should be empty");
+	
+	// Same contents in different memory is the same atom, and the bytes are copied
+	string hello = string_copy(STR("intern test hello"), heap);
+	Atom a = string_intern(hello);
+	Atom b = string_intern(STR("intern test hello"));
+	Atom c = string_intern(STR("intern test hello!"));
+	assert(a != ATOM_NONE && a == b, "Failed: Same contents should be the same atom");
+	assert(a != c, "Failed: Different contents should be different atoms");
+	memset(hello.data, 'x', hello.count);
+	dealloc_string(heap, hello);
+	assert(strings_match(atom_get_string(a), STR("intern test hello")), "Failed: Interned bytes should be a copy");
+	
+	// Short strings, and strings which are prefixes of each other
+	Atom x = string_intern(STR("x"));
+	Atom xy = string_intern(STR("xy"));
+	assert(x != xy && strings_match(atom_get_string(xy), STR("xy")), "Failed: Short strings");
+	
+	assert(string_find_atom(STR("intern test never interned")) == ATOM_NONE, "Failed: Find should not find what was never interned");
+	assert(string_find_atom(STR("intern test hello")) == a, "Failed: Find should find interned string");
+	
+	// Many, enough to grow the slots a couple of times
+	string names[] = { STR("intern test player"), STR(""), STR("intern test enemy"), STR("intern test player") };
+	Atom atoms[4];
+	string_intern_many(names, atoms, 4);
+	assert(atoms[0] == atoms[3] && atoms[0] != atoms[2] && atoms[1] == ATOM_NONE, "Failed: string_intern_many");
+	
+	// Threads interning the same strings all get the same atoms
+	const u64 thread_count = 8;
+	string *strings = (string*)alloc(heap, STRING_INTERN_TEST_STRINGS*sizeof(string));
+	for (u64 i = 0; i < STRING_INTERN_TEST_STRINGS; i += 1) {
+		strings[i] = sprint(heap, STR("intern test threaded %llu"), i);
+	}
+	Thread *threads = (Thread*)alloc(heap, sizeof(Thread)*thread_count);
+	String_Intern_Test *tests = (String_Intern_Test*)alloc(heap, sizeof(String_Intern_Test)*thread_count);
+	for (u64 i = 0; i < thread_count; i += 1) {
+		tests[i].strings = strings;
+		tests[i].atoms = (Atom*)alloc(heap, STRING_INTERN_TEST_STRINGS*sizeof(Atom));
+		tests[i].thread_index = i;
+		os_thread_init(&threads[i], string_intern_test_proc);
+		threads[i].data = &tests[i];
+	}
+	for (u64 i = 0; i < thread_count; i += 1) os_thread_start(&threads[i]);
+	for (u64 i = 0; i < thread_count; i += 1) os_thread_join(&threads[i]);
+	for (u64 n = 0; n < STRING_INTERN_TEST_STRINGS; n += 1) {
+		Atom atom = tests[0].atoms[n];
+		assert(strings_match(atom_get_string(atom), strings[n]), "Failed: Wrong string for atom %u", atom);
+		for (u64 i = 1; i < thread_count; i += 1) {
+			assert(tests[i].atoms[n] == atom, "Failed: Threads got different atoms for %s", strings[n]);
+		}
+		if (n > 0) assert(atom != tests[0].atoms[n-1], "Failed: Different strings got the same atom");
+	}
+	for (u64 i = 0; i < thread_count; i += 1) {
+		os_thread_destroy(&threads[i]);
+		dealloc(heap, tests[i].atoms);
+	}
+	dealloc(heap, threads);
+	dealloc(heap, tests);
+	for (u64 i = 0; i < STRING_INTERN_TEST_STRINGS; i += 1) dealloc_string(heap, strings[i]);
+	dealloc(heap, strings);
+	
+	// Benchmark: interning new paths, looking up ones which are already interned, and the same
+	// lookups in a Hash_Table with string keys
+	const u64 count = 100000;
+	const u64 lookup_count = 1000000;
+	string *paths = (string*)alloc(heap, count*sizeof(string));
+	for (u64 i = 0; i < count; i += 1) {
+		paths[i] = sprint(heap, STR("assets/intern_benchmark/level_%llu/texture_%llu.png"), i % 37, i);
+	}
+	Atom *path_atoms = (Atom*)alloc(heap, count*sizeof(Atom));
+	
+	float64 start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < count; i += 1) path_atoms[i] = string_intern(paths[i]);
+	float64 intern_seconds = os_get_elapsed_seconds() - start;
+	
+	u64 rng = 1;
+	u64 matches = 0;
+	start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < lookup_count; i += 1) {
+		rng = rng*6364136223846793005ULL + 1442695040888963407ULL;
+		u64 n = (rng >> 33) % count;
+		if (string_intern(paths[n]) == path_atoms[n]) matches += 1;
+	}
+	float64 lookup_seconds = os_get_elapsed_seconds() - start;
+	assert(matches == lookup_count, "Failed: Looked up atoms don't match");
+	
+	Hash_Table table = make_hash_table_reserve(string, u32, count, heap);
+	for (u64 i = 0; i < count; i += 1) hash_table_add(&table, paths[i], path_atoms[i]);
+	rng = 1;
+	u64 table_matches = 0;
+	start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < lookup_count; i += 1) {
+		rng = rng*6364136223846793005ULL + 1442695040888963407ULL;
+		u64 n = (rng >> 33) % count;
+		u32 *atom = (u32*)hash_table_find(&table, paths[n]);
+		if (atom && *atom == path_atoms[n]) table_matches += 1;
+	}
+	float64 table_seconds = os_get_elapsed_seconds() - start;
+	
+	print("\n\tIntern %llu new paths: %.1f ns each, %.2f million/sec\n", count, (intern_seconds*1000000000.0)/(float64)count, ((float64)count/intern_seconds)/1000000.0);
+	print("\tLook up interned path: %.1f ns, Hash_Table(string) find: %.1f ns (%llu, %llu hits)\n", (lookup_seconds*1000000000.0)/(float64)lookup_count, (table_seconds*1000000000.0)/(float64)lookup_count, matches, table_matches);
+	print("\t%u atoms, %llu bytes interned\n", string_interner.count, string_interner.byte_count);
+	
+	hash_table_destroy(&table);
+	for (u64 i = 0; i < count; i += 1) dealloc_string(heap, paths[i]);
+	dealloc(heap, paths);
+	dealloc(heap, path_atoms);
+}
 
-    Allocator allocator = get_heap_allocator();
+typedef struct Job_Test_Data {
+	volatile u64 sum;
+	Job_Counter *counter;
+	volatile u64 stage;
+	u64 stage_order[3];
+} Job_Test_Data;
+void job_test_add_one(void *data) {
+	Job_Test_Data *d = (Job_Test_Data*)data;
+	atomic_fetch_add_64(&d->sum, 1);
+}
+void job_test_spawn_and_wait(void *data) {
+	Job_Test_Data *d = (Job_Test_Data*)data;
+	
+	// Waiting inside of a job should run other jobs instead of deadlocking
+	Job_Counter children = ZERO(Job_Counter);
+	for (u64 i = 0; i < 10; i += 1) {
+		job_run(job_test_add_one, d, &children);
+	}
+	job_wait(&children);
+}
+// Not a worker, so everything it spawns goes through the injection queue
+void job_test_spawn_from_thread(Thread *t) {
+	Job_Test_Data *d = (Job_Test_Data*)t->data;
+	assert(job_get_worker_index() == -1, "Failed: a thread that isn't a worker has a worker index");
+	Job_Counter counter = ZERO(Job_Counter);
+	for (u64 i = 0; i < 100; i += 1) {
+		job_run(job_test_spawn_and_wait, d, &counter);
+	}
+	job_wait(&counter);
+}
+void job_test_stage(void *data) {
+	Job_Test_Data *d = (Job_Test_Data*)data;
+	u64 stage = atomic_fetch_add_64(&d->stage, 1);
+	d->stage_order[stage] = stage;
+}
+typedef struct Parallel_For_Test_Data {
+	u8 *touched;
+	u64 *sums; // Per worker
+} Parallel_For_Test_Data;
+void parallel_for_test_proc(u64 first, u64 end, void *data) {
+	Parallel_For_Test_Data *d = (Parallel_For_Test_Data*)data;
+	s64 worker = job_get_worker_index();
+	assert(worker >= 0 && worker < (s64)job_get_worker_count(), "Failed: parallel_for ran on a non-worker thread");
+	for (u64 i = first; i < end; i += 1) {
+		d->touched[i] += 1;
+		d->sums[worker] += i;
+	}
+}
 
-	const int num_threads = 100;
+#ifndef OOGABOOGA_HEADLESS
+#define JOB_BENCHMARK_SPRITE_COUNT 150000
+typedef struct Job_Benchmark_Thread {
+	Draw_Frame frame;
+	Binary_Semaphore start_sem;
+	Binary_Semaphore done_sem;
+	u64 number_of_sprites;
+	volatile bool *stop;
+} Job_Benchmark_Thread;
+void job_benchmark_draw_sprites(Draw_Frame *frame, u64 count) {
+	for (u64 i = 0; i < count; i += 1) {
+		draw_image_in_frame(
+			0,
+			v2(get_random_float32_in_range(-500, 500), get_random_float32_in_range(-500, 500)),
+			v2(8, 8),
+			COLOR_WHITE,
+			frame
+		);
+	}
+}
+// Two Binary_Semaphore's per thread, how examples/threaded_drawing.c used to do it
+void job_benchmark_thread(Thread *t) {
+	Job_Benchmark_Thread *b = (Job_Benchmark_Thread*)t->data;
+	while (true) {
+		os_binary_semaphore_wait(&b->start_sem);
+		if (*b->stop) break;
+		draw_frame_reset(&b->frame);
+		job_benchmark_draw_sprites(&b->frame, b->number_of_sprites);
+		os_binary_semaphore_signal(&b->done_sem);
+	}
+}
+void job_benchmark_parallel_for_proc(u64 first, u64 end, void *data) {
+	Draw_Frame *frames = (Draw_Frame*)data;
+	job_benchmark_draw_sprites(&frames[job_get_worker_index()], end-first);
+}
+#endif /* OOGABOOGA_HEADLESS */
 
-	Thread *threads = alloc(allocator, sizeof(Thread)*num_threads);
-	for (u64 i = 0; i < num_threads; i++) {
-		os_thread_init(&threads[i], mutex_test_increment_counter);
-		threads[i].data = &data;
+void test_jobs() {
+	u64 worker_count = job_get_worker_count();
+	assert(worker_count >= 1, "Failed: no workers");
+	assert(job_get_worker_index() == 0, "Failed: the thread which initted the job system should be worker 0");
+	
+	Job_Test_Data data = ZERO(Job_Test_Data);
+	
+	// Flat
+	Job_Counter counter = ZERO(Job_Counter);
+	for (u64 i = 0; i < 10000; i += 1) {
+		job_run(job_test_add_one, &data, &counter);
 	}
-	for (u64 i = 0; i < num_threads; i++) {
-    	os_thread_start(&threads[i]);
+	job_wait(&counter);
+	assert(counter.count == 0, "Failed: counter should be 0 after job_wait");
+	assert(data.sum == 10000, "Failed: expected 10000 jobs to run, got %llu", data.sum);
+	
+	// Jobs spawning jobs from inside jobs
+	data.sum = 0;
+	for (u64 i = 0; i < 100; i += 1) {
+		job_run(job_test_spawn_and_wait, &data, &counter);
 	}
-	for (u64 i = 0; i < num_threads; i++) {
-    	os_thread_join(&threads[i]);
+	job_wait(&counter);
+	assert(data.sum == 1000, "Failed: expected 1000 nested jobs to run, got %llu", data.sum);
+	
+	// Jobs from other threads go through the injection queue
+	data.sum = 0;
+	Thread spawner;
+	os_thread_init(&spawner, job_test_spawn_from_thread);
+	spawner.data = &data;
+	os_thread_start(&spawner);
+	os_thread_join(&spawner);
+	os_thread_destroy(&spawner);
+	assert(data.sum == 1000, "Failed: expected 1000 jobs spawned from another thread to run, got %llu", data.sum);
+	assert(job_system.injected_count == 0, "Failed: jobs left in the injection queue");
+	
+	// Dependencies
+	for (u64 i = 0; i < 100; i += 1) {
+		data.stage = 0;
+		Job_Counter a = ZERO(Job_Counter);
+		Job_Counter b = ZERO(Job_Counter);
+		Job_Counter c = ZERO(Job_Counter);
+		job_run(job_test_stage, &data, &a);
+		job_run_after(&a, job_test_stage, &data, &b);
+		job_run_after(&b, job_test_stage, &data, &c);
+		job_wait(&c);
+		assert(data.stage == 3, "Failed: expected 3 stages, got %llu", data.stage);
+		job_wait(&a);
+		job_wait(&b);
 	}
+	
+	// Dependency which is already done runs right away
+	Job_Counter done = ZERO(Job_Counter);
+	data.sum = 0;
+	job_run_after(&done, job_test_add_one, &data, &counter);
+	job_wait(&counter);
+	assert(data.sum == 1, "Failed: job_run_after on a finished counter");
+	
+	// parallel_for
+	const u64 count = 1000003;
+	Parallel_For_Test_Data pf;
+	pf.touched = alloc(get_heap_allocator(), count);
+	pf.sums = alloc(get_heap_allocator(), worker_count*sizeof(u64));
+	memset(pf.touched, 0, count);
+	memset(pf.sums, 0, worker_count*sizeof(u64));
+	
+	parallel_for(count, 1000, parallel_for_test_proc, &pf);
+	
+	u64 sum = 0;
+	for (u64 i = 0; i < worker_count; i += 1) sum += pf.sums[i];
+	assert(sum == (count*(count-1))/2, "Failed: parallel_for sum was %llu, expected %llu", sum, (count*(count-1))/2);
+	for (u64 i = 0; i < count; i += 1) {
+		assert(pf.touched[i] == 1, "Failed: parallel_for touched index %llu %d times", i, pf.touched[i]);
+	}
+	
+	parallel_for(0, 1000, parallel_for_test_proc, &pf); // Should do nothing
+	parallel_for(5, 0, parallel_for_test_proc, &pf); // Grain 0 is treated as 1
+	for (u64 i = 0; i < 5; i += 1) assert(pf.touched[i] == 2, "Failed: parallel_for with grain 0");
+	
+	dealloc(get_heap_allocator(), pf.touched);
+	dealloc(get_heap_allocator(), pf.sums);
+	
+#ifndef OOGABOOGA_HEADLESS
+	// Benchmark: draw 150k sprites into per-thread Draw_Frames, semaphore per thread vs parallel_for
+	const u64 frame_count = 20;
+	
+	volatile bool stop = false;
+	Thread *threads = alloc(get_heap_allocator(), worker_count*sizeof(Thread));
+	Job_Benchmark_Thread *bench = alloc(get_heap_allocator(), worker_count*sizeof(Job_Benchmark_Thread));
+	for (u64 i = 0; i < worker_count; i += 1) {
+		draw_frame_init(&bench[i].frame);
+		os_binary_semaphore_init(&bench[i].start_sem, false);
+		os_binary_semaphore_init(&bench[i].done_sem, false);
+		bench[i].number_of_sprites = JOB_BENCHMARK_SPRITE_COUNT/worker_count;
+		bench[i].stop = &stop;
+		os_thread_init(&threads[i], job_benchmark_thread);
+		threads[i].data = &bench[i];
+		os_thread_start(&threads[i]);
+	}
+	
+	float64 start_seconds = os_get_elapsed_seconds();
+	u64 start_cycles = rdtsc();
+	for (u64 f = 0; f < frame_count; f += 1) {
+		for (u64 i = 0; i < worker_count; i += 1) os_binary_semaphore_signal(&bench[i].start_sem);
+		for (u64 i = 0; i < worker_count; i += 1) os_binary_semaphore_wait(&bench[i].done_sem);
+	}
+	u64 semaphore_cycles = rdtsc() - start_cycles;
+	float64 semaphore_seconds = os_get_elapsed_seconds() - start_seconds;
+	
+	stop = true;
+	for (u64 i = 0; i < worker_count; i += 1) os_binary_semaphore_signal(&bench[i].start_sem);
+	for (u64 i = 0; i < worker_count; i += 1) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+		os_binary_semaphore_destroy(&bench[i].start_sem);
+		os_binary_semaphore_destroy(&bench[i].done_sem);
+		draw_frame_deinit(&bench[i].frame);
+	}
+	
+	Draw_Frame *frames = alloc(get_heap_allocator(), worker_count*sizeof(Draw_Frame));
+	for (u64 i = 0; i < worker_count; i += 1) draw_frame_init(&frames[i]);
+	
+	start_seconds = os_get_elapsed_seconds();
+	start_cycles = rdtsc();
+	for (u64 f = 0; f < frame_count; f += 1) {
+		for (u64 i = 0; i < worker_count; i += 1) draw_frame_reset(&frames[i]);
+		parallel_for(JOB_BENCHMARK_SPRITE_COUNT, 1024, job_benchmark_parallel_for_proc, frames);
+	}
+	u64 jobs_cycles = rdtsc() - start_cycles;
+	float64 jobs_seconds = os_get_elapsed_seconds() - start_seconds;
+	
+	u64 quad_count = 0;
+	for (u64 i = 0; i < worker_count; i += 1) {
+		quad_count += growing_array_get_valid_count(frames[i].quad_buffer);
+		draw_frame_deinit(&frames[i]);
+	}
+	assert(quad_count == JOB_BENCHMARK_SPRITE_COUNT, "Failed: parallel_for drew %llu quads, expected %d", quad_count, JOB_BENCHMARK_SPRITE_COUNT);
+	
+	print("Drawing %d sprites on %llu threads: semaphore per thread %llu cycles %.2f ms, parallel_for %llu cycles %.2f ms per frame\n", 
+		JOB_BENCHMARK_SPRITE_COUNT, worker_count,
+		semaphore_cycles/frame_count, (semaphore_seconds*1000.0)/(float64)frame_count,
+		jobs_cycles/frame_count, (jobs_seconds*1000.0)/(float64)frame_count);
+	
+	dealloc(get_heap_allocator(), threads);
+	dealloc(get_heap_allocator(), bench);
+	dealloc(get_heap_allocator(), frames);
+#endif /* OOGABOOGA_HEADLESS */
+}
 
-    assert(data.counter == num_threads * MUTEX_TEST_TASK_COUNT, "Failed: Counter does not match expected value after threading tasks");
-
-    mutex_destroy(&data.mutex);
+typedef enum Radix_Test_Input {
+	RADIX_TEST_RANDOM,
+	RADIX_TEST_EQUAL,
+	RADIX_TEST_SORTED,
+	RADIX_TEST_REVERSED,
+	RADIX_TEST_TWO_VALUES,   // Alternating, every pass that isn't skipped moves everything
+	RADIX_TEST_TOP_BITS,     // Only the highest digit differs
+	RADIX_TEST_BLOCKS,       // Every block its own key, in reverse
+	RADIX_TEST_GARBAGE_BITS, // Random bits above number_of_bits which must be ignored
+	RADIX_TEST_INPUT_COUNT,
+} Radix_Test_Input;
+u64 _radix_test_key(Radix_Test_Input input, u64 i, u64 count, u64 bits) {
+	u64 mask = bits == 64 ? 0xFFFFFFFFFFFFFFFFull : ((1ull << bits)-1);
+	switch (input) {
+		case RADIX_TEST_RANDOM:       return get_random() & mask;
+		case RADIX_TEST_EQUAL:        return 0x1234567890ABCDEFull & mask;
+		case RADIX_TEST_SORTED:       return (i*(mask/count)) & mask;
+		case RADIX_TEST_REVERSED:     return ((count-i)*(mask/count)) & mask;
+		case RADIX_TEST_TWO_VALUES:   return (i & 1) ? mask : 0;
+		case RADIX_TEST_TOP_BITS:     return ((u64)get_random_int_in_range(0, 3) << (bits-2)) & mask;
+		case RADIX_TEST_BLOCKS:       return (u64)(count-i)/RADIX_SORT_MIN_BLOCK_SIZE;
+		case RADIX_TEST_GARBAGE_BITS: return get_random() | ~mask;
+		default: return 0;
+	}
+}
+void _radix_test_check(void *sorted_pairs, void *serial_pairs, u64 count, bool wide, u64 bits, bool *seen) {
+	u64 mask = bits == 64 ? 0xFFFFFFFFFFFFFFFFull : ((1ull << bits)-1);
+	memset(seen, 0, count);
+	u64 last_key = 0;
+	u64 last_index = 0;
+	for (u64 i = 0; i < count; i++) {
+		u64 key, index;
+		if (wide) {
+			Radix_Pair64 p = ((Radix_Pair64*)sorted_pairs)[i];
+			assert(bytes_match(&p, &((Radix_Pair64*)serial_pairs)[i], sizeof(p)), "Parallel and serial sort differ at %llu", i);
+			key = p.key & mask;
+			index = p.index;
+		} else {
+			Radix_Pair32 p = ((Radix_Pair32*)sorted_pairs)[i];
+			assert(bytes_match(&p, &((Radix_Pair32*)serial_pairs)[i], sizeof(p)), "Parallel and serial sort differ at %llu", i);
+			key = p.key & mask;
+			index = p.index;
+		}
+		assert(index < count && !seen[index], "Index %llu lost or duplicated", index);
+		seen[index] = true;
+		if (i > 0) {
+			assert(key >= last_key, "Not sorted at %llu: %llu after %llu", i, key, last_key);
+			assert(key != last_key || index > last_index, "Not stable at %llu", i);
+		}
+		last_key = key;
+		last_index = index;
+	}
+}
+void test_radix_sort_pairs() {
+	Allocator heap = get_heap_allocator();
+	
+	// Need more than one worker for the parallel path to do anything
+	u64 old_worker_count = job_get_worker_count();
+	u64 worker_count = max(old_worker_count, 4);
+	if (worker_count != old_worker_count) {
+		job_system_shutdown();
+		job_system_init(worker_count);
+	}
+	
+	const u64 max_count = 1 << 20;
+	Radix_Pair64 *pairs64  = (Radix_Pair64*)alloc(heap, max_count*4*sizeof(Radix_Pair64));
+	Radix_Pair64 *help64   = pairs64 + max_count;
+	Radix_Pair64 *serial64 = pairs64 + max_count*2;
+	Radix_Pair64 *serial_help64 = pairs64 + max_count*3;
+	// 32 bit ones use the same memory
+	Radix_Pair32 *pairs32  = (Radix_Pair32*)pairs64;
+	Radix_Pair32 *help32   = (Radix_Pair32*)help64;
+	Radix_Pair32 *serial32 = (Radix_Pair32*)serial64;
+	Radix_Pair32 *serial_help32 = (Radix_Pair32*)serial_help64;
+	bool *seen = (bool*)alloc(heap, max_count);
+	
+	u64 counts[] = { 0, 1, 2, 3, 1000, RADIX_SORT_PARALLEL_MIN_COUNT-1, RADIX_SORT_PARALLEL_MIN_COUNT, RADIX_SORT_PARALLEL_MIN_COUNT+17, 300001, max_count };
+	u64 bit_counts[] = { 1, 7, 8, 21, 32, 33, 48, 64 };
+	
+	for (u64 c = 0; c < sizeof(counts)/sizeof(u64); c++) {
+		u64 count = counts[c];
+		for (u64 b = 0; b < sizeof(bit_counts)/sizeof(u64); b++) {
+			u64 bits = bit_counts[b];
+			for (Radix_Test_Input input = 0; input < RADIX_TEST_INPUT_COUNT; input++) {
+				// The big ones take a while, just do the interesting inputs
+				if (count == max_count && input != RADIX_TEST_RANDOM && input != RADIX_TEST_BLOCKS) continue;
+				
+				bool wide = bits > 32;
+				for (u64 i = 0; i < count; i++) {
+					u64 key = _radix_test_key(input, i, count, bits);
+					if (wide) { pairs64[i].key = key;      pairs64[i].index = i; }
+					else      { pairs32[i].key = (u32)key; pairs32[i].index = (u32)i; }
+				}
+				
+				void *sorted, *serial;
+				if (wide) {
+					memcpy(serial64, pairs64, count*sizeof(Radix_Pair64));
+					serial = radix_sort_pairs64(serial64, serial_help64, count, bits, 1);
+					sorted = radix_sort_pairs64(pairs64, help64, count, bits, 0);
+				} else {
+					memcpy(serial32, pairs32, count*sizeof(Radix_Pair32));
+					serial = radix_sort_pairs32(serial32, serial_help32, count, bits, 1);
+					sorted = radix_sort_pairs32(pairs32, help32, count, bits, 0);
+				}
+				_radix_test_check(sorted, serial, count, wide, bits, seen);
+			}
+		}
+	}
+	
+	// 32 bit keys sorted as 64 bit keys give the same order
+	for (u64 i = 0; i < 100000; i++) {
+		pairs32[i].key = (u32)get_random();
+		pairs32[i].index = (u32)i;
+		serial64[i].key = pairs32[i].key;
+		serial64[i].index = i;
+	}
+	Radix_Pair32 *sorted32 = radix_sort_pairs32(pairs32, help32, 100000, 32, 0);
+	Radix_Pair64 *sorted64 = radix_sort_pairs64(serial64, serial_help64, 100000, 32, 0);
+	for (u64 i = 0; i < 100000; i++) {
+		assert(sorted32[i].index == sorted64[i].index, "32 and 64 bit sort differ at %llu", i);
+	}
+	
+	// Scaling benchmark, random keys
+	u64 thread_counts[] = {1, 2, 4, 8, os_get_number_of_logical_processors()};
+	u64 bench_counts[] = { 100000, 1000000, 4000000 };
+	u64 bench_max_count = 4000000;
+	dealloc(heap, pairs64);
+	pairs64 = (Radix_Pair64*)alloc(heap, bench_max_count*2*sizeof(Radix_Pair64));
+	help64 = pairs64 + bench_max_count;
+	pairs32 = (Radix_Pair32*)pairs64;
+	help32 = (Radix_Pair32*)help64;
+	
+	print("\n\t(%llu logical processors, %llu workers)", os_get_number_of_logical_processors(), job_get_worker_count());
+	for (u64 wide = 0; wide <= 1; wide++) {
+		for (u64 c = 0; c < sizeof(bench_counts)/sizeof(u64); c++) {
+			u64 count = bench_counts[c];
+			u64 runs = max(20000000/count, 3);
+			float64 one_thread_seconds = 0;
+			u64 last_thread_count = 0;
+			print("\n\t%7llu %llu bit keys:", count, wide ? 64ull : 32ull);
+			for (u64 t = 0; t < sizeof(thread_counts)/sizeof(u64); t++) {
+				u64 thread_count = thread_counts[t];
+				if (thread_count > job_get_worker_count() || thread_count <= last_thread_count) continue;
+				last_thread_count = thread_count;
+				
+				float64 seconds = 0;
+				for (u64 run = 0; run < runs; run++) {
+					for (u64 i = 0; i < count; i++) {
+						if (wide) { pairs64[i].key = get_random();      pairs64[i].index = i; }
+						else      { pairs32[i].key = (u32)get_random(); pairs32[i].index = (u32)i; }
+					}
+					float64 start = os_get_elapsed_seconds();
+					if (wide) radix_sort_pairs64(pairs64, help64, count, 64, thread_count);
+					else      radix_sort_pairs32(pairs32, help32, count, 32, thread_count);
+					seconds += os_get_elapsed_seconds() - start;
+				}
+				seconds /= (float64)runs;
+				if (thread_count == 1) one_thread_seconds = seconds;
+				print(" %llu threads %.2f ms (%.1fx)", thread_count, seconds*1000.0, one_thread_seconds/seconds);
+			}
+		}
+	}
+	print("\n");
+	
+	dealloc(heap, pairs64);
+	dealloc(heap, seen);
+	
+	if (worker_count != old_worker_count) {
+		job_system_shutdown();
+		job_system_init(old_worker_count);
+	}
 }
 
 #ifndef OOGABOOGA_HEADLESS
 int compare_draw_quads(const void *a, const void *b) {
     return ((Draw_Quad*)a)->z-((Draw_Quad*)b)->z;
 }
+#define draw_quad_z_less(a, b) ((a)->z < (b)->z)
+DEFINE_SORT(draw_quads_by_z, Draw_Quad, draw_quad_z_less);
+
+// Like a "nearest enemies" query
+typedef struct Sort_Test_Item {
+    float32 distance;
+    u32 id;
+} Sort_Test_Item;
+int compare_sort_test_items(const void *a, const void *b) {
+    float32 da = ((Sort_Test_Item*)a)->distance;
+    float32 db = ((Sort_Test_Item*)b)->distance;
+    return da < db ? -1 : (da > db ? 1 : 0);
+}
+#define sort_test_item_less(a, b) ((a)->distance < (b)->distance)
+DEFINE_SORT(sort_test_items, Sort_Test_Item, sort_test_item_less);
+
+typedef enum Sort_Test_Pattern {
+    SORT_TEST_RANDOM,
+    SORT_TEST_FEW_UNIQUE,
+    SORT_TEST_SORTED,
+    SORT_TEST_REVERSED,
+    SORT_TEST_EQUAL,
+    SORT_TEST_ORGAN_PIPE,
+    SORT_TEST_SAWTOOTH,
+    SORT_TEST_SORTED_BUT_A_FEW,
+    SORT_TEST_PATTERN_COUNT,
+} Sort_Test_Pattern;
+void _sort_test_fill(Sort_Test_Item *items, u64 count, Sort_Test_Pattern pattern) {
+    for (u64 i = 0; i < count; i++) {
+        float32 d = 0;
+        switch (pattern) {
+            case SORT_TEST_RANDOM:           d = (float32)get_random_float64(); break;
+            case SORT_TEST_FEW_UNIQUE:       d = (float32)get_random_int_in_range(0, 7); break;
+            case SORT_TEST_SORTED:           d = (float32)i; break;
+            case SORT_TEST_REVERSED:         d = (float32)(count - i); break;
+            case SORT_TEST_EQUAL:            d = 1.0f; break;
+            case SORT_TEST_ORGAN_PIPE:       d = (float32)(i < count/2 ? i : count - i); break;
+            case SORT_TEST_SAWTOOTH:         d = (float32)(i % 97); break;
+            case SORT_TEST_SORTED_BUT_A_FEW: d = (float32)((i % 1000 == 7) ? get_random_int_in_range(0, count) : i); break;
+            default: break;
+        }
+        items[i].distance = d;
+        items[i].id = (u32)i;
+    }
+}
 void test_sort() {
     
     int num_samples = 500;
@@ -1498,6 +4467,372 @@ void test_sort() {
     }
     
     print("Merge sort took on average %llu cycles and %.2f ms\n", cycles / num_samples, (seconds * 1000.0) / (float64)num_samples);
+    
+    seconds = 0;
+    for (int a = 0; a < num_samples; a++) {
+        for (u64 i = 0; i < item_count; i++) {
+            if (i % 2 == 0) items[i].z = get_random_int_in_range(0, pow(2, id_bits) / 2);
+            else items[i].z = i;
+        }
+        float64 start_seconds = os_get_elapsed_seconds();
+        draw_quads_by_z_sort(items, item_count);
+        seconds += os_get_elapsed_seconds() - start_seconds;
+        for (u64 i = 1; i < item_count; i++) {
+            assert(items[i].z >= items[i-1].z, "Failed: not correctly sorted");
+        }
+    }
+    print("DEFINE_SORT sort took on average %.2f ms\n", (seconds * 1000.0) / (float64)num_samples);
+    
+    dealloc(get_heap_allocator(), items);
+    
+    ///
+    // DEFINE_SORT correctness, against merge_sort which is stable
+    {
+        const u64 max_count = 5000;
+        Sort_Test_Item *test_items = alloc(get_heap_allocator(), max_count*4*sizeof(Sort_Test_Item));
+        Sort_Test_Item *expected   = test_items + max_count;
+        Sort_Test_Item *original   = test_items + max_count*2;
+        Sort_Test_Item *help       = test_items + max_count*3;
+        u64 counts[] = { 0, 1, 2, 3, 23, 24, 25, 100, 128, 129, 1000, max_count };
+        
+        for (u64 c = 0; c < sizeof(counts)/sizeof(u64); c++) {
+            u64 count = counts[c];
+            for (Sort_Test_Pattern pattern = 0; pattern < SORT_TEST_PATTERN_COUNT; pattern++) {
+                _sort_test_fill(original, count, pattern);
+                memcpy(expected, original, count*sizeof(Sort_Test_Item));
+                merge_sort(expected, help, count, sizeof(Sort_Test_Item), compare_sort_test_items);
+                
+                // Not stable, so only the distances have to match. Ids all still there.
+                memcpy(test_items, original, count*sizeof(Sort_Test_Item));
+                sort_test_items_sort(test_items, count);
+                u64 id_sum = 0;
+                for (u64 i = 0; i < count; i++) {
+                    assert(test_items[i].distance == expected[i].distance, "sort: wrong at %llu of %llu (pattern %d)", i, count, pattern);
+                    id_sum += test_items[i].id;
+                }
+                assert(id_sum == (count*(count-1))/2 || count == 0, "sort: lost items (pattern %d)", pattern);
+                
+                memcpy(test_items, original, count*sizeof(Sort_Test_Item));
+                sort_test_items_stable_sort(test_items, help, count);
+                assert(count == 0 || bytes_match(test_items, expected, count*sizeof(Sort_Test_Item)), "stable_sort: differs from merge_sort (count %llu, pattern %d)", count, pattern);
+                
+                u64 ks[] = { 0, 1, 5, count/2, count ? count-1 : 0, count };
+                for (u64 k_index = 0; k_index < sizeof(ks)/sizeof(u64); k_index++) {
+                    u64 k = ks[k_index];
+                    
+                    memcpy(test_items, original, count*sizeof(Sort_Test_Item));
+                    sort_test_items_partial_sort(test_items, count, k);
+                    for (u64 i = 0; i < k; i++) {
+                        assert(test_items[i].distance == expected[i].distance, "partial_sort: wrong at %llu, k %llu of %llu (pattern %d)", i, k, count, pattern);
+                    }
+                    for (u64 i = k; i < count; i++) {
+                        assert(!(test_items[i].distance < expected[k ? k-1 : 0].distance), "partial_sort: smaller one after k");
+                    }
+                    
+                    if (k >= count) continue;
+                    memcpy(test_items, original, count*sizeof(Sort_Test_Item));
+                    sort_test_items_nth_element(test_items, count, k);
+                    float32 nth = test_items[k].distance;
+                    assert(nth == expected[k].distance, "nth_element: wrong nth, k %llu of %llu (pattern %d)", k, count, pattern);
+                    for (u64 i = 0; i < k; i++)         assert(!(nth < test_items[i].distance), "nth_element: bigger one before n");
+                    for (u64 i = k+1; i < count; i++)   assert(!(test_items[i].distance < nth), "nth_element: smaller one after n");
+                }
+            }
+        }
+        dealloc(get_heap_allocator(), test_items);
+    }
+    
+    ///
+    // DEFINE_SORT benchmarks against merge_sort
+    {
+        const u64 max_count = 1000000;
+        Sort_Test_Item *test_items = alloc(get_heap_allocator(), max_count*3*sizeof(Sort_Test_Item));
+        Sort_Test_Item *original   = test_items + max_count;
+        Sort_Test_Item *help       = test_items + max_count*2;
+        const char *pattern_names[SORT_TEST_PATTERN_COUNT] = {
+            "random          ", "few unique      ", "sorted          ", "reversed        ",
+            "equal           ", "organ pipe      ", "sawtooth        ", "sorted but a few",
+        };
+        
+        print("\t8 byte items:");
+        for (u64 count = 1000; count <= max_count; count *= 10) {
+            u64 runs = max(2000000/count, 2);
+            for (Sort_Test_Pattern pattern = 0; pattern < SORT_TEST_PATTERN_COUNT; pattern++) {
+                // Only random for the small ones
+                if (count < max_count && pattern != SORT_TEST_RANDOM) continue;
+                
+                _sort_test_fill(original, count, pattern);
+                float64 merge_seconds = 0, sort_seconds = 0, stable_seconds = 0;
+                for (u64 run = 0; run < runs; run++) {
+                    memcpy(test_items, original, count*sizeof(Sort_Test_Item));
+                    float64 start = os_get_elapsed_seconds();
+                    merge_sort(test_items, help, count, sizeof(Sort_Test_Item), compare_sort_test_items);
+                    merge_seconds += os_get_elapsed_seconds() - start;
+                    
+                    memcpy(test_items, original, count*sizeof(Sort_Test_Item));
+                    start = os_get_elapsed_seconds();
+                    sort_test_items_sort(test_items, count);
+                    sort_seconds += os_get_elapsed_seconds() - start;
+                    
+                    memcpy(test_items, original, count*sizeof(Sort_Test_Item));
+                    start = os_get_elapsed_seconds();
+                    sort_test_items_stable_sort(test_items, help, count);
+                    stable_seconds += os_get_elapsed_seconds() - start;
+                }
+                print("\n\t\t%7llu %cs: merge_sort %8.3f ms, sort %7.3f ms (%4.1fx), stable_sort %7.3f ms (%4.1fx)",
+                    count, pattern_names[pattern],
+                    merge_seconds*1000.0/runs,
+                    sort_seconds*1000.0/runs, merge_seconds/max(sort_seconds, 0.000000001),
+                    stable_seconds*1000.0/runs, merge_seconds/max(stable_seconds, 0.000000001));
+            }
+        }
+        
+        // Nearest 10 of 100k
+        {
+            u64 count = 100000;
+            u64 runs = 50;
+            _sort_test_fill(original, count, SORT_TEST_RANDOM);
+            float64 sort_seconds = 0, partial_seconds = 0;
+            for (u64 run = 0; run < runs; run++) {
+                memcpy(test_items, original, count*sizeof(Sort_Test_Item));
+                float64 start = os_get_elapsed_seconds();
+                sort_test_items_sort(test_items, count);
+                sort_seconds += os_get_elapsed_seconds() - start;
+                
+                memcpy(test_items, original, count*sizeof(Sort_Test_Item));
+                start = os_get_elapsed_seconds();
+                sort_test_items_partial_sort(test_items, count, 10);
+                partial_seconds += os_get_elapsed_seconds() - start;
+            }
+            print("\n\tNearest 10 of %llu: sort %.3f ms, partial_sort %.3f ms (%.1fx)\n",
+                count, sort_seconds*1000.0/runs, partial_seconds*1000.0/runs, sort_seconds/max(partial_seconds, 0.000000001));
+        }
+        
+        dealloc(get_heap_allocator(), test_items);
+    }
+}
+
+typedef enum Test_Z_Pattern {
+	TEST_Z_RANDOM,      // Every quad on its own layer
+	TEST_Z_FEW_LAYERS,  // Typical game frame: background, world, ui, mostly in order
+	TEST_Z_SORTED,
+	TEST_Z_PATTERN_COUNT,
+} Test_Z_Pattern;
+void _test_fill_z(Draw_Quad *quads, u64 count, Test_Z_Pattern pattern) {
+	for (u64 i = 0; i < count; i++) {
+		switch (pattern) {
+			case TEST_Z_RANDOM:     quads[i].z = (s32)get_random_int_in_range(-MAX_Z+1, MAX_Z-1); break;
+			case TEST_Z_FEW_LAYERS: quads[i].z = (i % 97 == 0) ? 100 : ((i % 13 == 0) ? -5 : 0); break;
+			case TEST_Z_SORTED:     quads[i].z = (s32)(i*MAX_Z/count); break;
+			default: break;
+		}
+		quads[i].uv.x = (float32)i; // Where it was, to check stability
+	}
+}
+void test_sort_indices() {
+	
+	// Same order as radix_sort, which is stable
+	{
+		const u64 count = 20000;
+		Draw_Quad *quads  = alloc(get_heap_allocator(), count*3*sizeof(Draw_Quad));
+		Draw_Quad *copy   = quads + count;
+		Draw_Quad *buffer = quads + count*2;
+		u64 *keys = alloc(get_heap_allocator(), count*2*sizeof(u64));
+		
+		for (Test_Z_Pattern pattern = 0; pattern < TEST_Z_PATTERN_COUNT; pattern++) {
+			for (u64 n = 0; n <= count; n = n ? n*3 : 1) {
+				_test_fill_z(quads, n, pattern);
+				memcpy(copy, quads, n*sizeof(Draw_Quad));
+				
+				u64 *order = radix_sort_indices(quads, n, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS, keys, keys + count);
+				radix_sort(copy, buffer, n, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS);
+				
+				if (pattern == TEST_Z_SORTED) assert(!order, "Already sorted input should return 0");
+				
+				for (u64 i = 0; i < n; i++) {
+					Draw_Quad *q = &quads[order ? (u32)order[i] : i];
+					assert(q->z == copy[i].z && q->uv.x == copy[i].uv.x, "radix_sort_indices order differs from radix_sort at %llu of %llu (pattern %d)", i, n, pattern);
+				}
+			}
+		}
+		
+		// Negative and positive z in every digit, max and min z.
+		// (radix_sort wraps MAX_Z around to the bottom, which is why it's not in the random ones)
+		s32 zs[] = { MAX_Z, -MAX_Z+1, 0, -1, 1, 255, 256, -256, -257, 65535, 65536, -65536, MAX_Z-1, -MAX_Z+2 };
+		u64 zcount = sizeof(zs)/sizeof(zs[0]);
+		for (u64 i = 0; i < zcount; i++) quads[i].z = zs[i];
+		u64 *order = radix_sort_indices(quads, zcount, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS, keys, keys + count);
+		assert(order, "Should not be sorted");
+		for (u64 i = 1; i < zcount; i++) {
+			assert(quads[(u32)order[i]].z >= quads[(u32)order[i-1]].z, "Not sorted: %d after %d", quads[(u32)order[i]].z, quads[(u32)order[i-1]].z);
+		}
+		
+		dealloc(get_heap_allocator(), quads);
+		dealloc(get_heap_allocator(), keys);
+	}
+	
+	// Benchmark. CPU only: sorting + walking the quads in sorted order like the vertex builder does.
+	{
+		const u64 max_count = 1000000;
+		Draw_Quad *quads  = alloc(get_heap_allocator(), max_count*2*sizeof(Draw_Quad));
+		Draw_Quad *buffer = quads + max_count;
+		u64 *keys = alloc(get_heap_allocator(), max_count*2*sizeof(u64));
+		s32 *zs = alloc(get_heap_allocator(), max_count*sizeof(s32));
+		
+		const char *pattern_names[TEST_Z_PATTERN_COUNT] = { "random z  ", "few layers", "sorted    " };
+		
+		for (u64 count = 10000; count <= max_count; count *= 10) {
+			u64 runs = max(10000000/count, 3);
+			for (Test_Z_Pattern pattern = 0; pattern < TEST_Z_PATTERN_COUNT; pattern++) {
+				float64 old_seconds = 0;
+				float64 new_seconds = 0;
+				u64 old_sum = 0;
+				u64 new_sum = 0;
+				for (u64 run = 0; run < runs; run++) {
+					// Both get the same z's
+					_test_fill_z(quads, count, pattern);
+					for (u64 i = 0; i < count; i++) zs[i] = quads[i].z;
+					
+					float64 start = os_get_elapsed_seconds();
+					radix_sort(quads, buffer, count, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS);
+					for (u64 i = 0; i < count; i++) old_sum += (u64)quads[i].uv.x*i;
+					old_seconds += os_get_elapsed_seconds() - start;
+					
+					for (u64 i = 0; i < count; i++) {
+						quads[i].z = zs[i];
+						quads[i].uv.x = (float32)i;
+					}
+					
+					start = os_get_elapsed_seconds();
+					u64 *order = radix_sort_indices(quads, count, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS, keys, keys + count);
+					for (u64 i = 0; i < count; i++) new_sum += (u64)quads[order ? (u32)order[i] : i].uv.x*i;
+					new_seconds += os_get_elapsed_seconds() - start;
+				}
+				assert(old_sum == new_sum, "Walked different quads");
+				print("\n\t%7llu quads, %cs: radix_sort %8.3f ms, radix_sort_indices %7.3f ms (%.1fx)",
+					count, pattern_names[pattern], old_seconds*1000.0/runs, new_seconds*1000.0/runs, old_seconds/max(new_seconds, 0.000000001));
+			}
+		}
+		print("\n");
+		
+		dealloc(get_heap_allocator(), quads);
+		dealloc(get_heap_allocator(), keys);
+		dealloc(get_heap_allocator(), zs);
+	}
+}
+
+// Pushes a lot of quads like a Draw_Frame does and counts how many bytes growing the array copied
+void test_draw_quad_buffer_growth() {
+	const u64 quad_count = 10000000;
+	
+	Draw_Quad *quads;
+	growing_array_init((void**)&quads, sizeof(Draw_Quad), get_heap_allocator());
+	
+	u64 bytes_copied = 0;
+	u64 bytes_copied_without_realloc = 0;
+	
+	Draw_Quad q = ZERO(Draw_Quad);
+	
+	float64 start_seconds = os_get_elapsed_seconds();
+	for (u64 i = 0; i < quad_count; i += 1) {
+		Draw_Quad *before = quads;
+		u64 allocated_bytes = growing_array_get_allocated_count(quads)*sizeof(Draw_Quad)+sizeof(Growing_Array_Header);
+		
+		q.z = (s32)i;
+		growing_array_add((void**)&quads, &q);
+		
+		if (growing_array_get_allocated_count(quads)*sizeof(Draw_Quad)+sizeof(Growing_Array_Header) != allocated_bytes) {
+			// Before in-place reallocation we always copied everything on growth
+			bytes_copied_without_realloc += allocated_bytes;
+			if (quads != before) bytes_copied += allocated_bytes;
+		}
+	}
+	float64 seconds = os_get_elapsed_seconds() - start_seconds;
+	
+	assert(quads[quad_count-1].z == (s32)(quad_count-1), "Quads corrupted");
+	assert(quads[quad_count/2].z == (s32)(quad_count/2), "Quads corrupted");
+	
+	print("Pushing %llu quads took %.2f ms. Growing copied %llu MB (was %llu MB without in-place realloc)\n", quad_count, seconds*1000.0, bytes_copied/MB(1), bytes_copied_without_realloc/MB(1));
+	
+	growing_array_deinit((void**)&quads);
+}
+
+void test_draw_frame() {
+	Draw_Frame frame;
+	draw_frame_init(&frame);
+	
+	// Way past the old 4096 limit
+	for (s32 i = 0; i < 10000; i++) {
+		push_z_layer_in_frame(i - 5000, &frame);
+		push_window_scissor_in_frame(v2(i, 0), v2(i + 10, 10), &frame);
+	}
+	Draw_Quad *q = draw_rect_in_frame(v2(0, 0), v2(10, 10), COLOR_WHITE, &frame);
+	assert(q->z == 4999, "Quad got z %d, expected 4999", q->z);
+	assert(q->has_scissor && q->scissor.x == 9999, "Quad got the wrong scissor");
+	for (s32 i = 0; i < 9999; i++) {
+		pop_z_layer_in_frame(&frame);
+		pop_window_scissor_in_frame(&frame);
+	}
+	q = draw_rect_in_frame(v2(0, 0), v2(10, 10), COLOR_WHITE, &frame);
+	assert(q->z == -5000 && q->scissor.x == 0, "Quad got the wrong z/scissor after popping");
+	
+	// Reset keeps the memory, clears the rest
+	frame.enable_z_sorting = true;
+	frame.cbuffer = &frame;
+	Draw_Quad *quads_before = frame.quad_buffer;
+	s32 *z_stack_before = frame.z_stack;
+	Vector4 *scissor_stack_before = frame.scissor_stack;
+	draw_frame_reset(&frame);
+	assert(frame.quad_buffer == quads_before && frame.z_stack == z_stack_before && frame.scissor_stack == scissor_stack_before, "Reset should keep the buffers");
+	assert(growing_array_count(frame.quad_buffer) == 0 && frame.z_count == 0 && frame.scissor_count == 0, "Reset should clear the counts");
+	assert(!frame.enable_z_sorting && !frame.cbuffer, "Reset should zero the rest");
+	q = draw_rect_in_frame(v2(0, 0), v2(10, 10), COLOR_WHITE, &frame);
+	assert(q->z == 0 && !q->has_scissor, "Quad after reset should have no z/scissor");
+	
+	draw_frame_deinit(&frame);
+	assert(!frame.quad_buffer && !frame.z_stack && !frame.scissor_stack, "Deinit should free everything");
+	
+	// A zeroed frame works without init
+	draw_frame_reset(&frame);
+	draw_rect_in_frame(v2(0, 0), v2(10, 10), COLOR_WHITE, &frame);
+	assert(growing_array_count(frame.quad_buffer) == 1, "Reset of a zeroed frame should make a quad buffer");
+	draw_frame_deinit(&frame);
+	
+	// Benchmark: reset + 1k quads per frame, 1 and 16 frames per tick like threaded_drawing.c
+	print("\n\tsizeof(Draw_Frame) = %llu bytes", (u64)sizeof(Draw_Frame));
+	u64 frames_per_tick[] = { 1, 16 };
+	for (u64 f = 0; f < sizeof(frames_per_tick)/sizeof(u64); f++) {
+		u64 frame_count = frames_per_tick[f];
+		u64 tick_count = 4000/frame_count;
+		Draw_Frame *frames = (Draw_Frame*)alloc(get_heap_allocator(), frame_count*sizeof(Draw_Frame));
+		for (u64 i = 0; i < frame_count; i++) draw_frame_init(&frames[i]);
+		
+		float64 reset_seconds = 0;
+		float64 total_seconds = 0;
+		for (u64 tick = 0; tick < tick_count; tick++) {
+			float64 start = os_get_elapsed_seconds();
+			for (u64 i = 0; i < frame_count; i++) {
+				float64 reset_start = os_get_elapsed_seconds();
+				draw_frame_reset(&frames[i]);
+				reset_seconds += os_get_elapsed_seconds() - reset_start;
+				
+				push_z_layer_in_frame(1, &frames[i]);
+				push_window_scissor_in_frame(v2(0, 0), v2(500, 500), &frames[i]);
+				for (u64 j = 0; j < 1000; j++) {
+					draw_rect_in_frame(v2((float32)(j % 100)*8 - 400, (float32)(j / 100)*8 - 40), v2(8, 8), COLOR_WHITE, &frames[i]);
+				}
+				pop_window_scissor_in_frame(&frames[i]);
+				pop_z_layer_in_frame(&frames[i]);
+			}
+			total_seconds += os_get_elapsed_seconds() - start;
+		}
+		print("\n\t%2llu frames per tick: %.3f ms per tick (reset %.2f us per frame)",
+			frame_count, total_seconds*1000.0/tick_count, reset_seconds*1000000.0/(tick_count*frame_count));
+		
+		for (u64 i = 0; i < frame_count; i++) draw_frame_deinit(&frames[i]);
+		dealloc(get_heap_allocator(), frames);
+	}
+	print("\n");
 }
 #endif /* OOGABOOGA_HEADLESS */
 
@@ -1565,6 +4900,104 @@ void test_growing_array() {
     assert(!bytes_match(&copy, thing, sizeof(Test_Thing)), "Failed: growing_array_unordered_remove_by_pointer");
     
     assert(growing_array_get_valid_count(things) == 99, "Failed: growing_array_get_valid_count");
+    
+    growing_array_deinit((void**)&things);
+    
+    // Typed API
+    u64 *numbers = 0;
+    growing_array_init_typed(&numbers, get_heap_allocator());
+    for (u64 i = 0; i < 1000; i += 1) growing_array_push(&numbers, i);
+    assert(growing_array_count(numbers) == 1000, "Failed: growing_array_push count");
+    assert(growing_array_capacity(numbers) >= 1000, "Failed: growing_array_capacity");
+    for (u64 i = 0; i < 1000; i += 1) assert(numbers[i] == i, "Failed: growing_array_push value at %llu", i);
+    assert(*growing_array_last(numbers) == 999, "Failed: growing_array_last");
+    
+    // Ordered remove moves overlapping ranges, which memcpy isn't allowed to do
+    growing_array_remove_at(&numbers, 0);
+    assert(numbers[0] == 1 && numbers[998] == 999 && growing_array_count(numbers) == 999, "Failed: growing_array_remove_at");
+    growing_array_remove_range(&numbers, 10, 100);
+    assert(numbers[9] == 10 && numbers[10] == 111 && growing_array_count(numbers) == 899, "Failed: growing_array_remove_range");
+    growing_array_remove_range(&numbers, 0, 0);
+    assert(growing_array_count(numbers) == 899, "Failed: growing_array_remove_range with 0");
+    
+    u64 more[] = {7001, 7002, 7003};
+    growing_array_insert_many(&numbers, 5, more, 3);
+    assert(numbers[4] == 5 && numbers[5] == 7001 && numbers[7] == 7003 && numbers[8] == 6, "Failed: growing_array_insert_many");
+    u64 first = 4242;
+    growing_array_insert(&numbers, 0, first);
+    assert(numbers[0] == 4242 && numbers[1] == 1, "Failed: growing_array_insert");
+    u64 last = 4343;
+    growing_array_insert(&numbers, growing_array_count(numbers), last);
+    assert(*growing_array_last(numbers) == 4343 && growing_array_count(numbers) == 904, "Failed: growing_array_insert at end");
+    
+    growing_array_remove_at_unordered(&numbers, 0);
+    assert(numbers[0] == 4343 && growing_array_count(numbers) == 903, "Failed: growing_array_remove_at_unordered");
+    
+    u64 *copy_of_numbers = 0;
+    growing_array_init_typed(&copy_of_numbers, get_heap_allocator());
+    growing_array_push_many(&copy_of_numbers, more, 3);
+    growing_array_append_array(&copy_of_numbers, numbers);
+    assert(growing_array_count(copy_of_numbers) == 906, "Failed: growing_array_append_array count");
+    assert(copy_of_numbers[2] == 7003 && bytes_match(copy_of_numbers+3, numbers, 903*sizeof(u64)), "Failed: growing_array_append_array");
+    
+    u64 *empty_slot = growing_array_push_empty(&copy_of_numbers);
+    *empty_slot = 5;
+    assert(*growing_array_last(copy_of_numbers) == 5, "Failed: growing_array_push_empty");
+    
+    growing_array_deinit((void**)&numbers);
+    growing_array_deinit((void**)&copy_of_numbers);
+}
+
+void test_growing_array_benchmark() {
+	Allocator heap = get_heap_allocator();
+	const u64 count = 10000000;
+	
+	print("\n");
+	
+	// Add
+	u64 *untyped = 0;
+	growing_array_init((void**)&untyped, sizeof(u64), heap);
+	float64 start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < count; i += 1) growing_array_add((void**)&untyped, &i);
+	float64 untyped_add_seconds = os_get_elapsed_seconds() - start;
+	
+	u64 *typed = 0;
+	growing_array_init_typed(&typed, heap);
+	start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < count; i += 1) growing_array_push(&typed, i);
+	float64 typed_add_seconds = os_get_elapsed_seconds() - start;
+	
+	assert(bytes_match(untyped, typed, count*sizeof(u64)), "Failed: Typed and untyped adds don't match");
+	print("\tAdd %llu u64: growing_array_add %.2f ns, growing_array_push %.2f ns\n", count, (untyped_add_seconds*1000000000.0)/(float64)count, (typed_add_seconds*1000000000.0)/(float64)count);
+	
+	// Unordered remove all
+	start = os_get_elapsed_seconds();
+	while (growing_array_get_valid_count(untyped)) growing_array_unordered_remove_by_index((void**)&untyped, 0);
+	float64 untyped_remove_seconds = os_get_elapsed_seconds() - start;
+	
+	start = os_get_elapsed_seconds();
+	while (growing_array_count(typed)) growing_array_remove_at_unordered(&typed, 0);
+	float64 typed_remove_seconds = os_get_elapsed_seconds() - start;
+	
+	print("\tUnordered remove %llu: growing_array_unordered_remove_by_index %.2f ns, growing_array_remove_at_unordered %.2f ns\n", count, (untyped_remove_seconds*1000000000.0)/(float64)count, (typed_remove_seconds*1000000000.0)/(float64)count);
+	
+	// Ordered removes from the front of 100k items, one at a time vs all at once
+	const u64 ordered_count = 100000;
+	const u64 ordered_removes = 1000;
+	growing_array_resize((void**)&untyped, ordered_count);
+	start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < ordered_removes; i += 1) growing_array_ordered_remove_by_index((void**)&untyped, 0);
+	float64 ordered_seconds = os_get_elapsed_seconds() - start;
+	
+	growing_array_resize((void**)&typed, ordered_count);
+	start = os_get_elapsed_seconds();
+	growing_array_remove_range(&typed, 0, ordered_removes);
+	float64 range_seconds = os_get_elapsed_seconds() - start;
+	
+	print("\tRemove first %llu of %llu in order: one by one %.3f ms, growing_array_remove_range %.3f ms\n", ordered_removes, ordered_count, ordered_seconds*1000.0, range_seconds*1000.0);
+	
+	growing_array_deinit((void**)&untyped);
+	growing_array_deinit((void**)&typed);
 }
 
 
@@ -1703,11 +5136,67 @@ void oogabooga_run_tests() {
 	print("Testing growing array... ");
 	test_growing_array();
 	print("OK!\n");
+	
+	print("Testing growing array benchmark... ");
+	test_growing_array_benchmark();
+	print("OK!\n");
     
 	print("Testing allocator... ");
 	test_allocator(true);
 	print("OK!\n");
 	
+	print("Testing allocator churn... ");
+	test_allocator_churn();
+	print("OK!\n");
+	
+	print("Testing threaded allocator scaling... ");
+	test_allocator_threaded_scaling();
+	print("OK!\n");
+	
+	print("Testing large allocations... ");
+	test_large_allocations();
+	print("OK!\n");
+	
+	print("Testing arena... ");
+	test_arena();
+	print("OK!\n");
+	
+	print("Testing temporary storage... ");
+	test_temporary_storage();
+	print("OK!\n");
+	
+	print("Testing pool... ");
+	test_pool();
+	print("OK!\n");
+	
+	print("Testing slot map... ");
+	test_slot_map();
+	print("OK!\n");
+	
+	print("Testing deque... ");
+	test_deque();
+	print("OK!\n");
+	
+	print("Testing priority queue... ");
+	test_priority_queue();
+	print("OK!\n");
+	
+	print("Testing timers... ");
+	test_timers();
+	print("OK!\n");
+	
+	print("Testing heap instrumentation... ");
+	test_heap_instrumentation();
+	print("OK!\n");
+	
+	print("Testing aligned allocations... ");
+	test_aligned_allocations();
+	print("OK!\n");
+	
+	print("Testing zero initialization... ");
+	test_zero_initialization();
+	print("OK!\n");
+	
 	print("Testing threads... ");
 	test_threads();
 	print("OK!\n");
@@ -1732,10 +5221,18 @@ void oogabooga_run_tests() {
 	test_simd();
 	print("OK!\n");
 	
+	print("Testing hash... ");
+	test_hash();
+	print("OK!\n");
+	
 	print("Testing hash table... ");
 	test_hash_table();
 	print("OK!\n");
 	
+	print("Testing hash table benchmark... ");
+	test_hash_table_benchmark();
+	print("OK!\n");
+	
 	print("Testing random distribution... ");
 	test_random_distribution();
 	print("OK!\n");
@@ -1744,14 +5241,58 @@ void oogabooga_run_tests() {
 	test_mutex();
 	print("OK!\n");
 	
+	print("Testing rw lock... ");
+	test_rw_lock();
+	print("OK!\n");
+	
+	print("Testing lock scaling... ");
+	test_lock_scaling();
+	print("OK!\n");
+	
+	print("Testing lock-free queues... ");
+	test_lock_free_queues();
+	print("OK!\n");
+	
 	print("Testing binary semaphore... ");
 	test_os_binary_semaphore();
 	print("OK!\n");
+	
+	print("Testing sync primitives... ");
+	test_sync_primitives();
+	print("OK!\n");
+	
+	print("Testing concurrent hash table... ");
+	test_concurrent_hash_table();
+	print("OK!\n");
+	
+	print("Testing string intern... ");
+	test_string_intern();
+	print("OK!\n");
+	
+	print("Testing jobs... ");
+	test_jobs();
+	print("OK!\n");
+
+	print("Testing radix sort pairs... ");
+	test_radix_sort_pairs();
+	print("OK!\n");
 
 #ifndef OOGABOOGA_HEADLESS
 	print("Testing radix sort... ");
 	test_sort();
 	print("OK!\n");
+	
+	print("Testing radix sort indices... ");
+	test_sort_indices();
+	print("OK!\n");
+	
+	print("Testing draw quad buffer growth... ");
+	test_draw_quad_buffer_growth();
+	print("OK!\n");
+	
+	print("Testing draw frame... ");
+	test_draw_frame();
+	print("OK!\n");
 #endif
 
 	
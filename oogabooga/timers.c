@@ -0,0 +1,132 @@
+// Timers
+// Call a proc after some time, once or repeating, without checking every timer every frame.
+// The timers sit in a Priority_Queue ordered by when they fire, so timer_scheduler_update() only
+// looks at the ones which are due. Time only moves when you update the scheduler, so pausing the
+// game pauses its timers and you can have one scheduler per world/menu/whatever.
+
+/*
+
+	Example Usage:
+
+	Timer_Scheduler timers;
+	timer_scheduler_init(&timers, 256, get_heap_allocator());
+
+	void spawn_enemy(Timer_Scheduler *s, Timer_Handle timer, void *data) {
+		World *world = (World*)data;
+		...
+	}
+	Timer_Handle spawner = timer_start_repeating(&timers, 3.0, spawn_enemy, world);
+
+	// No proc, just for checking if it's done, like a cooldown
+	Timer_Handle dash_cooldown = timer_start(&timers, 0.35, 0, 0);
+	if (!timer_is_running(&timers, dash_cooldown)) {
+		// Can dash again
+	}
+
+	// Every frame
+	timer_scheduler_update(&timers, delta_time);
+
+	timer_stop(&timers, spawner);
+
+	timer_scheduler_destroy(&timers);
+
+	Limitations:
+		- Timers fire in update, on the thread that calls it. Never earlier, but up to a frame late.
+		- A repeating timer which fell behind fires as many times as it missed in one update.
+		- Timers started or restarted from a proc don't fire until the next update, even with 0
+		  seconds. Anything due at the same time or later slips to the next update with it.
+		- Not thread safe.
+*/
+
+typedef Priority_Queue_Handle Timer_Handle;
+typedef struct Timer_Scheduler Timer_Scheduler;
+typedef void(*Timer_Proc)(Timer_Scheduler *s, Timer_Handle timer, void *data);
+
+typedef struct Timer {
+	Timer_Proc proc; // Can be 0
+	void *data;
+	float64 interval; // 0 if it only fires once
+	u64 started_in_update; // Timer_Scheduler.update_count when it was started or restarted
+} Timer;
+
+struct Timer_Scheduler {
+	Priority_Queue queue; // Timer, priority is the time it fires
+	float64 now; // Seconds since init, only moves in update
+	u64 update_count;
+};
+
+void timer_scheduler_init(Timer_Scheduler *s, u64 capacity, Allocator allocator) {
+	*s = ZERO(Timer_Scheduler);
+	priority_queue_init(&s->queue, sizeof(Timer), capacity, allocator);
+}
+void timer_scheduler_destroy(Timer_Scheduler *s) {
+	priority_queue_destroy(&s->queue);
+	*s = ZERO(Timer_Scheduler);
+}
+
+Timer_Handle timer_start(Timer_Scheduler *s, float64 seconds, Timer_Proc proc, void *data) {
+	Timer timer = ZERO(Timer);
+	timer.proc = proc;
+	timer.data = data;
+	timer.started_in_update = s->update_count;
+	return priority_queue_push(&s->queue, s->now + seconds, &timer);
+}
+// First fires after interval seconds
+Timer_Handle timer_start_repeating(Timer_Scheduler *s, float64 interval, Timer_Proc proc, void *data) {
+	assert(interval > 0, "Repeating timer interval must be more than 0, got %f", interval);
+	Timer timer = ZERO(Timer);
+	timer.proc = proc;
+	timer.data = data;
+	timer.interval = interval;
+	timer.started_in_update = s->update_count;
+	return priority_queue_push(&s->queue, s->now + interval, &timer);
+}
+
+// False if it already fired (non-repeating) or was stopped
+bool timer_stop(Timer_Scheduler *s, Timer_Handle h) {
+	return priority_queue_remove(&s->queue, h);
+}
+inline bool timer_is_running(Timer_Scheduler *s, Timer_Handle h) {
+	return priority_queue_contains(&s->queue, h);
+}
+// Fire in seconds from now instead. False if it isn't running.
+bool timer_restart(Timer_Scheduler *s, Timer_Handle h, float64 seconds) {
+	Timer *timer = (Timer*)priority_queue_get(&s->queue, h, 0);
+	if (!timer) return false;
+	timer->started_in_update = s->update_count;
+	return priority_queue_set_priority(&s->queue, h, s->now + seconds);
+}
+// Seconds until it fires, 0 if it isn't running
+float64 timer_get_time_left(Timer_Scheduler *s, Timer_Handle h) {
+	float64 fire_time;
+	if (!priority_queue_get(&s->queue, h, &fire_time)) return 0;
+	return max(fire_time - s->now, 0);
+}
+
+// Moves time forward and fires everything which is due, in order. Procs can start and stop
+// timers, including the one that's firing. Returns how many fired.
+u64 timer_scheduler_update(Timer_Scheduler *s, float64 delta_seconds) {
+	s->now += delta_seconds;
+	// Anything started from here on, by a proc, waits for the next update. Otherwise a proc
+	// restarting its timer with 0 seconds would keep this looping forever.
+	s->update_count += 1;
+
+	u64 fired = 0;
+	float64 fire_time;
+	Timer_Handle h;
+	Timer *next;
+	while ((next = (Timer*)priority_queue_peek_ex(&s->queue, &fire_time, &h)) && fire_time <= s->now) {
+		// Started by a proc in this update. What's behind it isn't due earlier than it, so that
+		// fires next update, a frame late at most.
+		if (next->started_in_update == s->update_count) break;
+
+		// Copy it and reschedule or remove it before calling, so the proc sees it the way it will be
+		Timer timer = *next;
+		if (timer.interval > 0) priority_queue_set_priority(&s->queue, h, fire_time + timer.interval);
+		else                    priority_queue_remove(&s->queue, h);
+
+		if (timer.proc) timer.proc(s, h, timer.data);
+		fired += 1;
+	}
+	return fired;
+}
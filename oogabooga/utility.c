@@ -65,6 +65,81 @@ void radix_sort(void *collection, void *help_buffer, u64 item_count, u64 item_si
     }
 }
 
+// Like radix_sort, but it doesn't move the items. It sorts (key, index) pairs instead, so each
+// pass moves 8 bytes per item rather than the whole item, which matters a lot for big items like
+// Draw_Quad. Sort value is an s32 at sort_value_offset_in_item, in the range
+// -2^(number_of_bits-1)+1 to 2^(number_of_bits-1), same as -MAX_Z+1 to MAX_Z for Draw_Quad.z.
+// key_buffer and help_buffer need item_count u64's each.
+// Returns the sorted pairs (one of the two buffers), the item index is the low 32 bits:
+//     u64 *order = radix_sort_indices(...);
+//     for (u64 i = 0; i < item_count; i++) Thing *t = &things[(u32)order[i]];
+// Returns 0 if the items were already sorted, so you can just use them as they are.
+// Same order as radix_sort (stable). Passes where every item has the same digit are skipped,
+// which is most of them when most things share a few z values.
+u64 *radix_sort_indices(void *collection, u64 item_count, u64 item_size, u64 sort_value_offset_in_item, u64 number_of_bits, u64 *key_buffer, u64 *help_buffer) {
+    assert(number_of_bits > 0 && number_of_bits <= 32, "radix_sort_indices sorts by at most 32 bits, got %llu", number_of_bits);
+    assert(item_count <= 0xFFFFFFFFull, "radix_sort_indices can sort at most 2^32 items");
+    
+    const u64 BITS_PER_PASS = 8;
+    const u64 RADIX = 256;
+    const u64 PASS_COUNT = (number_of_bits + BITS_PER_PASS - 1) / BITS_PER_PASS;
+    const u32 HALF_RANGE_OF_VALUE_BITS = 1u << (number_of_bits - 1);
+    const u32 KEY_MASK = (u32)(0xFFFFFFFFull >> (32 - number_of_bits));
+    
+    if (item_count < 2) return 0;
+    
+    // One read of the items makes the keys, the histograms of every pass and tells us if it's
+    // already sorted.
+    u64 count[4][256];
+    memset(count, 0, PASS_COUNT*sizeof(count[0]));
+    
+    bool sorted = true;
+    u32 last_key = 0;
+    u8 *item = (u8*)collection + sort_value_offset_in_item;
+    for (u64 i = 0; i < item_count; i++) {
+        u32 key = ((u32)*(s32*)item + HALF_RANGE_OF_VALUE_BITS - 1) & KEY_MASK; // We treat the value as a signed integer
+        item += item_size;
+        
+        sorted = sorted && key >= last_key;
+        last_key = key;
+        
+        key_buffer[i] = ((u64)key << 32) | i;
+        for (u64 pass = 0; pass < PASS_COUNT; pass++) {
+            count[pass][(key >> (pass*BITS_PER_PASS)) & (RADIX-1)] += 1;
+        }
+    }
+    if (sorted) return 0;
+    
+    u64 *from = key_buffer;
+    u64 *to = help_buffer;
+    for (u64 pass = 0; pass < PASS_COUNT; pass++) {
+        u64 shift = 32 + pass*BITS_PER_PASS;
+        
+        // All in one bucket, this pass wouldn't change anything
+        if (count[pass][(from[0] >> shift) & (RADIX-1)] == item_count) continue;
+        
+        u64 offset[256];
+        u64 sum = 0;
+        for (u64 d = 0; d < RADIX; d++) {
+            offset[d] = sum;
+            sum += count[pass][d];
+        }
+        
+        for (u64 i = 0; i < item_count; i++) {
+            u64 pair = from[i];
+            to[offset[(pair >> shift) & (RADIX-1)]++] = pair;
+        }
+        
+        u64 *temp = from;
+        from = to;
+        to = temp;
+    }
+    
+    return from;
+}
+
+// Stable. DEFINE_SORT in sort.c is a lot faster if you know the type, this one can't inline
+// compare and memcpy's every item at every level.
 void merge_sort(void *collection, void *help_buffer, u64 item_count, u64 item_size, int (*compare)(const void *, const void *)) {
     u8 *items = (u8 *)collection;
     u8 *buffer = (u8 *)help_buffer;